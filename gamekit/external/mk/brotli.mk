@@ -1,6 +1,7 @@
-all: constants.o dictionary.o shared_dictionary.o context.o platform.o transform.o bit_reader.o decode.o huffman.o state.o transform.o
-	$(AR) rcs $(PREFIX)/lib/libbrotlicommon.a constants.o dictionary.o shared_dictionary.o context.o platform.o
+all: constants.o dictionary.o shared_dictionary.o context.o platform.o transform.o bit_reader.o decode.o huffman.o state.o transform.o backward_references.o backward_references_hq.o bit_cost.o block_splitter.o brotli_bit_stream.o cluster.o command.o compound_dictionary.o compress_fragment.o compress_fragment_two_pass.o dictionary_hash.o encode.o encoder_dict.o entropy_encode.o fast_log.o histogram.o literal_cost.o memory.o metablock.o static_dict.o utf8_util.o
+	$(AR) rcs $(PREFIX)/lib/libbrotlicommon.a constants.o dictionary.o shared_dictionary.o context.o platform.o transform.o
 	$(AR) rcs $(PREFIX)/lib/libbrotlidec.a bit_reader.o decode.o huffman.o state.o
+	$(AR) rcs $(PREFIX)/lib/libbrotlienc.a backward_references.o backward_references_hq.o bit_cost.o block_splitter.o brotli_bit_stream.o cluster.o command.o compound_dictionary.o compress_fragment.o compress_fragment_two_pass.o dictionary_hash.o encode.o encoder_dict.o entropy_encode.o fast_log.o histogram.o literal_cost.o memory.o metablock.o static_dict.o utf8_util.o
 
 constants.o: c/common/constants.c
 	$(CC) -I./c/include $(CFLAGS) -c c/common/constants.c
@@ -31,3 +32,66 @@ huffman.o: c/dec/huffman.c
 
 state.o: c/dec/state.c
 	$(CC) -I./c/include $(CFLAGS) -c c/dec/state.c
+
+backward_references.o: c/enc/backward_references.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/backward_references.c
+
+backward_references_hq.o: c/enc/backward_references_hq.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/backward_references_hq.c
+
+bit_cost.o: c/enc/bit_cost.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/bit_cost.c
+
+block_splitter.o: c/enc/block_splitter.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/block_splitter.c
+
+brotli_bit_stream.o: c/enc/brotli_bit_stream.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/brotli_bit_stream.c
+
+cluster.o: c/enc/cluster.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/cluster.c
+
+command.o: c/enc/command.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/command.c
+
+compound_dictionary.o: c/enc/compound_dictionary.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/compound_dictionary.c
+
+compress_fragment.o: c/enc/compress_fragment.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/compress_fragment.c
+
+compress_fragment_two_pass.o: c/enc/compress_fragment_two_pass.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/compress_fragment_two_pass.c
+
+dictionary_hash.o: c/enc/dictionary_hash.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/dictionary_hash.c
+
+encode.o: c/enc/encode.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/encode.c
+
+encoder_dict.o: c/enc/encoder_dict.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/encoder_dict.c
+
+entropy_encode.o: c/enc/entropy_encode.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/entropy_encode.c
+
+fast_log.o: c/enc/fast_log.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/fast_log.c
+
+histogram.o: c/enc/histogram.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/histogram.c
+
+literal_cost.o: c/enc/literal_cost.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/literal_cost.c
+
+memory.o: c/enc/memory.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/memory.c
+
+metablock.o: c/enc/metablock.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/metablock.c
+
+static_dict.o: c/enc/static_dict.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/static_dict.c
+
+utf8_util.o: c/enc/utf8_util.c
+	$(CC) -I./c/include $(CFLAGS) -c c/enc/utf8_util.c
@@ -0,0 +1,79 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * atlas.h: "atlas_" component interface.
+ */
+
+/*
+ * The "atlas" component packs many small images into a few large
+ * textures (pages), so that sprites that use different images can be
+ * drawn without texture switches.  It is built on top of the "image"
+ * and "render" components, and thus it is platform-independent.
+ *
+ * Each image is surrounded by padding pixels that repeat its edge
+ * pixels, so that linear filtering and lower mip levels don't bleed
+ * neighbour images.
+ *
+ * An image added to an atlas is referred by a handle.  A handle
+ * becomes stale when the image is removed or its page is evicted, and
+ * atlas_get_region() fails for a stale handle.
+ *
+ * Pages are uploaded by atlas_flush().  Call it after adding images
+ * and before drawing.
+ */
+
+#ifndef GAMEKIT_ATLAS_H
+#define GAMEKIT_ATLAS_H
+
+#include "compat.h"
+#include "image.h"
+#include "render.h"
+
+/* Handle of an image in an atlas. (0 for invalid) */
+typedef uint32_t atlas_handle_t;
+
+/* A region in an atlas page. */
+struct atlas_region {
+	/* Texture of the page. */
+	struct render_texture *tex;
+
+	/* Page index. */
+	int page;
+
+	/* Rectangle in the page. (excluding the padding) */
+	int x, y, w, h;
+
+	/* Texture coordinates. */
+	float u0, v0, u1, v1;
+};
+
+/* Initialize the "atlas" module. */
+bool atlas_init_module(int page_size, int padding);
+
+/* Cleanup the "atlas" module. */
+void atlas_cleanup_module(void);
+
+/* Add an image to the atlas. */
+bool atlas_add_image(struct image *img, atlas_handle_t *handle);
+
+/* Remove an image from the atlas. */
+void atlas_remove_image(atlas_handle_t handle);
+
+/* Get the region of an image. (false for a stale handle) */
+bool atlas_get_region(atlas_handle_t handle, struct atlas_region *region);
+
+/* Evict all images in a page. */
+void atlas_evict_page(int page);
+
+/* Get the number of pages in use. */
+int atlas_get_page_count(void);
+
+/* Upload modified pages. */
+void atlas_flush(void);
+
+#endif
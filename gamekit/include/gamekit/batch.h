@@ -0,0 +1,85 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * batch.h: "batch_" component interface.
+ */
+
+/*
+ * The "batch" component accumulates textured and colored quads
+ * (sprites) into a CPU-side vertex array, and draws them with as few
+ * draw calls as possible.  It is built on top of the "render"
+ * component, and thus it is platform-independent.
+ *
+ * A custom pipeline set by batch_set_pipeline() must take the
+ * following vertex shader inputs in this order:
+ *
+ *  |Type |Note             |Details                        |
+ *  |-----|-----------------|-------------------------------|
+ *  |vec2 |RENDER_POSITION0 |Position in the clip space.    |
+ *  |vec2 |RENDER_TEXCOORD0 |Texture coordinate.            |
+ *  |vec4 |RENDER_COLOR0    |Vertex color. (0.0 to 1.0)     |
+ *
+ * and a sampler at the index 0.
+ */
+
+#ifndef GAMEKIT_BATCH_H
+#define GAMEKIT_BATCH_H
+
+#include "compat.h"
+#include "image.h"
+#include "render.h"
+
+/* Sort modes. */
+enum batch_sort_mode {
+	/* Keep the drawing order, and merge consecutive sprites only. */
+	BATCH_SORT_NONE,
+
+	/* Sort sprites by pipeline and texture. (stable) */
+	BATCH_SORT_TEXTURE,
+};
+
+/* Statistics of the last batch. */
+struct batch_stats {
+	/* Number of sprites drawn. */
+	int sprite_count;
+
+	/* Number of draw calls issued. */
+	int draw_count;
+
+	/* Number of vertex buffer uploads. */
+	int flush_count;
+};
+
+/* Initialize the "batch" module. */
+bool batch_init_module(int screen_width, int screen_height);
+
+/* Cleanup the "batch" module. */
+void batch_cleanup_module(void);
+
+/* Start a batch. */
+void batch_begin(int sort_mode);
+
+/* Record the following batches to a command list. (NULL for immediate) */
+void batch_set_cmd_list(struct render_cmd_list *list);
+
+/* Set a pipeline for the following sprites. (NULL for the default) */
+void batch_set_pipeline(struct render_pipeline *pipeline);
+
+/* Add a sprite. (NULL texture for a solid color) */
+bool batch_add_sprite(struct render_texture *tex,
+		      float x, float y, float w, float h,
+		      float u0, float v0, float u1, float v1,
+		      pixel_t color);
+
+/* Draw all the sprites and finish a batch. */
+void batch_end(void);
+
+/* Get the statistics of the last batch. */
+void batch_get_stats(struct batch_stats *stats);
+
+#endif
@@ -0,0 +1,94 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * cache.h: "cache_" component interface.
+ */
+
+/*
+ * The "cache" component keeps decoded images, so that a scene that
+ * revisits an asset doesn't read and decode it again.  It is built on
+ * top of the "file", "image" and "render" components, and thus it is
+ * platform-independent.
+ *
+ * An entry is keyed by the file name and the decode options.
+ * cache_load() returns a pinned entry, and cache_release() unpins it.
+ * When the pixels of the images and the textures exceed the budget,
+ * the least recently used entries that are not pinned are evicted.
+ * Pinned entries are never evicted, so the cache may exceed the budget
+ * while they are in use.
+ *
+ * The images are shared by the users of an entry, so don't modify
+ * them.  An entry holds a texture of its image when cache_get_texture()
+ * is called, and the texture is destroyed with the entry.  The
+ * functions must be called from the thread that uses the "render"
+ * component.
+ */
+
+#ifndef GAMEKIT_CACHE_H
+#define GAMEKIT_CACHE_H
+
+#include "compat.h"
+#include "image.h"
+#include "render.h"
+
+/* Decode flags. */
+#define CACHE_PREMULTIPLIED	(1)	/* Premultiply the alpha. */
+
+/* An entry of the cache. */
+struct cache_entry;
+
+/* Statistics. */
+struct cache_stats {
+	/* Loads that found an entry, and that decoded a file. */
+	uint64_t hit_count;
+	uint64_t miss_count;
+
+	/* Entries evicted for the budget. */
+	uint64_t eviction_count;
+
+	/* Bytes of the images and textures, and the budget. */
+	size_t used_bytes;
+	size_t budget_bytes;
+
+	/* Entries in the cache, and the pinned ones. */
+	int entry_count;
+	int pinned_count;
+};
+
+/* Initialize the "cache" module. (budget in bytes) */
+bool cache_init_module(size_t budget);
+
+/* Cleanup the "cache" module. (destroys all images and textures) */
+void cache_cleanup_module(void);
+
+/* Change the budget, and evict entries to fit it. */
+void cache_set_budget(size_t budget);
+
+/*
+ * Get an image, and pin it.
+ *  - On a miss, the file is read and decoded, and reduced to fit
+ *    max_width x max_height if they are positive. (see image.h)
+ */
+bool cache_load(const char *file, int max_width, int max_height, int flags, struct cache_entry **entry);
+
+/* Unpin an entry. (it stays cached until evicted) */
+void cache_release(struct cache_entry *entry);
+
+/* Get the image of a pinned entry. */
+struct image *cache_get_image(struct cache_entry *entry);
+
+/* Get the texture of a pinned entry, creating and uploading it if needed. */
+struct render_texture *cache_get_texture(struct cache_entry *entry);
+
+/* Evict all entries that are not pinned. */
+void cache_purge(void);
+
+/* Get the statistics. */
+void cache_get_stats(struct cache_stats *stats);
+
+#endif
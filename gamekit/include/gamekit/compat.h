@@ -106,6 +106,7 @@
 
 /* Suppress unused warnings. */
 #define UNUSED_PARAMETER(x)		(void)(x)
+#define THREAD_LOCAL			__thread
 
 /* UTF-8 string literal. */
 #define U8(s)				u8##s
@@ -144,6 +145,7 @@
 #define INLINE				__inline
 #define RESTRICT			__restrict
 #define UNUSED_PARAMETER(x)		(void)(x)
+#define THREAD_LOCAL			__thread
 #define U8(s)				u8##s
 #define U32_C(literal, unicode)		U##literal
 
@@ -182,6 +184,7 @@
 #define INLINE				__inline
 #define RESTRICT			__restrict
 #define UNUSED_PARAMETER(x)		(void)(x)
+#define THREAD_LOCAL			__declspec(thread)
 #define U8(s)				u8##s
 #define U32_C(literal, unicode)		U##literal
 
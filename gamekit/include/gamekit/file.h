@@ -50,4 +50,18 @@ void file_close(struct file *r);
 /* Rewind a file stream. */
 void file_rewind(struct file *f);
 
+/* Seek a file stream. (O(pos) for an entry of a v1 package) */
+bool file_seek(struct file *f, size_t pos);
+
+/*
+ * Map a whole file to read-only memory.
+ *  - A real file is mapped as is, and a packaged file is decoded to a
+ *    buffer, without a stream.
+ *  - Release the memory by file_unmap().
+ */
+bool file_map(const char *file, const void **ptr, size_t *size);
+
+/* Unmap a file mapped by file_map(). */
+void file_unmap(const void *ptr);
+
 #endif
@@ -20,6 +20,11 @@
 #include "image.h"
 #include "input.h"
 #include "render.h"
+#include "batch.h"
+#include "atlas.h"
+#include "cache.h"
+#include "prof.h"
+#include "job.h"
 
 /* C89 */
 #include <stdio.h>
@@ -31,6 +31,7 @@ typedef uint32_t pixel_t;
 #if defined(TARGET_WINDOWS) || defined(TARGET_MACOS) || defined(TARGET_IOS)
 /* Use RGBA on Direct3D and Metal */
 #define ORDER_RGBA
+#define IMAGE_ORDER_RGBA	/* Stays defined for the implementations. */
 #else
 /* Use BGRA o OpenGL */
 #define ORDER_BGRA
@@ -97,6 +98,22 @@ bool image_create_with_jpeg(const uint8_t *data, size_t size, struct image **img
 /* Create an image with a WebP file. */
 bool image_create_with_webp(const uint8_t *data, size_t size, struct image **img);
 
+/*
+ * Create an image with a JPEG file, reduced to fit a size.
+ *  - The DCT is scaled by the largest of 8/8 to 1/8 that fits, so the
+ *    image may be smaller than the size, or larger if even 1/8 is.
+ *  - A size of 0 or less leaves that direction unlimited.
+ */
+bool image_create_with_jpeg_scaled(const uint8_t *data, size_t size, int max_width, int max_height, struct image **img);
+
+/*
+ * Create an image with a WebP file, reduced to fit a size.
+ *  - The image is scaled to fit keeping the aspect ratio, and is not
+ *    enlarged.
+ *  - A size of 0 or less leaves that direction unlimited.
+ */
+bool image_create_with_webp_scaled(const uint8_t *data, size_t size, int max_width, int max_height, struct image **img);
+
 /* Destroy an image. */
 void image_destroy(struct image *img);
 
@@ -109,6 +126,24 @@ int image_get_height(struct image *img);
 /* Get image pixels. */
 pixel_t *image_get_pixels(struct image *img);
 
+/*
+ * Dirty rectangle
+ *
+ * The image_* drawing functions merge the rectangles they modify into
+ * a dirty rectangle, and render_update_texture() uploads only that
+ * rectangle and clears it.  Call image_mark_dirty() after writing to
+ * the pixels returned by image_get_pixels().
+ */
+
+/* Mark a rectangle of an image as modified. */
+void image_mark_dirty(struct image *img, int x, int y, int w, int h);
+
+/* Get a modified rectangle of an image. (false if not modified) */
+bool image_get_dirty_rect(struct image *img, int *x, int *y, int *w, int *h);
+
+/* Clear a modified rectangle of an image. */
+void image_clear_dirty(struct image *img);
+
 /* Clear an image with a uniform color. */
 void image_clear(struct image *img, pixel_t color);
 
@@ -131,11 +166,148 @@ void image_draw_add(struct image *dst_image, int dst_left, int dst_top,
 		    struct image *src_image, int width, int height,
 		    int src_left, int src_top, int alpha);
 
-/* Draw an image on an image. (add-blending) */
+/* Draw an image on an image. (sub-blending) */
 void image_draw_sub(struct image *dst_image, int dst_left, int dst_top,
 		    struct image *src_image, int width, int height,
 		    int src_left, int src_top, int alpha);
 
+/*
+ * Scaled and transformed drawing
+ *
+ * Each destination pixel whose center maps into the source rectangle
+ * is sampled at that point and alpha-blended like image_draw_alpha().
+ * The bilinear filter clamps to the source rectangle, so neighbors in
+ * an atlas don't bleed in.
+ */
+
+#define IMAGE_FILTER_NEAREST	0
+#define IMAGE_FILTER_BILINEAR	1
+
+/* Draw a scaled image on an image. (alpha-blending) */
+void image_draw_scaled(struct image *dst_image, int dst_left, int dst_top,
+		       int dst_width, int dst_height,
+		       struct image *src_image, int src_left, int src_top,
+		       int src_width, int src_height,
+		       int alpha, int filter);
+
+/*
+ * Draw an affine-transformed image on an image. (alpha-blending)
+ *  - m maps a point (x, y) in the source rectangle to the destination:
+ *    (m[0] * x + m[1] * y + m[2], m[3] * x + m[4] * y + m[5])
+ */
+void image_draw_transformed(struct image *dst_image,
+			    struct image *src_image, int src_left, int src_top,
+			    int src_width, int src_height,
+			    const float *m, int alpha, int filter);
+
+/*
+ * Resample a whole image to the whole size of another image with the
+ * box filter.  This averages the covered area of each pixel, which is
+ * suited to downscaling.  Premultiplied images average without dark
+ * fringes, and the result takes the mode of the source.
+ */
+bool image_resample_box(struct image *dst_image, struct image *src_image);
+
+/*
+ * Create the next level of a mip chain. (half size, at least 1x1)
+ *  - Upload the levels by render_upload_texture() with their level.
+ */
+bool image_create_mip(struct image *src_image, struct image **mip);
+
+/*
+ * The blending functions use SIMD kernels selected for the CPU at the
+ * initialization.  ("scalar", "sse2", "avx2" or "neon")  All kernels
+ * give the same results.
+ */
+
+/* Select the blending kernels by name. (NULL for the fastest) */
+bool image_set_blend_kernel(const char *name);
+
+/* Get the name of the blending kernels in use. */
+const char *image_get_blend_kernel(void);
+
+/*
+ * Premultiplied alpha
+ *
+ * A premultiplied image stores its colors multiplied by its alpha.
+ * The blending functions check the source image, and blend a
+ * premultiplied one with fewer multiplications: the alpha-blending
+ * composites the destination alpha as well (Porter-Duff "over"), and
+ * the add- and sub-blending keep it.  A premultiplied image also
+ * filters without dark fringes on the GPU, so draw its texture with
+ * RENDER_BLEND_PREMULTIPLIED.
+ *
+ * Images are created with straight alpha.  When enabled, the
+ * image_create_with_*() functions return premultiplied images.
+ * Colors passed to image_clear() and image_clear_rect() are stored as
+ * is, and image_draw_copy() copies pixels as is.
+ */
+
+/* Premultiply the alpha of the images decoded after this call. */
+void image_set_decode_premultiplied(bool enable);
+
+/* Check if the colors of an image are multiplied by the alpha. */
+bool image_is_premultiplied(struct image *img);
+
+/* Convert an image to premultiplied alpha. */
+void image_premultiply(struct image *img);
+
+/*
+ * The drawing and clearing functions split a large rectangle into
+ * bands of rows, and run them on the "job" pool.  The result is the
+ * same for any number of threads.  Small rectangles are drawn on the
+ * calling thread.
+ */
+
+/* Draw large rectangles in parallel. (enabled by default) */
+void image_set_parallel_enabled(bool enable);
+
+/*
+ * Asynchronous decoding
+ *
+ * image_decode_async() and image_decode_file_async() queue a request
+ * to a pool of decoder threads, and return a handle at once.  Poll the
+ * handle by image_is_decode_finished(), and get the image by
+ * image_wait_decode(), which blocks if needed and releases the handle.
+ * Every handle must be waited exactly once.
+ *
+ * Requests are taken in order, so with several threads one file is read
+ * while another is decoded.  Waiting a request no thread has taken yet
+ * runs it on the calling thread.  The decode mode (premultiplied or
+ * not) is the one at the time of the request.
+ *
+ * The pool starts on the first request, with one thread less than the
+ * "job" pool by default.  With 0 threads, the requests run in
+ * image_wait_decode().
+ */
+
+/* Image formats. */
+#define IMAGE_FORMAT_AUTO	(0)	/* Detect by the signature. */
+#define IMAGE_FORMAT_PNG	(1)
+#define IMAGE_FORMAT_JPEG	(2)
+#define IMAGE_FORMAT_WEBP	(3)
+
+/* Detect an image format by the signature. (IMAGE_FORMAT_AUTO if unknown) */
+int image_detect_format(const uint8_t *data, size_t size);
+
+/* A decoding request. */
+struct image_decode;
+
+/* Set the number of decoder threads. (0 to decode on the waiting thread, negative for the default) */
+void image_set_decoder_thread_count(int thread_count);
+
+/* Start decoding an image in memory. (data must live until waited) */
+bool image_decode_async(const uint8_t *data, size_t size, int format, struct image_decode **dec);
+
+/* Start reading and decoding an image file. */
+bool image_decode_file_async(const char *file, struct image_decode **dec);
+
+/* Check if a decoding request has finished. */
+bool image_is_decode_finished(struct image_decode *dec);
+
+/* Wait for a decoding request, get the image, and release the request. */
+bool image_wait_decode(struct image_decode *dec, struct image **img);
+
 /* Clip a rectangle by a source size. */
 bool image_clip_by_source(int src_cx,
 			  int src_cy,
@@ -9,9 +9,20 @@
  * input.h: "input_" component header.
  */
 
+/*
+ * Besides the polling functions, the "input" component keeps the input
+ * events in a queue with monotonic timestamps, so that the presses and
+ * the releases within a frame are not lost.  The queue has a single
+ * producer (the HAL, or an input thread) and a single consumer (the
+ * game thread), and needs no lock.  When the queue is full, the new
+ * events are dropped and counted.
+ */
+
 #ifndef GAMEKIT_INPUT_H
 #define GAMEKIT_INPUT_H
 
+#include "compat.h"
+
 enum input_button_code {
 	BUTTON_UP,
 	BUTTON_DOWN,
@@ -39,6 +50,43 @@ enum input_key_code {
 	KEY_CODE_SIZE,
 };
 
+enum input_mouse_code {
+	MOUSE_LEFT,
+	MOUSE_RIGHT,
+	MOUSE_MIDDLE,
+	MOUSE_CODE_SIZE,
+};
+
+enum input_event_type {
+	/* code is a key code. */
+	INPUT_EVENT_KEY_DOWN,
+	INPUT_EVENT_KEY_UP,
+
+	/* code is a mouse code, and x and y are the position. */
+	INPUT_EVENT_MOUSE_DOWN,
+	INPUT_EVENT_MOUSE_UP,
+
+	/* x and y are the position. */
+	INPUT_EVENT_MOUSE_MOVE,
+
+	/* x and y are the unaccelerated motion from the device. */
+	INPUT_EVENT_MOUSE_RAW_MOVE,
+
+	/* y is 1 for up and -1 for down. */
+	INPUT_EVENT_WHEEL,
+};
+
+/* An input event. */
+struct input_event {
+	int type;
+	int code;
+	int x;
+	int y;
+
+	/* Time by sys_get_nano_tick(). */
+	uint64_t time;
+};
+
 /* Initialize the "input" module. */
 bool input_init_module(void);
 
@@ -66,4 +114,13 @@ int input_get_mouse_x(void);
 /* Get a mouse Y position. */
 int input_get_mouse_y(void);
 
+/* Get the oldest input event. (false if there is none) */
+bool input_poll_event(struct input_event *event);
+
+/* Put an input event. (for the producer. false if the queue is full) */
+bool input_push_event(const struct input_event *event);
+
+/* Get the number of the events dropped by a full queue. */
+int input_get_dropped_event_count(void);
+
 #endif
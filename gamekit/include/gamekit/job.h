@@ -0,0 +1,51 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * job.h: "job_" component interface.
+ */
+
+/*
+ * The "job" component runs work on a pool of worker threads that the
+ * HAL creates at startup.  job_parallel_for() calls a function for each
+ * index of a range, and returns when all calls have finished.  The
+ * calling thread takes part in the work, so a pool of N threads has
+ * N - 1 workers.
+ *
+ * Only one parallel-for runs at a time.  If another thread is running
+ * one, or the function is called from inside one, the indices are run
+ * on the calling thread in order.  The results must therefore not
+ * depend on which thread runs an index.
+ */
+
+#ifndef GAMEKIT_JOB_H
+#define GAMEKIT_JOB_H
+
+#include "compat.h"
+
+/* Maximum number of threads including the calling thread. */
+#define JOB_THREAD_MAX	(16)
+
+/* A function to run for an index. */
+typedef void (*job_func)(void *arg, int index);
+
+/* Initialize the "job" module. (thread_count includes the calling thread) */
+bool job_init_module(int thread_count);
+
+/* Cleanup the "job" module. */
+void job_cleanup_module(void);
+
+/* Get the number of threads in use. */
+int job_get_thread_count(void);
+
+/* Limit the number of threads in use. (up to the initialized count) */
+void job_set_thread_count(int thread_count);
+
+/* Run a function for indices 0 to count - 1, and wait for them. */
+void job_parallel_for(int count, job_func func, void *arg);
+
+#endif
@@ -0,0 +1,90 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * prof.h: "prof_" component interface.
+ */
+
+/*
+ * The "prof" component measures where the time of a frame goes.  The
+ * HAL marks the frames and its own zones (the frame callback, the
+ * buffer swap and the event processing), and any code, including the
+ * scripting runtime, can mark its zones by prof_begin_zone() and
+ * prof_end_zone().  Zones nest, and a zone name must be a string that
+ * lives until the end of the program.
+ *
+ * Each thread records to a track.  The main thread uses
+ * PROF_TRACK_MAIN, and the HAL puts its render thread on
+ * PROF_TRACK_RENDER.  A track has its own frames, and prof_get_stats()
+ * returns the recent frames of the track of the calling thread.
+ *
+ * While a trace is started, the zones of each frame are written to a
+ * file in the Chrome trace event format, which can be opened by
+ * chrome://tracing or Perfetto.  The GPU time of the frames is written
+ * as a counter.
+ */
+
+#ifndef GAMEKIT_PROF_H
+#define GAMEKIT_PROF_H
+
+#include "compat.h"
+
+/* Tracks. */
+#define PROF_TRACK_MAIN		(0)
+#define PROF_TRACK_RENDER	(1)
+#define PROF_TRACK_MAX		(2)
+
+/* Statistics of the recent frames in milliseconds. */
+struct prof_stats {
+	/* Number of the frames measured. */
+	int frame_count;
+
+	/* Frame time on the CPU side. */
+	float frame_avg;
+	float frame_p50;
+	float frame_p99;
+	float frame_max;
+
+	/* GPU time. (negative if not measured) */
+	float gpu_p50;
+	float gpu_p99;
+};
+
+/* Initialize the "prof" module. */
+bool prof_init_module(void);
+
+/* Cleanup the "prof" module. */
+void prof_cleanup_module(void);
+
+/* Set the track of the calling thread. */
+void prof_set_track(int track);
+
+/* Begin a frame of the track of the calling thread. */
+void prof_begin_frame(void);
+
+/* End a frame of the track of the calling thread. */
+void prof_end_frame(void);
+
+/* Begin a zone. */
+void prof_begin_zone(const char *name);
+
+/* End the innermost zone. */
+void prof_end_zone(void);
+
+/* Set the GPU time of the current frame. */
+void prof_set_gpu_time(float ms);
+
+/* Get the statistics of the recent frames. */
+void prof_get_stats(struct prof_stats *stats);
+
+/* Start writing a trace. */
+bool prof_start_trace(const char *file);
+
+/* Stop writing a trace. (call when no other thread records) */
+void prof_stop_trace(void);
+
+#endif
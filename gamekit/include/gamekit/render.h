@@ -75,6 +75,7 @@ bool render_end_sampler(void);
 
 bool render_begin_vertex_shader_input(void);
 bool render_add_vertex_shader_input(const char *type, const char *name, const char *note);
+bool render_add_instance_input(const char *type, const char *name, const char *note);
 bool render_end_vertex_shader_input(void);
 
 bool render_begin_pixel_shader_input(void);
@@ -122,32 +123,93 @@ void render_destroy_texture(struct render_texture *tex);
 /* Upload pixels to a texture. */
 void render_upload_texture(struct render_texture *tex, int miplevel, struct image *img);
 
+/*
+ * Upload the dirty rectangle of an image to a texture, and clear it.
+ *  - The whole image is uploaded if the texture has no storage yet or
+ *    has another size.
+ *  - The dirty rectangle belongs to the image, so update a texture
+ *    only from the image that it was last uploaded from, and update
+ *    only one texture from an image.
+ */
+void render_update_texture(struct render_texture *tex, struct image *img);
+
+/* Upload a rectangle of pixels to a texture. */
+void render_upload_texture_rect(struct render_texture *tex, struct image *img, int x, int y, int w, int h);
+
+/*
+ * Upload a rectangle of packed pixels in memory to a texture.
+ *  - The texture is (re)specified as width x height if it is not yet
+ *    or has another size, and only the rectangle is defined then.
+ */
+void render_upload_texture_pixels(struct render_texture *tex, int width, int height, bool is_premultiplied, const pixel_t *pixels, int x, int y, int w, int h);
+
+/* Update a texture like render_update_texture(), through a pixel buffer object ring. */
+void render_upload_texture_async(struct render_texture *tex, struct image *img);
+
+/*
+ * Buffer Usage
+ */
+
+/*
+ * A static buffer is uploaded once, a dynamic buffer is updated
+ * sometimes, and a stream buffer is rewritten every frame.
+ *
+ * A stream buffer is a ring buffer.  render_stream_*_buffer()
+ * sub-allocates a range from the ring, writes data to it without
+ * synchronization, and makes the range current.  Vertex and index
+ * offsets in the following bind and draw calls are relative to the
+ * current range.  The ring should be a few times larger than the
+ * data streamed per frame.
+ */
+
+#define RENDER_BUFFER_STATIC	0
+#define RENDER_BUFFER_DYNAMIC	1
+#define RENDER_BUFFER_STREAM	2
+
 /*
  * Vertex Buffer
  */
 
-/* Create a vertex buffer. */
+/* Create a vertex buffer. (static) */
 bool render_create_vertex_buffer(int size, struct render_vertex_buffer **buf);
 
+/* Create a vertex buffer with a usage. */
+bool render_create_vertex_buffer_with_usage(int size, int usage, struct render_vertex_buffer **buf);
+
 /* Destroy a vertex buffer. */
 void render_destroy_vertex_buffer(struct render_vertex_buffer *buf);
 
-/* Upload data to a vertex buffer. */
+/* Upload data to a vertex buffer. (static and dynamic) */
 void render_upload_vertex_buffer(struct render_vertex_buffer *buf, const float *src);
 
+/* Update a range of a vertex buffer. (static and dynamic) */
+void render_update_vertex_buffer(struct render_vertex_buffer *buf, int offset, int count, const float *src);
+
+/* Stream data to a vertex buffer and make the range current. (stream) */
+bool render_stream_vertex_buffer(struct render_vertex_buffer *buf, const float *src, int count);
+
 /*
  * Index Buffer
  */
 
-/* Create an index buffer. */
+/* Create an index buffer. (static) */
 bool render_create_index_buffer(int size, struct render_index_buffer **buf);
 
+/* Create an index buffer with a usage. */
+bool render_create_index_buffer_with_usage(int size, int usage, struct render_index_buffer **buf);
+
 /* Destroy an index buffer. */
 void render_destroy_index_buffer(struct render_index_buffer *buf);
 
-/* Copy data to an index buffer. */
+/* Copy data to an index buffer. (static and dynamic) */
 void render_upload_index_buffer(struct render_index_buffer *buf, const short *src);
 
+/* Update a range of an index buffer. (static and dynamic) */
+void render_update_index_buffer(struct render_index_buffer *buf, int offset, int count, const short *src);
+
+/* Stream data to an index buffer and make the range current. (stream) */
+bool render_stream_index_buffer(struct render_index_buffer *buf, const short *src, int count);
+
 /*
  * Constant
  */
@@ -155,6 +217,12 @@ void render_upload_index_buffer(struct render_index_buffer *buf, const short *sr
 /* Update a pipeline constant. */
 bool render_update_constant(struct render_pipeline *pipeline, struct render_constant_buffer *buf, const char *name, void *src);
 
+/* Get an index of a pipeline constant. (-1 if not found) */
+int render_get_constant_index(struct render_pipeline *pipeline, const char *name);
+
+/* Update a pipeline constant by an index. (the pipeline must be bound) */
+bool render_update_constant_by_index(struct render_pipeline *pipeline, int index, const void *src);
+
 /*
  * Rendering
  */
@@ -165,6 +233,9 @@ void render_begin_frame(void);
 /* Finish a frame. */
 void render_end_frame(void);
 
+/* Read back the framebuffer to an image. (from the top-left corner) */
+bool render_read_pixels(struct image *img);
+
 /* Bind a vertex buffer. */
 void render_bind_vertex_buffer(struct render_vertex_buffer *buf);
 
@@ -180,4 +251,191 @@ void render_bind_texture(int index, struct render_texture *tex);
 /* Draw triangles. */
 void render_draw_triangle_strip(int offset, int count);
 
+/*
+ * Blending
+ *
+ * Draw straight alpha textures with RENDER_BLEND_ALPHA, and
+ * premultiplied ones (see image_premultiply()) with
+ * RENDER_BLEND_PREMULTIPLIED, which also composites the destination
+ * alpha correctly.  render_get_texture_blend_mode() returns the one for
+ * the image last uploaded to a texture.  render_begin_frame() resets
+ * the mode to RENDER_BLEND_ADD.
+ */
+
+#define RENDER_BLEND_NONE		0
+#define RENDER_BLEND_ALPHA		1
+#define RENDER_BLEND_PREMULTIPLIED	2
+#define RENDER_BLEND_ADD		3
+
+/* Set the blend mode. (flushes the submission queue on a change) */
+void render_set_blend_mode(int mode);
+
+/* Get the blend mode for a texture. */
+int render_get_texture_blend_mode(struct render_texture *tex);
+
+/*
+ * Instancing
+ */
+
+/*
+ * Inputs added by render_add_instance_input() advance per instance,
+ * and are read from the instance buffer with their own layout.  Any
+ * vertex buffer can be an instance buffer, and a stream buffer can be
+ * rewritten every frame by render_stream_vertex_buffer().  Matrices
+ * are not supported as instance inputs, so use vectors instead.
+ */
+
+/* Check if the instanced drawing is supported. */
+bool render_is_instancing_supported(void);
+
+/* Bind a vertex buffer as an instance buffer. (after a pipeline) */
+void render_bind_instance_buffer(struct render_vertex_buffer *buf);
+
+/* Draw instances of triangles. */
+void render_draw_instanced(int offset, int count, int instances);
+
+/*
+ * Submission Queue
+ */
+
+/*
+ * A draw item binds its pipeline, buffers and textures, updates its
+ * constants, and draws a triangle strip.  Bindings that are already
+ * current are skipped.
+ *
+ * When the queue is enabled, render_queue_draw() defers items until
+ * render_flush_queue() or render_end_frame(), and they are sorted by
+ * layer, pipeline, textures and buffers to minimize state changes.
+ * Items of the same state keep their order, but items of different
+ * states in a layer may be reordered, so put order-dependent
+ * (blended) items in separate layers.
+ *
+ * Queued items refer to their buffers and textures, so the functions
+ * that change the contents of a buffer or a texture, or the base of a
+ * stream buffer, flush the queue first, as a change of the blend mode
+ * does.
+ */
+
+#define RENDER_DRAW_TEXTURE_MAX		2
+#define RENDER_DRAW_CONSTANT_MAX	2
+
+struct render_draw_item {
+	/* Sort key with the highest priority. */
+	int layer;
+
+	struct render_pipeline *pipeline;
+	struct render_vertex_buffer *vertex_buffer;
+	struct render_index_buffer *index_buffer;
+	struct render_texture *texture[RENDER_DRAW_TEXTURE_MAX];
+
+	/* Instance buffer and count. (NULL for a non-instanced draw) */
+	struct render_vertex_buffer *instance_buffer;
+	int instance_count;
+
+	/* Constants by index. (see render_get_constant_index()) */
+	int constant_count;
+	struct {
+		int index;
+		float value[16];
+	} constant[RENDER_DRAW_CONSTANT_MAX];
+
+	/* Range of the index buffer. */
+	int offset;
+	int count;
+};
+
+/* Enable or disable the deferred submission queue. */
+void render_set_queue_enabled(bool enable);
+
+/* Draw an item, or put it to the submission queue. */
+void render_queue_draw(const struct render_draw_item *item);
+
+/* Sort the queued items and submit them. */
+void render_flush_queue(void);
+
+/*
+ * Command List
+ */
+
+/*
+ * A command list records render_ calls to replay them later.  Lists
+ * can be recorded by different threads, but a list must be recorded
+ * by one thread at a time.  Streamed data, constants and the pixels to
+ * upload are copied to the list, so an image may be modified after it
+ * is recorded.
+ *
+ * render_cmd_update_texture() copies only the dirty rectangle if the
+ * uploads recorded before have given the texture storage of the same
+ * size, and the whole image otherwise.  Upload a texture either through
+ * lists or directly, not both, and submit every list that records an
+ * upload.
+ *
+ * render_submit_cmd_list() replays a list immediately, or, when the
+ * HAL runs a render thread, replays it on the render thread after the
+ * current frame of the game thread.  In the latter case, the game
+ * thread must not call the other render_ functions in on_hal_frame(),
+ * including render_begin_frame() and render_end_frame() that the HAL
+ * calls on the render thread, and a list submitted in a frame must be
+ * kept intact until the next next frame.  (i.e., use two sets of lists
+ * alternately)
+ */
+
+struct render_cmd_list;
+
+/* Create a command list. */
+bool render_create_cmd_list(struct render_cmd_list **list);
+
+/* Destroy a command list. */
+void render_destroy_cmd_list(struct render_cmd_list *list);
+
+/* Clear the commands in a list. */
+void render_cmd_reset(struct render_cmd_list *list);
+
+/* Record commands. (see the functions of the same names) */
+void render_cmd_bind_pipeline(struct render_cmd_list *list, struct render_pipeline *pipeline);
+void render_cmd_bind_vertex_buffer(struct render_cmd_list *list, struct render_vertex_buffer *buf);
+void render_cmd_bind_index_buffer(struct render_cmd_list *list, struct render_index_buffer *buf);
+void render_cmd_bind_instance_buffer(struct render_cmd_list *list, struct render_vertex_buffer *buf);
+void render_cmd_bind_texture(struct render_cmd_list *list, int index, struct render_texture *tex);
+void render_cmd_set_blend_mode(struct render_cmd_list *list, int mode);
+void render_cmd_update_constant(struct render_cmd_list *list, struct render_pipeline *pipeline, int index, const float *src, int count);
+void render_cmd_stream_vertex_buffer(struct render_cmd_list *list, struct render_vertex_buffer *buf, const float *src, int count);
+void render_cmd_stream_index_buffer(struct render_cmd_list *list, struct render_index_buffer *buf, const short *src, int count);
+void render_cmd_upload_texture(struct render_cmd_list *list, struct render_texture *tex, struct image *img);
+void render_cmd_update_texture(struct render_cmd_list *list, struct render_texture *tex, struct image *img);
+void render_cmd_draw_triangle_strip(struct render_cmd_list *list, int offset, int count);
+void render_cmd_draw_instanced(struct render_cmd_list *list, int offset, int count, int instances);
+void render_cmd_queue_draw(struct render_cmd_list *list, const struct render_draw_item *item);
+
+/* Submit a command list. */
+void render_submit_cmd_list(struct render_cmd_list *list);
+
+/* Check whether the submitted lists are replayed on a render thread. */
+bool render_is_cmd_deferred(void);
+
+/*
+ * Statistics
+ */
+
+struct render_stats {
+	/* Number of API calls issued. (state, draw, constant and transfer) */
+	int api_call_count;
+
+	/* Number of state changes skipped as redundant. */
+	int redundant_call_count;
+
+	/* Number of draw calls. */
+	int draw_count;
+};
+
+/* Get the statistics of the last frame. */
+void render_get_stats(struct render_stats *stats);
+
+/*
+ * Get the GPU time of the latest frame measured, in milliseconds.
+ * The time is read a few frames later without stalling.  (false if
+ * timer queries are not supported or no frame has finished yet)
+ */
+bool render_get_gpu_time(float *ms);
+
 #endif
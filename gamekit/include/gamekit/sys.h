@@ -26,6 +26,30 @@ void sys_out_of_memory(void);
 /* Get a millisecond time. */
 uint64_t system_get_tick(void);
 
+/* Get a monotonic nanosecond time. */
+uint64_t sys_get_nano_tick(void);
+
+/*
+ * Fixed-timestep loop.  When set in on_hal_ready(), the HAL calls
+ * on_update() at a fixed tick rate and on_render() once per displayed
+ * frame instead of on_hal_frame().  Up to max_catch_up ticks run in a
+ * frame to catch up, and the rest of the delay is dropped.  alpha is
+ * the fraction of a tick elapsed after the last update, to interpolate
+ * the previous and the current states.  With is_threaded, ticks run on
+ * their own thread, but on_update() and on_render() never run at the
+ * same time.
+ */
+struct sys_fixed_loop {
+	int tick_rate;
+	int max_catch_up;
+	bool is_threaded;
+	bool (*on_update)(float dt);
+	bool (*on_render)(float alpha);
+};
+
+/* Use the fixed-timestep loop. */
+void sys_set_fixed_loop(const struct sys_fixed_loop *loop);
+
 /* Get a two-letter language code of a system. */
 const char *system_get_language(void);
 
@@ -0,0 +1,1073 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * benchprogram.c: Benchmark program.
+ */
+
+#include "gamekit/gamekit.h"
+
+#include <time.h>	/* clock() */
+
+/* Screen size. */
+#define SCREEN_WIDTH	1280
+#define SCREEN_HEIGHT	720
+
+/* Frames to run. */
+#define FRAME_COUNT	300
+
+/* Sprites per frame. */
+#define SPRITE_COUNT	20000
+
+/* Textures used by sprites. */
+#define TEXTURE_COUNT	8
+
+/* Bytes streamed per frame. */
+#define STREAM_BYTES	(4 * 1024 * 1024)
+
+/* Bytes streamed per call. */
+#define STREAM_CHUNK	(256 * 1024)
+
+/* Particles per frame. */
+#define PARTICLE_COUNT	10000
+
+/* Floats per particle instance. (rect and color) */
+#define PARTICLE_FLOATS	8
+
+/* Size of the images blended by the blit benchmark. */
+#define BLIT_SIZE	512
+
+/* Blits per kernel and operation. */
+#define BLIT_COUNT	20
+
+/* Layer size and count for the parallel compositing. */
+#define LAYER_W		1920
+#define LAYER_H		1080
+#define LAYER_COUNT	4
+
+/* Size and count of the images decoded by the decoder benchmark. */
+#define DECODE_SIZE	512
+#define DECODE_COUNT	32
+
+/* Size of the texture updated per frame. */
+#define UPLOAD_SIZE	1024
+
+/* Size of the rectangle updated per frame. */
+#define UPLOAD_RECT_W	256
+#define UPLOAD_RECT_H	32
+
+static struct image *sprite_image[TEXTURE_COUNT];
+static struct render_texture *sprite_texture[TEXTURE_COUNT];
+
+static int frame;
+static clock_t batch_clock;
+static int batch_sprites;
+static int batch_draws;
+
+static struct render_vertex_buffer *stream_buffer;
+static float stream_data[STREAM_CHUNK / sizeof(float)];
+static clock_t stream_clock;
+static clock_t stream_clock_max;
+
+static struct image *upload_image;
+static struct render_texture *upload_texture[3];
+static clock_t upload_clock[3];
+
+static struct render_pipeline *particle_pipeline;
+static struct render_vertex_buffer *particle_quad;
+static struct render_vertex_buffer *particle_buffer;
+static struct render_index_buffer *particle_index;
+static float particle_data[PARTICLE_COUNT * PARTICLE_FLOATS];
+static clock_t particle_clock[2];
+
+static int api_calls;
+static int redundant_calls;
+
+static struct render_cmd_list *cmd_list[2];
+
+/* Forward declaration. */
+static void bench_sprite_batch(void);
+static void bench_stream(void);
+static void bench_upload(void);
+static bool init_particles(void);
+static void bench_particles(void);
+static bool bench_cmd_frame(void);
+static void bench_blend(void);
+static bool check_blend(void);
+static void bench_parallel(void);
+static void bench_scale(void);
+static bool check_scale(void);
+static void bench_decode(void);
+static uint8_t *make_png(int width, int height, uint32_t seed, size_t *size);
+static void put_chunk(uint8_t *p, const char *type, size_t len);
+static uint32_t crc32_png(const uint8_t *p, size_t len);
+static void put_u32_be(uint8_t *p, uint32_t v);
+static void draw_blend(int op, struct image *dst, struct image *src, int alpha);
+static void fill_random(struct image *img, uint32_t seed);
+static void free_image(struct image *img);
+
+/*
+ * Called after the "file" initializain and before the "render" initialization.
+ */
+bool on_hal_init_render(char **title, int *width, int *height)
+{
+	*title = strdup("Benchmark");
+	*width = SCREEN_WIDTH;
+	*height = SCREEN_HEIGHT;
+
+	return true;
+}
+
+/*
+ * Called after the whole HAL initialization and before the game loop.
+ */
+bool on_hal_ready(void)
+{
+	int i;
+
+	if (!batch_init_module(SCREEN_WIDTH, SCREEN_HEIGHT))
+		return false;
+
+	for (i = 0; i < TEXTURE_COUNT; i++) {
+		if (!image_create(32, 32, &sprite_image[i]))
+			return false;
+		image_clear(sprite_image[i], make_pixel(255, (uint32_t)(i * 32), 128, 255 - (uint32_t)(i * 32)));
+		if (!render_create_texture(32, 32, 0, &sprite_texture[i]))
+			return false;
+		render_upload_texture(sprite_texture[i], 0, sprite_image[i]);
+	}
+
+	if (!render_create_vertex_buffer_with_usage(4 * STREAM_BYTES / (int)sizeof(float),
+						    RENDER_BUFFER_STREAM,
+						    &stream_buffer))
+		return false;
+
+	if (render_is_instancing_supported() && !init_particles())
+		return false;
+
+	for (i = 0; i < 2; i++) {
+		if (!render_create_cmd_list(&cmd_list[i]))
+			return false;
+	}
+
+	if (!image_create(UPLOAD_SIZE, UPLOAD_SIZE, &upload_image))
+		return false;
+	for (i = 0; i < 3; i++) {
+		if (!render_create_texture(UPLOAD_SIZE, UPLOAD_SIZE, 0, &upload_texture[i]))
+			return false;
+		render_upload_texture(upload_texture[i], 0, upload_image);
+	}
+
+	return true;
+}
+
+/*
+ * Called every frame.
+ */
+bool on_hal_frame(void)
+{
+	struct render_stats stats;
+	struct prof_stats prof;
+
+	/* Only the command lists can be used with a render thread. */
+	if (render_is_cmd_deferred())
+		return bench_cmd_frame();
+
+	render_begin_frame();
+	prof_begin_zone("bench_sprite_batch");
+	bench_sprite_batch();
+	prof_end_zone();
+	prof_begin_zone("bench_stream");
+	bench_stream();
+	prof_end_zone();
+	prof_begin_zone("bench_upload");
+	bench_upload();
+	prof_end_zone();
+	prof_begin_zone("bench_particles");
+	bench_particles();
+	prof_end_zone();
+	render_end_frame();
+
+	render_get_stats(&stats);
+	api_calls += stats.api_call_count;
+	redundant_calls += stats.redundant_call_count;
+
+	if (++frame < FRAME_COUNT)
+		return true;
+
+	/* Report. */
+	sys_log("sprite batch: %d sprites/frame, %d draws/frame, %.1f sprites/ms (CPU)\n",
+		batch_sprites / FRAME_COUNT,
+		batch_draws / FRAME_COUNT,
+		(double)batch_sprites / ((double)batch_clock * 1000.0 / CLOCKS_PER_SEC));
+	sys_log("vertex stream: %d KB/frame, %.3f ms/frame avg, %.3f ms/frame max (CPU)\n",
+		STREAM_BYTES / 1024,
+		(double)stream_clock * 1000.0 / CLOCKS_PER_SEC / FRAME_COUNT,
+		(double)stream_clock_max * 1000.0 / CLOCKS_PER_SEC);
+	sys_log("render: %d API calls/frame, %d redundant calls skipped/frame\n",
+		api_calls / FRAME_COUNT,
+		redundant_calls / FRAME_COUNT);
+	sys_log("particles: %d/frame, %.3f ms instanced, %.3f ms batched (CPU)\n",
+		PARTICLE_COUNT,
+		(double)particle_clock[0] * 1000.0 / CLOCKS_PER_SEC / FRAME_COUNT,
+		(double)particle_clock[1] * 1000.0 / CLOCKS_PER_SEC / FRAME_COUNT);
+	sys_log("texture upload: %dx%d rect, %.3f ms full, %.3f ms partial, %.3f ms async (CPU)\n",
+		UPLOAD_RECT_W,
+		UPLOAD_RECT_H,
+		(double)upload_clock[0] * 1000.0 / CLOCKS_PER_SEC / FRAME_COUNT,
+		(double)upload_clock[1] * 1000.0 / CLOCKS_PER_SEC / FRAME_COUNT,
+		(double)upload_clock[2] * 1000.0 / CLOCKS_PER_SEC / FRAME_COUNT);
+
+	bench_blend();
+	bench_parallel();
+	bench_scale();
+	bench_decode();
+
+	prof_get_stats(&prof);
+	sys_log("frame (last %d): p50 %.3f ms, p99 %.3f ms, GPU p50 %.3f ms, GPU p99 %.3f ms\n",
+		prof.frame_count,
+		(double)prof.frame_p50,
+		(double)prof.frame_p99,
+		(double)prof.gpu_p50,
+		(double)prof.gpu_p99);
+
+	return false;
+}
+
+/* Measure the blit throughput of each blending kernel. */
+static void bench_blend(void)
+{
+	static const char *kernel[] = {"scalar", "sse2", "avx2", "neon"};
+	struct image *src, *pre, *dst;
+	clock_t start, lap[6];
+	double mp;
+	int i, j, op;
+
+	if (!check_blend()) {
+		sys_log("blend: self-check FAILED\n");
+		return;
+	}
+
+	if (!image_create(BLIT_SIZE, BLIT_SIZE, &src))
+		return;
+	if (!image_create(BLIT_SIZE, BLIT_SIZE, &pre)) {
+		image_destroy(src);
+		return;
+	}
+	if (!image_create(BLIT_SIZE, BLIT_SIZE, &dst)) {
+		image_destroy(src);
+		image_destroy(pre);
+		return;
+	}
+	fill_random(src, 1);
+	fill_random(pre, 1);
+	image_premultiply(pre);
+	fill_random(dst, 2);
+
+	/* Ops 0-2 are straight, and 3-5 are premultiplied at alpha 255. */
+	mp = (double)BLIT_SIZE * BLIT_SIZE * BLIT_COUNT / 1000000.0;
+	for (i = 0; i < (int)(sizeof(kernel) / sizeof(kernel[0])); i++) {
+		if (!image_set_blend_kernel(kernel[i]))
+			continue;
+		for (op = 0; op < 6; op++) {
+			start = clock();
+			for (j = 0; j < BLIT_COUNT; j++) {
+				if (op < 3)
+					draw_blend(op, dst, src, 200);
+				else
+					draw_blend(op - 3, dst, pre, 255);
+			}
+			lap[op] = clock() - start;
+			if (lap[op] == 0)
+				lap[op] = 1;
+		}
+		sys_log("blend %s: %.1f/%.1f/%.1f MP/s alpha/add/sub, %.1f/%.1f/%.1f MP/s premultiplied\n",
+			kernel[i],
+			mp / ((double)lap[0] / CLOCKS_PER_SEC),
+			mp / ((double)lap[1] / CLOCKS_PER_SEC),
+			mp / ((double)lap[2] / CLOCKS_PER_SEC),
+			mp / ((double)lap[3] / CLOCKS_PER_SEC),
+			mp / ((double)lap[4] / CLOCKS_PER_SEC),
+			mp / ((double)lap[5] / CLOCKS_PER_SEC));
+	}
+	image_set_blend_kernel(NULL);
+
+	image_destroy(src);
+	image_destroy(pre);
+	image_destroy(dst);
+}
+
+/*
+ * Check that all kernels give the same result as the scalar one, that
+ * the scalar one is within 1 of the floating point formula, and that
+ * the premultiplied kernels give the colors of the straight ones
+ * within 2.
+ */
+static bool check_blend(void)
+{
+	static const char *kernel[] = {"sse2", "avx2", "neon"};
+	static const int alpha[] = {255, 128, 1};
+	struct image *src, *pre, *ref, *pref, *out, *tmp;
+	pixel_t *s, *r, *pr, *o, sp, dp;
+	float sa, f;
+	int w, h, i, k, a, op, c, shift, n;
+	bool ok;
+
+	/* An odd width to test the tails. */
+	w = 67;
+	h = 5;
+	src = pre = ref = pref = out = NULL;
+	if (!image_create(w, h, &src) ||
+	    !image_create(w, h, &pre) ||
+	    !image_create(w, h, &ref) ||
+	    !image_create(w, h, &pref) ||
+	    !image_create(w, h, &out)) {
+		free_image(src);
+		free_image(pre);
+		free_image(ref);
+		free_image(pref);
+		free_image(out);
+		return false;
+	}
+	fill_random(src, 3);
+	s = image_get_pixels(src);
+	r = image_get_pixels(ref);
+	pr = image_get_pixels(pref);
+	o = image_get_pixels(out);
+
+	/* The premultiplication. */
+	image_set_blend_kernel("scalar");
+	fill_random(pre, 3);
+	image_premultiply(pre);
+	ok = true;
+	for (k = 0; k < (int)(sizeof(kernel) / sizeof(kernel[0])); k++) {
+		if (!image_set_blend_kernel(kernel[k]))
+			continue;
+		if (!image_create(w, h, &tmp)) {
+			ok = false;
+			break;
+		}
+		fill_random(tmp, 3);
+		image_premultiply(tmp);
+		if (memcmp(image_get_pixels(pre), image_get_pixels(tmp), sizeof(pixel_t) * (size_t)(w * h)) != 0)
+			ok = false;
+		image_destroy(tmp);
+	}
+
+	for (op = 0; op < 3 && ok; op++) {
+		for (a = 0; a < 3 && ok; a++) {
+			/* The scalar kernels. */
+			image_set_blend_kernel("scalar");
+			fill_random(ref, 4);
+			draw_blend(op, ref, src, alpha[a]);
+			fill_random(pref, 4);
+			draw_blend(op, pref, pre, alpha[a]);
+
+			/* The scalar kernels against the float formula. */
+			fill_random(out, 4);
+			for (i = 0; i < w * h; i++) {
+				sp = s[i];
+				dp = o[i];
+				sa = (float)alpha[a] / 255.0f * (float)(sp >> 24) / 255.0f;
+				for (shift = 0; shift < 24; shift += 8) {
+					c = (int)((sp >> shift) & 0xff);
+					n = (int)((dp >> shift) & 0xff);
+					if (op == 0)
+						f = (float)c * sa + (float)n * (1.0f - sa);
+					else if (op == 1)
+						f = (float)n + (float)c * sa;
+					else
+						f = (float)n - (float)c * sa;
+					f = f < 0 ? 0 : (f > 255 ? 255 : f);
+					if (abs((int)((r[i] >> shift) & 0xff) - (int)(f + 0.5f)) > 1)
+						ok = false;
+					if (abs((int)((pr[i] >> shift) & 0xff) - (int)((r[i] >> shift) & 0xff)) > 2)
+						ok = false;
+				}
+			}
+
+			/* The SIMD kernels against the scalar kernels. */
+			for (k = 0; k < (int)(sizeof(kernel) / sizeof(kernel[0])); k++) {
+				if (!image_set_blend_kernel(kernel[k]))
+					continue;
+				fill_random(out, 4);
+				draw_blend(op, out, src, alpha[a]);
+				if (memcmp(r, o, sizeof(pixel_t) * (size_t)(w * h)) != 0)
+					ok = false;
+				fill_random(out, 4);
+				draw_blend(op, out, pre, alpha[a]);
+				if (memcmp(pr, o, sizeof(pixel_t) * (size_t)(w * h)) != 0)
+					ok = false;
+			}
+		}
+	}
+	image_set_blend_kernel(NULL);
+
+	image_destroy(src);
+	image_destroy(pre);
+	image_destroy(ref);
+	image_destroy(pref);
+	image_destroy(out);
+
+	return ok;
+}
+
+/*
+ * Measure the full-HD layer compositing on 1 to 16 threads, and check
+ * that the result is the same for any thread count.
+ */
+static void bench_parallel(void)
+{
+	struct image *layer[LAYER_COUNT], *dst, *ref;
+	uint64_t start, lap, base;
+	int max_threads, threads, i;
+	bool is_same;
+
+	if (!image_create(LAYER_W, LAYER_H, &dst))
+		return;
+	if (!image_create(LAYER_W, LAYER_H, &ref)) {
+		image_destroy(dst);
+		return;
+	}
+	for (i = 0; i < LAYER_COUNT; i++) {
+		if (!image_create(LAYER_W, LAYER_H, &layer[i])) {
+			while (i-- > 0)
+				image_destroy(layer[i]);
+			image_destroy(dst);
+			image_destroy(ref);
+			return;
+		}
+		fill_random(layer[i], (uint32_t)(10 + i));
+	}
+
+	max_threads = job_get_thread_count();
+	base = 0;
+	for (threads = 1; threads <= JOB_THREAD_MAX; threads *= 2) {
+		job_set_thread_count(threads);
+		if (job_get_thread_count() != threads)
+			break;
+
+		/* Clear and composite the layers. */
+		start = sys_get_nano_tick();
+		for (i = 0; i < BLIT_COUNT; i++) {
+			image_clear(dst, make_pixel(255, 0, 0, 0));
+			draw_blend(0, dst, layer[0], 255);
+			draw_blend(0, dst, layer[1], 128);
+			draw_blend(1, dst, layer[2], 64);
+			draw_blend(2, dst, layer[3], 32);
+		}
+		lap = (sys_get_nano_tick() - start) / BLIT_COUNT;
+		if (lap == 0)
+			lap = 1;
+
+		/* Compare with the single thread. */
+		if (threads == 1) {
+			base = lap;
+			image_draw_copy(ref, 0, 0, dst, LAYER_W, LAYER_H, 0, 0);
+			is_same = true;
+		} else {
+			is_same = memcmp(image_get_pixels(ref),
+					 image_get_pixels(dst),
+					 sizeof(pixel_t) * LAYER_W * LAYER_H) == 0;
+		}
+
+		sys_log("composite %dx%d x%d: %2d threads, %.3f ms, %.2fx%s\n",
+			LAYER_W,
+			LAYER_H,
+			LAYER_COUNT,
+			threads,
+			(double)lap / 1000000.0,
+			(double)base / (double)lap,
+			is_same ? "" : ", MISMATCH");
+	}
+	job_set_thread_count(max_threads);
+
+	for (i = 0; i < LAYER_COUNT; i++)
+		image_destroy(layer[i]);
+	image_destroy(dst);
+	image_destroy(ref);
+}
+
+/* Measure the rotated and scaled blits, and the mip generation. */
+static void bench_scale(void)
+{
+	static const char *kernel[] = {"scalar", "sse2", "avx2", "neon"};
+	struct image *src, *dst, *mip;
+	uint64_t start, lap[3];
+	float m[6];
+	double mp;
+	int i, j, f;
+
+	if (!check_scale()) {
+		sys_log("scale: self-check FAILED\n");
+		return;
+	}
+
+	if (!image_create(BLIT_SIZE, BLIT_SIZE, &src))
+		return;
+	if (!image_create(BLIT_SIZE * 2, BLIT_SIZE * 2, &dst)) {
+		image_destroy(src);
+		return;
+	}
+	fill_random(src, 5);
+	fill_random(dst, 6);
+
+	/* Rotate by 30 degrees and scale by 1.5 around the center. */
+	m[0] = 1.5f * 0.8660254f;
+	m[1] = -1.5f * 0.5f;
+	m[3] = 1.5f * 0.5f;
+	m[4] = 1.5f * 0.8660254f;
+	m[2] = BLIT_SIZE - (m[0] + m[1]) * BLIT_SIZE / 2;
+	m[5] = BLIT_SIZE - (m[3] + m[4]) * BLIT_SIZE / 2;
+
+	/* Megapixels written per blit. (the area of the rotated image) */
+	mp = (double)BLIT_SIZE * BLIT_SIZE * 1.5 * 1.5 * BLIT_COUNT / 1000000.0;
+	for (i = 0; i < (int)(sizeof(kernel) / sizeof(kernel[0])); i++) {
+		if (!image_set_blend_kernel(kernel[i]))
+			continue;
+		for (f = 0; f < 2; f++) {
+			start = sys_get_nano_tick();
+			for (j = 0; j < BLIT_COUNT; j++)
+				image_draw_transformed(dst, src, 0, 0, BLIT_SIZE, BLIT_SIZE, m, 200, f);
+			lap[f] = sys_get_nano_tick() - start + 1;
+		}
+		start = sys_get_nano_tick();
+		for (j = 0; j < BLIT_COUNT; j++) {
+			if (image_create_mip(dst, &mip))
+				image_destroy(mip);
+		}
+		lap[2] = sys_get_nano_tick() - start + 1;
+		sys_log("transform %s: %.1f MP/s nearest, %.1f MP/s bilinear, mip %dx%d %.3f ms\n",
+			kernel[i],
+			mp / ((double)lap[0] / 1e9),
+			mp / ((double)lap[1] / 1e9),
+			BLIT_SIZE * 2,
+			BLIT_SIZE * 2,
+			(double)lap[2] / 1e6 / BLIT_COUNT);
+	}
+	image_set_blend_kernel(NULL);
+
+	image_destroy(src);
+	image_destroy(dst);
+}
+
+/*
+ * Check that the identity transform gives the unscaled blit, that the
+ * bilinear sampler is the same on all kernels and thread counts, and
+ * that the box filter averages exactly.
+ */
+static bool check_scale(void)
+{
+	static const char *kernel[] = {"sse2", "avx2", "neon"};
+	static const float rotate[6] = {0.8f, -0.6f, 40.0f, 0.6f, 0.8f, -10.0f};
+	struct image *src, *ref, *out, *mip;
+	pixel_t *p;
+	size_t size;
+	int f, k, threads, i;
+	bool ok;
+
+	src = ref = out = NULL;
+	if (!image_create(67, 45, &src) ||
+	    !image_create(67, 45, &ref) ||
+	    !image_create(67, 45, &out)) {
+		free_image(src);
+		free_image(ref);
+		free_image(out);
+		return false;
+	}
+	fill_random(src, 7);
+	size = sizeof(pixel_t) * 67 * 45;
+	ok = true;
+
+	/* The identity with both filters. */
+	for (f = 0; f < 2; f++) {
+		fill_random(ref, 8);
+		image_draw_alpha(ref, 0, 0, src, 67, 45, 0, 0, 200);
+		fill_random(out, 8);
+		image_draw_scaled(out, 0, 0, 67, 45, src, 0, 0, 67, 45, 200, f);
+		if (memcmp(image_get_pixels(ref), image_get_pixels(out), size) != 0)
+			ok = false;
+	}
+
+	/* The rotation on the scalar kernel, the others and 1 thread. */
+	image_set_blend_kernel("scalar");
+	fill_random(ref, 9);
+	image_draw_transformed(ref, src, 3, 2, 60, 40, rotate, 255, IMAGE_FILTER_BILINEAR);
+	for (k = 0; k < (int)(sizeof(kernel) / sizeof(kernel[0])); k++) {
+		if (!image_set_blend_kernel(kernel[k]))
+			continue;
+		fill_random(out, 9);
+		image_draw_transformed(out, src, 3, 2, 60, 40, rotate, 255, IMAGE_FILTER_BILINEAR);
+		if (memcmp(image_get_pixels(ref), image_get_pixels(out), size) != 0)
+			ok = false;
+	}
+	image_set_blend_kernel(NULL);
+	threads = job_get_thread_count();
+	job_set_thread_count(1);
+	fill_random(out, 9);
+	image_draw_transformed(out, src, 3, 2, 60, 40, rotate, 255, IMAGE_FILTER_BILINEAR);
+	if (memcmp(image_get_pixels(ref), image_get_pixels(out), size) != 0)
+		ok = false;
+	job_set_thread_count(threads);
+
+	/* A 2x2 checker averages to the middle gray. */
+	p = image_get_pixels(src);
+	for (i = 0; i < 67 * 45; i++)
+		p[i] = ((i % 67 + i / 67) % 2 == 0) ? 0xffffffff : 0xff000000;
+	if (image_create_mip(src, &mip)) {
+		p = image_get_pixels(mip);
+		if (image_get_width(mip) != 33 || image_get_height(mip) != 22) {
+			ok = false;
+		} else {
+			for (i = 0; i < 33 * 22; i++) {
+				if (abs((int)(p[i] & 0xff) - 128) > 4 || (p[i] >> 24) != 255)
+					ok = false;
+			}
+		}
+		image_destroy(mip);
+	} else {
+		ok = false;
+	}
+
+	image_destroy(src);
+	image_destroy(ref);
+	image_destroy(out);
+
+	return ok;
+}
+
+/*
+ * Measure the decoding of PNG images on the calling thread and on the
+ * decoder pool, and check that the pool gives the same pixels.
+ */
+static void bench_decode(void)
+{
+	struct image_decode *dec[DECODE_COUNT];
+	struct image *ref, *img;
+	uint8_t *png;
+	const uint8_t *raw;
+	uint64_t start, lap, base;
+	size_t size;
+	int threads, i, ok;
+	bool is_same;
+
+	png = make_png(DECODE_SIZE, DECODE_SIZE, 11, &size);
+	if (png == NULL)
+		return;
+
+	/* The first pixel follows the filter byte of the first row. */
+	if (!image_create_with_png(png, size, &ref)) {
+		sys_log("decode: self-check FAILED\n");
+		free(png);
+		return;
+	}
+	raw = png + 8 + 25 + 8 + 2 + 5 + 1;
+	if (image_get_pixels(ref)[0] != make_pixel(raw[3], raw[0], raw[1], raw[2]))
+		sys_log("decode: self-check FAILED\n");
+
+	/* On the calling thread. */
+	start = sys_get_nano_tick();
+	for (i = 0; i < DECODE_COUNT; i++) {
+		if (image_create_with_png(png, size, &img))
+			image_destroy(img);
+	}
+	base = sys_get_nano_tick() - start + 1;
+	sys_log("decode %dx%d PNG x%d: sync, %.3f ms\n",
+		DECODE_SIZE,
+		DECODE_SIZE,
+		DECODE_COUNT,
+		(double)base / 1000000.0);
+
+	/* On the pool. */
+	for (threads = 1; threads <= JOB_THREAD_MAX; threads *= 2) {
+		image_set_decoder_thread_count(threads);
+		start = sys_get_nano_tick();
+		ok = 0;
+		for (i = 0; i < DECODE_COUNT; i++) {
+			if (image_decode_async(png, size, IMAGE_FORMAT_AUTO, &dec[i]))
+				ok++;
+		}
+		is_same = ok == DECODE_COUNT;
+		for (i = 0; i < ok; i++) {
+			if (!image_wait_decode(dec[i], &img)) {
+				is_same = false;
+				continue;
+			}
+			if (memcmp(image_get_pixels(ref),
+				   image_get_pixels(img),
+				   sizeof(pixel_t) * DECODE_SIZE * DECODE_SIZE) != 0)
+				is_same = false;
+			image_destroy(img);
+		}
+		lap = sys_get_nano_tick() - start + 1;
+
+		sys_log("decode %dx%d PNG x%d: %2d threads, %.3f ms, %.2fx%s\n",
+			DECODE_SIZE,
+			DECODE_SIZE,
+			DECODE_COUNT,
+			threads,
+			(double)lap / 1000000.0,
+			(double)base / (double)lap,
+			is_same ? "" : ", MISMATCH");
+
+		if (threads >= job_get_thread_count())
+			break;
+	}
+	image_set_decoder_thread_count(-1);
+
+	image_destroy(ref);
+	free(png);
+}
+
+/*
+ * Make an RGBA PNG file with pseudo-random pixels.  The pixels are in
+ * stored (uncompressed) deflate blocks, so no encoder is needed.
+ */
+static uint8_t *make_png(int width, int height, uint32_t seed, size_t *size)
+{
+	uint8_t *png, *raw, *p, *d;
+	size_t row_size, raw_size, block_count, z_size, pos, len, i;
+	uint32_t a, b;
+
+	row_size = 1 + (size_t)width * 4;
+	raw_size = row_size * (size_t)height;
+	block_count = (raw_size + 65534) / 65535;
+	z_size = 2 + block_count * 5 + raw_size + 4;
+
+	/* The rows with the filter byte 0. */
+	raw = malloc(raw_size);
+	if (raw == NULL)
+		return NULL;
+	for (i = 0; i < raw_size; i++) {
+		seed = seed * 1103515245 + 12345;
+		raw[i] = (i % row_size == 0) ? 0 : (uint8_t)(seed >> 16);
+	}
+
+	*size = 8 + 25 + 12 + z_size + 12;
+	png = malloc(*size);
+	if (png == NULL) {
+		free(raw);
+		return NULL;
+	}
+
+	/* Signature and header. */
+	memcpy(png, "\x89PNG\r\n\x1a\n", 8);
+	p = png + 8;
+	put_u32_be(p + 8, (uint32_t)width);
+	put_u32_be(p + 12, (uint32_t)height);
+	p[16] = 8;	/* Bit depth. */
+	p[17] = 6;	/* RGBA. */
+	p[18] = 0;
+	p[19] = 0;
+	p[20] = 0;
+	put_chunk(p, "IHDR", 13);
+
+	/* The zlib stream of stored blocks. */
+	p += 25;
+	d = p + 8;
+	*d++ = 0x78;
+	*d++ = 0x01;
+	a = 1;
+	b = 0;
+	for (pos = 0; pos < raw_size; pos += len) {
+		len = raw_size - pos < 65535 ? raw_size - pos : 65535;
+		d[0] = pos + len == raw_size ? 1 : 0;
+		d[1] = (uint8_t)len;
+		d[2] = (uint8_t)(len >> 8);
+		d[3] = (uint8_t)~len;
+		d[4] = (uint8_t)(~len >> 8);
+		memcpy(d + 5, raw + pos, len);
+		d += 5 + len;
+		for (i = pos; i < pos + len; i++) {
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+	}
+	put_u32_be(d, (b << 16) | a);
+	put_chunk(p, "IDAT", z_size);
+
+	/* Trailer. */
+	put_chunk(p + 12 + z_size, "IEND", 0);
+
+	free(raw);
+	return png;
+}
+
+/* Put the length, type and CRC around the data of a chunk. */
+static void put_chunk(uint8_t *p, const char *type, size_t len)
+{
+	put_u32_be(p, (uint32_t)len);
+	memcpy(p + 4, type, 4);
+	put_u32_be(p + 8 + len, crc32_png(p + 4, len + 4));
+}
+
+/* Compute the CRC of a chunk. */
+static uint32_t crc32_png(const uint8_t *p, size_t len)
+{
+	static uint32_t table[256];
+	uint32_t c;
+	size_t i;
+	int k;
+
+	if (table[1] == 0) {
+		for (i = 0; i < 256; i++) {
+			c = (uint32_t)i;
+			for (k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	}
+
+	c = 0xffffffff;
+	for (i = 0; i < len; i++)
+		c = table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+	return c ^ 0xffffffff;
+}
+
+/* Store a 32-bit value in big endian. */
+static void put_u32_be(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+/* Blend a whole image. (0: alpha, 1: add, 2: sub) */
+static void draw_blend(int op, struct image *dst, struct image *src, int alpha)
+{
+	int w, h;
+
+	w = image_get_width(src);
+	h = image_get_height(src);
+	switch (op) {
+	case 0:
+		image_draw_alpha(dst, 0, 0, src, w, h, 0, 0, alpha);
+		break;
+	case 1:
+		image_draw_add(dst, 0, 0, src, w, h, 0, 0, alpha);
+		break;
+	case 2:
+		image_draw_sub(dst, 0, 0, src, w, h, 0, 0, alpha);
+		break;
+	}
+}
+
+/* Fill an image with pseudo-random pixels. */
+static void fill_random(struct image *img, uint32_t seed)
+{
+	pixel_t *p;
+	int i, n;
+
+	p = image_get_pixels(img);
+	n = image_get_width(img) * image_get_height(img);
+	for (i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		p[i] = seed ^ (seed >> 16);
+	}
+	image_mark_dirty(img, 0, 0, image_get_width(img), image_get_height(img));
+}
+
+/* Destroy an image if it is created. */
+static void free_image(struct image *img)
+{
+	if (img != NULL)
+		image_destroy(img);
+}
+
+/* Record the sprite batch to a command list for the render thread. */
+static bool bench_cmd_frame(void)
+{
+	struct render_cmd_list *list;
+
+	/* A list is replayed while the next frame is recorded. */
+	list = cmd_list[frame % 2];
+	render_cmd_reset(list);
+
+	batch_set_cmd_list(list);
+	bench_sprite_batch();
+	batch_set_cmd_list(NULL);
+
+	render_submit_cmd_list(list);
+
+	if (++frame < FRAME_COUNT)
+		return true;
+
+	sys_log("sprite batch (command list): %d sprites/frame, %d draws/frame, %.1f sprites/ms (CPU)\n",
+		batch_sprites / FRAME_COUNT,
+		batch_draws / FRAME_COUNT,
+		(double)batch_sprites / ((double)batch_clock * 1000.0 / CLOCKS_PER_SEC));
+
+	return false;
+}
+
+/* Draw sprites that use textures in an interleaved order. */
+static void bench_sprite_batch(void)
+{
+	struct batch_stats stats;
+	clock_t start;
+	float x, y;
+	int i;
+
+	start = clock();
+
+	batch_begin(BATCH_SORT_TEXTURE);
+	for (i = 0; i < SPRITE_COUNT; i++) {
+		x = (float)((i * 37 + frame) % SCREEN_WIDTH);
+		y = (float)((i * 53) % SCREEN_HEIGHT);
+		batch_add_sprite(sprite_texture[i % TEXTURE_COUNT],
+				 x, y, 32.0f, 32.0f,
+				 0.0f, 0.0f, 1.0f, 1.0f,
+				 make_pixel(255, 255, 255, 255));
+	}
+	batch_end();
+
+	batch_clock += clock() - start;
+
+	batch_get_stats(&stats);
+	batch_sprites += stats.sprite_count;
+	batch_draws += stats.draw_count;
+}
+
+/* Stream vertices to a ring buffer. */
+static void bench_stream(void)
+{
+	clock_t start, lap;
+	int i;
+
+	start = clock();
+
+	for (i = 0; i < STREAM_BYTES / STREAM_CHUNK; i++)
+		render_stream_vertex_buffer(stream_buffer, stream_data, STREAM_CHUNK / (int)sizeof(float));
+
+	lap = clock() - start;
+	stream_clock += lap;
+	if (lap > stream_clock_max)
+		stream_clock_max = lap;
+}
+
+/* Update a small rectangle of a large texture in three ways. */
+static void bench_upload(void)
+{
+	clock_t start;
+	int x, y, i;
+
+	x = (frame * UPLOAD_RECT_W) % UPLOAD_SIZE;
+	y = (frame * UPLOAD_RECT_H) % UPLOAD_SIZE;
+
+	for (i = 0; i < 3; i++) {
+		image_clear_rect(upload_image, x, y, UPLOAD_RECT_W, UPLOAD_RECT_H,
+				 make_pixel(255, (uint32_t)frame & 0xff, 0, 0));
+
+		start = clock();
+		switch (i) {
+		case 0:
+			render_upload_texture(upload_texture[0], 0, upload_image);
+			break;
+		case 1:
+			render_update_texture(upload_texture[1], upload_image);
+			break;
+		case 2:
+			render_upload_texture_async(upload_texture[2], upload_image);
+			break;
+		}
+		upload_clock[i] += clock() - start;
+	}
+}
+
+/* Create an instanced particle pipeline. */
+static bool init_particles(void)
+{
+	static const float quad[] = {0, 0, 1, 0, 0, 1, 1, 1};
+	static const short index[] = {0, 1, 2, 3};
+
+	if (!render_begin_pipeline())
+		return false;
+
+	render_begin_vertex_shader_input();
+	render_add_vertex_shader_input(RENDER_VEC2, "a_corner", RENDER_POSITION0);
+	render_add_instance_input(RENDER_VEC4, "i_rect", RENDER_POSITION1);
+	render_add_instance_input(RENDER_VEC4, "i_color", RENDER_COLOR0);
+	render_end_vertex_shader_input();
+
+	render_begin_pixel_shader_input();
+	render_add_pixel_shader_input(RENDER_VEC4, "v_pos", RENDER_SVPOSITION);
+	render_add_pixel_shader_input(RENDER_VEC4, "v_color", RENDER_COLOR0);
+	render_end_pixel_shader_input();
+
+	render_begin_vertex_shader();
+	render_vertex_shader_assign_output("v_pos", "vec4(i_rect.xy + a_corner * i_rect.zw, 0.0, 1.0)");
+	render_vertex_shader_assign_output("v_color", "i_color");
+	render_end_vertex_shader();
+
+	render_begin_pixel_shader();
+	render_pixel_shader_return("v_color");
+	render_end_pixel_shader();
+
+	if (!render_end_pipeline(&particle_pipeline))
+		return false;
+
+	if (!render_create_vertex_buffer(8, &particle_quad))
+		return false;
+	render_upload_vertex_buffer(particle_quad, quad);
+
+	if (!render_create_index_buffer(4, &particle_index))
+		return false;
+	render_bind_pipeline(particle_pipeline);
+	render_upload_index_buffer(particle_index, index);
+
+	if (!render_create_vertex_buffer_with_usage(4 * PARTICLE_COUNT * PARTICLE_FLOATS,
+						    RENDER_BUFFER_STREAM,
+						    &particle_buffer))
+		return false;
+
+	return true;
+}
+
+/* Draw particles by a single instanced draw, and by the sprite batch. */
+static void bench_particles(void)
+{
+	clock_t start;
+	float *p;
+	int i;
+
+	if (particle_pipeline == NULL)
+		return;
+
+	start = clock();
+	for (i = 0; i < PARTICLE_COUNT; i++) {
+		p = &particle_data[i * PARTICLE_FLOATS];
+		p[0] = (float)((i * 37 + frame) % 200) / 100.0f - 1.0f;
+		p[1] = (float)((i * 53) % 200) / 100.0f - 1.0f;
+		p[2] = 0.01f;
+		p[3] = 0.01f;
+		p[4] = 1.0f;
+		p[5] = 0.5f;
+		p[6] = 0.25f;
+		p[7] = 1.0f;
+	}
+	render_bind_pipeline(particle_pipeline);
+	render_stream_vertex_buffer(particle_buffer, particle_data, PARTICLE_COUNT * PARTICLE_FLOATS);
+	render_bind_vertex_buffer(particle_quad);
+	render_bind_instance_buffer(particle_buffer);
+	render_bind_index_buffer(particle_index);
+	render_draw_instanced(0, 4, PARTICLE_COUNT);
+	particle_clock[0] += clock() - start;
+
+	start = clock();
+	batch_begin(BATCH_SORT_NONE);
+	for (i = 0; i < PARTICLE_COUNT; i++) {
+		batch_add_sprite(NULL,
+				 (float)((i * 37 + frame) % SCREEN_WIDTH),
+				 (float)((i * 53) % SCREEN_HEIGHT),
+				 6.0f, 4.0f,
+				 0.0f, 0.0f, 1.0f, 1.0f,
+				 make_pixel(255, 255, 128, 64));
+	}
+	batch_end();
+	particle_clock[1] += clock() - start;
+}
@@ -49,12 +49,47 @@ typedef SSIZE_T ssize_t;
 #define GL_COMPILE_STATUS			0x8B81
 #endif
 
+/*
+ * Define the missing macros for OpenGL 3+ and OpenGL ES 3+ buffers.
+ */
+#ifndef GL_MAP_WRITE_BIT
+#define GL_STREAM_DRAW				0x88E0
+#define GL_DYNAMIC_DRAW				0x88E8
+#define GL_MAP_WRITE_BIT			0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT		0x0004
+#define GL_MAP_INVALIDATE_BUFFER_BIT		0x0008
+#define GL_MAP_UNSYNCHRONIZED_BIT		0x0020
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT		0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH		0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS		0x87FE
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER			0x88EC
+#endif
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED			0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT			0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE		0x8867
+#endif
+
 /*
  * Define the missing typedefs if glext.h is not included.
  */
 #ifndef __gl_glext_h_
 typedef char GLchar;
 typedef ssize_t GLsizeiptr;
+typedef ssize_t GLintptr;
+typedef uint64_t GLuint64;
 #endif
 
 /*
@@ -87,16 +122,32 @@ extern void (APIENTRY *glVertexAttribPointer)(GLuint index, GLint size, GLenum t
 extern void (APIENTRY *glEnableVertexAttribArray)(GLuint index);
 extern GLint (APIENTRY *glGetUniformLocation)(GLuint program, const GLchar *name);
 extern void (APIENTRY *glUniform1i)(GLint location, GLint v0);
-extern void (APIENTRY *glUniform1f)(GLint location, GLfloat *v);
-extern void (APIENTRY *glUniform2fv)(GLint location, GLuint, GLboolean, GLfloat *v);
-extern void (APIENTRY *glUniform3fv)(GLint location, GLuint, GLboolean,  GLfloat *v);
-extern void (APIENTRY *glUniform4fv)(GLint location, GLuint, GLboolean, GLfloat *v);
-extern void (APIENTRY *glUniformMatrix4fv)(GLint location, GLuint, GLboolean, GLfloat *v);
+extern void (APIENTRY *glUniform1fv)(GLint location, GLsizei count, const GLfloat *value);
+extern void (APIENTRY *glUniform2fv)(GLint location, GLsizei count, const GLfloat *value);
+extern void (APIENTRY *glUniform3fv)(GLint location, GLsizei count, const GLfloat *value);
+extern void (APIENTRY *glUniform4fv)(GLint location, GLsizei count, const GLfloat *value);
+extern void (APIENTRY *glUniformMatrix2fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+extern void (APIENTRY *glUniformMatrix3fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+extern void (APIENTRY *glUniformMatrix4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
 extern void (APIENTRY *glBufferData)(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
 extern void (APIENTRY *glDeleteShader)(GLuint shader);
 extern void (APIENTRY *glDeleteProgram)(GLuint program);
 extern void (APIENTRY *glDeleteVertexArrays)(GLsizei n, const GLuint *arrays);
 extern void (APIENTRY *glDeleteBuffers)(GLsizei n, const GLuint *buffers);
+extern void (APIENTRY *glBufferSubData)(GLenum target, GLintptr offset, GLsizeiptr size, const void *data);
+extern void *(APIENTRY *glMapBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+extern GLboolean (APIENTRY *glUnmapBuffer)(GLenum target);
+extern void (APIENTRY *glGetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+extern void (APIENTRY *glProgramBinary)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+extern void (APIENTRY *glProgramParameteri)(GLuint program, GLenum pname, GLint value);
+extern void (APIENTRY *glDrawElementsInstanced)(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount);
+extern void (APIENTRY *glVertexAttribDivisor)(GLuint index, GLuint divisor);
+extern void (APIENTRY *glGenQueries)(GLsizei n, GLuint *ids);
+extern void (APIENTRY *glDeleteQueries)(GLsizei n, const GLuint *ids);
+extern void (APIENTRY *glBeginQuery)(GLenum target, GLuint id);
+extern void (APIENTRY *glEndQuery)(GLenum target);
+extern void (APIENTRY *glGetQueryObjectiv)(GLuint id, GLenum pname, GLint *params);
+extern void (APIENTRY *glGetQueryObjectui64v)(GLuint id, GLenum pname, GLuint64 *params);
 #ifdef TARGET_WIN32
 /* Note: only Windows lacks glActiveTexture(), libOpenGL.so exports one that actually works. */
 extern void (APIENTRY *glActiveTexture)(GLenum texture);
@@ -11,6 +11,7 @@
 
 #include "gamekit/gamekit.h"
 #include "glrender.h"
+#include "stdrendercmd.h"
 
 /* Linux (OpenGL 3.2) */
 #if defined(TARGET_LINUX)
@@ -53,6 +54,18 @@ static int conf_game_height;
 #define VARIABLE_MAX	32
 #define TEXT_MAX	32768
 
+/* Uniform types. */
+enum uniform_type {
+	UNIFORM_FLOAT,
+	UNIFORM_VEC2,
+	UNIFORM_VEC3,
+	UNIFORM_VEC4,
+	UNIFORM_MAT2,
+	UNIFORM_MAT3,
+	UNIFORM_MAT4,
+	UNIFORM_SAMPLER,
+};
+
 struct render_pipeline {
 	bool is_used;
 
@@ -61,6 +74,14 @@ struct render_pipeline {
 	GLuint fragment_shader;
 	GLuint vao;
 
+	/* The vertex buffer range that the VAO's attribute pointers refer to. */
+	GLuint vao_buf;
+	size_t vao_base;
+
+	/* The instance buffer range that the VAO's attribute pointers refer to. */
+	GLuint vao_inst_buf;
+	size_t vao_inst_base;
+
 	char vertex_shader_src[TEXT_MAX];
 	char fragment_shader_src[TEXT_MAX];
 
@@ -69,6 +90,8 @@ struct render_pipeline {
 		char name[NAME_MAX];
 		char note[NAME_MAX];
 		bool is_sampler;
+		int utype;
+		GLint location;
 	} uniform[VARIABLE_MAX];
 	int uniform_count;
 
@@ -77,9 +100,13 @@ struct render_pipeline {
 		char name[NAME_MAX];
 		char note[NAME_MAX];
 		int size;
+		int offset;
+		bool is_instance;
+		GLint location;
 	} attribute[VARIABLE_MAX];
 	int attribute_count;
 	int attribute_size;
+	int instance_attribute_size;
 
 	struct varying {
 		char type[NAME_MAX];
@@ -111,6 +138,12 @@ struct render_vertex_buffer {
 	bool is_used;
 	GLuint buf;
 	size_t size;
+	int usage;
+	bool is_allocated;
+
+	/* Streaming: the ring cursor and the last streamed range. (bytes) */
+	size_t ring_pos;
+	size_t base;
 };
 
 #define VERTEX_BUFFER_MAX	1024
@@ -125,12 +158,24 @@ struct render_index_buffer {
 	bool is_used;
 	GLuint buf;
 	size_t size;
+	int usage;
+	bool is_allocated;
+
+	/* Streaming: the ring cursor and the last streamed range. (bytes) */
+	size_t ring_pos;
+	size_t base;
 };
 
 #define INDEX_BUFFER_MAX	1024
 
 static struct render_index_buffer render_index_buffer[INDEX_BUFFER_MAX];
 
+/* A binded index buffer. */
+static struct render_index_buffer *render_binded_index_buffer;
+
+/* Alignment of a streamed range. */
+#define STREAM_ALIGN		(64)
+
 /*
  * Constant Buffer
  */
@@ -154,6 +199,16 @@ struct render_texture {
 	GLuint tex;
 	GLuint width;
 	GLuint height;
+
+	/* Is the level 0 storage specified? */
+	bool is_specified;
+
+	/* Was the last uploaded image premultiplied? */
+	bool is_premultiplied;
+
+	/* Size of the storage in the uploads recorded to lists. (0 if none) */
+	int recorded_width;
+	int recorded_height;
 };
 
 #define TEXTURE_MAX	1024
@@ -161,6 +216,84 @@ struct render_texture {
 static int render_texture_count;
 static struct render_texture render_texture[TEXTURE_MAX];
 
+/* Pixel buffer objects for asynchronous uploads. */
+#define PBO_COUNT	4
+
+/* GPU timer queries. (results are read a few frames later) */
+#define GPU_TIMER_COUNT	4
+
+static GLuint texture_pbo[PBO_COUNT];
+static int texture_pbo_cursor;
+
+/*
+ * Shadow State
+ */
+
+/* Texture units tracked by the shadow state. */
+#define TEXTURE_UNIT_MAX	8
+
+/* Maximum draw items in the submission queue. */
+#define QUEUE_MAX		4096
+
+/* A name not known to be bound. */
+#define STATE_UNKNOWN		((GLuint)-1)
+
+/*
+ * The GL bindings we made, to skip redundant GL calls.  Note that the
+ * element array buffer binding is a part of the VAO state.
+ */
+static struct render_state {
+	GLuint program;
+	GLuint vao;
+	GLuint array_buffer;
+	GLuint element_buffer;
+	GLuint active_texture;
+	GLuint texture[TEXTURE_UNIT_MAX];
+	int blend;
+	GLenum blend_src;
+	GLenum blend_dst;
+	bool is_clear_color_set;
+	GLfloat clear_color[4];
+} state;
+
+/* Statistics of the current and the last frame. */
+static struct render_stats frame_stats;
+static struct render_stats last_stats;
+
+/* GPU timer queries in flight. */
+static GLuint gpu_timer[GPU_TIMER_COUNT];
+static bool is_gpu_timer_pending[GPU_TIMER_COUNT];
+static int gpu_timer_index;
+static bool is_gpu_timer_running;
+
+/* GPU time of the latest frame measured. (negative if none) */
+static float gpu_time = -1.0f;
+
+/* Deferred submission queue. */
+static struct queue_item {
+	struct render_draw_item item;
+	int seq;
+} queue[QUEUE_MAX];
+static struct queue_item *queue_sorted[QUEUE_MAX];
+static int queue_count;
+static bool is_queue_enabled;
+
+/*
+ * Program Binary Cache
+ */
+
+/* Magic number of a cache file. ("GKPB") */
+#define PROGRAM_CACHE_MAGIC	0x42504b47
+
+/* Maximum size of a program binary. */
+#define PROGRAM_CACHE_SIZE_MAX	(16 * 1024 * 1024)
+
+/* Cache directory. (empty if disabled) */
+static char program_cache_dir[1024];
+
+/* Is the program binary supported by the driver? (-1 for unknown) */
+static int program_cache_state = -1;
+
 /*
  * Re-initialization
  */
@@ -178,9 +311,36 @@ static int reinit_count;
 static bool render_compile_vertex_shader(void);
 static bool render_compile_fragment_shader(void);
 static bool render_create_program(void);
-static void render_setup_attributes(struct render_pipeline *p);
+static void render_reset_state(void);
+static void render_begin_gpu_timer(void);
+static void render_end_gpu_timer(void);
+static void render_read_gpu_timers(void);
+static void render_use_program(GLuint program);
+static void render_bind_vao(GLuint vao);
+static void render_bind_gl_buffer(GLenum target, GLuint buf);
+static void render_bind_gl_texture(int unit, GLuint tex);
+static void render_set_blend(GLenum src, GLenum dst);
+static void render_disable_blend(void);
+static void render_forget_buffer(GLuint buf);
+static void render_forget_texture(GLuint tex);
+static int render_compare_queue_item(const void *a, const void *b);
+static void render_submit_item(struct render_draw_item *item);
+static bool render_get_program_cache_path(struct render_pipeline *p, char *path, size_t size);
+static bool render_load_program_cache(struct render_pipeline *p, const char *path);
+static void render_save_program_cache(struct render_pipeline *p, const char *path);
+static uint64_t render_hash_string(uint64_t hash, const char *s);
+static void render_setup_locations(struct render_pipeline *p);
+static bool render_add_attribute(const char *type, const char *name, const char *note, bool is_instance);
+static void render_setup_attributes(struct render_pipeline *p, size_t base);
+static void render_setup_instance_attributes(struct render_pipeline *p, size_t base);
+static GLenum render_get_usage_hint(int usage);
+static void render_write_buffer(GLenum target, int usage, bool *is_allocated, size_t capacity, size_t offset, size_t size, const void *src);
+static bool render_stream_buffer(GLenum target, bool *is_allocated, size_t capacity, size_t *ring_pos, size_t *base, size_t size, const void *src);
 static void render_setup_samplers(struct render_pipeline *p);
 static const char *render_translate_type(const char *type);
+static int render_get_uniform_type(const char *type);
+static void render_specify_texture(struct render_texture *tex, int miplevel, int width, int height, const pixel_t *pixels);
+static void render_upload_texture_pbo(struct render_texture *tex, struct image *img, int x, int y, int w, int h);
 
 /*
  * Initialize the glrender module.
@@ -196,9 +356,24 @@ bool glrender_init(int x, int y, int w, int h)
 	is_after_reinit = true;
 	reinit_count++;
 
+	/* The driver may be changed. */
+	program_cache_state = -1;
+
 	return true;
 }
 
+/*
+ * Set the program binary cache directory. (NULL to disable)
+ */
+void glrender_set_program_cache_dir(const char *dir)
+{
+	if (dir == NULL) {
+		program_cache_dir[0] = '\0';
+		return;
+	}
+	STRNCPY(program_cache_dir, dir);
+}
+
 /*
  * Cleanup the glreder module.
  */
@@ -227,11 +402,35 @@ void glrender_cleanup(void)
 		memset(&render_index_buffer[i], 0, sizeof(struct render_index_buffer));
 	}
 
+	render_binded_pipeline = NULL;
+	render_binded_index_buffer = NULL;
+
+	/* Delete pixel buffers. */
+	for (i = 0; i < PBO_COUNT; i++) {
+		if (texture_pbo[i] != 0) {
+			glDeleteBuffers(1, &texture_pbo[i]);
+			texture_pbo[i] = 0;
+		}
+	}
+
 	/* Delete constant buffers. */
 	for (i = 0; i < CONSTANT_BUFFER_MAX; i++) {
 		glDeleteBuffers(1, &render_constant_buffer[i].buf);
 		memset(&render_constant_buffer[i], 0, sizeof(struct render_constant_buffer));
 	}
+
+	/* Delete GPU timers. */
+	if (gpu_timer[0] != 0) {
+		glDeleteQueries(GPU_TIMER_COUNT, gpu_timer);
+		memset(gpu_timer, 0, sizeof(gpu_timer));
+		memset(is_gpu_timer_pending, 0, sizeof(is_gpu_timer_pending));
+	}
+	is_gpu_timer_running = false;
+	gpu_time = -1.0f;
+
+	/* Forget the bindings. */
+	render_reset_state();
+	queue_count = 0;
 }
 
 /*
@@ -274,41 +473,87 @@ bool render_begin_pipeline(void)
 bool render_end_pipeline(struct render_pipeline **pipeline)
 {
 	struct render_pipeline *p;
+	char path[1024 + 32];
+	bool is_cached;
 
 	p = &render_pipeline[render_pipeline_cursor];
 
-	/* Compile a vertex shader. */
-	if (!render_compile_vertex_shader())
-		return false;
+	/* Load a cached program binary if exists. */
+	is_cached = render_get_program_cache_path(p, path, sizeof(path));
+	if (!is_cached || !render_load_program_cache(p, path)) {
+		/* Compile a vertex shader. */
+		if (!render_compile_vertex_shader())
+			return false;
 
-	/* Compile a fragment shader. */
-	if (!render_compile_fragment_shader())
-		return false;
+		/* Compile a fragment shader. */
+		if (!render_compile_fragment_shader())
+			return false;
 
-	/* Create a program. */
-	if (!render_create_program())
-		return false;
+		/* Create a program. */
+		if (!render_create_program())
+			return false;
+
+		/* Store the program binary. */
+		if (is_cached)
+			render_save_program_cache(p, path);
+	}
+
+	render_use_program(p->program);
+
+	glGenVertexArrays(1, &p->vao);
+	render_bind_vao(p->vao);
+
+	/* Resolve attribute and uniform locations. */
+	render_setup_locations(p);
 
 	/* Setup sampler locations. */
 	render_setup_samplers(p);
 
+	p->is_used = true;
 	*pipeline = p;
 
 	return true;
 }
 
+static void render_setup_locations(struct render_pipeline *p)
+{
+	int attr_ofs;
+	int i;
+
+	/* Resolve attribute locations and offsets. (per-vertex) */
+	attr_ofs = 0;
+	for (i = 0; i < p->attribute_count; i++) {
+		if (p->attribute[i].is_instance)
+			continue;
+		p->attribute[i].location = glGetAttribLocation(p->program, p->attribute[i].name);
+		p->attribute[i].offset = attr_ofs;
+		attr_ofs += p->attribute[i].size;
+	}
+
+	/* Resolve attribute locations and offsets. (per-instance) */
+	attr_ofs = 0;
+	for (i = 0; i < p->attribute_count; i++) {
+		if (!p->attribute[i].is_instance)
+			continue;
+		p->attribute[i].location = glGetAttribLocation(p->program, p->attribute[i].name);
+		p->attribute[i].offset = attr_ofs;
+		attr_ofs += p->attribute[i].size;
+	}
+
+	/* Resolve uniform locations. */
+	for (i = 0; i < p->uniform_count; i++)
+		p->uniform[i].location = glGetUniformLocation(p->program, p->uniform[i].name);
+}
+
 static void render_setup_samplers(struct render_pipeline *p)
 {
 	int sampler_count;
-	int sampler_loc;
 	int i;
 
 	sampler_count = 0;
 	for (i = 0; i < p->uniform_count; i++) {
 		if (p->uniform[i].is_sampler) {
-			sampler_loc = glGetUniformLocation(p->program, p->uniform[i].name);
-			glUniform1i(sampler_loc, sampler_count);
-			printf("sampler %d:%s:%d\n", sampler_loc, p->uniform[i].name, sampler_count);
+			glUniform1i(p->uniform[i].location, sampler_count);
 			sampler_count++;
 		}
 	}
@@ -384,6 +629,8 @@ static bool render_create_program(void)
 	p->program = glCreateProgram();
 	glAttachShader(p->program, p->vertex_shader);
 	glAttachShader(p->program, p->fragment_shader);
+	if (program_cache_state == 1)
+		glProgramParameteri(p->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(p->program);
 
 	glGetProgramiv(p->program, GL_LINK_STATUS, &is_succeeded);
@@ -393,14 +640,160 @@ static bool render_create_program(void)
 		sys_error("%s", buf);
 		return false;
 	}
-	glUseProgram(p->program);
 
-	glGenVertexArrays(1, &p->vao);
-	glBindVertexArray(p->vao);
+	return true;
+}
+
+/*
+ * Get the cache file path of a program.
+ *  - The key is a hash of the shader sources and the driver strings,
+ *    so that a driver update invalidates the cache.
+ */
+static bool render_get_program_cache_path(struct render_pipeline *p, char *path, size_t size)
+{
+	GLint format_count;
+	uint64_t hash;
+
+	if (program_cache_dir[0] == '\0')
+		return false;
+
+	/* Check the driver support once. */
+	if (program_cache_state == -1) {
+		format_count = 0;
+		if (glGetProgramBinary != NULL && glProgramBinary != NULL && glProgramParameteri != NULL)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+		program_cache_state = format_count > 0 ? 1 : 0;
+	}
+	if (program_cache_state == 0)
+		return false;
+
+	/* FNV-1a */
+	hash = 0xcbf29ce484222325ULL;
+	hash = render_hash_string(hash, p->vertex_shader_src);
+	hash = render_hash_string(hash, p->fragment_shader_src);
+	hash = render_hash_string(hash, (const char *)glGetString(GL_VENDOR));
+	hash = render_hash_string(hash, (const char *)glGetString(GL_RENDERER));
+	hash = render_hash_string(hash, (const char *)glGetString(GL_VERSION));
+
+	snprintf(path, size, "%s/%08x%08x.bin",
+		 program_cache_dir,
+		 (unsigned int)(hash >> 32),
+		 (unsigned int)(hash & 0xffffffff));
+
+	return true;
+}
+
+/* Hash a string including the terminator. */
+static uint64_t render_hash_string(uint64_t hash, const char *s)
+{
+	if (s == NULL)
+		s = "";
+
+	do {
+		hash ^= (uint8_t)*s;
+		hash *= 0x100000001b3ULL;
+	} while (*s++ != '\0');
+
+	return hash;
+}
+
+/* Create a program from a cache file. */
+static bool render_load_program_cache(struct render_pipeline *p, const char *path)
+{
+	FILE *fp;
+	uint32_t header[3];
+	void *binary;
+	GLint is_succeeded;
+
+	/* Read the header: magic, format and size. */
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+		return false;
+	if (fread(header, sizeof(header), 1, fp) != 1 ||
+	    header[0] != PROGRAM_CACHE_MAGIC ||
+	    header[2] == 0 ||
+	    header[2] > PROGRAM_CACHE_SIZE_MAX) {
+		fclose(fp);
+		return false;
+	}
+
+	/* Read the binary. */
+	binary = malloc(header[2]);
+	if (binary == NULL) {
+		fclose(fp);
+		return false;
+	}
+	if (fread(binary, header[2], 1, fp) != 1) {
+		free(binary);
+		fclose(fp);
+		return false;
+	}
+	fclose(fp);
+
+	/* The driver may reject a binary, then we compile the sources. */
+	p->program = glCreateProgram();
+	glProgramBinary(p->program, (GLenum)header[1], binary, (GLsizei)header[2]);
+	free(binary);
+	glGetProgramiv(p->program, GL_LINK_STATUS, &is_succeeded);
+	if (!is_succeeded) {
+		glDeleteProgram(p->program);
+		p->program = 0;
+		return false;
+	}
 
 	return true;
 }
 
+/* Write a program binary to a cache file. */
+static void render_save_program_cache(struct render_pipeline *p, const char *path)
+{
+	char tmp_path[1024 + 48];
+	FILE *fp;
+	uint32_t header[3];
+	void *binary;
+	GLint size;
+	GLsizei len;
+	GLenum format;
+
+	glGetProgramiv(p->program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0 || size > PROGRAM_CACHE_SIZE_MAX)
+		return;
+
+	binary = malloc((size_t)size);
+	if (binary == NULL)
+		return;
+	len = 0;
+	glGetProgramBinary(p->program, size, &len, &format, binary);
+	if (len <= 0) {
+		free(binary);
+		return;
+	}
+
+	header[0] = PROGRAM_CACHE_MAGIC;
+	header[1] = (uint32_t)format;
+	header[2] = (uint32_t)len;
+
+	/* Write to a temporary file and rename it, so that a reader never sees a partial file. */
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	fp = fopen(tmp_path, "wb");
+	if (fp == NULL) {
+		free(binary);
+		return;
+	}
+	if (fwrite(header, sizeof(header), 1, fp) != 1 ||
+	    fwrite(binary, (size_t)len, 1, fp) != 1) {
+		fclose(fp);
+		remove(tmp_path);
+		free(binary);
+		return;
+	}
+	fclose(fp);
+	free(binary);
+
+	if (rename(tmp_path, path) != 0)
+		remove(tmp_path);
+}
+
 bool render_begin_constant(void)
 {
 	return true;
@@ -431,6 +824,11 @@ bool render_add_constant(const char *type, const char *name, const char *note)
 	STRNCPY(p->uniform[index].name, name);
 	STRNCPY(p->uniform[index].note, note);
 	p->uniform[index].is_sampler = false;
+	p->uniform[index].utype = render_get_uniform_type(ttype);
+	if (p->uniform[index].utype == -1) {
+		sys_error("Unsupported constant type \"%s\".", type);
+		return false;
+	}
 
 	/* Add a definition to the vertex shader source. */
 	STRNCAT(p->vertex_shader_src, "uniform ");
@@ -479,6 +877,7 @@ bool render_add_sampler(const char *name, const char *note)
 	STRNCPY(p->uniform[index].name, name);
 	STRNCPY(p->uniform[index].note, note);
 	p->uniform[index].is_sampler = true;
+	p->uniform[index].utype = UNIFORM_SAMPLER;
 
 	/* Add a definition to the fragment shader source. */
 	STRNCAT(p->fragment_shader_src, "uniform ");
@@ -501,6 +900,25 @@ bool render_begin_vertex_shader_input(void)
 }
 
 bool render_add_vertex_shader_input(const char *type, const char *name, const char *note)
+{
+	return render_add_attribute(type, name, note, false);
+}
+
+bool render_add_instance_input(const char *type, const char *name, const char *note)
+{
+	const char *ttype;
+
+	/* A matrix takes multiple attribute slots, so use vectors instead. */
+	ttype = render_translate_type(type);
+	if (ttype == NULL || strncmp(ttype, "mat", 3) == 0) {
+		sys_error("Unsupported instance input type \"%s\".", type);
+		return false;
+	}
+
+	return render_add_attribute(type, name, note, true);
+}
+
+static bool render_add_attribute(const char *type, const char *name, const char *note, bool is_instance)
 {
 	struct render_pipeline *p;
 	const char *ttype;
@@ -539,7 +957,11 @@ bool render_add_vertex_shader_input(const char *type, const char *name, const ch
 		p->attribute[index].size = 16;
 	else
 		assert(NEVER_COME_HERE);
-	p->attribute_size += p->attribute[index].size;
+	p->attribute[index].is_instance = is_instance;
+	if (is_instance)
+		p->instance_attribute_size += p->attribute[index].size;
+	else
+		p->attribute_size += p->attribute[index].size;
 
 	/* Copy a type and a name. */
 	STRNCPY(p->attribute[index].type, ttype);
@@ -956,6 +1378,51 @@ const char *render_translate_type(const char *type)
 	return type;
 }
 
+static int render_get_uniform_type(const char *type)
+{
+	if (strcmp(type, "float") == 0)
+		return UNIFORM_FLOAT;
+	else if (strcmp(type, "vec2") == 0)
+		return UNIFORM_VEC2;
+	else if (strcmp(type, "vec3") == 0)
+		return UNIFORM_VEC3;
+	else if (strcmp(type, "vec4") == 0)
+		return UNIFORM_VEC4;
+	else if (strcmp(type, "mat2") == 0)
+		return UNIFORM_MAT2;
+	else if (strcmp(type, "mat3") == 0)
+		return UNIFORM_MAT3;
+	else if (strcmp(type, "mat4") == 0)
+		return UNIFORM_MAT4;
+
+	return -1;
+}
+
+/*
+ * Destroy a pipeline.
+ */
+void render_destroy_pipeline(struct render_pipeline *pipeline)
+{
+	assert(pipeline != NULL);
+
+	if (render_binded_pipeline == pipeline)
+		render_binded_pipeline = NULL;
+
+	/* A program in use stays alive until unbound, so forget it. */
+	if (state.program == pipeline->program)
+		state.program = STATE_UNKNOWN;
+	if (state.vao == pipeline->vao) {
+		state.vao = 0;
+		state.element_buffer = STATE_UNKNOWN;
+	}
+
+	glDeleteProgram(pipeline->program);
+	glDeleteShader(pipeline->vertex_shader);
+	glDeleteShader(pipeline->fragment_shader);
+	glDeleteVertexArrays(1, &pipeline->vao);
+	memset(pipeline, 0, sizeof(struct render_pipeline));
+}
+
 /*
  * Bind a program.
  */
@@ -963,17 +1430,26 @@ void render_bind_pipeline(struct render_pipeline *pipeline)
 {
 	render_binded_pipeline = pipeline;
 
-	glUseProgram(pipeline->program);
-	glBindVertexArray(pipeline->vao);
+	render_use_program(pipeline->program);
+	render_bind_vao(pipeline->vao);
 }
 
 /*
  * Create a vertex buffer.
  */
 bool render_create_vertex_buffer(int size, struct render_vertex_buffer **buf)
+{
+	return render_create_vertex_buffer_with_usage(size, RENDER_BUFFER_STATIC, buf);
+}
+
+/*
+ * Create a vertex buffer with a usage.
+ */
+bool render_create_vertex_buffer_with_usage(int size, int usage, struct render_vertex_buffer **buf)
 {
 	int index, i;
 
+	assert(size > 0);
 	assert(buf != NULL);
 
 	/* Allocate a struct. */
@@ -990,8 +1466,10 @@ bool render_create_vertex_buffer(int size, struct render_vertex_buffer **buf)
 	}
 
 	*buf = &render_vertex_buffer[index];
+	memset(*buf, 0, sizeof(struct render_vertex_buffer));
 	(*buf)->is_used = true;
-	(*buf)->size = size;
+	(*buf)->size = (size_t)size;
+	(*buf)->usage = usage;
 
 	/* Create a VBO. */
 	glGenBuffers(1, &(*buf)->buf);
@@ -1004,31 +1482,85 @@ bool render_create_vertex_buffer(int size, struct render_vertex_buffer **buf)
  */
 void render_bind_vertex_buffer(struct render_vertex_buffer *buf)
 {
-	assert(buf != NULL);
+	struct render_pipeline *p;
 
-	glBindBuffer(GL_ARRAY_BUFFER, buf->buf);
+	assert(buf != NULL);
 
-	if (render_binded_pipeline != NULL)
-		render_setup_attributes(render_binded_pipeline);
+	render_bind_gl_buffer(GL_ARRAY_BUFFER, buf->buf);
+
+	/*
+	 * The attribute pointers are recorded in the pipeline's VAO,
+	 * so we set them only when the VAO refers to another range.
+	 */
+	p = render_binded_pipeline;
+	if (p != NULL && (p->vao_buf != buf->buf || p->vao_base != buf->base)) {
+		render_setup_attributes(p, buf->base);
+		p->vao_buf = buf->buf;
+		p->vao_base = buf->base;
+	}
 }
 
-static void render_setup_attributes(struct render_pipeline *p)
+static void render_setup_attributes(struct render_pipeline *p, size_t base)
 {
-	int attr_ofs;
-	int attr_loc;
+	GLint loc;
 	int i;
 
-	attr_ofs = 0;
 	for (i = 0; i < p->attribute_count; i++) {
-		attr_loc = glGetAttribLocation(p->program, p->attribute[i].name);
-		glVertexAttribPointer((GLuint)attr_loc,
+		if (p->attribute[i].is_instance)
+			continue;
+		loc = p->attribute[i].location;
+		if (loc < 0)
+			continue;	/* Optimized out by the compiler. */
+		glVertexAttribPointer((GLuint)loc,
 				      p->attribute[i].size,
 				      GL_FLOAT,
 				      GL_FALSE,
 				      p->attribute_size * sizeof(GLfloat),
-				      (const GLvoid *)(attr_ofs * sizeof(GLfloat)));
-		glEnableVertexAttribArray((GLuint)attr_loc);
-		attr_ofs += p->attribute[i].size;
+				      (const GLvoid *)(base + p->attribute[i].offset * sizeof(GLfloat)));
+		glEnableVertexAttribArray((GLuint)loc);
+	}
+}
+
+/*
+ * Bind a vertex buffer as an instance buffer.
+ */
+void render_bind_instance_buffer(struct render_vertex_buffer *buf)
+{
+	struct render_pipeline *p;
+
+	assert(buf != NULL);
+	assert(render_binded_pipeline != NULL);
+
+	render_bind_gl_buffer(GL_ARRAY_BUFFER, buf->buf);
+
+	/* Same as render_bind_vertex_buffer(). */
+	p = render_binded_pipeline;
+	if (p->vao_inst_buf != buf->buf || p->vao_inst_base != buf->base) {
+		render_setup_instance_attributes(p, buf->base);
+		p->vao_inst_buf = buf->buf;
+		p->vao_inst_base = buf->base;
+	}
+}
+
+static void render_setup_instance_attributes(struct render_pipeline *p, size_t base)
+{
+	GLint loc;
+	int i;
+
+	for (i = 0; i < p->attribute_count; i++) {
+		if (!p->attribute[i].is_instance)
+			continue;
+		loc = p->attribute[i].location;
+		if (loc < 0)
+			continue;	/* Optimized out by the compiler. */
+		glVertexAttribPointer((GLuint)loc,
+				      p->attribute[i].size,
+				      GL_FLOAT,
+				      GL_FALSE,
+				      p->instance_attribute_size * sizeof(GLfloat),
+				      (const GLvoid *)(base + p->attribute[i].offset * sizeof(GLfloat)));
+		glEnableVertexAttribArray((GLuint)loc);
+		glVertexAttribDivisor((GLuint)loc, 1);
 	}
 }
 
@@ -1038,8 +1570,69 @@ static void render_setup_attributes(struct render_pipeline *p)
 void render_upload_vertex_buffer(struct render_vertex_buffer *buf, const float *src)
 {
 	assert(buf != NULL);
+	assert(buf->usage != RENDER_BUFFER_STREAM);
+
+	/* Draw the queued items with the old contents. */
+	if (queue_count > 0)
+		render_flush_queue();
+
+	render_bind_gl_buffer(GL_ARRAY_BUFFER, buf->buf);
+	render_write_buffer(GL_ARRAY_BUFFER,
+			    buf->usage,
+			    &buf->is_allocated,
+			    sizeof(GLfloat) * buf->size,
+			    0,
+			    sizeof(GLfloat) * buf->size,
+			    src);
+}
+
+/*
+ * Update a range of a vertex buffer.
+ */
+void render_update_vertex_buffer(struct render_vertex_buffer *buf, int offset, int count, const float *src)
+{
+	assert(buf != NULL);
+	assert(buf->usage != RENDER_BUFFER_STREAM);
+	assert(offset >= 0 && count >= 0);
+	assert((size_t)offset + (size_t)count <= buf->size);
+
+	if (count == 0)
+		return;
+
+	if (queue_count > 0)
+		render_flush_queue();
+
+	render_bind_gl_buffer(GL_ARRAY_BUFFER, buf->buf);
+	render_write_buffer(GL_ARRAY_BUFFER,
+			    buf->usage,
+			    &buf->is_allocated,
+			    sizeof(GLfloat) * buf->size,
+			    sizeof(GLfloat) * (size_t)offset,
+			    sizeof(GLfloat) * (size_t)count,
+			    src);
+}
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * buf->size, src, GL_STATIC_DRAW);
+/*
+ * Stream data to a vertex buffer.
+ */
+bool render_stream_vertex_buffer(struct render_vertex_buffer *buf, const float *src, int count)
+{
+	assert(buf != NULL);
+	assert(buf->usage == RENDER_BUFFER_STREAM);
+	assert(count > 0);
+
+	/* Draw the queued items before the base moves. */
+	if (queue_count > 0)
+		render_flush_queue();
+
+	render_bind_gl_buffer(GL_ARRAY_BUFFER, buf->buf);
+	return render_stream_buffer(GL_ARRAY_BUFFER,
+				    &buf->is_allocated,
+				    sizeof(GLfloat) * buf->size,
+				    &buf->ring_pos,
+				    &buf->base,
+				    sizeof(GLfloat) * (size_t)count,
+				    src);
 }
 
 /*
@@ -1047,8 +1640,19 @@ void render_upload_vertex_buffer(struct render_vertex_buffer *buf, const float *
  */
 void render_destroy_vertex_buffer(struct render_vertex_buffer *buf)
 {
+	int i;
+
 	assert(buf != NULL);
 
+	/* The name may be reused by a new buffer, so forget it in VAOs. */
+	for (i = 0; i < PIPELINE_MAX; i++) {
+		if (render_pipeline[i].vao_buf == buf->buf)
+			render_pipeline[i].vao_buf = 0;
+		if (render_pipeline[i].vao_inst_buf == buf->buf)
+			render_pipeline[i].vao_inst_buf = 0;
+	}
+
+	render_forget_buffer(buf->buf);
 	glDeleteBuffers(1, (const GLuint *)&buf->buf);
 
 	buf->is_used = false;
@@ -1059,9 +1663,18 @@ void render_destroy_vertex_buffer(struct render_vertex_buffer *buf)
  * Create an index buffer.
  */
 bool render_create_index_buffer(int size, struct render_index_buffer **buf)
+{
+	return render_create_index_buffer_with_usage(size, RENDER_BUFFER_STATIC, buf);
+}
+
+/*
+ * Create an index buffer with a usage.
+ */
+bool render_create_index_buffer_with_usage(int size, int usage, struct render_index_buffer **buf)
 {
 	int index, i;
 
+	assert(size > 0);
 	assert(buf != NULL);
 
 	/* Allocate a struct. */
@@ -1078,8 +1691,10 @@ bool render_create_index_buffer(int size, struct render_index_buffer **buf)
 	}
 
 	*buf = &render_index_buffer[index];
+	memset(*buf, 0, sizeof(struct render_index_buffer));
 	(*buf)->is_used = true;
-	(*buf)->size = size;
+	(*buf)->size = (size_t)size;
+	(*buf)->usage = usage;
 
 	/* Create an IBO. */
 	glGenBuffers(1, &(*buf)->buf);
@@ -1094,17 +1709,78 @@ void render_bind_index_buffer(struct render_index_buffer *buf)
 {
 	assert(buf != NULL);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buf->buf);
+	render_bind_gl_buffer(GL_ELEMENT_ARRAY_BUFFER, buf->buf);
+
+	render_binded_index_buffer = buf;
 }
 
 /*
- * Upload data to a vertex buffer.
+ * Upload data to an index buffer.
  */
 void render_upload_index_buffer(struct render_index_buffer *buf, const short *src)
 {
 	assert(buf != NULL);
+	assert(buf->usage != RENDER_BUFFER_STREAM);
+
+	if (queue_count > 0)
+		render_flush_queue();
+
+	render_bind_index_buffer(buf);
+	render_write_buffer(GL_ELEMENT_ARRAY_BUFFER,
+			    buf->usage,
+			    &buf->is_allocated,
+			    sizeof(GLushort) * buf->size,
+			    0,
+			    sizeof(GLushort) * buf->size,
+			    src);
+}
+
+/*
+ * Update a range of an index buffer.
+ */
+void render_update_index_buffer(struct render_index_buffer *buf, int offset, int count, const short *src)
+{
+	assert(buf != NULL);
+	assert(buf->usage != RENDER_BUFFER_STREAM);
+	assert(offset >= 0 && count >= 0);
+	assert((size_t)offset + (size_t)count <= buf->size);
+
+	if (count == 0)
+		return;
+
+	if (queue_count > 0)
+		render_flush_queue();
+
+	render_bind_index_buffer(buf);
+	render_write_buffer(GL_ELEMENT_ARRAY_BUFFER,
+			    buf->usage,
+			    &buf->is_allocated,
+			    sizeof(GLushort) * buf->size,
+			    sizeof(GLushort) * (size_t)offset,
+			    sizeof(GLushort) * (size_t)count,
+			    src);
+}
 
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * buf->size, src, GL_STATIC_DRAW);
+/*
+ * Stream data to an index buffer.
+ */
+bool render_stream_index_buffer(struct render_index_buffer *buf, const short *src, int count)
+{
+	assert(buf != NULL);
+	assert(buf->usage == RENDER_BUFFER_STREAM);
+	assert(count > 0);
+
+	if (queue_count > 0)
+		render_flush_queue();
+
+	render_bind_index_buffer(buf);
+	return render_stream_buffer(GL_ELEMENT_ARRAY_BUFFER,
+				    &buf->is_allocated,
+				    sizeof(GLushort) * buf->size,
+				    &buf->ring_pos,
+				    &buf->base,
+				    sizeof(GLushort) * (size_t)count,
+				    src);
 }
 
 /*
@@ -1114,61 +1790,201 @@ void render_destroy_index_buffer(struct render_index_buffer *buf)
 {
 	assert(buf != NULL);
 
+	if (render_binded_index_buffer == buf)
+		render_binded_index_buffer = NULL;
+
+	render_forget_buffer(buf->buf);
 	glDeleteBuffers(1, (const GLuint *)&buf->buf);
 
 	buf->is_used = false;
 	buf->buf = -1;
 }
 
+/* Get a GL usage hint. */
+static GLenum render_get_usage_hint(int usage)
+{
+	switch (usage) {
+	case RENDER_BUFFER_STATIC:
+		return GL_STATIC_DRAW;
+	case RENDER_BUFFER_DYNAMIC:
+		return GL_DYNAMIC_DRAW;
+	case RENDER_BUFFER_STREAM:
+		return GL_STREAM_DRAW;
+	default:
+		assert(NEVER_COME_HERE);
+		break;
+	}
+	return GL_STATIC_DRAW;
+}
+
+/* Write to a bound static or dynamic buffer. */
+static void render_write_buffer(GLenum target, int usage, bool *is_allocated, size_t capacity, size_t offset, size_t size, const void *src)
+{
+	/* A static buffer is re-specified by a whole upload. */
+	frame_stats.api_call_count++;
+	if (usage == RENDER_BUFFER_STATIC && offset == 0 && size == capacity) {
+		glBufferData(target, (GLsizeiptr)capacity, src, GL_STATIC_DRAW);
+		*is_allocated = true;
+		return;
+	}
+
+	/* Allocate the storage once, and update it in place. */
+	if (!*is_allocated) {
+		glBufferData(target, (GLsizeiptr)capacity, NULL, render_get_usage_hint(usage));
+		*is_allocated = true;
+	}
+	glBufferSubData(target, (GLintptr)offset, (GLsizeiptr)size, src);
+}
+
 /*
- * Update a pipeline constant.
+ * Sub-allocate a range from a bound ring buffer and write to it.
+ *
+ * Ranges are written with unsynchronized mappings, so the CPU never
+ * waits for the GPU to finish reading the previous ranges.  When the
+ * ring wraps, we orphan the storage by glBufferData(NULL) and the
+ * driver gives us a fresh one while the GPU keeps the old one.
  */
-bool render_update_constant(struct render_pipeline *pipeline, struct render_constant_buffer *buf, const char *name, void *src)
+static bool render_stream_buffer(GLenum target, bool *is_allocated, size_t capacity, size_t *ring_pos, size_t *base, size_t size, const void *src)
 {
-	int i, index, location;
+	void *p;
+	size_t pos;
 
-	/* Search an item by a name. */
-	index = -1;
-	for (i = 0; i < pipeline->uniform_count; i++) {
-		if (strcmp(pipeline->uniform[i].name, name) == 0) {
-			index = i;
-			break;
-		}
-	}
-	if (index == -1) {
-		sys_error("Cannot find a constant \"%s\".", name);
+	if (size > capacity) {
+		sys_error("Too large data to stream.");
 		return false;
 	}
 
-	/* Update by the type. */
-	location = glGetUniformLocation(pipeline->program, pipeline->uniform[i].name);
-	if (strcmp(pipeline->uniform[index].type, "float") == 0)
-		glUniform1f(location,  (float *)src);
-	else if (strcmp(pipeline->uniform[index].type, "vec2") == 0)
-		glUniform2fv(location, 1, GL_FALSE, (float *)src);
-	else if (strcmp(pipeline->uniform[index].type, "vec3") == 0)
-		glUniform3fv(location, 1, GL_FALSE, (float *)src);
-	else if (strcmp(pipeline->uniform[index].type, "vec4") == 0)
-		glUniform4fv(location, 1, GL_FALSE, (float *)src);
-	else if (strcmp(pipeline->uniform[index].type, "mat4") == 0)
-		glUniformMatrix4fv(location, 1, GL_FALSE, (float *)src);
-	else
-		assert(NEVER_COME_HERE);
+	frame_stats.api_call_count++;
+
+	/* Orphan the storage if the ring wraps. */
+	pos = (*ring_pos + STREAM_ALIGN - 1) & ~(size_t)(STREAM_ALIGN - 1);
+	if (!*is_allocated || pos + size > capacity) {
+		glBufferData(target, (GLsizeiptr)capacity, NULL, GL_STREAM_DRAW);
+		*is_allocated = true;
+		pos = 0;
+	}
+
+	/* Write to the range. */
+	p = glMapBufferRange(target,
+			     (GLintptr)pos,
+			     (GLsizeiptr)size,
+			     GL_MAP_WRITE_BIT |
+			     GL_MAP_INVALIDATE_RANGE_BIT |
+			     GL_MAP_UNSYNCHRONIZED_BIT);
+	if (p != NULL) {
+		memcpy(p, src, size);
+		glUnmapBuffer(target);
+	} else {
+		/* Fallback. */
+		glBufferSubData(target, (GLintptr)pos, (GLsizeiptr)size, src);
+	}
+
+	*base = pos;
+	*ring_pos = pos + size;
 
 	return true;
 }
 
 /*
- * Create a texture.
+ * Update a pipeline constant.
  */
-bool render_create_texture(int width, int height, int miplevel, struct render_texture **tex)
+bool render_update_constant(struct render_pipeline *pipeline, struct render_constant_buffer *buf, const char *name, void *src)
 {
-	int index, i;
+	int index;
 
-	/* Allocate a struct. */
-	index = -1;
-	for (i = 0; i < TEXTURE_MAX; i++) {
-		if (!render_texture[i].is_used) {
+	UNUSED_PARAMETER(buf);
+
+	/* Search an item by a name. */
+	index = render_get_constant_index(pipeline, name);
+	if (index == -1) {
+		sys_error("Cannot find a constant \"%s\".", name);
+		return false;
+	}
+
+	return render_update_constant_by_index(pipeline, index, src);
+}
+
+/*
+ * Get an index of a pipeline constant.
+ */
+int render_get_constant_index(struct render_pipeline *pipeline, const char *name)
+{
+	int i;
+
+	assert(pipeline != NULL);
+	assert(name != NULL);
+
+	for (i = 0; i < pipeline->uniform_count; i++) {
+		if (strcmp(pipeline->uniform[i].name, name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Update a pipeline constant by an index.
+ */
+bool render_update_constant_by_index(struct render_pipeline *pipeline, int index, const void *src)
+{
+	GLint location;
+
+	assert(pipeline != NULL);
+	assert(pipeline == render_binded_pipeline);
+	assert(src != NULL);
+
+	if (index < 0 || index >= pipeline->uniform_count) {
+		sys_error("Invalid constant index %d.", index);
+		return false;
+	}
+
+	/* Update by the type. */
+	frame_stats.api_call_count++;
+	location = pipeline->uniform[index].location;
+	switch (pipeline->uniform[index].utype) {
+	case UNIFORM_FLOAT:
+		glUniform1fv(location, 1, (const GLfloat *)src);
+		break;
+	case UNIFORM_VEC2:
+		glUniform2fv(location, 1, (const GLfloat *)src);
+		break;
+	case UNIFORM_VEC3:
+		glUniform3fv(location, 1, (const GLfloat *)src);
+		break;
+	case UNIFORM_VEC4:
+		glUniform4fv(location, 1, (const GLfloat *)src);
+		break;
+	case UNIFORM_MAT2:
+		glUniformMatrix2fv(location, 1, GL_FALSE, (const GLfloat *)src);
+		break;
+	case UNIFORM_MAT3:
+		glUniformMatrix3fv(location, 1, GL_FALSE, (const GLfloat *)src);
+		break;
+	case UNIFORM_MAT4:
+		glUniformMatrix4fv(location, 1, GL_FALSE, (const GLfloat *)src);
+		break;
+	case UNIFORM_SAMPLER:
+		sys_error("Cannot update a sampler \"%s\".", pipeline->uniform[index].name);
+		return false;
+	default:
+		assert(NEVER_COME_HERE);
+		break;
+	}
+
+	return true;
+}
+
+/*
+ * Create a texture.
+ */
+bool render_create_texture(int width, int height, int miplevel, struct render_texture **tex)
+{
+	int index, i;
+
+	/* Allocate a struct. */
+	index = -1;
+	for (i = 0; i < TEXTURE_MAX; i++) {
+		if (!render_texture[i].is_used) {
 			index = i;
 			break;
 		}
@@ -1179,18 +1995,43 @@ bool render_create_texture(int width, int height, int miplevel, struct render_te
 	}
 
 	/* Create a texture. */
-	glGenTextures(1, &render_texture[i].tex);
+	glGenTextures(1, &render_texture[index].tex);
+	render_texture[index].is_used = true;
+	render_texture[index].width = (GLuint)width;
+	render_texture[index].height = (GLuint)height;
+	render_texture[index].is_specified = false;
+	render_texture[index].is_premultiplied = false;
+	render_texture[index].recorded_width = 0;
+	render_texture[index].recorded_height = 0;
+
+	*tex = &render_texture[index];
 
 	return true;
 }
 
+/*
+ * Destroy a texture.
+ */
+void render_destroy_texture(struct render_texture *tex)
+{
+	assert(tex != NULL);
+
+	render_forget_texture(tex->tex);
+	glDeleteTextures(1, &tex->tex);
+
+	tex->is_used = false;
+	tex->tex = 0;
+}
+
 /*
  * Bind a texture.
  */
 void render_bind_texture(int index, struct render_texture *tex)
 {
-	glActiveTexture(GL_TEXTURE0 + index);
-	glBindTexture(GL_TEXTURE_2D, tex->tex);
+	assert(index >= 0 && index < TEXTURE_UNIT_MAX);
+	assert(tex != NULL);
+
+	render_bind_gl_texture(index, tex->tex);
 }
 
 /*
@@ -1198,25 +2039,264 @@ void render_bind_texture(int index, struct render_texture *tex)
  */
 void render_upload_texture(struct render_texture *tex, int miplevel, struct image *img)
 {
+	assert(tex != NULL);
+	assert(img != NULL);
+
+	/* Draw the queued items with the old pixels. */
+	if (queue_count > 0)
+		render_flush_queue();
+
+	tex->is_premultiplied = image_is_premultiplied(img);
+
+	/* Specify the storage for the first time or for a new size. */
+	if (miplevel != 0 ||
+	    !tex->is_specified ||
+	    tex->width != (GLuint)image_get_width(img) ||
+	    tex->height != (GLuint)image_get_height(img)) {
+		render_specify_texture(tex, miplevel, image_get_width(img), image_get_height(img), image_get_pixels(img));
+		return;
+	}
+
+	/* Update the whole storage without re-specifying it. */
+	render_upload_texture_rect(tex, img, 0, 0, image_get_width(img), image_get_height(img));
+}
+
+/*
+ * Upload the dirty rectangle of an image to a texture.
+ */
+void render_update_texture(struct render_texture *tex, struct image *img)
+{
+	int x, y, w, h;
+
+	assert(tex != NULL);
+	assert(img != NULL);
+
+	/* Upload the whole image for the first time or for a new size. */
+	if (!tex->is_specified ||
+	    tex->width != (GLuint)image_get_width(img) ||
+	    tex->height != (GLuint)image_get_height(img)) {
+		render_upload_texture(tex, 0, img);
+		image_clear_dirty(img);
+		return;
+	}
+
+	/* Update the dirty rectangle only. */
+	if (!image_get_dirty_rect(img, &x, &y, &w, &h))
+		return;
+	render_upload_texture_rect(tex, img, x, y, w, h);
+	image_clear_dirty(img);
+}
+
+/* Specify the texture storage and parameters. (pixels may be NULL) */
+static void render_specify_texture(struct render_texture *tex, int miplevel, int width, int height, const pixel_t *pixels)
+{
+	frame_stats.api_call_count++;
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-	glBindTexture(GL_TEXTURE_2D, tex->tex);
+	render_bind_gl_texture(0, tex->tex);
+	if (miplevel == 0) {
 #ifdef TARGET_WASM
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 #else
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 #endif
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	} else {
+		/* Sample the levels uploaded so far. (upload them in order) */
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, miplevel);
+	}
 	glTexImage2D(GL_TEXTURE_2D,
-		     0,
+		     miplevel,
 		     GL_RGBA,
-		     image_get_width(img),
-		     image_get_height(img),
+		     width,
+		     height,
 		     0,
 		     GL_RGBA,
 		     GL_UNSIGNED_BYTE,
-		     image_get_pixels(img));
-	glActiveTexture(GL_TEXTURE0);
+		     pixels);
+
+	if (miplevel == 0) {
+		tex->width = (GLuint)width;
+		tex->height = (GLuint)height;
+		tex->is_specified = true;
+	}
+}
+
+/*
+ * Upload a rectangle of pixels to a texture.
+ */
+void render_upload_texture_rect(struct render_texture *tex, struct image *img, int x, int y, int w, int h)
+{
+	assert(tex != NULL);
+	assert(img != NULL);
+	assert(x >= 0 && y >= 0 && w >= 0 && h >= 0);
+	assert(x + w <= image_get_width(img) && y + h <= image_get_height(img));
+
+	if (queue_count > 0)
+		render_flush_queue();
+
+	tex->is_premultiplied = image_is_premultiplied(img);
+
+	if (!tex->is_specified) {
+		render_specify_texture(tex, 0, image_get_width(img), image_get_height(img), image_get_pixels(img));
+		return;
+	}
+	if (w == 0 || h == 0)
+		return;
+
+	/* Read rows of the rectangle from the whole image. */
+	frame_stats.api_call_count++;
+	render_bind_gl_texture(0, tex->tex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, image_get_width(img));
+	glTexSubImage2D(GL_TEXTURE_2D,
+			0,
+			x,
+			y,
+			w,
+			h,
+			GL_RGBA,
+			GL_UNSIGNED_BYTE,
+			image_get_pixels(img) + y * image_get_width(img) + x);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+/*
+ * Upload a rectangle of pixels in memory to a texture.
+ */
+void render_upload_texture_pixels(struct render_texture *tex, int width, int height, bool is_premultiplied, const pixel_t *pixels, int x, int y, int w, int h)
+{
+	assert(tex != NULL);
+	assert(pixels != NULL || w == 0 || h == 0);
+	assert(x >= 0 && y >= 0 && w >= 0 && h >= 0);
+	assert(x + w <= width && y + h <= height);
+
+	if (queue_count > 0)
+		render_flush_queue();
+
+	tex->is_premultiplied = is_premultiplied;
+
+	/* Specify the storage for the first time or for a new size. */
+	if (!tex->is_specified ||
+	    tex->width != (GLuint)width ||
+	    tex->height != (GLuint)height)
+		render_specify_texture(tex, 0, width, height, NULL);
+	if (w == 0 || h == 0)
+		return;
+
+	/* The rows are packed. */
+	frame_stats.api_call_count++;
+	render_bind_gl_texture(0, tex->tex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D,
+			0,
+			x,
+			y,
+			w,
+			h,
+			GL_RGBA,
+			GL_UNSIGNED_BYTE,
+			pixels);
+}
+
+/*
+ * Mirror the storage of a texture for a recorded upload.
+ */
+bool render_record_texture_storage(struct render_texture *tex, int width, int height)
+{
+	bool is_specified;
+
+	assert(tex != NULL);
+
+	is_specified = tex->recorded_width == width && tex->recorded_height == height;
+	tex->recorded_width = width;
+	tex->recorded_height = height;
+
+	return is_specified;
+}
+
+/*
+ * Upload pixels to a texture asynchronously.
+ */
+void render_upload_texture_async(struct render_texture *tex, struct image *img)
+{
+	int x, y, w, h;
+
+	assert(tex != NULL);
+	assert(img != NULL);
+
+	if (queue_count > 0)
+		render_flush_queue();
+
+	tex->is_premultiplied = image_is_premultiplied(img);
+
+	/* The storage is specified synchronously. */
+	if (!tex->is_specified ||
+	    tex->width != (GLuint)image_get_width(img) ||
+	    tex->height != (GLuint)image_get_height(img)) {
+		render_specify_texture(tex, 0, image_get_width(img), image_get_height(img), image_get_pixels(img));
+		image_clear_dirty(img);
+		return;
+	}
+
+	/* Update the dirty rectangle only. */
+	if (!image_get_dirty_rect(img, &x, &y, &w, &h))
+		return;
+	render_upload_texture_pbo(tex, img, x, y, w, h);
+	image_clear_dirty(img);
+}
+
+/*
+ * Copy a rectangle to a pixel buffer object, and let the driver
+ * transfer it to the texture.  Each upload uses the next PBO in the
+ * ring and orphans its storage, so that the CPU doesn't wait for
+ * previous transfers.
+ */
+static void render_upload_texture_pbo(struct render_texture *tex, struct image *img, int x, int y, int w, int h)
+{
+	const pixel_t *src;
+	uint8_t *dst;
+	size_t row_bytes;
+	GLuint pbo;
+	int i;
+
+	/* Get the next PBO. */
+	if (texture_pbo[texture_pbo_cursor] == 0)
+		glGenBuffers(1, &texture_pbo[texture_pbo_cursor]);
+	pbo = texture_pbo[texture_pbo_cursor];
+	texture_pbo_cursor = (texture_pbo_cursor + 1) % PBO_COUNT;
+
+	/* Orphan and map the storage. */
+	row_bytes = (size_t)w * sizeof(pixel_t);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)(row_bytes * (size_t)h), NULL, GL_STREAM_DRAW);
+	dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+			       0,
+			       (GLsizeiptr)(row_bytes * (size_t)h),
+			       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (dst == NULL) {
+		/* Fallback. */
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		render_upload_texture_rect(tex, img, x, y, w, h);
+		return;
+	}
+
+	/* Pack the rows. */
+	src = image_get_pixels(img) + y * image_get_width(img) + x;
+	for (i = 0; i < h; i++) {
+		memcpy(dst, src, row_bytes);
+		dst += row_bytes;
+		src += image_get_width(img);
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	/* Transfer from the PBO. (the pointer is an offset in the PBO) */
+	frame_stats.api_call_count++;
+	render_bind_gl_texture(0, tex->tex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, (const GLvoid *)0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
 /*
@@ -1224,11 +2304,22 @@ void render_upload_texture(struct render_texture *tex, int miplevel, struct imag
  */
 void render_begin_frame(void)
 {
-	glClearColor(0.0f, 0.0f, 1.0f, 0.0f);
+	memset(&frame_stats, 0, sizeof(frame_stats));
+	queue_count = 0;
+
+	render_begin_gpu_timer();
+
+	if (!state.is_clear_color_set) {
+		glClearColor(0.0f, 0.0f, 1.0f, 0.0f);
+		state.is_clear_color_set = true;
+		frame_stats.api_call_count++;
+	} else {
+		frame_stats.redundant_call_count++;
+	}
 	glClear(GL_COLOR_BUFFER_BIT);
+	frame_stats.api_call_count++;
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE, GL_ONE);
+	render_set_blend(GL_ONE, GL_ONE);
 }
 
 /*
@@ -1236,8 +2327,144 @@ void render_begin_frame(void)
  */
 void render_end_frame(void)
 {
+	/* Submit the remaining draws. */
+	if (queue_count > 0)
+		render_flush_queue();
+
+	render_end_gpu_timer();
+
+	prof_begin_zone("glFlush");
 	glFlush();
+	prof_end_zone();
 	is_after_reinit = false;
+
+	frame_stats.api_call_count++;
+	last_stats = frame_stats;
+}
+
+/*
+ * Get the statistics of the last frame.
+ */
+void render_get_stats(struct render_stats *stats)
+{
+	assert(stats != NULL);
+
+	*stats = last_stats;
+}
+
+/*
+ * Get the GPU time of the latest frame measured.
+ */
+bool render_get_gpu_time(float *ms)
+{
+	assert(ms != NULL);
+
+	if (gpu_time < 0)
+		return false;
+
+	*ms = gpu_time;
+	return true;
+}
+
+/* Start the GPU timer of a frame if a query is free. */
+static void render_begin_gpu_timer(void)
+{
+	if (glGenQueries == NULL || glGetQueryObjectui64v == NULL)
+		return;
+	if (gpu_timer[0] == 0)
+		glGenQueries(GPU_TIMER_COUNT, gpu_timer);
+
+	/* Skip the frame rather than stall if the GPU is too far behind. */
+	render_read_gpu_timers();
+	if (is_gpu_timer_pending[gpu_timer_index])
+		return;
+
+	glBeginQuery(GL_TIME_ELAPSED, gpu_timer[gpu_timer_index]);
+	is_gpu_timer_running = true;
+}
+
+/* Stop the GPU timer of a frame. */
+static void render_end_gpu_timer(void)
+{
+	if (!is_gpu_timer_running)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	is_gpu_timer_running = false;
+	is_gpu_timer_pending[gpu_timer_index] = true;
+	gpu_timer_index = (gpu_timer_index + 1) % GPU_TIMER_COUNT;
+}
+
+/* Read the results of the finished GPU timers in order. */
+static void render_read_gpu_timers(void)
+{
+	GLuint64 elapsed;
+	GLint available;
+	int i, index;
+
+	for (i = 0; i < GPU_TIMER_COUNT; i++) {
+		index = (gpu_timer_index + i) % GPU_TIMER_COUNT;
+		if (!is_gpu_timer_pending[index])
+			continue;
+
+		available = 0;
+		glGetQueryObjectiv(gpu_timer[index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		glGetQueryObjectui64v(gpu_timer[index], GL_QUERY_RESULT, &elapsed);
+		gpu_time = (float)((double)elapsed / 1000000.0);
+		is_gpu_timer_pending[index] = false;
+	}
+}
+
+/*
+ * Read back the framebuffer to an image.
+ */
+bool render_read_pixels(struct image *img)
+{
+	GLint viewport[4];
+	pixel_t *pixels, tmp;
+	int w, h, x, y;
+
+	assert(img != NULL);
+
+	w = image_get_width(img);
+	h = image_get_height(img);
+	pixels = image_get_pixels(img);
+
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (w > viewport[2] || h > viewport[3]) {
+		sys_error("Image larger than the viewport.");
+		return false;
+	}
+
+	/* Read the rows at the top of the viewport. */
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(viewport[0],
+		     viewport[1] + viewport[3] - h,
+		     w,
+		     h,
+		     GL_RGBA,
+		     GL_UNSIGNED_BYTE,
+		     pixels);
+	if (glGetError() != GL_NO_ERROR) {
+		sys_error("glReadPixels() failed.");
+		return false;
+	}
+
+	/* Flip vertically since OpenGL stores the bottom row first. */
+	for (y = 0; y < h / 2; y++) {
+		for (x = 0; x < w; x++) {
+			tmp = pixels[y * w + x];
+			pixels[y * w + x] = pixels[(h - 1 - y) * w + x];
+			pixels[(h - 1 - y) * w + x] = tmp;
+		}
+	}
+
+	image_mark_dirty(img, 0, 0, w, h);
+
+	return true;
 }
 
 /*
@@ -1245,5 +2472,327 @@ void render_end_frame(void)
  */
 void render_draw_triangle_strip(int offset, int count)
 {
-	glDrawElements(GL_TRIANGLE_STRIP, count, GL_UNSIGNED_SHORT, 0);
+	size_t base;
+
+	base = render_binded_index_buffer != NULL ? render_binded_index_buffer->base : 0;
+
+	frame_stats.draw_count++;
+	frame_stats.api_call_count++;
+	glDrawElements(GL_TRIANGLE_STRIP, count, GL_UNSIGNED_SHORT, (const GLvoid *)(base + (size_t)offset * sizeof(GLushort)));
+}
+
+/*
+ * Check if the instanced drawing is supported.
+ */
+bool render_is_instancing_supported(void)
+{
+	return glDrawElementsInstanced != NULL && glVertexAttribDivisor != NULL;
+}
+
+/*
+ * Draw instances of triangles.
+ */
+void render_draw_instanced(int offset, int count, int instances)
+{
+	size_t base;
+
+	assert(render_is_instancing_supported());
+	assert(instances >= 0);
+
+	if (instances == 0)
+		return;
+
+	base = render_binded_index_buffer != NULL ? render_binded_index_buffer->base : 0;
+
+	frame_stats.draw_count++;
+	frame_stats.api_call_count++;
+	glDrawElementsInstanced(GL_TRIANGLE_STRIP,
+				count,
+				GL_UNSIGNED_SHORT,
+				(const GLvoid *)(base + (size_t)offset * sizeof(GLushort)),
+				instances);
+}
+
+/*
+ * Set the blend mode.
+ */
+void render_set_blend_mode(int mode)
+{
+	GLenum src, dst;
+
+	switch (mode) {
+	case RENDER_BLEND_NONE:
+		if (state.blend == 0)
+			return;
+		if (queue_count > 0)
+			render_flush_queue();
+		render_disable_blend();
+		return;
+	case RENDER_BLEND_ALPHA:
+		src = GL_SRC_ALPHA;
+		dst = GL_ONE_MINUS_SRC_ALPHA;
+		break;
+	case RENDER_BLEND_PREMULTIPLIED:
+		src = GL_ONE;
+		dst = GL_ONE_MINUS_SRC_ALPHA;
+		break;
+	case RENDER_BLEND_ADD:
+		src = GL_ONE;
+		dst = GL_ONE;
+		break;
+	default:
+		assert(NEVER_COME_HERE);
+		return;
+	}
+
+	/* The queued items were drawn in the previous mode. */
+	if (state.blend == 1 && state.blend_src == src && state.blend_dst == dst)
+		return;
+	if (queue_count > 0)
+		render_flush_queue();
+
+	render_set_blend(src, dst);
+}
+
+/*
+ * Get the blend mode for a texture.
+ */
+int render_get_texture_blend_mode(struct render_texture *tex)
+{
+	assert(tex != NULL);
+
+	return tex->is_premultiplied ? RENDER_BLEND_PREMULTIPLIED : RENDER_BLEND_ALPHA;
+}
+
+/*
+ * Enable or disable the deferred submission queue.
+ */
+void render_set_queue_enabled(bool enable)
+{
+	if (!enable && queue_count > 0)
+		render_flush_queue();
+
+	is_queue_enabled = enable;
+}
+
+/*
+ * Draw an item, or put it to the submission queue.
+ */
+void render_queue_draw(const struct render_draw_item *item)
+{
+	assert(item != NULL);
+	assert(item->pipeline != NULL);
+	assert(item->vertex_buffer != NULL);
+	assert(item->index_buffer != NULL);
+	assert(item->constant_count >= 0 && item->constant_count <= RENDER_DRAW_CONSTANT_MAX);
+
+	if (!is_queue_enabled) {
+		render_submit_item((struct render_draw_item *)item);
+		return;
+	}
+
+	/* Keep the submission order of the queued items when full. */
+	if (queue_count == QUEUE_MAX)
+		render_flush_queue();
+
+	queue[queue_count].item = *item;
+	queue[queue_count].seq = queue_count;
+	queue_count++;
+}
+
+/*
+ * Sort the queued items by state, and submit them.
+ */
+void render_flush_queue(void)
+{
+	int i;
+
+	prof_begin_zone("render_flush_queue");
+
+	for (i = 0; i < queue_count; i++)
+		queue_sorted[i] = &queue[i];
+	qsort(queue_sorted, (size_t)queue_count, sizeof(struct queue_item *), render_compare_queue_item);
+
+	for (i = 0; i < queue_count; i++)
+		render_submit_item(&queue_sorted[i]->item);
+
+	queue_count = 0;
+
+	prof_end_zone();
+}
+
+/* Compare draw items by layer, pipeline, textures and buffers. (stable) */
+static int render_compare_queue_item(const void *a, const void *b)
+{
+	const struct queue_item *x = *(struct queue_item *const *)a;
+	const struct queue_item *y = *(struct queue_item *const *)b;
+	int i;
+
+	if (x->item.layer != y->item.layer)
+		return x->item.layer < y->item.layer ? -1 : 1;
+	if (x->item.pipeline != y->item.pipeline)
+		return x->item.pipeline < y->item.pipeline ? -1 : 1;
+	for (i = 0; i < RENDER_DRAW_TEXTURE_MAX; i++) {
+		if (x->item.texture[i] != y->item.texture[i])
+			return x->item.texture[i] < y->item.texture[i] ? -1 : 1;
+	}
+	if (x->item.vertex_buffer != y->item.vertex_buffer)
+		return x->item.vertex_buffer < y->item.vertex_buffer ? -1 : 1;
+	if (x->item.index_buffer != y->item.index_buffer)
+		return x->item.index_buffer < y->item.index_buffer ? -1 : 1;
+	if (x->item.instance_buffer != y->item.instance_buffer)
+		return x->item.instance_buffer < y->item.instance_buffer ? -1 : 1;
+
+	return x->seq - y->seq;
+}
+
+/* Bind the state of an item and draw it. */
+static void render_submit_item(struct render_draw_item *item)
+{
+	int i;
+
+	render_bind_pipeline(item->pipeline);
+	render_bind_vertex_buffer(item->vertex_buffer);
+	render_bind_index_buffer(item->index_buffer);
+	for (i = 0; i < RENDER_DRAW_TEXTURE_MAX; i++) {
+		if (item->texture[i] != NULL)
+			render_bind_texture(i, item->texture[i]);
+	}
+	for (i = 0; i < item->constant_count; i++) {
+		render_update_constant_by_index(item->pipeline,
+						item->constant[i].index,
+						item->constant[i].value);
+	}
+	if (item->instance_buffer != NULL) {
+		render_bind_instance_buffer(item->instance_buffer);
+		render_draw_instanced(item->offset, item->count, item->instance_count);
+		return;
+	}
+	render_draw_triangle_strip(item->offset, item->count);
+}
+
+/*
+ * Shadow state
+ */
+
+/* Forget all the bindings. */
+static void render_reset_state(void)
+{
+	int i;
+
+	state.program = STATE_UNKNOWN;
+	state.vao = STATE_UNKNOWN;
+	state.array_buffer = STATE_UNKNOWN;
+	state.element_buffer = STATE_UNKNOWN;
+	state.active_texture = STATE_UNKNOWN;
+	for (i = 0; i < TEXTURE_UNIT_MAX; i++)
+		state.texture[i] = STATE_UNKNOWN;
+	state.blend = -1;
+	state.blend_src = STATE_UNKNOWN;
+	state.blend_dst = STATE_UNKNOWN;
+	state.is_clear_color_set = false;
+}
+
+static void render_use_program(GLuint program)
+{
+	if (state.program == program) {
+		frame_stats.redundant_call_count++;
+		return;
+	}
+	glUseProgram(program);
+	state.program = program;
+	frame_stats.api_call_count++;
+}
+
+static void render_bind_vao(GLuint vao)
+{
+	if (state.vao == vao) {
+		frame_stats.redundant_call_count++;
+		return;
+	}
+	glBindVertexArray(vao);
+	state.vao = vao;
+	state.element_buffer = STATE_UNKNOWN;
+	frame_stats.api_call_count++;
+}
+
+static void render_bind_gl_buffer(GLenum target, GLuint buf)
+{
+	GLuint *cur;
+
+	cur = target == GL_ARRAY_BUFFER ? &state.array_buffer : &state.element_buffer;
+	if (*cur == buf) {
+		frame_stats.redundant_call_count++;
+		return;
+	}
+	glBindBuffer(target, buf);
+	*cur = buf;
+	frame_stats.api_call_count++;
+}
+
+/* Make a unit active and bind a texture to it. */
+static void render_bind_gl_texture(int unit, GLuint tex)
+{
+	if (state.active_texture != (GLuint)unit) {
+		glActiveTexture(GL_TEXTURE0 + (GLenum)unit);
+		state.active_texture = (GLuint)unit;
+		frame_stats.api_call_count++;
+	}
+	if (state.texture[unit] == tex) {
+		frame_stats.redundant_call_count++;
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, tex);
+	state.texture[unit] = tex;
+	frame_stats.api_call_count++;
+}
+
+static void render_set_blend(GLenum src, GLenum dst)
+{
+	if (state.blend != 1) {
+		glEnable(GL_BLEND);
+		state.blend = 1;
+		frame_stats.api_call_count++;
+	} else {
+		frame_stats.redundant_call_count++;
+	}
+	if (state.blend_src != src || state.blend_dst != dst) {
+		glBlendFunc(src, dst);
+		state.blend_src = src;
+		state.blend_dst = dst;
+		frame_stats.api_call_count++;
+	} else {
+		frame_stats.redundant_call_count++;
+	}
+}
+
+static void render_disable_blend(void)
+{
+	if (state.blend != 0) {
+		glDisable(GL_BLEND);
+		state.blend = 0;
+		frame_stats.api_call_count++;
+	} else {
+		frame_stats.redundant_call_count++;
+	}
+}
+
+/* A deleted buffer is unbound from the current bindings. */
+static void render_forget_buffer(GLuint buf)
+{
+	if (state.array_buffer == buf)
+		state.array_buffer = STATE_UNKNOWN;
+	if (state.element_buffer == buf)
+		state.element_buffer = STATE_UNKNOWN;
+}
+
+/* A deleted texture is unbound from the texture units. */
+static void render_forget_texture(GLuint tex)
+{
+	int i;
+
+	for (i = 0; i < TEXTURE_UNIT_MAX; i++) {
+		if (state.texture[i] == tex)
+			state.texture[i] = STATE_UNKNOWN;
+	}
 }
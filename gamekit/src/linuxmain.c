@@ -14,6 +14,7 @@
 #include "stdfile.h"
 #include "stdimage.h"
 #include "glrender.h"
+#include "stdrendercmd.h"
 
 /* X11 */
 #include <X11/Xlib.h>
@@ -21,26 +22,44 @@
 #include <X11/xpm.h>
 #include <X11/Xatom.h>
 #include <X11/Xlocale.h>
+#if defined(HAVE_XINPUT2)
+#include <X11/extensions/XInput2.h>
+#endif
 
 /* OpenGL */
 #include <GL/glx.h>
+#include <EGL/egl.h>
 
 /* POSIX */
 #include <sys/types.h>
 #include <sys/stat.h>	/* stat(), mkdir() */
 #include <sys/time.h>	/* gettimeofday() */
-#include <unistd.h>	/* usleep(), access() */
+#include <unistd.h>	/* access(), sysconf() */
+#include <time.h>	/* clock_gettime(), clock_nanosleep() */
+#include <poll.h>	/* poll() */
+#include <pthread.h>
 
 /*
  * Framerate
  */
 
-/* Frame Time */
-#define FRAME_MILLI	(16)	/* Millisec of a frame */
-#define SLEEP_MILLI	(5)	/* Millisec to sleep */
+/* Nanosec of a frame. (60 fps) */
+#define FRAME_NANO	(1000000000LL / 60)
 
-/* Frame start time */
-static struct timeval tv_start;
+/* Nanosec of a millisec. */
+#define MILLI_NANO	(1000000LL)
+
+/* Deadline of the current frame. (CLOCK_MONOTONIC) */
+static struct timespec frame_deadline;
+
+/* Microsec to spin before a deadline instead of sleeping. */
+static int spin_micro;
+
+/* Is the frame paced by the buffer swap? */
+static bool is_vsync_enabled;
+
+/* Threads of the job pool. (0 for the number of CPUs) */
+static int job_thread_count;
 
 /*
  * Window
@@ -62,6 +81,87 @@ static Atom delete_message = BadAlloc;
 static Pixmap icon = BadAlloc;
 static Pixmap icon_mask = BadAlloc;
 
+/*
+ * Headless
+ */
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA	0x31DD
+#endif
+
+/* Default frames to run in the headless mode. */
+#define HEADLESS_FRAMES	(300)
+
+/* Is in the headless mode? */
+static bool is_headless;
+
+/* Frames to run in the headless mode. */
+static int headless_frames = HEADLESS_FRAMES;
+
+/* File to write the per-frame timings to. */
+static const char *timings_file;
+
+/* File to write the last frame to. */
+static const char *dump_file;
+
+/* Is the program binary cache disabled? */
+static bool is_program_cache_disabled;
+
+/* File to write the trace to. */
+static const char *trace_file;
+
+/* EGL Objects */
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLSurface egl_surface = EGL_NO_SURFACE;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+
+/*
+ * Render Thread
+ */
+
+/* Is the render thread enabled? */
+static bool is_render_thread_enabled;
+
+/* Render thread. */
+static pthread_t render_thread;
+static pthread_mutex_t render_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t render_cond = PTHREAD_COND_INITIALIZER;
+
+/* Is a frame handed to the render thread? */
+static bool is_render_frame_ready;
+
+/* Should the render thread quit? */
+static bool is_render_thread_quit;
+
+/*
+ * Fixed Timestep
+ */
+
+/* Fixed-timestep loop settings. (tick_rate is zero if not used) */
+static struct sys_fixed_loop fixed_loop;
+
+/* Nanosec of a tick. */
+static uint64_t tick_nano;
+
+/* Time not consumed by the ticks. (single-threaded) */
+static uint64_t tick_accum;
+
+/* Time of the last accounting. (single-threaded) */
+static uint64_t tick_last;
+
+/* Update thread. */
+static pthread_t update_thread;
+static pthread_mutex_t update_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Scheduled time of the last tick. (threaded) */
+static uint64_t tick_sched;
+
+/* Should the update thread quit? */
+static bool is_update_thread_quit;
+
+/* Did on_update() return false? */
+static bool is_update_finished;
+
 /*
  * OpenGL
  */
@@ -86,54 +186,87 @@ GLint (APIENTRY *glGetAttribLocation)(GLuint program, const GLchar *name);
 void (APIENTRY *glVertexAttribPointer)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer);
 void (APIENTRY *glEnableVertexAttribArray)(GLuint index);
 GLint (APIENTRY *glGetUniformLocation)(GLuint program, const GLchar *name);
-void (APIENTRY *glUniform1i)(GLint location, GLint v);
-void (APIENTRY *glUniform1f)(GLint location, GLfloat v);
-void (APIENTRY *glUniform2fv)(GLint location, GLfloat *v);
-void (APIENTRY *glUniform3fv)(GLint location, GLfloat *v);
-void (APIENTRY *glUniform4fv)(GLint location, GLfloat *v);
-void (APIENTRY *glUniformMatrix4fv)(GLint location, GLfloat *v);
+void (APIENTRY *glUniform1i)(GLint location, GLint v0);
+void (APIENTRY *glUniform1fv)(GLint location, GLsizei count, const GLfloat *value);
+void (APIENTRY *glUniform2fv)(GLint location, GLsizei count, const GLfloat *value);
+void (APIENTRY *glUniform3fv)(GLint location, GLsizei count, const GLfloat *value);
+void (APIENTRY *glUniform4fv)(GLint location, GLsizei count, const GLfloat *value);
+void (APIENTRY *glUniformMatrix2fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+void (APIENTRY *glUniformMatrix3fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+void (APIENTRY *glUniformMatrix4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
 void (APIENTRY *glBufferData)(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
 void (APIENTRY *glDeleteShader)(GLuint shader);
 void (APIENTRY *glDeleteProgram)(GLuint program);
 void (APIENTRY *glDeleteVertexArrays)(GLsizei n, const GLuint *arrays);
 void (APIENTRY *glDeleteBuffers)(GLsizei n, const GLuint *buffers);
+void (APIENTRY *glBufferSubData)(GLenum target, GLintptr offset, GLsizeiptr size, const void *data);
+void *(APIENTRY *glMapBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+GLboolean (APIENTRY *glUnmapBuffer)(GLenum target);
+void (APIENTRY *glGetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+void (APIENTRY *glProgramBinary)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+void (APIENTRY *glProgramParameteri)(GLuint program, GLenum pname, GLint value);
+void (APIENTRY *glDrawElementsInstanced)(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount);
+void (APIENTRY *glVertexAttribDivisor)(GLuint index, GLuint divisor);
+void (APIENTRY *glGenQueries)(GLsizei n, GLuint *ids);
+void (APIENTRY *glDeleteQueries)(GLsizei n, const GLuint *ids);
+void (APIENTRY *glBeginQuery)(GLenum target, GLuint id);
+void (APIENTRY *glEndQuery)(GLenum target);
+void (APIENTRY *glGetQueryObjectiv)(GLuint id, GLenum pname, GLint *params);
+void (APIENTRY *glGetQueryObjectui64v)(GLuint id, GLenum pname, GLuint64 *params);
 
 /* Symbol table */
 struct API {
 	void **func;
 	const char *name;
+	bool is_optional;
 };
 static struct API api[] = {
-	{(void **)&glCreateShader, "glCreateShader"},
-	{(void **)&glShaderSource, "glShaderSource"},
-	{(void **)&glCompileShader, "glCompileShader"},
-	{(void **)&glGetShaderiv, "glGetShaderiv"},
-	{(void **)&glGetShaderInfoLog, "glGetShaderInfoLog"},
-	{(void **)&glAttachShader, "glAttachShader"},
-	{(void **)&glLinkProgram, "glLinkProgram"},
-	{(void **)&glGetProgramiv, "glGetProgramiv"},
-	{(void **)&glGetProgramInfoLog, "glGetProgramInfoLog"},
-	{(void **)&glCreateProgram, "glCreateProgram"},
-	{(void **)&glUseProgram, "glUseProgram"},
-	{(void **)&glGenVertexArrays, "glGenVertexArrays"},
-	{(void **)&glBindVertexArray, "glBindVertexArray"},
-	{(void **)&glGenBuffers, "glGenBuffers"},
-	{(void **)&glBindBuffer, "glBindBuffer"},
-	{(void **)&glGetAttribLocation, "glGetAttribLocation"},
-	{(void **)&glVertexAttribPointer, "glVertexAttribPointer"},
-	{(void **)&glEnableVertexAttribArray, "glEnableVertexAttribArray"},
-	{(void **)&glGetUniformLocation, "glGetUniformLocation"},
-	{(void **)&glUniform1i, "glUniform1i"},
-	{(void **)&glUniform1f, "glUniform1f"},
-	{(void **)&glUniform2fv, "glUniform2fv"},
-	{(void **)&glUniform3fv, "glUniform3fv"},
-	{(void **)&glUniform4fv, "glUniform4fv"},
-	{(void **)&glUniformMatrix4fv, "glUniformMatrix4fv"},
-	{(void **)&glBufferData, "glBufferData"},
-	{(void **)&glDeleteShader, "glDeleteShader"},
-	{(void **)&glDeleteProgram, "glDeleteProgram"},
-	{(void **)&glDeleteVertexArrays, "glDeleteVertexArrays"},
-	{(void **)&glDeleteBuffers, "glDeleteBuffers"},
+	{(void **)&glCreateShader, "glCreateShader", false},
+	{(void **)&glShaderSource, "glShaderSource", false},
+	{(void **)&glCompileShader, "glCompileShader", false},
+	{(void **)&glGetShaderiv, "glGetShaderiv", false},
+	{(void **)&glGetShaderInfoLog, "glGetShaderInfoLog", false},
+	{(void **)&glAttachShader, "glAttachShader", false},
+	{(void **)&glLinkProgram, "glLinkProgram", false},
+	{(void **)&glGetProgramiv, "glGetProgramiv", false},
+	{(void **)&glGetProgramInfoLog, "glGetProgramInfoLog", false},
+	{(void **)&glCreateProgram, "glCreateProgram", false},
+	{(void **)&glUseProgram, "glUseProgram", false},
+	{(void **)&glGenVertexArrays, "glGenVertexArrays", false},
+	{(void **)&glBindVertexArray, "glBindVertexArray", false},
+	{(void **)&glGenBuffers, "glGenBuffers", false},
+	{(void **)&glBindBuffer, "glBindBuffer", false},
+	{(void **)&glGetAttribLocation, "glGetAttribLocation", false},
+	{(void **)&glVertexAttribPointer, "glVertexAttribPointer", false},
+	{(void **)&glEnableVertexAttribArray, "glEnableVertexAttribArray", false},
+	{(void **)&glGetUniformLocation, "glGetUniformLocation", false},
+	{(void **)&glUniform1i, "glUniform1i", false},
+	{(void **)&glUniform1fv, "glUniform1fv", false},
+	{(void **)&glUniform2fv, "glUniform2fv", false},
+	{(void **)&glUniform3fv, "glUniform3fv", false},
+	{(void **)&glUniform4fv, "glUniform4fv", false},
+	{(void **)&glUniformMatrix2fv, "glUniformMatrix2fv", false},
+	{(void **)&glUniformMatrix3fv, "glUniformMatrix3fv", false},
+	{(void **)&glUniformMatrix4fv, "glUniformMatrix4fv", false},
+	{(void **)&glBufferData, "glBufferData", false},
+	{(void **)&glDeleteShader, "glDeleteShader", false},
+	{(void **)&glDeleteProgram, "glDeleteProgram", false},
+	{(void **)&glDeleteVertexArrays, "glDeleteVertexArrays", false},
+	{(void **)&glDeleteBuffers, "glDeleteBuffers", false},
+	{(void **)&glBufferSubData, "glBufferSubData", false},
+	{(void **)&glMapBufferRange, "glMapBufferRange", false},
+	{(void **)&glUnmapBuffer, "glUnmapBuffer", false},
+	{(void **)&glGetProgramBinary, "glGetProgramBinary", true},
+	{(void **)&glProgramBinary, "glProgramBinary", true},
+	{(void **)&glProgramParameteri, "glProgramParameteri", true},
+	{(void **)&glDrawElementsInstanced, "glDrawElementsInstanced", true},
+	{(void **)&glVertexAttribDivisor, "glVertexAttribDivisor", true},
+	{(void **)&glGenQueries, "glGenQueries", true},
+	{(void **)&glDeleteQueries, "glDeleteQueries", true},
+	{(void **)&glBeginQuery, "glBeginQuery", true},
+	{(void **)&glEndQuery, "glEndQuery", true},
+	{(void **)&glGetQueryObjectiv, "glGetQueryObjectiv", true},
+	{(void **)&glGetQueryObjectui64v, "glGetQueryObjectui64v", true},
 };
 
 /*
@@ -153,6 +286,14 @@ static bool is_mouse_down_pressed;
 static int mouse_pos_x;
 static int mouse_pos_y;
 
+#if defined(HAVE_XINPUT2)
+/* XInput2 opcode. (-1 if raw events are not available) */
+static int xi_opcode = -1;
+
+/* Fractions of the raw motion not reported yet. */
+static double raw_rest[2];
+#endif
+
 /*
  * Logging
  */
@@ -163,10 +304,38 @@ static int mouse_pos_y;
  * Forward declaration
  */
 
+static bool parse_options(int argc, char *argv[]);
 static bool init_window(void);
 static void cleanup_window(void);
+static bool init_headless(void);
+static void cleanup_headless(void);
+static bool load_api(void);
+static void init_program_cache(void);
+static void *get_proc_address(const char *name);
 static void run_game_loop(void);
+static void run_headless_loop(void);
+static bool start_render_thread(void);
+static void stop_render_thread(void);
+static void *render_thread_main(void *arg);
+static void submit_render_frame(void);
+static void make_context_current(bool is_current);
+static void swap_buffers(void);
+static bool run_frame(void);
+static bool run_fixed_frame(void);
+static bool start_update_thread(void);
+static void stop_update_thread(void);
+static void *update_thread_main(void *arg);
+static void present_frame(void);
+static void record_gpu_time(void);
+static double get_elapsed_milli(struct timespec *start, struct timespec *end);
+static int compare_double(const void *a, const void *b);
+static void report_timings(double *cpu, double *wall, int count);
+static bool dump_frame(void);
+static void init_vsync(void);
+static void reset_frame_deadline(void);
 static bool wait_for_next_frame(void);
+static bool process_events(void);
+static int64_t get_nano_until(struct timespec *deadline);
 static bool next_event(void);
 static void on_key_press(XEvent *event);
 static void on_key_release(XEvent *event);
@@ -174,6 +343,11 @@ static int get_key_code(XEvent *event);
 static void on_button_press(XEvent *event);
 static void on_button_release(XEvent *event);
 static void on_motion_notify(XEvent *event);
+static void push_event(int type, int code, int x, int y);
+#if defined(HAVE_XINPUT2)
+static void init_xinput2(void);
+static void on_generic_event(XEvent *event);
+#endif
 static char *make_path(const char *path);
 
 /*
@@ -184,6 +358,26 @@ int main(int argc, char *argv[])
 	setlocale(LC_ALL, "");
 	setlocale(LC_NUMERIC, "C");
 
+	/* Parse the command line options. */
+	if (!parse_options(argc, argv))
+		return 1;
+
+	/* Initialize the prof module, and start a trace if requested. */
+	if (!prof_init_module())
+		return 1;
+	if (trace_file != NULL && !prof_start_trace(trace_file))
+		return 1;
+
+	/* Initialize the job pool. */
+	if (job_thread_count <= 0)
+		job_thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (!job_init_module(job_thread_count))
+		return 1;
+
+	/* Xlib must be thread-safe to swap buffers on the render thread. */
+	if (is_render_thread_enabled && !is_headless)
+		XInitThreads();
+
 	/* Initialize the stdfile module. */
 	if (!stdfile_init(make_path))
 		return 1;
@@ -196,22 +390,42 @@ int main(int argc, char *argv[])
 	if (!stdimage_init())
 		return 1;
 
-	/* Initialize the window. */
-	if (!init_window())
-		return 1;
+	/* Set the program binary cache directory. */
+	init_program_cache();
+
+	/* Initialize the window or the offscreen surface. */
+	if (is_headless) {
+		if (!init_headless())
+			return 1;
+	} else {
+		if (!init_window())
+			return 1;
+	}
 
 	/* Tell application that HAL is ready. */
 	if (!on_hal_ready())
 		return 1;
 
 	/* Run the game loop */
-	run_game_loop();
+	if (is_headless)
+		run_headless_loop();
+	else
+		run_game_loop();
 
-	/* Cleanup the window. */
-	cleanup_window();
+	/* Cleanup the window or the offscreen surface. */
+	if (is_headless)
+		cleanup_headless();
+	else
+		cleanup_window();
 
-	/* Cleanup the stdimage module. */
-	stdfile_cleanup();
+	/* Cleanup the stdimage module. (this stops the decoder threads) */
+	stdimage_cleanup();
+
+	/* Cleanup the job pool. */
+	job_cleanup_module();
+
+	/* Cleanup the prof module. (this finishes the trace) */
+	prof_cleanup_module();
 
 	/* Cleanup the stdfile module. */
 	stdfile_cleanup();
@@ -219,6 +433,54 @@ int main(int argc, char *argv[])
 	return 0;
 }
 
+/*
+ * Parse the command line options.
+ *  --headless [frames]  Run offscreen for a fixed number of frames.
+ *  --timings <file>     Write the per-frame timings in CSV. (headless)
+ *  --dump <file>        Write the last frame in PPM. (headless)
+ *  --no-program-cache   Always compile shaders.
+ *  --render-thread      Replay the command lists on a render thread.
+ *  --vsync              Pace the frames by the buffer swap.
+ *  --spin <usec>        Spin for the last microseconds of a frame.
+ *  --trace <file>       Write the frame zones in the Chrome trace format.
+ *  --threads <n>        Use n threads for the job pool.
+ */
+static bool parse_options(int argc, char *argv[])
+{
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			is_headless = true;
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+				headless_frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--timings") == 0 && i + 1 < argc) {
+			timings_file = argv[++i];
+		} else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+			dump_file = argv[++i];
+		} else if (strcmp(argv[i], "--no-program-cache") == 0) {
+			is_program_cache_disabled = true;
+		} else if (strcmp(argv[i], "--render-thread") == 0) {
+			is_render_thread_enabled = true;
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_file = argv[++i];
+		} else if (strcmp(argv[i], "--vsync") == 0) {
+			is_vsync_enabled = true;
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			job_thread_count = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--spin") == 0 && i + 1 < argc) {
+			spin_micro = atoi(argv[++i]);
+			if (spin_micro < 0)
+				spin_micro = 0;
+		} else {
+			sys_error("Unknown option %s.\n", argv[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
 bool init_window(void)
 {
 	int pix_attr[] = {
@@ -248,7 +510,7 @@ bool init_window(void)
 	XSizeHints *sh;
 	XTextProperty tp;
 	XEvent event;
-	int i, n, ret;
+	int n, ret;
 
 	/* Open a display. */
 	display = XOpenDisplay(NULL);
@@ -310,17 +572,13 @@ bool init_window(void)
 	glXMakeContextCurrent(display, glx_window, glx_window, glx_context);
 
 	/* Get the API pointers. */
-	for (i = 0; i < (int)(sizeof(api)/sizeof(struct API)); i++) {
-		*api[i].func = (void *)glXGetProcAddress((const unsigned char *)api[i].name);
-		if(*api[i].func == NULL) {
-			sys_error("Failed to get API %s().", api[i].name);
-			glXMakeContextCurrent(display, None, None, None);
-			glXDestroyContext(display, glx_context);
-			glXDestroyWindow(display, glx_window);
-			glx_context = None;
-			glx_window = None;
-			return false;
-		}
+	if (!load_api()) {
+		glXMakeContextCurrent(display, None, None, None);
+		glXDestroyContext(display, glx_context);
+		glXDestroyWindow(display, glx_window);
+		glx_context = None;
+		glx_window = None;
+		return false;
 	}
 
 	/* Initialize the OpenGL rendering subsystem. */
@@ -333,6 +591,10 @@ bool init_window(void)
 		return false;
 	}
 
+	/* Pace the frames by the buffer swap if requested. */
+	if (is_vsync_enabled)
+		init_vsync();
+
 	/* Set the window title. */
 	ret = XmbTextListToTextProperty(display, &window_title, 1, XCompoundTextStyle, &tp);
 	if (ret == XNoMemory || ret == XLocaleNotSupported) {
@@ -373,6 +635,11 @@ bool init_window(void)
 		return false;
 	}
 
+#if defined(HAVE_XINPUT2)
+	/* Receive the raw mouse motion if possible. */
+	init_xinput2();
+#endif
+
 	/* Capture close button events if possible. */
 	delete_message = XInternAtom(display, "WM_DELETE_WINDOW", True);
 	if (delete_message != None && delete_message != BadAlloc && delete_message != BadValue)
@@ -407,65 +674,810 @@ void cleanup_window(void)
 	}
 }
 
+/*
+ * Initialize an offscreen surface with EGL.
+ *  - Mesa's surfaceless platform is used if available, so that no
+ *    X server nor GPU is required. (llvmpipe)
+ */
+static bool init_headless(void)
+{
+	EGLint config_attr[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_NONE
+	};
+	EGLint surface_attr[] = {
+		EGL_WIDTH, 0,
+		EGL_HEIGHT, 0,
+		EGL_NONE
+	};
+	EGLDisplay (*eglGetPlatformDisplayEXT)(EGLenum platform,
+					       void *native_display,
+					       const EGLint *attrib_list);
+	const char *ext;
+	EGLConfig config;
+	EGLint major, minor, n;
+
+	/* Open a display. */
+	ext = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (ext != NULL && strstr(ext, "EGL_MESA_platform_surfaceless") != NULL) {
+		eglGetPlatformDisplayEXT = (void *)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (eglGetPlatformDisplayEXT != NULL)
+			egl_display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (egl_display == EGL_NO_DISPLAY)
+		egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, &major, &minor)) {
+		sys_error("eglInitialize() failed.");
+		return false;
+	}
+
+	/* Choose a framebuffer format. */
+	if (!eglChooseConfig(egl_display, config_attr, &config, 1, &n) || n < 1) {
+		sys_error("eglChooseConfig() failed.");
+		cleanup_headless();
+		return false;
+	}
+
+	/* Create a pbuffer surface. */
+	surface_attr[1] = window_width;
+	surface_attr[3] = window_height;
+	egl_surface = eglCreatePbufferSurface(egl_display, config, surface_attr);
+	if (egl_surface == EGL_NO_SURFACE) {
+		sys_error("eglCreatePbufferSurface() failed.");
+		cleanup_headless();
+		return false;
+	}
+
+	/* Create a context. */
+	eglBindAPI(EGL_OPENGL_API);
+	egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, NULL);
+	if (egl_context == EGL_NO_CONTEXT) {
+		sys_error("eglCreateContext() failed.");
+		cleanup_headless();
+		return false;
+	}
+	eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context);
+
+	/* Get the API pointers. */
+	if (!load_api()) {
+		cleanup_headless();
+		return false;
+	}
+
+	/* Initialize the OpenGL rendering subsystem. */
+	if (!glrender_init(0, 0, window_width, window_height)) {
+		cleanup_headless();
+		return false;
+	}
+
+	sys_log("Headless: %s, %d frames\n", (const char *)glGetString(GL_RENDERER), headless_frames);
+
+	return true;
+}
+
+/* Cleanup the offscreen surface. */
+static void cleanup_headless(void)
+{
+	if (egl_display == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+	if (egl_context != EGL_NO_CONTEXT) {
+		eglDestroyContext(egl_display, egl_context);
+		egl_context = EGL_NO_CONTEXT;
+	}
+
+	if (egl_surface != EGL_NO_SURFACE) {
+		eglDestroySurface(egl_display, egl_surface);
+		egl_surface = EGL_NO_SURFACE;
+	}
+
+	eglTerminate(egl_display);
+	egl_display = EGL_NO_DISPLAY;
+}
+
+/* Get the API pointers. */
+static bool load_api(void)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(api)/sizeof(struct API)); i++) {
+		*api[i].func = get_proc_address(api[i].name);
+		if(*api[i].func == NULL && !api[i].is_optional) {
+			sys_error("Failed to get API %s().", api[i].name);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Set the program binary cache directory.
+ *  - $XDG_CACHE_HOME/gamekit or ~/.cache/gamekit
+ */
+static void init_program_cache(void)
+{
+	char dir[1024];
+	const char *base;
+
+	if (is_program_cache_disabled)
+		return;
+
+	base = getenv("XDG_CACHE_HOME");
+	if (base != NULL && base[0] != '\0') {
+		snprintf(dir, sizeof(dir), "%s", base);
+	} else {
+		base = getenv("HOME");
+		if (base == NULL || base[0] == '\0')
+			return;
+		snprintf(dir, sizeof(dir), "%s/.cache", base);
+	}
+	mkdir(dir, 0700);
+
+	strncat(dir, "/gamekit", sizeof(dir) - strlen(dir) - 1);
+	mkdir(dir, 0700);
+
+	glrender_set_program_cache_dir(dir);
+}
+
+/* Get an API pointer from GLX or EGL. */
+static void *get_proc_address(const char *name)
+{
+	if (is_headless)
+		return (void *)eglGetProcAddress(name);
+
+	return (void *)glXGetProcAddress((const unsigned char *)name);
+}
+
 /* Run a game loop. */
 static void run_game_loop(void)
 {
-	/* Get the frame start time. */
-	gettimeofday(&tv_start, NULL);
+	if (is_render_thread_enabled && !start_render_thread())
+		return;
+	if (!start_update_thread()) {
+		if (is_render_thread_enabled)
+			stop_render_thread();
+		return;
+	}
+
+	/* Set the deadline of the first frame. */
+	reset_frame_deadline();
 
 	/* Main Loop. */
 	while (true) {
+		prof_begin_frame();
+
 		/* Run a frame. */
-		if (!on_hal_frame())
+		if (!run_frame()) {
+			prof_end_frame();
 			break;
+		}
 
-		/* Swap buffers. */
-		glXSwapBuffers(display, glx_window);
+		/* Swap buffers, or hand the frame to the render thread. */
+		present_frame();
 
 		/* Wait for the next frame timing. */
-		if (!wait_for_next_frame())
+		prof_begin_zone("wait");
+		if (!wait_for_next_frame()) {
+			prof_end_zone();
+			prof_end_frame();
 			break;	/* Close button was pressed. */
+		}
+		prof_end_zone();
+
+		prof_end_frame();
+	}
+
+	stop_update_thread();
+	if (is_render_thread_enabled)
+		stop_render_thread();
+}
+
+/*
+ * Run a fixed number of frames offscreen without waiting, and report
+ * the CPU time of each frame. (the thread CPU time excludes the time
+ * of the rasterizer threads)
+ */
+static void run_headless_loop(void)
+{
+	struct timespec cpu_start, cpu_end, wall_start, wall_end;
+	double *cpu, *wall;
+	int frame;
+
+	cpu = malloc(sizeof(double) * (size_t)headless_frames);
+	wall = malloc(sizeof(double) * (size_t)headless_frames);
+	if (cpu == NULL || wall == NULL) {
+		sys_out_of_memory();
+		free(cpu);
+		free(wall);
+		return;
+	}
+
+	if (is_render_thread_enabled && !start_render_thread()) {
+		free(cpu);
+		free(wall);
+		return;
+	}
+	if (!start_update_thread()) {
+		if (is_render_thread_enabled)
+			stop_render_thread();
+		free(cpu);
+		free(wall);
+		return;
+	}
 
-		/* Get the frame start time. */
-		gettimeofday(&tv_start, NULL);
+	for (frame = 0; frame < headless_frames; frame++) {
+		clock_gettime(CLOCK_MONOTONIC, &wall_start);
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+		prof_begin_frame();
+
+		/* Run a frame. */
+		if (!run_frame()) {
+			/* Render the last frame to dump. */
+			if (is_render_thread_enabled)
+				submit_render_frame();
+			prof_end_frame();
+			break;
+		}
+
+		present_frame();
+
+		prof_end_frame();
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+		clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+		cpu[frame] = get_elapsed_milli(&cpu_start, &cpu_end);
+		wall[frame] = get_elapsed_milli(&wall_start, &wall_end);
+	}
+
+	/* Finish the last frame on the render thread. */
+	stop_update_thread();
+	if (is_render_thread_enabled)
+		stop_render_thread();
+
+	/* Read back the last frame. (a pbuffer is single-buffered) */
+	if (dump_file != NULL)
+		dump_frame();
+
+	report_timings(cpu, wall, frame);
+
+	free(cpu);
+	free(wall);
+}
+
+/*
+ * Start the render thread.  The GL context is moved to the render
+ * thread, and the submitted command lists are replayed there.
+ */
+static bool start_render_thread(void)
+{
+	make_context_current(false);
+	stdrendercmd_set_deferred(true);
+
+	is_render_frame_ready = false;
+	is_render_thread_quit = false;
+	if (pthread_create(&render_thread, NULL, render_thread_main, NULL) != 0) {
+		sys_error("Failed to create the render thread.");
+		stdrendercmd_set_deferred(false);
+		make_context_current(true);
+		return false;
 	}
+
+	return true;
+}
+
+/*
+ * Stop the render thread after the frame handed to it, and move the GL
+ * context back to the main thread.
+ */
+static void stop_render_thread(void)
+{
+	pthread_mutex_lock(&render_mutex);
+	is_render_thread_quit = true;
+	pthread_cond_broadcast(&render_cond);
+	pthread_mutex_unlock(&render_mutex);
+
+	pthread_join(render_thread, NULL);
+
+	stdrendercmd_set_deferred(false);
+	make_context_current(true);
+}
+
+/* Render thread main. */
+static void *render_thread_main(void *arg)
+{
+	UNUSED_PARAMETER(arg);
+
+	prof_set_track(PROF_TRACK_RENDER);
+	make_context_current(true);
+
+	while (true) {
+		/* Wait for a frame. */
+		pthread_mutex_lock(&render_mutex);
+		while (!is_render_frame_ready && !is_render_thread_quit)
+			pthread_cond_wait(&render_cond, &render_mutex);
+		if (!is_render_frame_ready) {
+			pthread_mutex_unlock(&render_mutex);
+			break;
+		}
+		pthread_mutex_unlock(&render_mutex);
+
+		/* Replay the frame. */
+		prof_begin_frame();
+		prof_begin_zone("replay");
+		render_begin_frame();
+		stdrendercmd_replay_frame();
+		render_end_frame();
+		prof_end_zone();
+		prof_begin_zone("swap");
+		swap_buffers();
+		prof_end_zone();
+		record_gpu_time();
+		prof_end_frame();
+
+		/* Let the game thread hand the next frame. */
+		pthread_mutex_lock(&render_mutex);
+		is_render_frame_ready = false;
+		pthread_cond_broadcast(&render_cond);
+		pthread_mutex_unlock(&render_mutex);
+	}
+
+	make_context_current(false);
+
+	return NULL;
+}
+
+/*
+ * Hand the lists submitted in this frame to the render thread.  This
+ * waits only while the render thread is still replaying the previous
+ * frame.
+ */
+static void submit_render_frame(void)
+{
+	pthread_mutex_lock(&render_mutex);
+	while (is_render_frame_ready)
+		pthread_cond_wait(&render_cond, &render_mutex);
+	stdrendercmd_swap_frame();
+	is_render_frame_ready = true;
+	pthread_cond_broadcast(&render_cond);
+	pthread_mutex_unlock(&render_mutex);
+}
+
+/* Run the frame callback. */
+static bool run_frame(void)
+{
+	bool ret;
+
+	if (fixed_loop.tick_rate > 0)
+		return run_fixed_frame();
+
+	prof_begin_zone("on_hal_frame");
+	ret = on_hal_frame();
+	prof_end_zone();
+
+	return ret;
+}
+
+/*
+ * Use the fixed-timestep loop.
+ */
+void sys_set_fixed_loop(const struct sys_fixed_loop *loop)
+{
+	assert(loop != NULL);
+	assert(loop->tick_rate > 0);
+	assert(loop->on_update != NULL);
+	assert(loop->on_render != NULL);
+
+	fixed_loop = *loop;
+	if (fixed_loop.max_catch_up < 1)
+		fixed_loop.max_catch_up = 1;
+
+	tick_nano = 1000000000ULL / (uint64_t)fixed_loop.tick_rate;
+	tick_accum = 0;
+	tick_last = sys_get_nano_tick();
+	tick_sched = tick_last;
+}
+
+/* Run the ticks due and render a frame. */
+static bool run_fixed_frame(void)
+{
+	uint64_t now, elapsed;
+	float alpha;
+	bool ret;
+	int i;
+
+	now = sys_get_nano_tick();
+
+	/* The update thread runs the ticks. */
+	if (fixed_loop.is_threaded) {
+		pthread_mutex_lock(&update_mutex);
+		if (is_update_finished) {
+			pthread_mutex_unlock(&update_mutex);
+			return false;
+		}
+		elapsed = now > tick_sched ? now - tick_sched : 0;
+		alpha = (float)((double)elapsed / (double)tick_nano);
+		if (alpha > 1.0f)
+			alpha = 1.0f;
+		prof_begin_zone("on_render");
+		ret = fixed_loop.on_render(alpha);
+		prof_end_zone();
+		pthread_mutex_unlock(&update_mutex);
+		return ret;
+	}
+
+	/* Run the ticks due, up to the cap. */
+	tick_accum += now - tick_last;
+	tick_last = now;
+	for (i = 0; i < fixed_loop.max_catch_up && tick_accum >= tick_nano; i++) {
+		prof_begin_zone("on_update");
+		ret = fixed_loop.on_update((float)((double)tick_nano / 1000000000.0));
+		prof_end_zone();
+		if (!ret)
+			return false;
+		tick_accum -= tick_nano;
+	}
+
+	/* Drop the delay that can't be caught up. */
+	if (tick_accum >= tick_nano)
+		tick_accum %= tick_nano;
+
+	alpha = (float)((double)tick_accum / (double)tick_nano);
+
+	prof_begin_zone("on_render");
+	ret = fixed_loop.on_render(alpha);
+	prof_end_zone();
+
+	return ret;
+}
+
+/* Start the update thread if the fixed-timestep loop is threaded. */
+static bool start_update_thread(void)
+{
+	if (fixed_loop.tick_rate == 0 || !fixed_loop.is_threaded)
+		return true;
+
+	is_update_thread_quit = false;
+	is_update_finished = false;
+	tick_sched = sys_get_nano_tick();
+	if (pthread_create(&update_thread, NULL, update_thread_main, NULL) != 0) {
+		sys_error("Failed to create the update thread.");
+		return false;
+	}
+
+	return true;
+}
+
+/* Stop the update thread. */
+static void stop_update_thread(void)
+{
+	if (fixed_loop.tick_rate == 0 || !fixed_loop.is_threaded)
+		return;
+
+	pthread_mutex_lock(&update_mutex);
+	is_update_thread_quit = true;
+	pthread_mutex_unlock(&update_mutex);
+
+	pthread_join(update_thread, NULL);
+}
+
+/* Update thread main. */
+static void *update_thread_main(void *arg)
+{
+	struct timespec ts;
+	uint64_t next, now;
+	float dt;
+	bool ret;
+	int i;
+
+	UNUSED_PARAMETER(arg);
+
+	dt = (float)((double)tick_nano / 1000000000.0);
+	next = tick_sched + tick_nano;
+	while (true) {
+		/* Run the ticks due, up to the cap. */
+		now = sys_get_nano_tick();
+		for (i = 0; i < fixed_loop.max_catch_up && now >= next; i++) {
+			pthread_mutex_lock(&update_mutex);
+			if (is_update_thread_quit) {
+				pthread_mutex_unlock(&update_mutex);
+				return NULL;
+			}
+			ret = fixed_loop.on_update(dt);
+			tick_sched = next;
+			if (!ret)
+				is_update_finished = true;
+			pthread_mutex_unlock(&update_mutex);
+			if (!ret)
+				return NULL;
+			next += tick_nano;
+		}
+
+		/* Drop the delay that can't be caught up. */
+		if (now >= next) {
+			next = now + tick_nano;
+			pthread_mutex_lock(&update_mutex);
+			tick_sched = now;
+			pthread_mutex_unlock(&update_mutex);
+		}
+
+		pthread_mutex_lock(&update_mutex);
+		if (is_update_thread_quit) {
+			pthread_mutex_unlock(&update_mutex);
+			return NULL;
+		}
+		pthread_mutex_unlock(&update_mutex);
+
+		/* Sleep until the next tick. */
+		ts.tv_sec = (time_t)(next / 1000000000ULL);
+		ts.tv_nsec = (long)(next % 1000000000ULL);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+}
+
+/* Swap buffers, or hand the frame to the render thread. */
+static void present_frame(void)
+{
+	if (is_render_thread_enabled) {
+		prof_begin_zone("submit");
+		submit_render_frame();
+		prof_end_zone();
+	} else {
+		prof_begin_zone("swap");
+		swap_buffers();
+		prof_end_zone();
+		record_gpu_time();
+	}
+}
+
+/* Pass the latest GPU time to the prof module. */
+static void record_gpu_time(void)
+{
+	float ms;
+
+	if (render_get_gpu_time(&ms))
+		prof_set_gpu_time(ms);
+}
+
+/* Make the GL context current or not current on the calling thread. */
+static void make_context_current(bool is_current)
+{
+	if (is_headless) {
+		if (is_current)
+			eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context);
+		else
+			eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	} else {
+		if (is_current)
+			glXMakeContextCurrent(display, glx_window, glx_window, glx_context);
+		else
+			glXMakeContextCurrent(display, None, None, None);
+	}
+}
+
+/* Swap the buffers. */
+static void swap_buffers(void)
+{
+	if (is_headless)
+		eglSwapBuffers(egl_display, egl_surface);
+	else
+		glXSwapBuffers(display, glx_window);
+}
+
+/* Get an elapsed time in milliseconds. */
+static double get_elapsed_milli(struct timespec *start, struct timespec *end)
+{
+	return (double)(end->tv_sec - start->tv_sec) * 1000.0 +
+	       (double)(end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/* Compare doubles for qsort(). */
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Print a summary of the timings, and write the per-frame timings. */
+static void report_timings(double *cpu, double *wall, int count)
+{
+	FILE *fp;
+	double sum;
+	int i;
+
+	if (count <= 0)
+		return;
+
+	/* Write the per-frame timings before sorting. */
+	if (timings_file != NULL) {
+		fp = fopen(timings_file, "w");
+		if (fp == NULL) {
+			sys_error("Cannot open %s.\n", timings_file);
+		} else {
+			fprintf(fp, "frame,cpu_ms,wall_ms\n");
+			for (i = 0; i < count; i++)
+				fprintf(fp, "%d,%.4f,%.4f\n", i, cpu[i], wall[i]);
+			fclose(fp);
+		}
+	}
+
+	sum = 0;
+	for (i = 0; i < count; i++)
+		sum += cpu[i];
+	qsort(cpu, (size_t)count, sizeof(double), compare_double);
+	qsort(wall, (size_t)count, sizeof(double), compare_double);
+
+	sys_log("Frame CPU: avg %.3f ms, min %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms (%d frames)\n",
+		sum / count,
+		cpu[0],
+		cpu[count / 2],
+		cpu[count * 99 / 100],
+		cpu[count - 1],
+		count);
+	sys_log("Frame wall: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		wall[count / 2],
+		wall[count * 99 / 100],
+		wall[count - 1]);
+}
+
+/* Write the framebuffer to a PPM file. */
+static bool dump_frame(void)
+{
+	struct image *img;
+	pixel_t *p;
+	FILE *fp;
+	int i;
+
+	if (!image_create(window_width, window_height, &img))
+		return false;
+	if (!render_read_pixels(img)) {
+		image_destroy(img);
+		return false;
+	}
+
+	fp = fopen(dump_file, "wb");
+	if (fp == NULL) {
+		sys_error("Cannot open %s.\n", dump_file);
+		image_destroy(img);
+		return false;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", window_width, window_height);
+	p = image_get_pixels(img);
+	for (i = 0; i < window_width * window_height; i++) {
+		fputc((int)get_pixel_r(p[i]), fp);
+		fputc((int)get_pixel_g(p[i]), fp);
+		fputc((int)get_pixel_b(p[i]), fp);
+	}
+	fclose(fp);
+	image_destroy(img);
+
+	return true;
 }
 
 /* Wait for the next frame timing. */
 static bool wait_for_next_frame(void)
 {
-	struct timeval tv_end;
-	uint32_t lap, wait, span;
+	int64_t rest, spin;
+	int timeout;
+	struct pollfd pfd;
+	struct timespec ts;
+
+	/* The buffer swap has already waited for the vertical blank. */
+	if (is_vsync_enabled)
+		return process_events();
+
+	/* Advance the deadline, or restart from now if a frame is missed. */
+	frame_deadline.tv_nsec += FRAME_NANO;
+	while (frame_deadline.tv_nsec >= 1000000000L) {
+		frame_deadline.tv_sec++;
+		frame_deadline.tv_nsec -= 1000000000L;
+	}
+	if (get_nano_until(&frame_deadline) < -FRAME_NANO)
+		reset_frame_deadline();
+
+	pfd.fd = ConnectionNumber(display);
+	pfd.events = POLLIN;
+	spin = (int64_t)spin_micro * 1000;
+
+	/* Process events as they arrive until the deadline. */
+	while (true) {
+		if (!process_events())
+			return false;
+
+		rest = get_nano_until(&frame_deadline);
+		if (rest <= 0)
+			break;
+
+		if (rest - spin >= MILLI_NANO) {
+			/* Sleep on the X connection for whole millisecs. */
+			timeout = (int)((rest - spin) / MILLI_NANO);
+			poll(&pfd, 1, timeout);
+		} else if (rest > spin) {
+			/* Sleep for the fraction. */
+			ts = frame_deadline;
+			ts.tv_nsec -= (long)spin;
+			while (ts.tv_nsec < 0) {
+				ts.tv_sec--;
+				ts.tv_nsec += 1000000000L;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		}
+
+		/* Otherwise, spin. */
+	}
+
+	return true;
+}
+
+/* Process the queued events. (false if the close button was pressed) */
+static bool process_events(void)
+{
+	bool ret;
 
-	span = FRAME_MILLI;
+	/* Don't record a zone for each wakeup without events. */
+	if (XEventsQueued(display, QueuedAfterFlush) == 0)
+		return true;
 
-	/* Do event processing and sleep until the time of next frame start. */
+	prof_begin_zone("events");
+	ret = true;
 	do {
-		/* Process events if exist. */
-		while (XEventsQueued(display, QueuedAfterFlush) > 0)
-			if (!next_event())
-				return false;
-
-		/* Get a lap time. */
-		gettimeofday(&tv_end, NULL);
-		lap = (uint32_t)((tv_end.tv_sec - tv_start.tv_sec) * 1000 +
-				 (tv_end.tv_usec - tv_start.tv_usec) / 1000);
-
-		/* Break if the time has come. */
-		if (lap > span) {
-			tv_start = tv_end;
+		if (!next_event()) {
+			ret = false;
 			break;
 		}
+	} while (XEventsQueued(display, QueuedAfterFlush) > 0);
+	prof_end_zone();
+
+	return ret;
+}
+
+/* Set the deadline of the current frame to now. */
+static void reset_frame_deadline(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &frame_deadline);
+}
 
-		/* Calc a sleep time. */
-		wait = (span - lap > SLEEP_MILLI) ? SLEEP_MILLI : span - lap;
+/* Get nanosecs until a deadline. (negative if passed) */
+static int64_t get_nano_until(struct timespec *deadline)
+{
+	struct timespec now;
 
-		/* Do sleep. */
-		usleep(wait * 1000);
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	} while(wait > 0);
+	return (int64_t)(deadline->tv_sec - now.tv_sec) * 1000000000LL +
+	       (int64_t)(deadline->tv_nsec - now.tv_nsec);
+}
 
-	return true;
+/*
+ * Enable the swap interval for the vsync mode.  Falls back to the
+ * timer if the driver can't do it.
+ */
+static void init_vsync(void)
+{
+	void (*glXSwapIntervalEXT)(Display *dpy, GLXDrawable drawable, int interval);
+	int (*glXSwapIntervalMESA)(unsigned int interval);
+
+	glXSwapIntervalEXT = (void *)glXGetProcAddress((const unsigned char *)"glXSwapIntervalEXT");
+	if (glXSwapIntervalEXT != NULL) {
+		glXSwapIntervalEXT(display, glx_window, 1);
+		return;
+	}
+
+	glXSwapIntervalMESA = (void *)glXGetProcAddress((const unsigned char *)"glXSwapIntervalMESA");
+	if (glXSwapIntervalMESA != NULL && glXSwapIntervalMESA(1) == 0)
+		return;
+
+	sys_log("Swap interval is not supported. Using the timer.\n");
+	is_vsync_enabled = false;
 }
 
 /* Process an event. */
@@ -490,6 +1502,11 @@ static bool next_event(void)
 	case MotionNotify:
 		on_motion_notify(&event);
 		break;
+#if defined(HAVE_XINPUT2)
+	case GenericEvent:
+		on_generic_event(&event);
+		break;
+#endif
 	case MappingNotify:
 		XRefreshKeyboardMapping(&event.xmapping);
 		break;
@@ -514,6 +1531,7 @@ static void on_key_press(XEvent *event)
 	assert(key < KEY_CODE_SIZE);
 
 	is_key_pressed[key] = true;
+	push_event(INPUT_EVENT_KEY_DOWN, key, 0, 0);
 }
 
 /* Process a KeyRelease event. */
@@ -540,6 +1558,7 @@ static void on_key_release(XEvent *event)
 	assert(key < KEY_CODE_SIZE);
 
 	is_key_pressed[key] = false;
+	push_event(INPUT_EVENT_KEY_UP, key, 0, 0);
 }
 
 /* Convert 'KeySym' to 'enum key_code'. */
@@ -578,33 +1597,55 @@ static int get_key_code(XEvent *event)
 /* Process a ButtonPress event. */
 static void on_button_press(XEvent *event)
 {
+	int x, y;
+
+	x = event->xbutton.x;
+	y = event->xbutton.y;
+
 	switch (event->xbutton.button) {
 	case Button1:
 		is_mouse_left_pressed = true;
+		push_event(INPUT_EVENT_MOUSE_DOWN, MOUSE_LEFT, x, y);
+		break;
+	case Button2:
+		push_event(INPUT_EVENT_MOUSE_DOWN, MOUSE_MIDDLE, x, y);
 		break;
 	case Button3:
 		is_mouse_right_pressed = true;
+		push_event(INPUT_EVENT_MOUSE_DOWN, MOUSE_RIGHT, x, y);
 		break;
 	case Button4:
 		is_mouse_up_pressed = true;
+		push_event(INPUT_EVENT_WHEEL, 0, 0, 1);
 		break;
 	case Button5:
 		is_mouse_down_pressed = true;
+		push_event(INPUT_EVENT_WHEEL, 0, 0, -1);
 		break;
 	default:
 		break;
 	}
 }
 
-/* Process a ButtonPress event. */
+/* Process a ButtonRelease event. */
 static void on_button_release(XEvent *event)
 {
+	int x, y;
+
+	x = event->xbutton.x;
+	y = event->xbutton.y;
+
 	switch (event->xbutton.button) {
 	case Button1:
-		is_mouse_left_pressed = true;
+		is_mouse_left_pressed = false;
+		push_event(INPUT_EVENT_MOUSE_UP, MOUSE_LEFT, x, y);
+		break;
+	case Button2:
+		push_event(INPUT_EVENT_MOUSE_UP, MOUSE_MIDDLE, x, y);
 		break;
 	case Button3:
-		is_mouse_right_pressed = true;
+		is_mouse_right_pressed = false;
+		push_event(INPUT_EVENT_MOUSE_UP, MOUSE_RIGHT, x, y);
 		break;
 	}
 }
@@ -614,7 +1655,87 @@ static void on_motion_notify(XEvent *event)
 {
 	mouse_pos_x = event->xmotion.x;
 	mouse_pos_y = event->xmotion.y;
+	push_event(INPUT_EVENT_MOUSE_MOVE, 0, mouse_pos_x, mouse_pos_y);
+}
+
+/* Put an event to the input queue with the current time. */
+static void push_event(int type, int code, int x, int y)
+{
+	struct input_event ev;
+
+	ev.type = type;
+	ev.code = code;
+	ev.x = x;
+	ev.y = y;
+	ev.time = sys_get_nano_tick();
+	input_push_event(&ev);
+}
+
+#if defined(HAVE_XINPUT2)
+/* Select the XInput2 raw motion events if the server supports them. */
+static void init_xinput2(void)
+{
+	XIEventMask mask;
+	unsigned char bits[XIMaskLen(XI_LASTEVENT)];
+	int event, error, major, minor;
+
+	if (!XQueryExtension(display, "XInputExtension", &xi_opcode, &event, &error)) {
+		xi_opcode = -1;
+		return;
+	}
+
+	major = 2;
+	minor = 0;
+	if (XIQueryVersion(display, &major, &minor) != Success) {
+		xi_opcode = -1;
+		return;
+	}
+
+	/* Raw events are delivered to the root window. */
+	memset(bits, 0, sizeof(bits));
+	XISetMask(bits, XI_RawMotion);
+	mask.deviceid = XIAllMasterDevices;
+	mask.mask_len = sizeof(bits);
+	mask.mask = bits;
+	XISelectEvents(display, DefaultRootWindow(display), &mask, 1);
+}
+
+/* Process a GenericEvent event. */
+static void on_generic_event(XEvent *event)
+{
+	XIRawEvent *raw;
+	double v[2];
+	int i, n, dx, dy;
+
+	if (event->xcookie.extension != xi_opcode)
+		return;
+	if (!XGetEventData(display, &event->xcookie))
+		return;
+
+	if (event->xcookie.evtype == XI_RawMotion) {
+		/* The values are packed for the valuators set in the mask. */
+		raw = event->xcookie.data;
+		v[0] = v[1] = 0;
+		n = 0;
+		for (i = 0; i < 2 && i < raw->valuators.mask_len * 8; i++) {
+			if (XIMaskIsSet(raw->valuators.mask, i))
+				v[i] = raw->raw_values[n++];
+		}
+
+		/* Carry the fractions to the next event, for slow motion. */
+		v[0] += raw_rest[0];
+		v[1] += raw_rest[1];
+		dx = (int)v[0];
+		dy = (int)v[1];
+		raw_rest[0] = v[0] - dx;
+		raw_rest[1] = v[1] - dy;
+		if (dx != 0 || dy != 0)
+			push_event(INPUT_EVENT_MOUSE_RAW_MOVE, 0, dx, dy);
+	}
+
+	XFreeEventData(display, &event->xcookie);
 }
+#endif
 
 
 /*
@@ -733,6 +1854,18 @@ uint64_t sys_get_tick(void)
 	return (uint64_t)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
 }
 
+/*
+ * Get a monotonic nanosecond time.
+ */
+uint64_t sys_get_nano_tick(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
 /*
  * Get a two-letter language code of a system.
  */
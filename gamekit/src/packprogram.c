@@ -0,0 +1,608 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * packprogram.c: Package maker.
+ *
+ * Usage:
+ *  pack [-s] [-k chunk_kb] <game.dat> <directory>
+ *      Make a package of the files under a directory.
+ *      -s stores all files without compression.
+ *  pack -t <game.dat> <directory>
+ *      Load all files of a package from a cold disk, and verify them.
+ */
+
+/*
+ * [Codec]
+ *
+ * A codec is chosen per file type:
+ *  - Compressed formats (images, sounds, archives) are stored.
+ *  - Texts are compressed by brotli.
+ *  - Other files are compressed by the codec that makes the first chunk
+ *    the smallest.  bzip2 decodes a few times slower than the others,
+ *    so it is taken only if it is 10% smaller.
+ *  - A file that shrinks less than 5% is stored.
+ */
+
+#include "gamekit/gamekit.h"
+#include "stdfile.h"
+
+#include <stdarg.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Codecs */
+#include <zlib.h>
+#include <bzlib.h>
+#include <brotli/encode.h>
+
+/* Default chunk size. */
+#define CHUNK_SIZE		(256 * 1024)
+
+/* Header size. (magic, version and count) */
+#define HEADER_BYTES		(4 + 4 + 8)
+
+/* Size of an entry. */
+#define ENTRY_BYTES		(STDFILE_NAME_SIZE + 8 + 8 + 8 + 4 + 4)
+
+/* Brotli quality, and the window bits. (a chunk needs no larger window) */
+#define BROTLI_QUALITY		(9)
+#define BROTLI_WINDOW_MIN	(BROTLI_MIN_WINDOW_BITS)
+#define BROTLI_WINDOW_MAX	(24)
+
+/* A file to pack. */
+struct pack_file {
+	/* Name in the package. */
+	char name[STDFILE_NAME_SIZE];
+
+	/* Entry. */
+	uint64_t size;
+	uint64_t offset;
+	uint64_t stored_size;
+	int codec;
+	uint32_t chunk_size;
+};
+
+/* Extensions of compressed formats. */
+static const char *store_ext[] = {
+	"png", "jpg", "jpeg", "webp", "ogg", "mp3", "mp4", "webm", "zip",
+	"gz", "bz2", "br", "ttf", "otf", "woff2", NULL,
+};
+
+/* Extensions of texts. */
+static const char *text_ext[] = {
+	"txt", "ls", "novel", "csv", "json", "xml", "html", "css", "js",
+	"md", "ini", "glsl", "hlsl", "msl", NULL,
+};
+
+/* Files. */
+static struct pack_file *files;
+static int file_count;
+static int file_alloc;
+
+/* Source directory. */
+static const char *src_dir;
+
+/* Package path for -t. */
+static const char *package_path;
+
+/*
+ * Forward declarations.
+ */
+static bool pack(const char *out, bool is_stored, uint32_t chunk_size);
+static bool scan(const char *dir, const char *prefix);
+static int cmp_file(const void *a, const void *b);
+static int choose_codec(const char *name, const uint8_t *data, size_t size, uint32_t chunk_size);
+static bool has_ext(const char *name, const char **ext);
+static size_t compress_chunk(int codec, uint8_t *dst, size_t dst_size, const uint8_t *src, size_t size);
+static size_t bound(size_t size);
+static bool write_entry(FILE *fp, struct pack_file *pf, int index, uint8_t *data, uint32_t chunk_size);
+static bool write_at(FILE *fp, uint64_t offset, void *buf, size_t size, int index, uint64_t pos);
+static bool test(void);
+static char *make_path(const char *file);
+static double now(void);
+
+int main(int argc, char *argv[])
+{
+	uint32_t chunk_size;
+	bool is_stored, is_test;
+	int i, j;
+
+	is_stored = false;
+	is_test = false;
+	chunk_size = CHUNK_SIZE;
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-s") == 0) {
+			is_stored = true;
+		} else if (strcmp(argv[i], "-t") == 0) {
+			is_test = true;
+		} else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+			chunk_size = (uint32_t)atoi(argv[++i]) * 1024;
+		} else {
+			break;
+		}
+	}
+	if (argc - i != 2 || chunk_size == 0) {
+		printf("Usage: pack [-s] [-k chunk_kb] <game.dat> <directory>\n");
+		printf("       pack -t <game.dat> <directory>\n");
+		return 1;
+	}
+	src_dir = argv[i + 1];
+
+	/* List the files. */
+	if (!scan(src_dir, ""))
+		return 1;
+	qsort(files, (size_t)file_count, sizeof(struct pack_file), cmp_file);
+	if (file_count > STDFILE_ENTRY_MAX) {
+		printf("Too many files.\n");
+		return 1;
+	}
+
+	/* The names are case-insensitive in a package. (sorted so) */
+	for (j = 1; j < file_count; j++) {
+		if (strcasecmp(files[j - 1].name, files[j].name) == 0) {
+			printf("%s and %s have the same name.\n", files[j - 1].name, files[j].name);
+			return 1;
+		}
+	}
+
+	if (is_test) {
+		package_path = argv[i];
+		return test() ? 0 : 1;
+	}
+	return pack(argv[i], is_stored, chunk_size) ? 0 : 1;
+}
+
+/* Make a package. */
+static bool pack(const char *out, bool is_stored, uint32_t chunk_size)
+{
+	uint8_t header[HEADER_BYTES], entry[ENTRY_BYTES];
+	char path[1024];
+	struct pack_file *pf;
+	uint64_t offset, total, stored;
+	uint32_t u32;
+	uint64_t u64;
+	uint8_t *data;
+	FILE *fp, *src;
+	long len;
+	int i, codec_count[4];
+
+	fp = fopen(out, "wb");
+	if (fp == NULL) {
+		printf("Cannot open %s.\n", out);
+		return false;
+	}
+
+	/* Write the bodies after the index. */
+	memset(codec_count, 0, sizeof(codec_count));
+	total = 0;
+	stored = 0;
+	offset = HEADER_BYTES + (uint64_t)file_count * ENTRY_BYTES;
+	for (i = 0; i < file_count; i++) {
+		pf = &files[i];
+
+		/* Read the file. */
+		snprintf(path, sizeof(path), "%s/%s", src_dir, pf->name);
+		src = fopen(path, "rb");
+		if (src == NULL) {
+			printf("Cannot open %s.\n", path);
+			fclose(fp);
+			return false;
+		}
+		fseek(src, 0, SEEK_END);
+		len = ftell(src);
+		rewind(src);
+		data = malloc(len > 0 ? (size_t)len : 1);
+		if (data == NULL || (len > 0 && fread(data, (size_t)len, 1, src) < 1)) {
+			printf("Cannot read %s.\n", path);
+			free(data);
+			fclose(src);
+			fclose(fp);
+			return false;
+		}
+		fclose(src);
+
+		/* Write the body. */
+		pf->size = (uint64_t)len;
+		pf->offset = offset;
+		pf->codec = is_stored ? STDFILE_CODEC_STORE : choose_codec(pf->name, data, (size_t)len, chunk_size);
+		if (!write_entry(fp, pf, i, data, chunk_size)) {
+			printf("Cannot write %s.\n", out);
+			free(data);
+			fclose(fp);
+			return false;
+		}
+		free(data);
+
+		offset += pf->stored_size;
+		total += pf->size;
+		stored += pf->stored_size;
+		codec_count[pf->codec]++;
+	}
+
+	/* Write the header. */
+	memcpy(header, "GKPK", 4);
+	u32 = HOSTTOLE32(STDFILE_PACKAGE_VERSION);
+	memcpy(header + 4, &u32, 4);
+	u64 = HOSTTOLE64((uint64_t)file_count);
+	memcpy(header + 8, &u64, 8);
+	if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(header, HEADER_BYTES, 1, fp) < 1) {
+		printf("Cannot write %s.\n", out);
+		fclose(fp);
+		return false;
+	}
+
+	/* Write the index. */
+	for (i = 0; i < file_count; i++) {
+		pf = &files[i];
+		memset(entry, 0, sizeof(entry));
+		strcpy((char *)entry, pf->name);
+		stdfile_crypt(entry, STDFILE_NAME_SIZE, (uint64_t)i, true, 0);
+		u64 = HOSTTOLE64(pf->size);
+		memcpy(entry + STDFILE_NAME_SIZE, &u64, 8);
+		u64 = HOSTTOLE64(pf->offset);
+		memcpy(entry + STDFILE_NAME_SIZE + 8, &u64, 8);
+		u64 = HOSTTOLE64(pf->stored_size);
+		memcpy(entry + STDFILE_NAME_SIZE + 16, &u64, 8);
+		u32 = HOSTTOLE32((uint32_t)pf->codec);
+		memcpy(entry + STDFILE_NAME_SIZE + 24, &u32, 4);
+		u32 = HOSTTOLE32(pf->chunk_size);
+		memcpy(entry + STDFILE_NAME_SIZE + 28, &u32, 4);
+		if (fwrite(entry, ENTRY_BYTES, 1, fp) < 1) {
+			printf("Cannot write %s.\n", out);
+			fclose(fp);
+			return false;
+		}
+	}
+	if (fclose(fp) != 0) {
+		printf("Cannot write %s.\n", out);
+		return false;
+	}
+
+	printf("%d files, %llu bytes -> %llu bytes (%.1f%%)\n",
+	       file_count,
+	       (unsigned long long)total,
+	       (unsigned long long)stored,
+	       total > 0 ? (double)stored * 100.0 / (double)total : 100.0);
+	printf("store %d, zlib %d, bzip2 %d, brotli %d\n",
+	       codec_count[STDFILE_CODEC_STORE],
+	       codec_count[STDFILE_CODEC_ZLIB],
+	       codec_count[STDFILE_CODEC_BZIP2],
+	       codec_count[STDFILE_CODEC_BROTLI]);
+	return true;
+}
+
+/* List the regular files under a directory. */
+static bool scan(const char *dir, const char *prefix)
+{
+	char path[1024], name[STDFILE_NAME_SIZE];
+	struct dirent *d;
+	struct stat st;
+	DIR *dp;
+
+	dp = opendir(dir);
+	if (dp == NULL) {
+		printf("Cannot open %s.\n", dir);
+		return false;
+	}
+	while ((d = readdir(dp)) != NULL) {
+		if (d->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, d->d_name);
+		if (snprintf(name, sizeof(name), "%s%s", prefix, d->d_name) >= (int)sizeof(name)) {
+			printf("Too long file name %s.\n", path);
+			closedir(dp);
+			return false;
+		}
+		if (stat(path, &st) != 0)
+			continue;
+		if (S_ISDIR(st.st_mode)) {
+			strcat(name, "/");
+			if (!scan(path, name)) {
+				closedir(dp);
+				return false;
+			}
+			continue;
+		}
+		if (!S_ISREG(st.st_mode))
+			continue;
+
+		/* Add a file. */
+		if (file_count == file_alloc) {
+			file_alloc = file_alloc == 0 ? 256 : file_alloc * 2;
+			files = realloc(files, (size_t)file_alloc * sizeof(struct pack_file));
+			if (files == NULL) {
+				printf("Out of memory.\n");
+				closedir(dp);
+				return false;
+			}
+		}
+		memset(&files[file_count], 0, sizeof(struct pack_file));
+		strcpy(files[file_count].name, name);
+		file_count++;
+	}
+	closedir(dp);
+	return true;
+}
+
+/* Compare file names. (ignoring the case) */
+static int cmp_file(const void *a, const void *b)
+{
+	return strcasecmp(((const struct pack_file *)a)->name, ((const struct pack_file *)b)->name);
+}
+
+/* Choose a codec for a file. */
+static int choose_codec(const char *name, const uint8_t *data, size_t size, uint32_t chunk_size)
+{
+	uint8_t *buf;
+	size_t len, sample, best_size, zlib_size, bzip2_size, brotli_size;
+	int best;
+
+	if (size == 0 || has_ext(name, store_ext))
+		return STDFILE_CODEC_STORE;
+
+	/* Compress the first chunk. */
+	sample = size < chunk_size ? size : chunk_size;
+	buf = malloc(bound(sample));
+	if (buf == NULL)
+		return STDFILE_CODEC_STORE;
+	len = bound(sample);
+	brotli_size = compress_chunk(STDFILE_CODEC_BROTLI, buf, len, data, sample);
+	if (has_ext(name, text_ext)) {
+		best = STDFILE_CODEC_BROTLI;
+		best_size = brotli_size;
+	} else {
+		zlib_size = compress_chunk(STDFILE_CODEC_ZLIB, buf, len, data, sample);
+		bzip2_size = compress_chunk(STDFILE_CODEC_BZIP2, buf, len, data, sample);
+		best = zlib_size < brotli_size ? STDFILE_CODEC_ZLIB : STDFILE_CODEC_BROTLI;
+		best_size = zlib_size < brotli_size ? zlib_size : brotli_size;
+		if (bzip2_size < best_size - best_size / 10) {
+			best = STDFILE_CODEC_BZIP2;
+			best_size = bzip2_size;
+		}
+	}
+	free(buf);
+
+	/* Store if it doesn't shrink enough. */
+	if (best_size == 0 || best_size > sample - sample / 20)
+		return STDFILE_CODEC_STORE;
+	return best;
+}
+
+/* Check the extension of a file name. */
+static bool has_ext(const char *name, const char **ext)
+{
+	const char *dot;
+	int i;
+
+	dot = strrchr(name, '.');
+	if (dot == NULL || strchr(dot, '/') != NULL)
+		return false;
+	for (i = 0; ext[i] != NULL; i++) {
+		if (strcasecmp(dot + 1, ext[i]) == 0)
+			return true;
+	}
+	return false;
+}
+
+/* Compress a chunk. (0 if failed) */
+static size_t compress_chunk(int codec, uint8_t *dst, size_t dst_size, const uint8_t *src, size_t size)
+{
+	uLongf zlib_size;
+	unsigned int bzip2_size;
+	size_t brotli_size;
+	int window;
+
+	switch (codec) {
+	case STDFILE_CODEC_ZLIB:
+		zlib_size = (uLongf)dst_size;
+		if (compress2(dst, &zlib_size, src, (uLong)size, Z_BEST_COMPRESSION) != Z_OK)
+			return 0;
+		return (size_t)zlib_size;
+	case STDFILE_CODEC_BZIP2:
+		bzip2_size = (unsigned int)dst_size;
+		if (BZ2_bzBuffToBuffCompress((char *)dst, &bzip2_size, (char *)src, (unsigned int)size, 9, 0, 0) != BZ_OK)
+			return 0;
+		return (size_t)bzip2_size;
+	case STDFILE_CODEC_BROTLI:
+		window = BROTLI_WINDOW_MIN;
+		while (window < BROTLI_WINDOW_MAX && ((size_t)1 << window) < size)
+			window++;
+		brotli_size = dst_size;
+		if (!BrotliEncoderCompress(BROTLI_QUALITY, window, BROTLI_MODE_GENERIC, size, src, &brotli_size, dst))
+			return 0;
+		return brotli_size;
+	default:
+		break;
+	}
+	return 0;
+}
+
+/* Get a buffer size for any codec. */
+static size_t bound(size_t size)
+{
+	size_t n;
+
+	/* bzip2 needs 1% + 600 bytes. */
+	n = compressBound((uLong)size);
+	if (n < size + size / 100 + 600)
+		n = size + size / 100 + 600;
+	if (n < BrotliEncoderMaxCompressedSize(size))
+		n = BrotliEncoderMaxCompressedSize(size);
+	return n;
+}
+
+/* Write the body of an entry. */
+static bool write_entry(FILE *fp, struct pack_file *pf, int index, uint8_t *data, uint32_t chunk_size)
+{
+	uint64_t *table;
+	uint8_t *buf;
+	uint64_t count, i, pos;
+	size_t len, packed;
+
+	/* A stored body. */
+	if (pf->codec == STDFILE_CODEC_STORE) {
+		pf->stored_size = pf->size;
+		pf->chunk_size = 0;
+		return write_at(fp, pf->offset, data, (size_t)pf->size, index, 0);
+	}
+
+	/* A compressed body: the chunk table and the chunks. */
+	pf->chunk_size = chunk_size;
+	count = (pf->size + chunk_size - 1) / chunk_size;
+	table = malloc((size_t)count * 8);
+	buf = malloc(bound(chunk_size));
+	if (table == NULL || buf == NULL) {
+		free(table);
+		free(buf);
+		return false;
+	}
+	pos = count * 8;
+	for (i = 0; i < count; i++) {
+		len = (size_t)(pf->size - i * chunk_size);
+		if (len > chunk_size)
+			len = chunk_size;
+		packed = compress_chunk(pf->codec, buf, bound(chunk_size), data + i * chunk_size, len);
+		if (packed == 0 || !write_at(fp, pf->offset + pos, buf, packed, index, pos)) {
+			free(table);
+			free(buf);
+			return false;
+		}
+		pos += packed;
+		table[i] = HOSTTOLE64(pos);
+	}
+	pf->stored_size = pos;
+	if (!write_at(fp, pf->offset, table, (size_t)count * 8, index, 0)) {
+		free(table);
+		free(buf);
+		return false;
+	}
+	free(table);
+	free(buf);
+	return true;
+}
+
+/* Obfuscate and write bytes at a position of a body. (buf is overwritten) */
+static bool write_at(FILE *fp, uint64_t offset, void *buf, size_t size, int index, uint64_t pos)
+{
+	stdfile_crypt(buf, size, (uint64_t)index, false, pos);
+	if (fseek(fp, (long)offset, SEEK_SET) != 0)
+		return false;
+	if (size > 0 && fwrite(buf, size, 1, fp) < 1)
+		return false;
+	return true;
+}
+
+/* Load all files from a cold disk, and verify them. */
+static bool test(void)
+{
+	char path[1024];
+	const void *ptr;
+	size_t size;
+	uint64_t total;
+	uint8_t *data;
+	double t0, t1;
+	FILE *fp;
+	int fd, i, bad;
+
+	/* Drop the package from the page cache. */
+	fd = open(package_path, O_RDONLY);
+	if (fd < 0) {
+		printf("Cannot open %s.\n", package_path);
+		return false;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+
+	/* Load. */
+	t0 = now();
+	if (!stdfile_init(make_path))
+		return false;
+	total = 0;
+	for (i = 0; i < file_count; i++) {
+		if (!file_map(files[i].name, &ptr, &size))
+			return false;
+		total += size;
+		file_unmap(ptr);
+	}
+	t1 = now();
+	printf("%d files, %llu bytes in %.1f ms (%.1f MB/s)\n",
+	       file_count,
+	       (unsigned long long)total,
+	       (t1 - t0) * 1000.0,
+	       (double)total / (t1 - t0) / 1e6);
+
+	/* Verify. */
+	bad = 0;
+	for (i = 0; i < file_count; i++) {
+		snprintf(path, sizeof(path), "%s/%s", src_dir, files[i].name);
+		fp = fopen(path, "rb");
+		if (fp == NULL || !file_map(files[i].name, &ptr, &size)) {
+			if (fp != NULL)
+				fclose(fp);
+			bad++;
+			continue;
+		}
+		data = malloc(size > 0 ? size : 1);
+		if (data == NULL ||
+		    (size > 0 && fread(data, size, 1, fp) < 1) ||
+		    fgetc(fp) != EOF ||
+		    memcmp(data, ptr, size) != 0)
+			bad++;
+		free(data);
+		fclose(fp);
+		file_unmap(ptr);
+	}
+	stdfile_cleanup();
+	printf("%d files differ\n", bad);
+
+	return bad == 0;
+}
+
+/* Make a path for stdfile. (the package is the only file) */
+static char *make_path(const char *file)
+{
+	char *s;
+
+	UNUSED_PARAMETER(file);
+
+	s = strdup(package_path);
+	if (s == NULL)
+		sys_out_of_memory();
+	return s;
+}
+
+/* Get the time in seconds. */
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * For stdfile
+ */
+
+void sys_error(const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	vprintf(format, ap);
+	va_end(ap);
+	printf("\n");
+}
+
+void sys_out_of_memory(void)
+{
+	printf("Out of memory.\n");
+}
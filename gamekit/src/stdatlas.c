@@ -0,0 +1,464 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdatlas.c: The standard implementation of the atlas_ interface.
+ */
+
+/*
+ * [Packing]
+ *
+ * Each page is packed by the skyline bottom-left algorithm.  The
+ * skyline is a list of horizontal segments that covers the page width,
+ * and a new rectangle is placed on the segment that gives the lowest
+ * top edge.  (the narrowest segment for a tie)
+ *
+ * The skyline can't reuse the space under it, so a page is reset as a
+ * whole when all its images are removed or when it is evicted.
+ *
+ * [Handle]
+ *
+ * A handle has a slot index in the lower 16 bits and the generation
+ * of the slot in the upper 16 bits.  The generation is incremented
+ * when the slot is freed, and thus old handles become stale.
+ */
+
+#include "gamekit/gamekit.h"
+
+/* Maximum pages. */
+#define PAGE_MAX	(8)
+
+/* Maximum images. */
+#define SLOT_MAX	(4096)
+
+/* A skyline segment. */
+struct skyline {
+	int x, y, w;
+};
+
+/* A page. */
+struct page {
+	bool is_used;
+	struct image *img;
+	struct render_texture *tex;
+
+	/* Skyline segments. */
+	struct skyline *node;
+	int node_count;
+
+	/* Number of images in this page. */
+	int image_count;
+};
+
+/* An image slot. */
+struct slot {
+	bool is_used;
+	uint16_t generation;
+	int page;
+	int x, y, w, h;
+};
+
+static struct page page[PAGE_MAX];
+static struct slot slot[SLOT_MAX];
+
+/* Page size. */
+static int page_size;
+
+/* Padding around each image. */
+static int padding;
+
+/* Forward declaration. */
+static void atlas_reset_page(int index);
+static bool atlas_alloc_page(int index);
+static bool atlas_pack(struct page *p, int w, int h, int *x, int *y);
+static int atlas_fit(struct page *p, int index, int w, int h);
+static void atlas_insert_node(struct page *p, int index, int x, int y, int w);
+static void atlas_copy_image(struct page *p, int x, int y, struct image *img);
+static struct slot *atlas_get_slot(atlas_handle_t handle);
+static void atlas_free_slot(struct slot *s);
+
+/*
+ * Initialize the "atlas" module.
+ */
+bool atlas_init_module(int size, int pad)
+{
+	assert(size > 0);
+	assert(pad >= 0);
+
+	page_size = size;
+	padding = pad;
+
+	memset(page, 0, sizeof(page));
+	memset(slot, 0, sizeof(slot));
+
+	return true;
+}
+
+/*
+ * Cleanup the "atlas" module.
+ */
+void atlas_cleanup_module(void)
+{
+	int i;
+
+	for (i = 0; i < PAGE_MAX; i++) {
+		if (!page[i].is_used)
+			continue;
+		render_destroy_texture(page[i].tex);
+		image_destroy(page[i].img);
+		free(page[i].node);
+		page[i].is_used = false;
+	}
+	memset(slot, 0, sizeof(slot));
+}
+
+/*
+ * Add an image to the atlas.
+ */
+bool atlas_add_image(struct image *img, atlas_handle_t *handle)
+{
+	int w, h, x, y, i, s;
+
+	assert(img != NULL);
+	assert(handle != NULL);
+
+	w = image_get_width(img) + padding * 2;
+	h = image_get_height(img) + padding * 2;
+	if (w > page_size || h > page_size) {
+		sys_error("Image too large for atlas.");
+		return false;
+	}
+
+	/* Find a free slot. */
+	for (s = 0; s < SLOT_MAX; s++)
+		if (!slot[s].is_used)
+			break;
+	if (s == SLOT_MAX) {
+		sys_error("Too many atlas images.");
+		return false;
+	}
+
+	/* Try the pages in use first, then allocate a new page. */
+	for (i = 0; i < PAGE_MAX; i++) {
+		if (page[i].is_used && atlas_pack(&page[i], w, h, &x, &y))
+			break;
+	}
+	if (i == PAGE_MAX) {
+		for (i = 0; i < PAGE_MAX; i++)
+			if (!page[i].is_used)
+				break;
+		if (i == PAGE_MAX) {
+			sys_error("Atlas pages full.");
+			return false;
+		}
+		if (!atlas_alloc_page(i))
+			return false;
+		if (!atlas_pack(&page[i], w, h, &x, &y)) {
+			sys_error("Atlas packing failed.");
+			return false;
+		}
+	}
+
+	/* Copy the pixels. */
+	atlas_copy_image(&page[i], x, y, img);
+	page[i].image_count++;
+
+	slot[s].is_used = true;
+	slot[s].page = i;
+	slot[s].x = x + padding;
+	slot[s].y = y + padding;
+	slot[s].w = image_get_width(img);
+	slot[s].h = image_get_height(img);
+
+	*handle = ((atlas_handle_t)slot[s].generation << 16) | (atlas_handle_t)(s + 1);
+
+	return true;
+}
+
+/*
+ * Remove an image from the atlas.
+ */
+void atlas_remove_image(atlas_handle_t handle)
+{
+	struct slot *s;
+	int index;
+
+	s = atlas_get_slot(handle);
+	if (s == NULL)
+		return;
+
+	index = s->page;
+	atlas_free_slot(s);
+
+	/* Reclaim the page space when the page gets empty. */
+	if (--page[index].image_count == 0)
+		atlas_reset_page(index);
+}
+
+/*
+ * Get the region of an image.
+ */
+bool atlas_get_region(atlas_handle_t handle, struct atlas_region *region)
+{
+	struct slot *s;
+
+	assert(region != NULL);
+
+	s = atlas_get_slot(handle);
+	if (s == NULL)
+		return false;
+
+	region->tex = page[s->page].tex;
+	region->page = s->page;
+	region->x = s->x;
+	region->y = s->y;
+	region->w = s->w;
+	region->h = s->h;
+	region->u0 = (float)s->x / (float)page_size;
+	region->v0 = (float)s->y / (float)page_size;
+	region->u1 = (float)(s->x + s->w) / (float)page_size;
+	region->v1 = (float)(s->y + s->h) / (float)page_size;
+
+	return true;
+}
+
+/*
+ * Evict all images in a page.
+ */
+void atlas_evict_page(int index)
+{
+	int i;
+
+	assert(index >= 0 && index < PAGE_MAX);
+
+	if (!page[index].is_used)
+		return;
+
+	for (i = 0; i < SLOT_MAX; i++) {
+		if (slot[i].is_used && slot[i].page == index)
+			atlas_free_slot(&slot[i]);
+	}
+	page[index].image_count = 0;
+	atlas_reset_page(index);
+}
+
+/*
+ * Get the number of pages in use.
+ */
+int atlas_get_page_count(void)
+{
+	int i, count;
+
+	count = 0;
+	for (i = 0; i < PAGE_MAX; i++)
+		if (page[i].is_used)
+			count++;
+
+	return count;
+}
+
+/*
+ * Upload modified pages.
+ */
+void atlas_flush(void)
+{
+	int i;
+
+	/* Only the dirty rectangle of each page is uploaded. */
+	for (i = 0; i < PAGE_MAX; i++) {
+		if (page[i].is_used)
+			render_update_texture(page[i].tex, page[i].img);
+	}
+}
+
+/* Allocate a page. */
+static bool atlas_alloc_page(int index)
+{
+	struct page *p;
+
+	p = &page[index];
+
+	/* A segment is inserted before the hidden ones are removed. */
+	p->node = malloc(sizeof(struct skyline) * (size_t)(page_size + 1));
+	if (p->node == NULL) {
+		sys_out_of_memory();
+		return false;
+	}
+	if (!image_create(page_size, page_size, &p->img)) {
+		free(p->node);
+		return false;
+	}
+	if (!render_create_texture(page_size, page_size, 0, &p->tex)) {
+		image_destroy(p->img);
+		free(p->node);
+		return false;
+	}
+
+	p->is_used = true;
+	p->image_count = 0;
+	atlas_reset_page(index);
+
+	return true;
+}
+
+/* Reset the skyline and the pixels of a page. */
+static void atlas_reset_page(int index)
+{
+	struct page *p;
+
+	p = &page[index];
+	p->node[0].x = 0;
+	p->node[0].y = 0;
+	p->node[0].w = page_size;
+	p->node_count = 1;
+
+	image_clear(p->img, make_pixel(0, 0, 0, 0));
+}
+
+/* Find a place for a rectangle, and update the skyline. */
+static bool atlas_pack(struct page *p, int w, int h, int *x, int *y)
+{
+	int i, top, best, best_top, best_w;
+
+	best = -1;
+	best_top = page_size;
+	best_w = page_size;
+	for (i = 0; i < p->node_count; i++) {
+		top = atlas_fit(p, i, w, h);
+		if (top < 0)
+			continue;
+		if (top + h < best_top ||
+		    (top + h == best_top && p->node[i].w < best_w)) {
+			best = i;
+			best_top = top + h;
+			best_w = p->node[i].w;
+		}
+	}
+	if (best < 0)
+		return false;
+
+	*x = p->node[best].x;
+	*y = best_top - h;
+	atlas_insert_node(p, best, *x, best_top, w);
+
+	return true;
+}
+
+/* Get the top edge of a rectangle placed at a segment. (-1 if it doesn't fit) */
+static int atlas_fit(struct page *p, int index, int w, int h)
+{
+	int x, y, rest;
+
+	x = p->node[index].x;
+	if (x + w > page_size)
+		return -1;
+
+	/* Rest on the highest segment under the rectangle. */
+	y = 0;
+	rest = w;
+	while (rest > 0) {
+		if (p->node[index].y > y)
+			y = p->node[index].y;
+		if (y + h > page_size)
+			return -1;
+		rest -= p->node[index].w;
+		index++;
+	}
+
+	return y;
+}
+
+/* Insert a segment and remove the segments hidden by it. */
+static void atlas_insert_node(struct page *p, int index, int x, int y, int w)
+{
+	int i, shrink;
+
+	memmove(&p->node[index + 1], &p->node[index], sizeof(struct skyline) * (size_t)(p->node_count - index));
+	p->node[index].x = x;
+	p->node[index].y = y;
+	p->node[index].w = w;
+	p->node_count++;
+
+	/* Shrink or remove the following segments under the new one. */
+	for (i = index + 1; i < p->node_count; i++) {
+		if (p->node[i].x >= x + w)
+			break;
+		shrink = x + w - p->node[i].x;
+		if (shrink < p->node[i].w) {
+			p->node[i].x += shrink;
+			p->node[i].w -= shrink;
+			break;
+		}
+		memmove(&p->node[i], &p->node[i + 1], sizeof(struct skyline) * (size_t)(p->node_count - i - 1));
+		p->node_count--;
+		i--;
+	}
+
+	/* Merge the segments of the same height. */
+	for (i = 0; i < p->node_count - 1; i++) {
+		if (p->node[i].y == p->node[i + 1].y) {
+			p->node[i].w += p->node[i + 1].w;
+			memmove(&p->node[i + 1], &p->node[i + 2], sizeof(struct skyline) * (size_t)(p->node_count - i - 2));
+			p->node_count--;
+			i--;
+		}
+	}
+}
+
+/* Copy an image into a page, and extrude its edges to the padding. */
+static void atlas_copy_image(struct page *p, int x, int y, struct image *img)
+{
+	pixel_t *dst, *src;
+	int w, h, pitch, i, j, sx, sy;
+
+	w = image_get_width(img);
+	h = image_get_height(img);
+	pitch = page_size;
+	src = image_get_pixels(img);
+	dst = image_get_pixels(p->img);
+
+	for (i = 0; i < h + padding * 2; i++) {
+		sy = i - padding;
+		if (sy < 0)
+			sy = 0;
+		else if (sy >= h)
+			sy = h - 1;
+		for (j = 0; j < w + padding * 2; j++) {
+			sx = j - padding;
+			if (sx < 0)
+				sx = 0;
+			else if (sx >= w)
+				sx = w - 1;
+			dst[(y + i) * pitch + x + j] = src[sy * w + sx];
+		}
+	}
+
+	image_mark_dirty(p->img, x, y, w + padding * 2, h + padding * 2);
+}
+
+/* Get a slot from a handle. (NULL for a stale handle) */
+static struct slot *atlas_get_slot(atlas_handle_t handle)
+{
+	int index;
+
+	index = (int)(handle & 0xffff) - 1;
+	if (index < 0 || index >= SLOT_MAX)
+		return NULL;
+	if (!slot[index].is_used)
+		return NULL;
+	if (slot[index].generation != (uint16_t)(handle >> 16))
+		return NULL;
+
+	return &slot[index];
+}
+
+/* Free a slot and make its handles stale. */
+static void atlas_free_slot(struct slot *s)
+{
+	s->is_used = false;
+	s->generation++;
+}
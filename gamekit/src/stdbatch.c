@@ -0,0 +1,468 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdbatch.c: The standard implementation of the batch_ interface.
+ */
+
+/*
+ * [Vertex Layout]
+ *
+ * Each sprite is expanded to 4 vertices, and each vertex has 8 floats:
+ *   x, y, u, v, r, g, b, a
+ *
+ * [Index Layout]
+ *
+ * Each sprite uses 6 indices in a triangle strip:
+ *   4n, 4n, 4n+1, 4n+2, 4n+3, 4n+3
+ *
+ * The duplicated first and last indices make degenerate triangles
+ * that connect sprites, so that a run of sprites that share a
+ * pipeline and a texture is drawn with a single draw call.  Since
+ * every sprite has an even number of indices, a run can start at
+ * any sprite.
+ */
+
+#include "gamekit/gamekit.h"
+
+/* Maximum sprites in a batch. */
+#define SPRITE_MAX		(65536)
+
+/*
+ * Maximum sprites in a vertex buffer.  The 16-bit indices stop below
+ * 0xffff, the primitive restart index that WebGL 2 always enables.
+ */
+#define FLUSH_SPRITE_MAX	(16383)
+
+/* Floats per vertex. */
+#define VERTEX_FLOATS		(8)
+
+/* Floats per sprite. */
+#define SPRITE_FLOATS		(VERTEX_FLOATS * 4)
+
+/* Indices per sprite. */
+#define SPRITE_INDICES		(6)
+
+/* Flushes that fit in the vertex ring buffer. */
+#define RING_FLUSH_COUNT	(4)
+
+/* A sprite. */
+struct sprite {
+	struct render_pipeline *pipeline;
+	struct render_texture *tex;
+	int seq;
+	float x, y, w, h;
+	float u0, v0, u1, v1;
+	pixel_t color;
+};
+
+/* Sprites in the current batch. */
+static struct sprite sprite[SPRITE_MAX];
+static int sprite_count;
+
+/* Sprite pointers to be sorted. */
+static struct sprite *sorted[SPRITE_MAX];
+
+/* Current sort mode. */
+static int batch_sort_mode;
+
+/* Current pipeline. */
+static struct render_pipeline *cur_pipeline;
+
+/* Is in a batch? */
+static bool is_in_batch;
+
+/* Screen size. */
+static float screen_width;
+static float screen_height;
+
+/* Default pipeline. */
+static struct render_pipeline *default_pipeline;
+
+/* White texture for solid sprites. */
+static struct image *white_image;
+static struct render_texture *white_texture;
+
+/* Vertex buffer. */
+static struct render_vertex_buffer *vertex_buffer;
+static float vertex_data[FLUSH_SPRITE_MAX * SPRITE_FLOATS];
+
+/* Index buffer. */
+static struct render_index_buffer *index_buffer;
+static short index_data[FLUSH_SPRITE_MAX * SPRITE_INDICES];
+
+/* Command list to record to. (NULL for immediate) */
+static struct render_cmd_list *cmd_list;
+
+/* Statistics. */
+static struct batch_stats stats;
+
+/* Forward declaration. */
+static bool batch_create_default_pipeline(void);
+static int batch_compare_sprite(const void *a, const void *b);
+static void batch_flush(struct sprite **list, int count);
+static void batch_flush_cmd(struct sprite **list, int count);
+static void batch_put_sprite(float *v, struct sprite *s);
+
+/*
+ * Initialize the "batch" module.
+ */
+bool batch_init_module(int width, int height)
+{
+	int i;
+
+	screen_width = (float)width;
+	screen_height = (float)height;
+
+	/* Create the default pipeline. */
+	if (!batch_create_default_pipeline())
+		return false;
+
+	/* Create a white texture. */
+	if (!image_create(1, 1, &white_image))
+		return false;
+	image_clear(white_image, make_pixel(255, 255, 255, 255));
+	if (!render_create_texture(1, 1, 0, &white_texture))
+		return false;
+	render_upload_texture(white_texture, 0, white_image);
+
+	/* Create a vertex ring buffer. */
+	if (!render_create_vertex_buffer_with_usage(RING_FLUSH_COUNT * FLUSH_SPRITE_MAX * SPRITE_FLOATS,
+						    RENDER_BUFFER_STREAM,
+						    &vertex_buffer))
+		return false;
+
+	/* Create an index buffer. */
+	if (!render_create_index_buffer(FLUSH_SPRITE_MAX * SPRITE_INDICES, &index_buffer))
+		return false;
+	for (i = 0; i < FLUSH_SPRITE_MAX; i++) {
+		index_data[i * SPRITE_INDICES + 0] = (short)(i * 4);
+		index_data[i * SPRITE_INDICES + 1] = (short)(i * 4);
+		index_data[i * SPRITE_INDICES + 2] = (short)(i * 4 + 1);
+		index_data[i * SPRITE_INDICES + 3] = (short)(i * 4 + 2);
+		index_data[i * SPRITE_INDICES + 4] = (short)(i * 4 + 3);
+		index_data[i * SPRITE_INDICES + 5] = (short)(i * 4 + 3);
+	}
+	render_bind_pipeline(default_pipeline);
+	render_bind_index_buffer(index_buffer);
+	render_upload_index_buffer(index_buffer, index_data);
+
+	return true;
+}
+
+/* Create the default sprite pipeline. */
+static bool batch_create_default_pipeline(void)
+{
+	if (!render_begin_pipeline())
+		return false;
+
+	render_begin_sampler();
+	render_add_sampler("u_tex", "tex0");
+	render_end_sampler();
+
+	render_begin_vertex_shader_input();
+	render_add_vertex_shader_input(RENDER_VEC2, "a_pos", RENDER_POSITION0);
+	render_add_vertex_shader_input(RENDER_VEC2, "a_uv", RENDER_TEXCOORD0);
+	render_add_vertex_shader_input(RENDER_VEC4, "a_color", RENDER_COLOR0);
+	render_end_vertex_shader_input();
+
+	render_begin_pixel_shader_input();
+	render_add_pixel_shader_input(RENDER_VEC4, "v_pos", RENDER_SVPOSITION);
+	render_add_pixel_shader_input(RENDER_VEC2, "v_uv", RENDER_TEXCOORD0);
+	render_add_pixel_shader_input(RENDER_VEC4, "v_color", RENDER_COLOR0);
+	render_end_pixel_shader_input();
+
+	render_begin_vertex_shader();
+	render_vertex_shader_assign_output("v_pos", "vec4(a_pos.x, a_pos.y, 0.0, 1.0)");
+	render_vertex_shader_assign_output("v_uv", "a_uv");
+	render_vertex_shader_assign_output("v_color", "a_color");
+	render_end_vertex_shader();
+
+	render_begin_pixel_shader();
+	render_pixel_shader_return("texture2D(u_tex, v_uv) * v_color");
+	render_end_pixel_shader();
+
+	if (!render_end_pipeline(&default_pipeline))
+		return false;
+
+	return true;
+}
+
+/*
+ * Cleanup the "batch" module.
+ */
+void batch_cleanup_module(void)
+{
+	if (index_buffer != NULL) {
+		render_destroy_index_buffer(index_buffer);
+		index_buffer = NULL;
+	}
+	if (vertex_buffer != NULL) {
+		render_destroy_vertex_buffer(vertex_buffer);
+		vertex_buffer = NULL;
+	}
+	if (white_texture != NULL) {
+		render_destroy_texture(white_texture);
+		white_texture = NULL;
+	}
+	if (white_image != NULL) {
+		image_destroy(white_image);
+		white_image = NULL;
+	}
+	if (default_pipeline != NULL) {
+		render_destroy_pipeline(default_pipeline);
+		default_pipeline = NULL;
+	}
+}
+
+/*
+ * Start a batch.
+ */
+void batch_begin(int sort_mode)
+{
+	assert(!is_in_batch);
+	assert(sort_mode == BATCH_SORT_NONE || sort_mode == BATCH_SORT_TEXTURE);
+
+	is_in_batch = true;
+	batch_sort_mode = sort_mode;
+	cur_pipeline = default_pipeline;
+	sprite_count = 0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * Record the following batches to a command list.
+ */
+void batch_set_cmd_list(struct render_cmd_list *list)
+{
+	assert(!is_in_batch);
+
+	cmd_list = list;
+}
+
+/*
+ * Set a pipeline for the following sprites.
+ */
+void batch_set_pipeline(struct render_pipeline *pipeline)
+{
+	assert(is_in_batch);
+
+	cur_pipeline = pipeline != NULL ? pipeline : default_pipeline;
+}
+
+/*
+ * Add a sprite.
+ */
+bool batch_add_sprite(struct render_texture *tex,
+		      float x, float y, float w, float h,
+		      float u0, float v0, float u1, float v1,
+		      pixel_t color)
+{
+	struct sprite *s;
+
+	assert(is_in_batch);
+
+	if (sprite_count >= SPRITE_MAX) {
+		sys_error("Too many sprites.");
+		return false;
+	}
+
+	s = &sprite[sprite_count];
+	s->pipeline = cur_pipeline;
+	s->tex = tex != NULL ? tex : white_texture;
+	s->seq = sprite_count;
+	s->x = x;
+	s->y = y;
+	s->w = w;
+	s->h = h;
+	s->u0 = u0;
+	s->v0 = v0;
+	s->u1 = u1;
+	s->v1 = v1;
+	s->color = color;
+	sorted[sprite_count] = s;
+	sprite_count++;
+
+	return true;
+}
+
+/*
+ * Draw all the sprites and finish a batch.
+ */
+void batch_end(void)
+{
+	int i, n;
+
+	assert(is_in_batch);
+
+	/* Sort the sprites if requested. */
+	if (batch_sort_mode == BATCH_SORT_TEXTURE)
+		qsort(sorted, (size_t)sprite_count, sizeof(struct sprite *), batch_compare_sprite);
+
+	/* Draw in chunks of the vertex buffer size. */
+	for (i = 0; i < sprite_count; i += FLUSH_SPRITE_MAX) {
+		n = sprite_count - i;
+		if (n > FLUSH_SPRITE_MAX)
+			n = FLUSH_SPRITE_MAX;
+		batch_flush(&sorted[i], n);
+	}
+
+	stats.sprite_count = sprite_count;
+	sprite_count = 0;
+	is_in_batch = false;
+}
+
+/* Compare sprites by a pipeline, a texture, and a sequence. */
+static int batch_compare_sprite(const void *a, const void *b)
+{
+	const struct sprite *sa = *(const struct sprite * const *)a;
+	const struct sprite *sb = *(const struct sprite * const *)b;
+
+	if (sa->pipeline != sb->pipeline)
+		return (uintptr_t)sa->pipeline < (uintptr_t)sb->pipeline ? -1 : 1;
+	if (sa->tex != sb->tex)
+		return (uintptr_t)sa->tex < (uintptr_t)sb->tex ? -1 : 1;
+	return sa->seq - sb->seq;
+}
+
+/* Upload sprites and draw them by runs. */
+static void batch_flush(struct sprite **list, int count)
+{
+	struct render_pipeline *pipeline;
+	struct render_texture *tex;
+	int i, start;
+
+	/* Expand sprites to vertices. */
+	for (i = 0; i < count; i++)
+		batch_put_sprite(&vertex_data[i * SPRITE_FLOATS], list[i]);
+
+	/* Upload vertices. */
+	if (cmd_list != NULL) {
+		batch_flush_cmd(list, count);
+		return;
+	}
+	render_bind_pipeline(list[0]->pipeline);
+	if (!render_stream_vertex_buffer(vertex_buffer, vertex_data, count * SPRITE_FLOATS))
+		return;
+	render_bind_vertex_buffer(vertex_buffer);
+	render_bind_index_buffer(index_buffer);
+	stats.flush_count++;
+
+	/* Draw each run that shares a pipeline and a texture. */
+	pipeline = list[0]->pipeline;
+	tex = NULL;
+	start = 0;
+	for (i = 0; i <= count; i++) {
+		if (i < count &&
+		    list[i]->pipeline == list[start]->pipeline &&
+		    list[i]->tex == list[start]->tex)
+			continue;
+
+		/* Switch the pipeline. (the vertex layout is per pipeline) */
+		if (list[start]->pipeline != pipeline) {
+			pipeline = list[start]->pipeline;
+			render_bind_pipeline(pipeline);
+			render_bind_vertex_buffer(vertex_buffer);
+			render_bind_index_buffer(index_buffer);
+			tex = NULL;
+		}
+
+		/* Switch the texture. */
+		if (list[start]->tex != tex) {
+			tex = list[start]->tex;
+			render_bind_texture(0, tex);
+		}
+
+		/* Draw the run. */
+		render_draw_triangle_strip(start * SPRITE_INDICES, (i - start) * SPRITE_INDICES);
+		stats.draw_count++;
+
+		start = i;
+	}
+}
+
+/* Record the expanded sprites to a command list. */
+static void batch_flush_cmd(struct sprite **list, int count)
+{
+	struct render_pipeline *pipeline;
+	struct render_texture *tex;
+	int i, start;
+
+	render_cmd_bind_pipeline(cmd_list, list[0]->pipeline);
+	render_cmd_stream_vertex_buffer(cmd_list, vertex_buffer, vertex_data, count * SPRITE_FLOATS);
+	render_cmd_bind_vertex_buffer(cmd_list, vertex_buffer);
+	render_cmd_bind_index_buffer(cmd_list, index_buffer);
+	stats.flush_count++;
+
+	/* Same as batch_flush(). */
+	pipeline = list[0]->pipeline;
+	tex = NULL;
+	start = 0;
+	for (i = 0; i <= count; i++) {
+		if (i < count &&
+		    list[i]->pipeline == list[start]->pipeline &&
+		    list[i]->tex == list[start]->tex)
+			continue;
+
+		if (list[start]->pipeline != pipeline) {
+			pipeline = list[start]->pipeline;
+			render_cmd_bind_pipeline(cmd_list, pipeline);
+			render_cmd_bind_vertex_buffer(cmd_list, vertex_buffer);
+			render_cmd_bind_index_buffer(cmd_list, index_buffer);
+			tex = NULL;
+		}
+
+		if (list[start]->tex != tex) {
+			tex = list[start]->tex;
+			render_cmd_bind_texture(cmd_list, 0, tex);
+		}
+
+		render_cmd_draw_triangle_strip(cmd_list, start * SPRITE_INDICES, (i - start) * SPRITE_INDICES);
+		stats.draw_count++;
+
+		start = i;
+	}
+}
+
+/* Expand a sprite to 4 vertices in the clip space. */
+static void batch_put_sprite(float *v, struct sprite *s)
+{
+	float x0, y0, x1, y1, r, g, b, a;
+
+	x0 = s->x / screen_width * 2.0f - 1.0f;
+	y0 = 1.0f - s->y / screen_height * 2.0f;
+	x1 = (s->x + s->w) / screen_width * 2.0f - 1.0f;
+	y1 = 1.0f - (s->y + s->h) / screen_height * 2.0f;
+	r = (float)get_pixel_r(s->color) / 255.0f;
+	g = (float)get_pixel_g(s->color) / 255.0f;
+	b = (float)get_pixel_b(s->color) / 255.0f;
+	a = (float)get_pixel_a(s->color) / 255.0f;
+
+	/* Top-left. */
+	v[0] = x0; v[1] = y0; v[2] = s->u0; v[3] = s->v0;
+	v[4] = r; v[5] = g; v[6] = b; v[7] = a;
+
+	/* Bottom-left. */
+	v[8] = x0; v[9] = y1; v[10] = s->u0; v[11] = s->v1;
+	v[12] = r; v[13] = g; v[14] = b; v[15] = a;
+
+	/* Top-right. */
+	v[16] = x1; v[17] = y0; v[18] = s->u1; v[19] = s->v0;
+	v[20] = r; v[21] = g; v[22] = b; v[23] = a;
+
+	/* Bottom-right. */
+	v[24] = x1; v[25] = y1; v[26] = s->u1; v[27] = s->v1;
+	v[28] = r; v[29] = g; v[30] = b; v[31] = a;
+}
+
+/*
+ * Get the statistics of the last batch.
+ */
+void batch_get_stats(struct batch_stats *ret)
+{
+	*ret = stats;
+}
@@ -0,0 +1,1225 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdblend.c: Pixel row blending kernels for stdimage.
+ */
+
+/*
+ * [Math]
+ *
+ * All kernels use the same integer math, and thus they are bit-exact
+ * to each other.  The color channels are the bytes 0 to 2 of a pixel
+ * in both RGBA and BGRA orders, and the alpha channel is the byte 3.
+ *
+ *   div255(x) = (x + 128 + ((x + 128) >> 8)) >> 8   (x / 255, rounded)
+ *   sa        = div255(alpha * src_a)
+ *   alpha:      dst = div255(src * sa + dst * (255 - sa))
+ *   add:        dst = min(dst + div255(src * sa), 255)
+ *   sub:        dst = max(dst - div255(src * sa), 0)
+ *
+ * The destination alpha is set to 255.
+ *
+ * A premultiplied source already has its colors multiplied by its
+ * alpha, so only the global alpha is applied, and not at all when it
+ * is 255.  The "alpha" kernel composites all 4 channels including the
+ * destination alpha, and the "add" and "sub" kernels keep it.
+ *
+ *   scale(x)     = (alpha == 255) ? x : div255(x * alpha)
+ *   premul_alpha: dst = min(scale(src) + div255(dst * (255 - scale(src_a))), 255)
+ *   premul_add:   dst = min(dst + scale(src), 255)
+ *   premul_sub:   dst = max(dst - scale(src), 0)
+ *   premultiply:  c = div255(c * a)
+ *
+ * div255(x * 255) is x, so skipping the multiplications gives the
+ * same results.
+ *
+ * The bilinear sampler takes the 8 upper bits of the fractions as the
+ * weights fx and fy (0 to 255), and interpolates in two steps:
+ *
+ *   lerp(a, b, f) = (a * (256 - f) + b * f + 128) >> 8
+ *   out           = lerp(lerp(p00, p01, fx), lerp(p10, p11, fx), fy)
+ *
+ * Every intermediate value fits in 16 bits, so the SIMD kernels work
+ * on 16-bit lanes.  The bilinear sampler loads the texels one by one
+ * since their addresses are clamped, and the AVX2 set uses the SSE2
+ * sampler.
+ *
+ * The RGB expansion stores make_pixel(255, r, g, b) for each 3 bytes.
+ * The SIMD kernels load 16 bytes at a time, so they stop early enough
+ * not to read past the row and leave the rest to the scalar kernel.
+ *
+ * [Dispatch]
+ *
+ * SSE2 is always available on x86_64, and NEON on arm64.  AVX2 is
+ * detected at runtime and compiled by the target attribute, so the
+ * module needs no special compiler flags.
+ */
+
+#include "stdblend.h"
+
+#if defined(ARCH_X86_64)
+#include <emmintrin.h>
+#define USE_SSE2
+#if defined(__GNUC__) || defined(__llvm__)
+#include <immintrin.h>
+#define USE_AVX2
+#define TARGET_AVX2	__attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(ARCH_ARM64)
+#include <arm_neon.h>
+#define USE_NEON
+#endif
+
+/* Forward declaration. */
+static void blend_alpha_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_add_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_sub_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_alpha_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_add_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_sub_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void premultiply_scalar(pixel_t *pixels, int count);
+static void bilinear_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int pitch, int src_w, int src_h, int32_t u, int32_t v, int32_t du, int32_t dv, int count);
+static void expand_rgb_scalar(pixel_t * RESTRICT dst, const uint8_t * RESTRICT src, int count);
+#if defined(USE_SSE2)
+static void blend_alpha_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_add_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_sub_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_alpha_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_add_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_sub_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void premultiply_sse2(pixel_t *pixels, int count);
+static void bilinear_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int pitch, int src_w, int src_h, int32_t u, int32_t v, int32_t du, int32_t dv, int count);
+static void expand_rgb_sse2(pixel_t * RESTRICT dst, const uint8_t * RESTRICT src, int count);
+#endif
+#if defined(USE_AVX2)
+static void blend_alpha_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_add_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_sub_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_alpha_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_add_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_sub_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void premultiply_avx2(pixel_t *pixels, int count);
+static void expand_rgb_avx2(pixel_t * RESTRICT dst, const uint8_t * RESTRICT src, int count);
+#endif
+#if defined(USE_NEON)
+static void blend_alpha_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_add_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_sub_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_alpha_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_add_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void blend_premul_sub_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+static void premultiply_neon(pixel_t *pixels, int count);
+static void bilinear_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int pitch, int src_w, int src_h, int32_t u, int32_t v, int32_t du, int32_t dv, int count);
+static void expand_rgb_neon(pixel_t * RESTRICT dst, const uint8_t * RESTRICT src, int count);
+#endif
+
+/* Kernel sets, from the slowest to the fastest. */
+static const struct stdblend_kernels kernel_table[] = {
+	{"scalar",
+	 blend_alpha_scalar, blend_add_scalar, blend_sub_scalar,
+	 blend_premul_alpha_scalar, blend_premul_add_scalar, blend_premul_sub_scalar,
+	 premultiply_scalar,
+	 bilinear_scalar,
+	 expand_rgb_scalar},
+#if defined(USE_SSE2)
+	{"sse2",
+	 blend_alpha_sse2, blend_add_sse2, blend_sub_sse2,
+	 blend_premul_alpha_sse2, blend_premul_add_sse2, blend_premul_sub_sse2,
+	 premultiply_sse2,
+	 bilinear_sse2,
+	 expand_rgb_sse2},
+#endif
+#if defined(USE_AVX2)
+	{"avx2",
+	 blend_alpha_avx2, blend_add_avx2, blend_sub_avx2,
+	 blend_premul_alpha_avx2, blend_premul_add_avx2, blend_premul_sub_avx2,
+	 premultiply_avx2,
+	 bilinear_sse2,
+	 expand_rgb_avx2},
+#endif
+#if defined(USE_NEON)
+	{"neon",
+	 blend_alpha_neon, blend_add_neon, blend_sub_neon,
+	 blend_premul_alpha_neon, blend_premul_add_neon, blend_premul_sub_neon,
+	 premultiply_neon,
+	 bilinear_neon,
+	 expand_rgb_neon},
+#endif
+};
+
+#define KERNEL_COUNT	((int)(sizeof(kernel_table) / sizeof(kernel_table[0])))
+
+/* The kernels in use. */
+struct stdblend_kernels stdblend = {
+	"scalar",
+	blend_alpha_scalar, blend_add_scalar, blend_sub_scalar,
+	blend_premul_alpha_scalar, blend_premul_add_scalar, blend_premul_sub_scalar,
+	premultiply_scalar,
+	bilinear_scalar,
+	expand_rgb_scalar,
+};
+
+/* Check if a kernel set runs on this CPU. */
+static bool is_kernel_supported(const struct stdblend_kernels *k)
+{
+#if defined(USE_AVX2)
+	if (strcmp(k->name, "avx2") == 0) {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+	}
+#endif
+	UNUSED_PARAMETER(k);
+	return true;
+}
+
+/*
+ * Select the kernels by name.
+ */
+bool stdblend_select(const char *name)
+{
+	int i;
+
+	/* The fastest one. */
+	if (name == NULL) {
+		for (i = KERNEL_COUNT - 1; i > 0; i--)
+			if (is_kernel_supported(&kernel_table[i]))
+				break;
+		stdblend = kernel_table[i];
+		return true;
+	}
+
+	for (i = 0; i < KERNEL_COUNT; i++) {
+		if (strcmp(kernel_table[i].name, name) == 0) {
+			if (!is_kernel_supported(&kernel_table[i]))
+				return false;
+			stdblend = kernel_table[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Scalar
+ */
+
+/* Divide by 255 with rounding. (x <= 255 * 255) */
+static INLINE uint32_t div255(uint32_t x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+static void blend_alpha_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint32_t s, d, sa, da, c, out;
+	int i, shift;
+
+	for (i = 0; i < count; i++) {
+		s = src[i];
+		d = dst[i];
+		sa = div255((uint32_t)alpha * (s >> 24));
+		da = 255 - sa;
+		out = 0xff000000;
+		for (shift = 0; shift < 24; shift += 8) {
+			c = div255(((s >> shift) & 0xff) * sa + ((d >> shift) & 0xff) * da);
+			out |= c << shift;
+		}
+		dst[i] = out;
+	}
+}
+
+static void blend_add_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint32_t s, d, sa, c, out;
+	int i, shift;
+
+	for (i = 0; i < count; i++) {
+		s = src[i];
+		d = dst[i];
+		sa = div255((uint32_t)alpha * (s >> 24));
+		out = 0xff000000;
+		for (shift = 0; shift < 24; shift += 8) {
+			c = ((d >> shift) & 0xff) + div255(((s >> shift) & 0xff) * sa);
+			if (c > 255)
+				c = 255;
+			out |= c << shift;
+		}
+		dst[i] = out;
+	}
+}
+
+static void blend_sub_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint32_t s, d, sa, sc, dc, out;
+	int i, shift;
+
+	for (i = 0; i < count; i++) {
+		s = src[i];
+		d = dst[i];
+		sa = div255((uint32_t)alpha * (s >> 24));
+		out = 0xff000000;
+		for (shift = 0; shift < 24; shift += 8) {
+			sc = div255(((s >> shift) & 0xff) * sa);
+			dc = (d >> shift) & 0xff;
+			out |= (dc > sc ? dc - sc : 0) << shift;
+		}
+		dst[i] = out;
+	}
+}
+
+/* Apply the global alpha to a premultiplied channel. */
+static INLINE uint32_t scale255(uint32_t c, uint32_t alpha)
+{
+	return alpha == 255 ? c : div255(c * alpha);
+}
+
+static void blend_premul_alpha_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint32_t s, d, da, c, out;
+	int i, shift;
+
+	for (i = 0; i < count; i++) {
+		s = src[i];
+		d = dst[i];
+		da = 255 - scale255(s >> 24, (uint32_t)alpha);
+		out = 0;
+		for (shift = 0; shift < 32; shift += 8) {
+			c = scale255((s >> shift) & 0xff, (uint32_t)alpha) + div255(((d >> shift) & 0xff) * da);
+			if (c > 255)
+				c = 255;
+			out |= c << shift;
+		}
+		dst[i] = out;
+	}
+}
+
+static void blend_premul_add_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint32_t s, d, c, out;
+	int i, shift;
+
+	for (i = 0; i < count; i++) {
+		s = src[i];
+		d = dst[i];
+		out = d & 0xff000000;
+		for (shift = 0; shift < 24; shift += 8) {
+			c = ((d >> shift) & 0xff) + scale255((s >> shift) & 0xff, (uint32_t)alpha);
+			if (c > 255)
+				c = 255;
+			out |= c << shift;
+		}
+		dst[i] = out;
+	}
+}
+
+static void blend_premul_sub_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint32_t s, d, sc, dc, out;
+	int i, shift;
+
+	for (i = 0; i < count; i++) {
+		s = src[i];
+		d = dst[i];
+		out = d & 0xff000000;
+		for (shift = 0; shift < 24; shift += 8) {
+			sc = scale255((s >> shift) & 0xff, (uint32_t)alpha);
+			dc = (d >> shift) & 0xff;
+			out |= (dc > sc ? dc - sc : 0) << shift;
+		}
+		dst[i] = out;
+	}
+}
+
+static void premultiply_scalar(pixel_t *pixels, int count)
+{
+	uint32_t p, a, out;
+	int i, shift;
+
+	for (i = 0; i < count; i++) {
+		p = pixels[i];
+		a = p >> 24;
+		if (a == 255)
+			continue;
+		out = p & 0xff000000;
+		for (shift = 0; shift < 24; shift += 8)
+			out |= div255(((p >> shift) & 0xff) * a) << shift;
+		pixels[i] = out;
+	}
+}
+
+/* Get the texel indices and the weight for a position. */
+static INLINE void bilinear_setup(int32_t u, int size, int *i0, int *i1, uint32_t *f)
+{
+	int i;
+
+	i = u >> 16;
+	*f = ((uint32_t)u >> 8) & 0xff;
+	*i0 = i < 0 ? 0 : (i >= size ? size - 1 : i);
+	*i1 = i + 1 < 0 ? 0 : (i + 1 >= size ? size - 1 : i + 1);
+}
+
+/* Interpolate the bytes of 2 pixels. */
+static INLINE uint32_t lerp_pixel(uint32_t a, uint32_t b, uint32_t f)
+{
+	uint32_t out, c;
+	int shift;
+
+	out = 0;
+	for (shift = 0; shift < 32; shift += 8) {
+		c = (((a >> shift) & 0xff) * (256 - f) + ((b >> shift) & 0xff) * f + 128) >> 8;
+		out |= c << shift;
+	}
+	return out;
+}
+
+static void bilinear_scalar(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int pitch, int src_w, int src_h, int32_t u, int32_t v, int32_t du, int32_t dv, int count)
+{
+	const pixel_t *row0, *row1;
+	uint32_t fx, fy;
+	int i, x0, x1, y0, y1;
+
+	for (i = 0; i < count; i++) {
+		bilinear_setup(u, src_w, &x0, &x1, &fx);
+		bilinear_setup(v, src_h, &y0, &y1, &fy);
+		row0 = src + pitch * y0;
+		row1 = src + pitch * y1;
+		dst[i] = lerp_pixel(lerp_pixel(row0[x0], row0[x1], fx),
+				    lerp_pixel(row1[x0], row1[x1], fx),
+				    fy);
+		u += du;
+		v += dv;
+	}
+}
+
+static void expand_rgb_scalar(pixel_t * RESTRICT dst, const uint8_t * RESTRICT src, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		dst[i] = make_pixel(255, src[0], src[1], src[2]);
+		src += 3;
+	}
+}
+
+/*
+ * SSE2 (4 pixels per iteration)
+ */
+#if defined(USE_SSE2)
+
+/* Divide 16-bit lanes by 255 with rounding. */
+static INLINE __m128i sse2_div255(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/* Get sa for each lane of 2 unpacked pixels. */
+static INLINE __m128i sse2_src_alpha(__m128i s, __m128i va)
+{
+	__m128i a;
+
+	a = _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+	a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+	return sse2_div255(_mm_mullo_epi16(a, va));
+}
+
+/* Alpha-blend 2 unpacked pixels. */
+static INLINE __m128i sse2_alpha2(__m128i s, __m128i d, __m128i va)
+{
+	__m128i sa, da;
+
+	sa = sse2_src_alpha(s, va);
+	da = _mm_sub_epi16(_mm_set1_epi16(255), sa);
+	return sse2_div255(_mm_add_epi16(_mm_mullo_epi16(s, sa), _mm_mullo_epi16(d, da)));
+}
+
+/* Get the source multiplied by sa for 2 unpacked pixels. */
+static INLINE __m128i sse2_mul2(__m128i s, __m128i va)
+{
+	return sse2_div255(_mm_mullo_epi16(s, sse2_src_alpha(s, va)));
+}
+
+static void blend_alpha_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	__m128i zero, va, amask, s, d, lo, hi;
+	int i;
+
+	zero = _mm_setzero_si128();
+	va = _mm_set1_epi16((short)alpha);
+	amask = _mm_set1_epi32((int)0xff000000);
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		s = _mm_loadu_si128((const __m128i *)(src + i));
+		d = _mm_loadu_si128((const __m128i *)(dst + i));
+		lo = sse2_alpha2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), va);
+		hi = sse2_alpha2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), va);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), amask));
+	}
+
+	blend_alpha_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void blend_add_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	__m128i zero, va, amask, s, d, lo, hi;
+	int i;
+
+	zero = _mm_setzero_si128();
+	va = _mm_set1_epi16((short)alpha);
+	amask = _mm_set1_epi32((int)0xff000000);
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		s = _mm_loadu_si128((const __m128i *)(src + i));
+		d = _mm_loadu_si128((const __m128i *)(dst + i));
+		lo = sse2_mul2(_mm_unpacklo_epi8(s, zero), va);
+		hi = sse2_mul2(_mm_unpackhi_epi8(s, zero), va);
+		d = _mm_adds_epu8(d, _mm_packus_epi16(lo, hi));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(d, amask));
+	}
+
+	blend_add_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void blend_sub_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	__m128i zero, va, amask, s, d, lo, hi;
+	int i;
+
+	zero = _mm_setzero_si128();
+	va = _mm_set1_epi16((short)alpha);
+	amask = _mm_set1_epi32((int)0xff000000);
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		s = _mm_loadu_si128((const __m128i *)(src + i));
+		d = _mm_loadu_si128((const __m128i *)(dst + i));
+		lo = sse2_mul2(_mm_unpacklo_epi8(s, zero), va);
+		hi = sse2_mul2(_mm_unpackhi_epi8(s, zero), va);
+		d = _mm_subs_epu8(d, _mm_packus_epi16(lo, hi));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(d, amask));
+	}
+
+	blend_sub_scalar(dst + i, src + i, count - i, alpha);
+}
+
+/* Broadcast the alpha lane of 2 unpacked pixels. */
+static INLINE __m128i sse2_splat_alpha(__m128i x)
+{
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+/* Scale 4 premultiplied pixels by the global alpha. */
+static INLINE __m128i sse2_scale4(__m128i s, __m128i va)
+{
+	__m128i zero, lo, hi;
+
+	zero = _mm_setzero_si128();
+	lo = sse2_div255(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), va));
+	hi = sse2_div255(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), va));
+	return _mm_packus_epi16(lo, hi);
+}
+
+/* Composite 2 unpacked premultiplied pixels. */
+static INLINE __m128i sse2_over2(__m128i s, __m128i d, __m128i va, bool is_scaled)
+{
+	__m128i da;
+
+	if (is_scaled)
+		s = sse2_div255(_mm_mullo_epi16(s, va));
+	da = _mm_sub_epi16(_mm_set1_epi16(255), sse2_splat_alpha(s));
+	return _mm_add_epi16(s, sse2_div255(_mm_mullo_epi16(d, da)));
+}
+
+/* Composite a row, and return the number of pixels done. */
+static INLINE int sse2_over_row(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha, bool is_scaled)
+{
+	__m128i zero, va, s, d, lo, hi;
+	int i;
+
+	zero = _mm_setzero_si128();
+	va = _mm_set1_epi16((short)alpha);
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		s = _mm_loadu_si128((const __m128i *)(src + i));
+		d = _mm_loadu_si128((const __m128i *)(dst + i));
+		lo = sse2_over2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), va, is_scaled);
+		hi = sse2_over2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), va, is_scaled);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+
+	return i;
+}
+
+/* Add or subtract a row keeping the alpha, and return the number of pixels done. */
+static INLINE int sse2_add_row(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha, bool is_scaled, bool is_sub)
+{
+	__m128i va, amask, s, d, r;
+	int i;
+
+	va = _mm_set1_epi16((short)alpha);
+	amask = _mm_set1_epi32((int)0xff000000);
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		s = _mm_loadu_si128((const __m128i *)(src + i));
+		d = _mm_loadu_si128((const __m128i *)(dst + i));
+		if (is_scaled)
+			s = sse2_scale4(s, va);
+		r = is_sub ? _mm_subs_epu8(d, s) : _mm_adds_epu8(d, s);
+		r = _mm_or_si128(_mm_andnot_si128(amask, r), _mm_and_si128(amask, d));
+		_mm_storeu_si128((__m128i *)(dst + i), r);
+	}
+
+	return i;
+}
+
+static void blend_premul_alpha_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	int i;
+
+	if (alpha == 255)
+		i = sse2_over_row(dst, src, count, alpha, false);
+	else
+		i = sse2_over_row(dst, src, count, alpha, true);
+
+	blend_premul_alpha_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void blend_premul_add_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	int i;
+
+	if (alpha == 255)
+		i = sse2_add_row(dst, src, count, alpha, false, false);
+	else
+		i = sse2_add_row(dst, src, count, alpha, true, false);
+
+	blend_premul_add_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void blend_premul_sub_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	int i;
+
+	if (alpha == 255)
+		i = sse2_add_row(dst, src, count, alpha, false, true);
+	else
+		i = sse2_add_row(dst, src, count, alpha, true, true);
+
+	blend_premul_sub_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void premultiply_sse2(pixel_t *pixels, int count)
+{
+	__m128i zero, amask, p, lo, hi, r;
+	int i;
+
+	zero = _mm_setzero_si128();
+	amask = _mm_set1_epi32((int)0xff000000);
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		p = _mm_loadu_si128((const __m128i *)(pixels + i));
+		lo = _mm_unpacklo_epi8(p, zero);
+		hi = _mm_unpackhi_epi8(p, zero);
+		lo = sse2_div255(_mm_mullo_epi16(lo, sse2_splat_alpha(lo)));
+		hi = sse2_div255(_mm_mullo_epi16(hi, sse2_splat_alpha(hi)));
+		r = _mm_packus_epi16(lo, hi);
+		r = _mm_or_si128(_mm_andnot_si128(amask, r), _mm_and_si128(amask, p));
+		_mm_storeu_si128((__m128i *)(pixels + i), r);
+	}
+
+	premultiply_scalar(pixels + i, count - i);
+}
+
+/* Interpolate 16-bit lanes. */
+static INLINE __m128i sse2_lerp(__m128i a, __m128i b, __m128i f)
+{
+	__m128i r;
+
+	r = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(_mm_set1_epi16(256), f)), _mm_mullo_epi16(b, f));
+	return _mm_srli_epi16(_mm_add_epi16(r, _mm_set1_epi16(128)), 8);
+}
+
+/* 2 pixels per iteration. */
+static void bilinear_sse2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int pitch, int src_w, int src_h, int32_t u, int32_t v, int32_t du, int32_t dv, int count)
+{
+	__m128i zero, p00, p01, p10, p11, wx, wy, r;
+	const pixel_t *a0, *a1, *b0, *b1;
+	uint32_t fxa, fya, fxb, fyb;
+	int i, xa0, xa1, ya0, ya1, xb0, xb1, yb0, yb1;
+
+	zero = _mm_setzero_si128();
+
+	for (i = 0; i + 2 <= count; i += 2) {
+		bilinear_setup(u, src_w, &xa0, &xa1, &fxa);
+		bilinear_setup(v, src_h, &ya0, &ya1, &fya);
+		bilinear_setup(u + du, src_w, &xb0, &xb1, &fxb);
+		bilinear_setup(v + dv, src_h, &yb0, &yb1, &fyb);
+		a0 = src + pitch * ya0;
+		a1 = src + pitch * ya1;
+		b0 = src + pitch * yb0;
+		b1 = src + pitch * yb1;
+
+		/* The lower 4 lanes are the first pixel. */
+		p00 = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)b0[xb0], (int)a0[xa0]), zero);
+		p01 = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)b0[xb1], (int)a0[xa1]), zero);
+		p10 = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)b1[xb0], (int)a1[xa0]), zero);
+		p11 = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)b1[xb1], (int)a1[xa1]), zero);
+		wx = _mm_set_epi16((short)fxb, (short)fxb, (short)fxb, (short)fxb,
+				   (short)fxa, (short)fxa, (short)fxa, (short)fxa);
+		wy = _mm_set_epi16((short)fyb, (short)fyb, (short)fyb, (short)fyb,
+				   (short)fya, (short)fya, (short)fya, (short)fya);
+
+		r = sse2_lerp(sse2_lerp(p00, p01, wx), sse2_lerp(p10, p11, wx), wy);
+		_mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(r, zero));
+
+		u += du * 2;
+		v += dv * 2;
+	}
+
+	bilinear_scalar(dst + i, src, pitch, src_w, src_h, u, v, du, dv, count - i);
+}
+
+static void expand_rgb_sse2(pixel_t * RESTRICT dst, const uint8_t * RESTRICT src, int count)
+{
+	__m128i v, p01, p23, p, amask;
+#if defined(IMAGE_ORDER_RGBA)
+	__m128i gmask, bmask;
+#endif
+	int i;
+
+	amask = _mm_set1_epi32((int)0xff000000);
+#if defined(IMAGE_ORDER_RGBA)
+	gmask = _mm_set1_epi32(0x0000ff00);
+	bmask = _mm_set1_epi32(0x000000ff);
+#endif
+
+	/* The 16-byte load reads 4 bytes past the 4 pixels. */
+	for (i = 0; i + 6 <= count; i += 4) {
+		v = _mm_loadu_si128((const __m128i *)(src + i * 3));
+		p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+		p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+		p = _mm_unpacklo_epi64(p01, p23);
+#if defined(IMAGE_ORDER_RGBA)
+		/* Swap the bytes 0 and 2. */
+		p = _mm_or_si128(_mm_or_si128(_mm_and_si128(p, gmask),
+					      _mm_srli_epi32(_mm_slli_epi32(p, 24), 8)),
+				 _mm_and_si128(_mm_srli_epi32(p, 16), bmask));
+#endif
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(p, amask));
+	}
+
+	expand_rgb_scalar(dst + i, src + i * 3, count - i);
+}
+
+#endif /* USE_SSE2 */
+
+/*
+ * AVX2 (8 pixels per iteration)
+ *
+ * Unpacking and packing work within each 128-bit half, so the pixel
+ * order is kept as in SSE2.
+ */
+#if defined(USE_AVX2)
+
+TARGET_AVX2
+static INLINE __m256i avx2_div255(__m256i x)
+{
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+TARGET_AVX2
+static INLINE __m256i avx2_src_alpha(__m256i s, __m256i va)
+{
+	__m256i a;
+
+	a = _mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+	a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+	return avx2_div255(_mm256_mullo_epi16(a, va));
+}
+
+TARGET_AVX2
+static INLINE __m256i avx2_alpha4(__m256i s, __m256i d, __m256i va)
+{
+	__m256i sa, da;
+
+	sa = avx2_src_alpha(s, va);
+	da = _mm256_sub_epi16(_mm256_set1_epi16(255), sa);
+	return avx2_div255(_mm256_add_epi16(_mm256_mullo_epi16(s, sa), _mm256_mullo_epi16(d, da)));
+}
+
+TARGET_AVX2
+static INLINE __m256i avx2_mul4(__m256i s, __m256i va)
+{
+	return avx2_div255(_mm256_mullo_epi16(s, avx2_src_alpha(s, va)));
+}
+
+TARGET_AVX2
+static void blend_alpha_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	__m256i zero, va, amask, s, d, lo, hi;
+	int i;
+
+	zero = _mm256_setzero_si256();
+	va = _mm256_set1_epi16((short)alpha);
+	amask = _mm256_set1_epi32((int)0xff000000);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = _mm256_loadu_si256((const __m256i *)(src + i));
+		d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		lo = avx2_alpha4(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), va);
+		hi = avx2_alpha4(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), va);
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(_mm256_packus_epi16(lo, hi), amask));
+	}
+
+	blend_alpha_sse2(dst + i, src + i, count - i, alpha);
+}
+
+TARGET_AVX2
+static void blend_add_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	__m256i zero, va, amask, s, d, lo, hi;
+	int i;
+
+	zero = _mm256_setzero_si256();
+	va = _mm256_set1_epi16((short)alpha);
+	amask = _mm256_set1_epi32((int)0xff000000);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = _mm256_loadu_si256((const __m256i *)(src + i));
+		d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		lo = avx2_mul4(_mm256_unpacklo_epi8(s, zero), va);
+		hi = avx2_mul4(_mm256_unpackhi_epi8(s, zero), va);
+		d = _mm256_adds_epu8(d, _mm256_packus_epi16(lo, hi));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(d, amask));
+	}
+
+	blend_add_sse2(dst + i, src + i, count - i, alpha);
+}
+
+TARGET_AVX2
+static void blend_sub_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	__m256i zero, va, amask, s, d, lo, hi;
+	int i;
+
+	zero = _mm256_setzero_si256();
+	va = _mm256_set1_epi16((short)alpha);
+	amask = _mm256_set1_epi32((int)0xff000000);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = _mm256_loadu_si256((const __m256i *)(src + i));
+		d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		lo = avx2_mul4(_mm256_unpacklo_epi8(s, zero), va);
+		hi = avx2_mul4(_mm256_unpackhi_epi8(s, zero), va);
+		d = _mm256_subs_epu8(d, _mm256_packus_epi16(lo, hi));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(d, amask));
+	}
+
+	blend_sub_sse2(dst + i, src + i, count - i, alpha);
+}
+
+TARGET_AVX2
+static INLINE __m256i avx2_splat_alpha(__m256i x)
+{
+	x = _mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm256_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+TARGET_AVX2
+static INLINE __m256i avx2_scale8(__m256i s, __m256i va)
+{
+	__m256i zero, lo, hi;
+
+	zero = _mm256_setzero_si256();
+	lo = avx2_div255(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), va));
+	hi = avx2_div255(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), va));
+	return _mm256_packus_epi16(lo, hi);
+}
+
+TARGET_AVX2
+static INLINE __m256i avx2_over4(__m256i s, __m256i d, __m256i va, bool is_scaled)
+{
+	__m256i da;
+
+	if (is_scaled)
+		s = avx2_div255(_mm256_mullo_epi16(s, va));
+	da = _mm256_sub_epi16(_mm256_set1_epi16(255), avx2_splat_alpha(s));
+	return _mm256_add_epi16(s, avx2_div255(_mm256_mullo_epi16(d, da)));
+}
+
+TARGET_AVX2
+static INLINE int avx2_over_row(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha, bool is_scaled)
+{
+	__m256i zero, va, s, d, lo, hi;
+	int i;
+
+	zero = _mm256_setzero_si256();
+	va = _mm256_set1_epi16((short)alpha);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = _mm256_loadu_si256((const __m256i *)(src + i));
+		d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		lo = avx2_over4(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), va, is_scaled);
+		hi = avx2_over4(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), va, is_scaled);
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+	}
+
+	return i;
+}
+
+TARGET_AVX2
+static INLINE int avx2_add_row(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha, bool is_scaled, bool is_sub)
+{
+	__m256i va, amask, s, d, r;
+	int i;
+
+	va = _mm256_set1_epi16((short)alpha);
+	amask = _mm256_set1_epi32((int)0xff000000);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = _mm256_loadu_si256((const __m256i *)(src + i));
+		d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		if (is_scaled)
+			s = avx2_scale8(s, va);
+		r = is_sub ? _mm256_subs_epu8(d, s) : _mm256_adds_epu8(d, s);
+		r = _mm256_blendv_epi8(r, d, amask);
+		_mm256_storeu_si256((__m256i *)(dst + i), r);
+	}
+
+	return i;
+}
+
+TARGET_AVX2
+static void blend_premul_alpha_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	int i;
+
+	if (alpha == 255)
+		i = avx2_over_row(dst, src, count, alpha, false);
+	else
+		i = avx2_over_row(dst, src, count, alpha, true);
+
+	blend_premul_alpha_sse2(dst + i, src + i, count - i, alpha);
+}
+
+TARGET_AVX2
+static void blend_premul_add_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	int i;
+
+	if (alpha == 255)
+		i = avx2_add_row(dst, src, count, alpha, false, false);
+	else
+		i = avx2_add_row(dst, src, count, alpha, true, false);
+
+	blend_premul_add_sse2(dst + i, src + i, count - i, alpha);
+}
+
+TARGET_AVX2
+static void blend_premul_sub_avx2(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	int i;
+
+	if (alpha == 255)
+		i = avx2_add_row(dst, src, count, alpha, false, true);
+	else
+		i = avx2_add_row(dst, src, count, alpha, true, true);
+
+	blend_premul_sub_sse2(dst + i, src + i, count - i, alpha);
+}
+
+TARGET_AVX2
+static void premultiply_avx2(pixel_t *pixels, int count)
+{
+	__m256i zero, amask, p, lo, hi, r;
+	int i;
+
+	zero = _mm256_setzero_si256();
+	amask = _mm256_set1_epi32((int)0xff000000);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		p = _mm256_loadu_si256((const __m256i *)(pixels + i));
+		lo = _mm256_unpacklo_epi8(p, zero);
+		hi = _mm256_unpackhi_epi8(p, zero);
+		lo = avx2_div255(_mm256_mullo_epi16(lo, avx2_splat_alpha(lo)));
+		hi = avx2_div255(_mm256_mullo_epi16(hi, avx2_splat_alpha(hi)));
+		r = _mm256_blendv_epi8(_mm256_packus_epi16(lo, hi), p, amask);
+		_mm256_storeu_si256((__m256i *)(pixels + i), r);
+	}
+
+	premultiply_sse2(pixels + i, count - i);
+}
+
+TARGET_AVX2
+static void expand_rgb_avx2(pixel_t * RESTRICT dst, const uint8_t * RESTRICT src, int count)
+{
+	__m256i shuf, amask, v;
+	int i;
+
+	/* Spread 3 bytes to 4 in each half. (-1 gives 0) */
+#if defined(IMAGE_ORDER_RGBA)
+	shuf = _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+				2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+#else
+	shuf = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+#endif
+	amask = _mm256_set1_epi32((int)0xff000000);
+
+	/* The upper half loads 16 bytes from the 5th pixel. */
+	for (i = 0; i + 10 <= count; i += 8) {
+		v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + i * 3))),
+					    _mm_loadu_si128((const __m128i *)(src + i * 3 + 12)),
+					    1);
+		v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuf), amask);
+		_mm256_storeu_si256((__m256i *)(dst + i), v);
+	}
+
+	expand_rgb_sse2(dst + i, src + i * 3, count - i);
+}
+
+#endif /* USE_AVX2 */
+
+/*
+ * NEON (8 pixels per iteration)
+ *
+ * vld4 splits the channels into separate registers, and vraddhn(x,
+ * vrshr(x, 8)) is exactly div255() narrowed to 8 bits.
+ */
+#if defined(USE_NEON)
+
+static INLINE uint8x8_t neon_div255(uint16x8_t x)
+{
+	return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+static void blend_alpha_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint8x8x4_t s, d;
+	uint8x8_t va, sa, da;
+	int i, c;
+
+	va = vdup_n_u8((uint8_t)alpha);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = vld4_u8((const uint8_t *)(src + i));
+		d = vld4_u8((const uint8_t *)(dst + i));
+		sa = neon_div255(vmull_u8(s.val[3], va));
+		da = vmvn_u8(sa);
+		for (c = 0; c < 3; c++)
+			d.val[c] = neon_div255(vmlal_u8(vmull_u8(s.val[c], sa), d.val[c], da));
+		d.val[3] = vdup_n_u8(255);
+		vst4_u8((uint8_t *)(dst + i), d);
+	}
+
+	blend_alpha_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void blend_add_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint8x8x4_t s, d;
+	uint8x8_t va, sa;
+	int i, c;
+
+	va = vdup_n_u8((uint8_t)alpha);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = vld4_u8((const uint8_t *)(src + i));
+		d = vld4_u8((const uint8_t *)(dst + i));
+		sa = neon_div255(vmull_u8(s.val[3], va));
+		for (c = 0; c < 3; c++)
+			d.val[c] = vqadd_u8(d.val[c], neon_div255(vmull_u8(s.val[c], sa)));
+		d.val[3] = vdup_n_u8(255);
+		vst4_u8((uint8_t *)(dst + i), d);
+	}
+
+	blend_add_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void blend_sub_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint8x8x4_t s, d;
+	uint8x8_t va, sa;
+	int i, c;
+
+	va = vdup_n_u8((uint8_t)alpha);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = vld4_u8((const uint8_t *)(src + i));
+		d = vld4_u8((const uint8_t *)(dst + i));
+		sa = neon_div255(vmull_u8(s.val[3], va));
+		for (c = 0; c < 3; c++)
+			d.val[c] = vqsub_u8(d.val[c], neon_div255(vmull_u8(s.val[c], sa)));
+		d.val[3] = vdup_n_u8(255);
+		vst4_u8((uint8_t *)(dst + i), d);
+	}
+
+	blend_sub_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void blend_premul_alpha_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint8x8x4_t s, d;
+	uint8x8_t va, da;
+	int i, c;
+
+	va = vdup_n_u8((uint8_t)alpha);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = vld4_u8((const uint8_t *)(src + i));
+		d = vld4_u8((const uint8_t *)(dst + i));
+		if (alpha != 255) {
+			for (c = 0; c < 4; c++)
+				s.val[c] = neon_div255(vmull_u8(s.val[c], va));
+		}
+		da = vmvn_u8(s.val[3]);
+		for (c = 0; c < 4; c++)
+			d.val[c] = vqadd_u8(s.val[c], neon_div255(vmull_u8(d.val[c], da)));
+		vst4_u8((uint8_t *)(dst + i), d);
+	}
+
+	blend_premul_alpha_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void blend_premul_add_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint8x8x4_t s, d;
+	uint8x8_t va;
+	int i, c;
+
+	va = vdup_n_u8((uint8_t)alpha);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = vld4_u8((const uint8_t *)(src + i));
+		d = vld4_u8((const uint8_t *)(dst + i));
+		for (c = 0; c < 3; c++) {
+			if (alpha != 255)
+				s.val[c] = neon_div255(vmull_u8(s.val[c], va));
+			d.val[c] = vqadd_u8(d.val[c], s.val[c]);
+		}
+		vst4_u8((uint8_t *)(dst + i), d);
+	}
+
+	blend_premul_add_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void blend_premul_sub_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha)
+{
+	uint8x8x4_t s, d;
+	uint8x8_t va;
+	int i, c;
+
+	va = vdup_n_u8((uint8_t)alpha);
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = vld4_u8((const uint8_t *)(src + i));
+		d = vld4_u8((const uint8_t *)(dst + i));
+		for (c = 0; c < 3; c++) {
+			if (alpha != 255)
+				s.val[c] = neon_div255(vmull_u8(s.val[c], va));
+			d.val[c] = vqsub_u8(d.val[c], s.val[c]);
+		}
+		vst4_u8((uint8_t *)(dst + i), d);
+	}
+
+	blend_premul_sub_scalar(dst + i, src + i, count - i, alpha);
+}
+
+static void premultiply_neon(pixel_t *pixels, int count)
+{
+	uint8x8x4_t p;
+	int i, c;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		p = vld4_u8((const uint8_t *)(pixels + i));
+		for (c = 0; c < 3; c++)
+			p.val[c] = neon_div255(vmull_u8(p.val[c], p.val[3]));
+		vst4_u8((uint8_t *)(pixels + i), p);
+	}
+
+	premultiply_scalar(pixels + i, count - i);
+}
+
+static INLINE uint16x8_t neon_lerp(uint16x8_t a, uint16x8_t b, uint16x8_t f)
+{
+	uint16x8_t r;
+
+	r = vmlaq_u16(vmulq_u16(a, vsubq_u16(vdupq_n_u16(256), f)), b, f);
+	return vshrq_n_u16(vaddq_u16(r, vdupq_n_u16(128)), 8);
+}
+
+/* Load 2 pixels to 16-bit lanes. */
+static INLINE uint16x8_t neon_load2(pixel_t a, pixel_t b)
+{
+	return vmovl_u8(vreinterpret_u8_u32(vset_lane_u32(b, vdup_n_u32(a), 1)));
+}
+
+/* 2 pixels per iteration. */
+static void bilinear_neon(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int pitch, int src_w, int src_h, int32_t u, int32_t v, int32_t du, int32_t dv, int count)
+{
+	uint16x8_t p00, p01, p10, p11, wx, wy, r;
+	const pixel_t *a0, *a1, *b0, *b1;
+	uint32_t fxa, fya, fxb, fyb;
+	int i, xa0, xa1, ya0, ya1, xb0, xb1, yb0, yb1;
+
+	for (i = 0; i + 2 <= count; i += 2) {
+		bilinear_setup(u, src_w, &xa0, &xa1, &fxa);
+		bilinear_setup(v, src_h, &ya0, &ya1, &fya);
+		bilinear_setup(u + du, src_w, &xb0, &xb1, &fxb);
+		bilinear_setup(v + dv, src_h, &yb0, &yb1, &fyb);
+		a0 = src + pitch * ya0;
+		a1 = src + pitch * ya1;
+		b0 = src + pitch * yb0;
+		b1 = src + pitch * yb1;
+
+		p00 = neon_load2(a0[xa0], b0[xb0]);
+		p01 = neon_load2(a0[xa1], b0[xb1]);
+		p10 = neon_load2(a1[xa0], b1[xb0]);
+		p11 = neon_load2(a1[xa1], b1[xb1]);
+		wx = vcombine_u16(vdup_n_u16((uint16_t)fxa), vdup_n_u16((uint16_t)fxb));
+		wy = vcombine_u16(vdup_n_u16((uint16_t)fya), vdup_n_u16((uint16_t)fyb));
+
+		r = neon_lerp(neon_lerp(p00, p01, wx), neon_lerp(p10, p11, wx), wy);
+		vst1_u32(dst + i, vreinterpret_u32_u8(vmovn_u16(r)));
+
+		u += du * 2;
+		v += dv * 2;
+	}
+
+	bilinear_scalar(dst + i, src, pitch, src_w, src_h, u, v, du, dv, count - i);
+}
+
+static void expand_rgb_neon(pixel_t * RESTRICT dst, const uint8_t * RESTRICT src, int count)
+{
+	uint8x16x3_t s;
+	uint8x16x4_t d;
+	int i;
+
+	d.val[3] = vdupq_n_u8(255);
+	for (i = 0; i + 16 <= count; i += 16) {
+		s = vld3q_u8(src + i * 3);
+#if defined(IMAGE_ORDER_RGBA)
+		d.val[0] = s.val[2];
+		d.val[2] = s.val[0];
+#else
+		d.val[0] = s.val[0];
+		d.val[2] = s.val[2];
+#endif
+		d.val[1] = s.val[1];
+		vst4q_u8((uint8_t *)(dst + i), d);
+	}
+
+	expand_rgb_scalar(dst + i, src + i * 3, count - i);
+}
+
+#endif /* USE_NEON */
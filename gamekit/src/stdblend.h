@@ -0,0 +1,64 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdblend.h: Pixel row blending kernels for stdimage.
+ */
+
+#ifndef GAMEKIT_STDBLEND_H
+#define GAMEKIT_STDBLEND_H
+
+#include "gamekit/gamekit.h"
+
+/* A row blending kernel. (alpha is 1 to 255) */
+typedef void (*stdblend_row_func)(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int count, int alpha);
+
+/* A row conversion kernel. */
+typedef void (*stdblend_convert_func)(pixel_t *pixels, int count);
+
+/* A row expansion kernel from packed 8-bit RGB. */
+typedef void (*stdblend_expand_func)(pixel_t * RESTRICT dst, const uint8_t * RESTRICT src, int count);
+
+/*
+ * A row sampling kernel.  (u, v) is the position of the first sample
+ * relative to the top-left of the source rectangle, and (du, dv) is
+ * the step per pixel, in 16.16 fixed point.  The positions are clamped
+ * to the rectangle.
+ */
+typedef void (*stdblend_sample_func)(pixel_t * RESTRICT dst, const pixel_t * RESTRICT src, int pitch, int src_w, int src_h, int32_t u, int32_t v, int32_t du, int32_t dv, int count);
+
+/* A set of kernels. */
+struct stdblend_kernels {
+	const char *name;
+
+	/* For straight alpha sources. */
+	stdblend_row_func alpha;
+	stdblend_row_func add;
+	stdblend_row_func sub;
+
+	/* For premultiplied alpha sources. */
+	stdblend_row_func premul_alpha;
+	stdblend_row_func premul_add;
+	stdblend_row_func premul_sub;
+
+	/* Convert straight alpha to premultiplied alpha. */
+	stdblend_convert_func premultiply;
+
+	/* Sample with the bilinear filter. (texel centers at integers) */
+	stdblend_sample_func bilinear;
+
+	/* Expand RGB to opaque pixels. */
+	stdblend_expand_func expand_rgb;
+};
+
+/* The kernels in use. */
+extern struct stdblend_kernels stdblend;
+
+/* Select the kernels by name. (NULL for the fastest on this CPU) */
+bool stdblend_select(const char *name);
+
+#endif
@@ -0,0 +1,466 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdcache.c: The standard implementation of the cache_ interface.
+ */
+
+/*
+ * [Lookup]
+ *
+ * The entries are in a static table, and are chained from the buckets
+ * of a hash table by the FNV-1a hash of the file name and the options.
+ *
+ * [Eviction]
+ *
+ * All entries are in a list in the order of use, with the most recent
+ * at the head.  The eviction walks the list from the tail and skips
+ * the pinned entries, so an entry is released but not moved when it is
+ * unpinned.
+ */
+
+#include "gamekit/gamekit.h"
+#include "stdimage.h"
+
+/* Maximum entries. */
+#define ENTRY_MAX	(1024)
+
+/* Hash buckets. (a power of 2) */
+#define BUCKET_COUNT	(2048)
+
+/* The body of the entry structure. */
+struct cache_entry {
+	bool is_used;
+
+	/* Key. */
+	char *file;
+	int max_width;
+	int max_height;
+	int flags;
+	uint32_t hash;
+
+	/* Image and texture. (tex is NULL until requested) */
+	struct image *img;
+	struct render_texture *tex;
+
+	/* Bytes of the image and the texture. */
+	size_t bytes;
+
+	int pin_count;
+
+	/* Next entry in the bucket. */
+	struct cache_entry *hash_next;
+
+	/* Neighbors in the use order. */
+	struct cache_entry *lru_prev;
+	struct cache_entry *lru_next;
+};
+
+static struct cache_entry entry_table[ENTRY_MAX];
+static struct cache_entry *bucket[BUCKET_COUNT];
+
+/* The use order. (head is the most recent) */
+static struct cache_entry *lru_head;
+static struct cache_entry *lru_tail;
+
+/* Budget and statistics. */
+static struct cache_stats stats;
+
+/* Forward declaration. */
+static struct cache_entry *cache_find(const char *file, int max_width, int max_height, int flags, uint32_t hash);
+static bool cache_decode(const char *file, int max_width, int max_height, int flags, struct image **img);
+static bool cache_fit(struct image **img, int max_width, int max_height);
+static uint32_t cache_hash(const char *file, int max_width, int max_height, int flags);
+static void cache_evict(void);
+static void cache_free_entry(struct cache_entry *e);
+static void cache_link_head(struct cache_entry *e);
+static void cache_unlink(struct cache_entry *e);
+
+/*
+ * Initialize the "cache" module.
+ */
+bool cache_init_module(size_t budget)
+{
+	memset(entry_table, 0, sizeof(entry_table));
+	memset(bucket, 0, sizeof(bucket));
+	memset(&stats, 0, sizeof(stats));
+	lru_head = NULL;
+	lru_tail = NULL;
+	stats.budget_bytes = budget;
+
+	return true;
+}
+
+/*
+ * Cleanup the "cache" module.
+ */
+void cache_cleanup_module(void)
+{
+	int i;
+
+	for (i = 0; i < ENTRY_MAX; i++) {
+		if (entry_table[i].is_used)
+			cache_free_entry(&entry_table[i]);
+	}
+}
+
+/*
+ * Change the budget.
+ */
+void cache_set_budget(size_t budget)
+{
+	stats.budget_bytes = budget;
+	cache_evict();
+}
+
+/*
+ * Get an image, and pin it.
+ */
+bool cache_load(const char *file, int max_width, int max_height, int flags, struct cache_entry **entry)
+{
+	struct cache_entry *e;
+	struct image *img;
+	uint32_t hash;
+	int i;
+
+	assert(file != NULL);
+	assert(entry != NULL);
+
+	if (max_width < 0)
+		max_width = 0;
+	if (max_height < 0)
+		max_height = 0;
+
+	/* Hit. */
+	hash = cache_hash(file, max_width, max_height, flags);
+	e = cache_find(file, max_width, max_height, flags, hash);
+	if (e != NULL) {
+		stats.hit_count++;
+		if (e->pin_count++ == 0)
+			stats.pinned_count++;
+		cache_unlink(e);
+		cache_link_head(e);
+		*entry = e;
+		return true;
+	}
+	stats.miss_count++;
+
+	/* Make room for the entry. */
+	for (i = 0; i < ENTRY_MAX; i++)
+		if (!entry_table[i].is_used)
+			break;
+	if (i == ENTRY_MAX) {
+		for (e = lru_tail; e != NULL; e = e->lru_prev)
+			if (e->pin_count == 0)
+				break;
+		if (e == NULL) {
+			sys_error("Too many cached images.");
+			return false;
+		}
+		stats.eviction_count++;
+		cache_free_entry(e);
+		i = (int)(e - entry_table);
+	}
+
+	/* Read and decode. */
+	if (!cache_decode(file, max_width, max_height, flags, &img))
+		return false;
+
+	e = &entry_table[i];
+	e->file = strdup(file);
+	if (e->file == NULL) {
+		image_destroy(img);
+		sys_out_of_memory();
+		return false;
+	}
+	e->is_used = true;
+	e->max_width = max_width;
+	e->max_height = max_height;
+	e->flags = flags;
+	e->hash = hash;
+	e->img = img;
+	e->tex = NULL;
+	e->bytes = (size_t)image_get_width(img) * (size_t)image_get_height(img) * sizeof(pixel_t);
+	e->pin_count = 1;
+	e->hash_next = bucket[hash & (BUCKET_COUNT - 1)];
+	bucket[hash & (BUCKET_COUNT - 1)] = e;
+	cache_link_head(e);
+
+	stats.entry_count++;
+	stats.pinned_count++;
+	stats.used_bytes += e->bytes;
+	cache_evict();
+
+	*entry = e;
+	return true;
+}
+
+/*
+ * Unpin an entry.
+ */
+void cache_release(struct cache_entry *entry)
+{
+	assert(entry != NULL);
+	assert(entry->is_used);
+	assert(entry->pin_count > 0);
+
+	if (--entry->pin_count > 0)
+		return;
+	stats.pinned_count--;
+
+	/* Evict it now if it was kept over the budget. */
+	cache_evict();
+}
+
+/*
+ * Get the image of a pinned entry.
+ */
+struct image *cache_get_image(struct cache_entry *entry)
+{
+	assert(entry != NULL);
+	assert(entry->pin_count > 0);
+
+	return entry->img;
+}
+
+/*
+ * Get the texture of a pinned entry.
+ */
+struct render_texture *cache_get_texture(struct cache_entry *entry)
+{
+	size_t bytes;
+	int w, h;
+
+	assert(entry != NULL);
+	assert(entry->pin_count > 0);
+
+	if (entry->tex != NULL)
+		return entry->tex;
+
+	w = image_get_width(entry->img);
+	h = image_get_height(entry->img);
+	if (!render_create_texture(w, h, 0, &entry->tex))
+		return NULL;
+	render_upload_texture(entry->tex, 0, entry->img);
+
+	bytes = (size_t)w * (size_t)h * sizeof(pixel_t);
+	entry->bytes += bytes;
+	stats.used_bytes += bytes;
+	cache_evict();
+
+	return entry->tex;
+}
+
+/*
+ * Evict all entries that are not pinned.
+ */
+void cache_purge(void)
+{
+	struct cache_entry *e, *prev;
+
+	for (e = lru_tail; e != NULL; e = prev) {
+		prev = e->lru_prev;
+		if (e->pin_count == 0)
+			cache_free_entry(e);
+	}
+}
+
+/*
+ * Get the statistics.
+ */
+void cache_get_stats(struct cache_stats *s)
+{
+	assert(s != NULL);
+
+	*s = stats;
+}
+
+/* Find an entry. */
+static struct cache_entry *cache_find(const char *file, int max_width, int max_height, int flags, uint32_t hash)
+{
+	struct cache_entry *e;
+
+	for (e = bucket[hash & (BUCKET_COUNT - 1)]; e != NULL; e = e->hash_next) {
+		if (e->hash == hash &&
+		    e->max_width == max_width &&
+		    e->max_height == max_height &&
+		    e->flags == flags &&
+		    strcmp(e->file, file) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+/* Read and decode a file. */
+static bool cache_decode(const char *file, int max_width, int max_height, int flags, struct image **img)
+{
+	const void *map;
+	const uint8_t *buf;
+	size_t size;
+	bool premultiply, is_succeeded;
+
+	/* Map the whole file. */
+	if (!file_map(file, &map, &size))
+		return false;
+	buf = map;
+
+	/*
+	 * Decode in the mode of the flags, not the global one, so that the
+	 * pixels match the key.  The alpha is premultiplied before any
+	 * reduction so that the box filter does not make dark fringes.
+	 */
+	premultiply = (flags & CACHE_PREMULTIPLIED) != 0;
+
+	/* Decode, reducing by the decoder if it can. */
+	switch (image_detect_format(buf, size)) {
+	case IMAGE_FORMAT_PNG:
+		is_succeeded = image_decode_png(buf, size, premultiply, img);
+		break;
+	case IMAGE_FORMAT_JPEG:
+		is_succeeded = image_decode_jpeg(buf, size, premultiply, max_width, max_height, img);
+		break;
+	case IMAGE_FORMAT_WEBP:
+		is_succeeded = image_decode_webp(buf, size, premultiply, max_width, max_height, img);
+		break;
+	default:
+		sys_error("Unknown image format \"%s\".", file);
+		is_succeeded = false;
+		break;
+	}
+	file_unmap(map);
+	if (!is_succeeded)
+		return false;
+
+	/* Reduce the rest. (PNG, and JPEG beyond 1/8) */
+	if (!cache_fit(img, max_width, max_height)) {
+		image_destroy(*img);
+		return false;
+	}
+
+	return true;
+}
+
+/* Reduce an image to fit a size, keeping the aspect ratio. */
+static bool cache_fit(struct image **img, int max_width, int max_height)
+{
+	struct image *fit;
+	int w, h, fw, fh;
+
+	w = image_get_width(*img);
+	h = image_get_height(*img);
+	fw = w;
+	fh = h;
+	if (max_width > 0 && fw > max_width) {
+		fh = (int)((int64_t)fh * max_width / fw);
+		fw = max_width;
+	}
+	if (max_height > 0 && fh > max_height) {
+		fw = (int)((int64_t)fw * max_height / fh);
+		fh = max_height;
+	}
+	if (fw == w && fh == h)
+		return true;
+
+	if (!image_create(fw > 0 ? fw : 1, fh > 0 ? fh : 1, &fit))
+		return false;
+	if (!image_resample_box(fit, *img)) {
+		image_destroy(fit);
+		return false;
+	}
+	image_destroy(*img);
+	*img = fit;
+
+	return true;
+}
+
+/* Hash a key by FNV-1a. */
+static uint32_t cache_hash(const char *file, int max_width, int max_height, int flags)
+{
+	uint32_t h;
+	int i;
+
+	h = 2166136261u;
+	for (; *file != '\0'; file++) {
+		h ^= (uint8_t)*file;
+		h *= 16777619u;
+	}
+	for (i = 0; i < 4; i++) {
+		h ^= (uint32_t)((max_width >> (i * 8)) & 0xff);
+		h *= 16777619u;
+		h ^= (uint32_t)((max_height >> (i * 8)) & 0xff);
+		h *= 16777619u;
+	}
+	h ^= (uint32_t)flags;
+	h *= 16777619u;
+
+	return h;
+}
+
+/* Evict the least recently used entries until the budget is met. */
+static void cache_evict(void)
+{
+	struct cache_entry *e, *prev;
+
+	for (e = lru_tail; e != NULL && stats.used_bytes > stats.budget_bytes; e = prev) {
+		prev = e->lru_prev;
+		if (e->pin_count > 0)
+			continue;
+		stats.eviction_count++;
+		cache_free_entry(e);
+	}
+}
+
+/* Destroy the image and the texture of an entry, and free it. */
+static void cache_free_entry(struct cache_entry *e)
+{
+	struct cache_entry **link;
+
+	/* Remove from the bucket. */
+	for (link = &bucket[e->hash & (BUCKET_COUNT - 1)]; *link != e; link = &(*link)->hash_next)
+		;
+	*link = e->hash_next;
+	cache_unlink(e);
+
+	if (e->tex != NULL)
+		render_destroy_texture(e->tex);
+	image_destroy(e->img);
+	free(e->file);
+
+	stats.used_bytes -= e->bytes;
+	stats.entry_count--;
+	if (e->pin_count > 0)
+		stats.pinned_count--;
+
+	memset(e, 0, sizeof(struct cache_entry));
+}
+
+/* Put an entry at the head of the use order. */
+static void cache_link_head(struct cache_entry *e)
+{
+	e->lru_prev = NULL;
+	e->lru_next = lru_head;
+	if (lru_head != NULL)
+		lru_head->lru_prev = e;
+	else
+		lru_tail = e;
+	lru_head = e;
+}
+
+/* Remove an entry from the use order. */
+static void cache_unlink(struct cache_entry *e)
+{
+	if (e->lru_prev != NULL)
+		e->lru_prev->lru_next = e->lru_next;
+	else
+		lru_head = e->lru_next;
+	if (e->lru_next != NULL)
+		e->lru_next->lru_prev = e->lru_prev;
+	else
+		lru_tail = e->lru_prev;
+	e->lru_prev = NULL;
+	e->lru_next = NULL;
+}
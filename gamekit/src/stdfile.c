@@ -21,14 +21,103 @@
  *     } [file_count];
  * };
  * u8 file_body[file_count][file_length]; // Obfuscated
+ *
+ * [Archive File Format v2]
+ *
+ * struct header {
+ *     u8  magic[4];       // "GKPK"
+ *     u32 version;        // 2
+ *     u64 file_count;
+ *     struct file_entry {
+ *         u8  file_name[256]; // Obfuscated by the name stream
+ *         u64 file_size;
+ *         u64 file_offset;
+ *     } [file_count];
+ * };
+ * u8 file_body[file_count][file_length]; // Obfuscated by the body stream
+ *
+ * [Archive File Format v3]
+ *
+ * struct header {
+ *     u8  magic[4];       // "GKPK"
+ *     u32 version;        // 3
+ *     u64 file_count;
+ *     struct file_entry {
+ *         u8  file_name[256]; // Obfuscated by the name stream
+ *         u64 file_size;      // Decompressed size
+ *         u64 file_offset;
+ *         u64 stored_size;    // Size in the package
+ *         u32 codec;          // 0: store, 1: zlib, 2: bzip2, 3: brotli
+ *         u32 chunk_size;     // Decompressed bytes per chunk
+ *     } [file_count];
+ * };
+ * u8 file_body[file_count][stored_size]; // Obfuscated by the body stream
+ *
+ * A stored body is the file as is.  A compressed body is a table of
+ * the chunks and the chunks that are compressed independently:
+ *
+ * u64 chunk_end[chunk_count]; // End of a chunk from the body start
+ * u8  chunk[chunk_count][];   // (chunk_count is file_size / chunk_size, rounded up)
+ *
+ * A stream of a compressed entry decompresses a chunk at a time, and
+ * can seek to any position by decompressing its chunk.
+ *
+ * The first format is "v1".  A v1 package starts with the file count,
+ * which cannot be the magic.  Packages are made by packprogram.c.
+ *
+ * [Obfuscation]
+ *
+ * v1 XORs a keystream whose bytes depend on all the previous bytes of
+ * an entry, so that it must be generated from the start.  It is
+ * generated in blocks with the key in a register, and the modulo is
+ * replaced by subtractions since the product is less than 4 times the
+ * key.
+ *
+ * v2 XORs a counter-mode keystream.  The 8 bytes at the offset 8n of a
+ * stream are the mix of the stream key and n, so that any position can
+ * be decoded in O(1), and blocks can be decoded in parallel.  Each
+ * entry has two streams, one for its name and one for its body.  (v3
+ * is the same.)
+ *
+ * [Index]
+ *
+ * The entry table is read at once, and the names are put to an
+ * open-addressing hash table by their case-insensitive hash, so that
+ * opening a file doesn't search the whole table.
+ *
+ * [Seed]
+ *
+ * The seed of the entry i is the initial value stepped i times by
+ * rotl(x ^ NEXT_MASK1, 1).  Stepping 64 times rotates the value back
+ * and XORs it with all rotations of the mask, which is a constant, so
+ * a seed needs at most 63 steps after applying the constant.
+ *
+ * [Mapping]
+ *
+ * The package is mapped to memory once, and a stream of an entry reads
+ * a slice of the mapping, so that opening a file doesn't open a handle
+ * or seek.  If the package cannot be mapped, a stream falls back to a
+ * FILE pointer per entry.  file_map() maps a real file as is, and
+ * decodes an obfuscated entry to a buffer.
  */
 
 #include "gamekit/gamekit.h"
 #include "stdfile.h"
+#include "stdthread.h"
+
+/* Codecs */
+#include <zlib.h>
+#include <bzlib.h>
+#include <brotli/decode.h>
 
 /* Win32 */
 #ifdef TARGET_WIN32
 #include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 /*
@@ -66,11 +155,21 @@ static const uint64_t NEXT_MASK2 = 0xfcbfaff8f2f4f3f0;
 /* The package file. */
 #define PACKAGE_FILE		"game.dat"
 
+/* Magic of the v2 and v3 packages. */
+#define PACKAGE_MAGIC		"GKPK"
+
 /* Maximum entries in a package. */
-#define ENTRY_SIZE		(65536)
+#define ENTRY_SIZE		STDFILE_ENTRY_MAX
 
 /* File name length for an entry. */
-#define FILE_NAME_SIZE		(256)
+#define FILE_NAME_SIZE		STDFILE_NAME_SIZE
+
+/* Size of an entry in the package file. */
+#define ENTRY_BYTES		(FILE_NAME_SIZE + 8 + 8)
+#define ENTRY_BYTES_V3		(FILE_NAME_SIZE + 8 + 8 + 8 + 4 + 4)
+
+/* Slots of the hash table. (a power of 2, twice the entries) */
+#define HASH_SIZE		(ENTRY_SIZE * 2)
 
 /* Package file entry. */
 struct file_entry {
@@ -82,17 +181,63 @@ struct file_entry {
 
 	/* Offset in the package file. */
 	uint64_t offset;
+
+	/* Size in the package file. */
+	uint64_t stored_size;
+
+	/* Codec, and decompressed bytes per chunk. */
+	int codec;
+	uint32_t chunk_size;
+
+	/* Hash of the name. */
+	uint32_t hash;
 };
 
 /* Package file path. */
 static char *file_package_path;
 
+/* Package version. (1 to 3) */
+static int file_package_version;
+
 /* File entry count. */
 static uint64_t file_entry_count;
 
 /* File entry table. */
 static struct file_entry file_entry[ENTRY_SIZE];
 
+/* Hash table of the entries. (index + 1, or 0 for empty) */
+static uint32_t file_hash_table[HASH_SIZE];
+
+/* Mapping of the package file. (NULL if not mapped) */
+static const uint8_t *file_package_map;
+static size_t file_package_size;
+
+/*
+ * Mappings by file_map()
+ */
+
+/* Maximum mappings at a time. */
+#define MAPPING_MAX		(256)
+
+/* A mapping. */
+struct file_mapping {
+	/* Address, or NULL for an empty slot. */
+	const void *ptr;
+
+	/* Size. */
+	size_t size;
+
+	/* Is mapped? (or allocated) */
+	bool is_mapped;
+};
+
+/* Mapping table. */
+static struct file_mapping file_mapping[MAPPING_MAX];
+
+/* Mutex for the mapping table. */
+static stdthread_mutex_t file_mapping_mutex;
+static bool is_file_mapping_mutex_initialized;
+
 /*
  * File read stream
  */
@@ -106,15 +251,31 @@ struct file {
 	/* stdio FILE pointer */
 	FILE *fp;
 
-	/* Obfuscation parameters */
+	/* Mapped entry, or NULL to read fp. */
+	const uint8_t *map;
+
+	/* Obfuscation parameters (v1) */
 	uint64_t next_random;
 	uint64_t prev_random;
 
+	/* Obfuscation parameter (v2) */
+	uint64_t stream_key;
+
 	/* Effective for a packaged file: */
 	uint64_t index;
 	uint64_t size;
 	uint64_t offset;
 	uint64_t pos;
+
+	/* Effective for a compressed entry: */
+	int codec;
+	uint32_t chunk_size;
+	uint64_t chunk_count;
+	uint64_t stored_size;
+	uint64_t *chunk_end;	/* Chunk table */
+	uint8_t *chunk;		/* Decompressed chunk */
+	uint64_t chunk_index;	/* Index of the chunk, or UINT64_MAX */
+	uint8_t *packed;	/* Compressed chunk */
 };
 
 /*
@@ -126,10 +287,30 @@ char *(*file_make_path)(const char *file);
 /*
  * Forward declarations.
  */
+static bool file_read_index(FILE *fp);
+static int file_find_entry(const char *path);
+static uint32_t file_hash_name(const char *name);
 static bool file_open_package(struct file *f, const char *path);
 static bool file_open_real(struct file *f, const char *path);
+static bool file_open_chunks(struct file *f);
+static bool file_read_compressed(struct file *f, void *buf, size_t size, size_t *ret);
+static bool file_load_chunk(struct file *f, uint64_t index, uint8_t *dst);
+static bool file_read_stored(struct file *f, void *buf, uint64_t pos, size_t size);
+static bool file_decompress(int codec, uint8_t *dst, size_t dst_size, const uint8_t *src, size_t src_size);
 static void file_ungetc(struct file *f, char c);
 static void file_set_random_seed(uint64_t index, uint64_t *next_random);
+static uint64_t file_step_seed(uint64_t next);
+static uint64_t file_get_key(void);
+static void file_decode(struct file *f, void *dst, const void *src, size_t size);
+static void file_decode_v1(uint8_t *dst, const uint8_t *src, size_t size, uint64_t *next_random, uint64_t *prev_random);
+static void file_decode_v2(uint8_t *dst, const uint8_t *src, size_t size, uint64_t stream_key, uint64_t pos);
+static void file_xor(uint8_t *dst, const uint8_t *src, const uint8_t *key, size_t size);
+static uint64_t file_get_stream_key(uint64_t index, bool is_name);
+static uint64_t file_mix(uint64_t key, uint64_t counter);
+static const uint8_t *file_map_fp(FILE *fp, size_t *size);
+static void file_unmap_region(const void *ptr, size_t size);
+static bool file_read_all(const char *file, const void **ptr, size_t *size);
+static bool file_add_mapping(const void *ptr, size_t size, bool is_mapped);
 static char file_get_next_random(uint64_t *next_random, uint64_t *prev_random);
 static void file_rewind_random(uint64_t *next_random, uint64_t *prev_random);
 
@@ -139,12 +320,19 @@ static void file_rewind_random(uint64_t *next_random, uint64_t *prev_random);
 bool stdfile_init(char *(*make_path_func)(const char *))
 {
 	FILE *fp;
-	uint64_t i, next_random;
-	int j;
 
 	/* Save a function pointer. */
 	file_make_path = make_path_func;
 
+	/* Initialize the mutex for the mappings. */
+	if (!is_file_mapping_mutex_initialized) {
+		if (!stdthread_mutex_init(&file_mapping_mutex)) {
+			sys_error("Cannot initialize a mutex.");
+			return false;
+		}
+		is_file_mapping_mutex_initialized = true;
+	}
+
 	/* Get a real path to a package file. */
 	file_package_path = file_make_path(PACKAGE_FILE);
 	if (file_package_path == NULL)
@@ -170,42 +358,124 @@ bool stdfile_init(char *(*make_path_func)(const char *))
 #endif
 	}
 
-	/* Read the number of the file entries. */
-	if (fread(&file_entry_count, sizeof(uint64_t), 1, fp) < 1) {
+	/* Read the entries. */
+	if (!file_read_index(fp)) {
 		sys_error("Corrupted package file.");
 		fclose(fp);
 		return false;
 	}
-	if (file_entry_count > ENTRY_SIZE) {
-		sys_error("Corrupted package file.");
-		fclose(fp);
+
+	/*
+	 * Map the package, and close it.
+	 * If we cannot map it, we will reopen a FILE pointer per an input
+	 * stream.
+	 */
+	file_package_map = file_map_fp(fp, &file_package_size);
+	fclose(fp);
+
+	return true;
+}
+
+/* Read the entries, and make the hash table. */
+static bool file_read_index(FILE *fp)
+{
+	uint8_t *buf, *p;
+	uint64_t count, seed, next_random, val;
+	uint32_t slot, version, val32;
+	size_t entry_bytes;
+	uint64_t i;
+	int j;
+
+	/* Read the magic, or the number of the file entries for v1. */
+	if (fread(&val, sizeof(uint64_t), 1, fp) < 1)
 		return false;
+	if (memcmp(&val, PACKAGE_MAGIC, 4) == 0) {
+		memcpy(&version, (uint8_t *)&val + 4, 4);
+		version = LETOHOST32(version);
+		if (version != 2 && version != 3)
+			return false;
+		file_package_version = (int)version;
+
+		/* Read the number of the file entries. */
+		if (fread(&val, sizeof(uint64_t), 1, fp) < 1)
+			return false;
+	} else {
+		file_package_version = 1;
 	}
+	count = LETOHOST64(val);
+	if (count > ENTRY_SIZE)
+		return false;
+	entry_bytes = file_package_version == 3 ? ENTRY_BYTES_V3 : ENTRY_BYTES;
 
-	/* Read the file entries. */
-	for (i = 0; i < file_entry_count; i++) {
-		if (fread(&file_entry[i].name, FILE_NAME_SIZE, 1, fp) < 1)
-			break;
-		file_set_random_seed(i, &next_random);
-		for (j = 0; j < FILE_NAME_SIZE; j++)
-			file_entry[i].name[j] ^= file_get_next_random(&next_random, NULL);
-		if (fread(&file_entry[i].size, sizeof(uint64_t), 1, fp) < 1)
-			break;
-		if (fread(&file_entry[i].offset, sizeof(uint64_t), 1, fp) < 1)
-			break;
+	/* Read the entry table at once. */
+	buf = malloc(count > 0 ? (size_t)count * entry_bytes : 1);
+	if (buf == NULL) {
+		sys_out_of_memory();
+		return false;
 	}
-	if (i != file_entry_count) {
-		sys_error("Package file corrupted.");
-		fclose(fp);
+	if (count > 0 && fread(buf, entry_bytes, (size_t)count, fp) < count) {
+		free(buf);
 		return false;
 	}
 
-	/*
-	 * Close the package for now;
-	 * we will reopen a FILE pointer per an input stream.
-	 */
-	fclose(fp);
+	memset(file_hash_table, 0, sizeof(file_hash_table));
+	file_set_random_seed(0, &seed);
+	for (i = 0; i < count; i++) {
+		p = buf + i * entry_bytes;
+
+		if (file_package_version >= 2) {
+			/* Decode the name by the name stream. */
+			file_decode_v2((uint8_t *)file_entry[i].name, p, FILE_NAME_SIZE, file_get_stream_key(i, true), 0);
+			file_entry[i].name[FILE_NAME_SIZE - 1] = '\0';
+		} else {
+			/* Decode the name up to the terminator. (the seed is per entry) */
+			next_random = seed;
+			seed = file_step_seed(seed);
+			for (j = 0; j < FILE_NAME_SIZE - 1; j++) {
+				file_entry[i].name[j] = (char)p[j] ^ file_get_next_random(&next_random, NULL);
+				if (file_entry[i].name[j] == '\0')
+					break;
+			}
+			file_entry[i].name[j] = '\0';
+		}
+
+		memcpy(&val, p + FILE_NAME_SIZE, 8);
+		file_entry[i].size = LETOHOST64(val);
+		memcpy(&val, p + FILE_NAME_SIZE + 8, 8);
+		file_entry[i].offset = LETOHOST64(val);
+		if (file_package_version == 3) {
+			memcpy(&val, p + FILE_NAME_SIZE + 16, 8);
+			file_entry[i].stored_size = LETOHOST64(val);
+			memcpy(&val32, p + FILE_NAME_SIZE + 24, 4);
+			val32 = LETOHOST32(val32);
+			if (val32 > STDFILE_CODEC_BROTLI) {
+				free(buf);
+				return false;
+			}
+			file_entry[i].codec = (int)val32;
+			memcpy(&val32, p + FILE_NAME_SIZE + 28, 4);
+			file_entry[i].chunk_size = LETOHOST32(val32);
+		} else {
+			file_entry[i].stored_size = file_entry[i].size;
+			file_entry[i].codec = STDFILE_CODEC_STORE;
+			file_entry[i].chunk_size = 0;
+		}
+		if (file_entry[i].codec != STDFILE_CODEC_STORE &&
+		    file_entry[i].chunk_size == 0) {
+			free(buf);
+			return false;
+		}
+
+		/* Put to the hash table. (the first one wins for duplicates) */
+		file_entry[i].hash = file_hash_name(file_entry[i].name);
+		slot = file_entry[i].hash & (HASH_SIZE - 1);
+		while (file_hash_table[slot] != 0)
+			slot = (slot + 1) & (HASH_SIZE - 1);
+		file_hash_table[slot] = (uint32_t)i + 1;
+	}
+	file_entry_count = count;
 
+	free(buf);
 	return true;
 }
 
@@ -214,6 +484,29 @@ bool stdfile_init(char *(*make_path_func)(const char *))
  */
 void stdfile_cleanup(void)
 {
+	int i;
+
+	/* Release the mappings that are left. */
+	if (is_file_mapping_mutex_initialized) {
+		for (i = 0; i < MAPPING_MAX; i++) {
+			if (file_mapping[i].ptr == NULL)
+				continue;
+			if (file_mapping[i].is_mapped)
+				file_unmap_region(file_mapping[i].ptr, file_mapping[i].size);
+			else
+				free((void *)file_mapping[i].ptr);
+			file_mapping[i].ptr = NULL;
+		}
+		stdthread_mutex_destroy(&file_mapping_mutex);
+		is_file_mapping_mutex_initialized = false;
+	}
+
+	if (file_package_map != NULL) {
+		file_unmap_region(file_package_map, file_package_size);
+		file_package_map = NULL;
+		file_package_size = 0;
+	}
+
 	if (file_package_path != NULL) {
 		free(file_package_path);
 		file_package_path = NULL;
@@ -225,19 +518,13 @@ void stdfile_cleanup(void)
  */
 bool file_check_exist(const char *file)
 {
-	char entry_name[FILE_NAME_SIZE];
 	FILE *fp;
-	uint64_t i;
 
 	/* If we're using a package file. */
 	if (file_package_path != NULL) {
 		/* Check whether a file entry exists in the package. */
-		for (i = 0; i < file_entry_count; i++) {
-			if (strcasecmp(file_entry[i].name, entry_name) == 0) {
-				/* Entry exists. */
-				return true;
-			}
-		}
+		if (file_find_entry(file) >= 0)
+			return true;
 	}
 
 #if defined(TARGET_IOS) || defined(TARGET_WASM)
@@ -321,33 +608,42 @@ static bool file_open_package(struct file *f, const char *path)
 	int i;
 
 	/* Search a file entry on the package. */
-	for (i = 0; i < file_entry_count; i++) {
-		if (strcasecmp(file_entry[i].name, path) == 0)
-			break;
-	}
-	if (i == file_entry_count) {
+	i = file_find_entry(path);
+	if (i < 0) {
 		/* Not found. */
 		sys_error("Cannot open file \"%s\".", path);
 		return false;
 	}
 
-	/* Open a new FILE pointer to the package file. */
+	if (file_package_map != NULL) {
+		/* Refer to a slice of the mapping. */
+		if (file_entry[i].offset > file_package_size ||
+		    file_entry[i].stored_size > file_package_size - file_entry[i].offset) {
+			sys_error("Cannot read file \"%s\".", PACKAGE_FILE);
+			return false;
+		}
+		f->fp = NULL;
+		f->map = file_package_map + file_entry[i].offset;
+	} else {
+		/* Open a new FILE pointer to the package file. */
 #ifdef TARGET_WIN32
-	_fmode = _O_BINARY;
-	f->fp = _wfopen(utf8_to_utf16(file_package_path), L"r");
+		_fmode = _O_BINARY;
+		f->fp = _wfopen(utf8_to_utf16(file_package_path), L"r");
 #else
-	f->fp = fopen(file_package_path, "r");
+		f->fp = fopen(file_package_path, "r");
 #endif
-	if (f->fp == NULL) {
-		sys_error("Cannot open file \"%s\".", PACKAGE_FILE);
-		return false;
-	}
+		if (f->fp == NULL) {
+			sys_error("Cannot open file \"%s\".", PACKAGE_FILE);
+			return false;
+		}
 
-	/* Seek to the offset. */
-	if (fseek(f->fp, (long)file_entry[i].offset, SEEK_SET) != 0) {
-		sys_error("Cannot read file \"%s\".", PACKAGE_FILE);
-		fclose(f->fp);
-		return false;
+		/* Seek to the offset. */
+		if (fseek(f->fp, (long)file_entry[i].offset, SEEK_SET) != 0) {
+			sys_error("Cannot read file \"%s\".", PACKAGE_FILE);
+			fclose(f->fp);
+			return false;
+		}
+		f->map = NULL;
 	}
 
 	/* Setup the file struct. */
@@ -357,12 +653,107 @@ static bool file_open_package(struct file *f, const char *path)
 	f->size = file_entry[i].size;
 	f->offset = file_entry[i].offset;
 	f->pos = 0;
-	file_set_random_seed(i, &f->next_random);
-	f->prev_random = 0;
+	if (file_package_version >= 2) {
+		f->stream_key = file_get_stream_key(i, false);
+	} else {
+		file_set_random_seed(i, &f->next_random);
+		f->prev_random = 0;
+	}
+
+	/* Read the chunk table of a compressed entry. */
+	f->codec = file_entry[i].codec;
+	f->chunk_size = file_entry[i].chunk_size;
+	f->stored_size = file_entry[i].stored_size;
+	f->chunk_end = NULL;
+	f->chunk = NULL;
+	f->packed = NULL;
+	if (f->codec != STDFILE_CODEC_STORE && !file_open_chunks(f)) {
+		sys_error("Cannot read file \"%s\".", path);
+		if (f->fp != NULL)
+			fclose(f->fp);
+		return false;
+	}
+
+	return true;
+}
+
+/* Read the chunk table, and allocate the buffers. */
+static bool file_open_chunks(struct file *f)
+{
+	uint64_t i, start, max_size;
+
+	f->chunk_count = (f->size + f->chunk_size - 1) / f->chunk_size;
+	f->chunk_index = UINT64_MAX;
+	if (f->chunk_count > f->stored_size / 8)
+		return false;
+
+	/* Read the table, and check that the chunks are in the body. */
+	f->chunk_end = malloc(f->chunk_count > 0 ? (size_t)f->chunk_count * 8 : 1);
+	if (f->chunk_end == NULL) {
+		sys_out_of_memory();
+		return false;
+	}
+	if (!file_read_stored(f, f->chunk_end, 0, (size_t)f->chunk_count * 8)) {
+		free(f->chunk_end);
+		return false;
+	}
+	max_size = 0;
+	start = f->chunk_count * 8;
+	for (i = 0; i < f->chunk_count; i++) {
+		f->chunk_end[i] = LETOHOST64(f->chunk_end[i]);
+		if (f->chunk_end[i] < start || f->chunk_end[i] > f->stored_size) {
+			free(f->chunk_end);
+			return false;
+		}
+		if (f->chunk_end[i] - start > max_size)
+			max_size = f->chunk_end[i] - start;
+		start = f->chunk_end[i];
+	}
+
+	/* Allocate the buffer for a compressed chunk. */
+	f->packed = malloc(max_size > 0 ? (size_t)max_size : 1);
+	if (f->packed == NULL) {
+		sys_out_of_memory();
+		free(f->chunk_end);
+		return false;
+	}
 
 	return true;
 }
 
+/* Find an entry by a name. (-1 if not found) */
+static int file_find_entry(const char *path)
+{
+	uint32_t hash, slot, index;
+
+	hash = file_hash_name(path);
+	for (slot = hash & (HASH_SIZE - 1);
+	     (index = file_hash_table[slot]) != 0;
+	     slot = (slot + 1) & (HASH_SIZE - 1)) {
+		if (file_entry[index - 1].hash == hash &&
+		    strcasecmp(file_entry[index - 1].name, path) == 0)
+			return (int)(index - 1);
+	}
+	return -1;
+}
+
+/* Hash a name by FNV-1a, ignoring the ASCII case. */
+static uint32_t file_hash_name(const char *name)
+{
+	uint32_t h;
+	char c;
+
+	h = 2166136261u;
+	for (; *name != '\0'; name++) {
+		c = *name;
+		if (c >= 'A' && c <= 'Z')
+			c = (char)(c - 'A' + 'a');
+		h ^= (uint8_t)c;
+		h *= 16777619u;
+	}
+	return h;
+}
+
 /* Open a real file on a file system. */
 static bool file_open_real(struct file *f, const char *path)
 {
@@ -385,6 +776,7 @@ static bool file_open_real(struct file *f, const char *path)
 		return false;
 
 	f->is_packaged = false;
+	f->map = NULL;
 	return true;
 }
 
@@ -415,12 +807,30 @@ bool file_get_size(struct file *f, size_t *ret)
  */
 bool file_read(struct file *f, void *buf, size_t size, size_t *ret)
 {
-	size_t len, obf;
+	size_t len;
 
 	assert(f != NULL);
-	assert(f->fp != NULL);
+	assert(f->fp != NULL || f->map != NULL);
 
-	if (f->is_packaged) {
+	if (f->is_packaged && f->codec != STDFILE_CODEC_STORE) {
+		/*
+		 * For the case f points to a compressed package entry.
+		 */
+		return file_read_compressed(f, buf, size, ret);
+	} else if (f->is_packaged && f->map != NULL) {
+		/*
+		 * For the case f points to a mapped package entry.
+		 */
+
+		/* Decode from the mapping directly. */
+		if (f->pos + size > f->size)
+			size = (size_t)(f->size - f->pos);
+		if (size == 0)
+			return false;
+		file_decode(f, buf, f->map + f->pos, size);
+		f->pos += size;
+		len = size;
+	} else if (f->is_packaged) {
 		/*
 		 * For the case f points to a package entry.
 		 */
@@ -431,11 +841,10 @@ bool file_read(struct file *f, void *buf, size_t size, size_t *ret)
 		if (size == 0)
 			return false;
 		len = fread(buf, 1, size, f->fp);
-		f->pos += len;
 
 		/* Do obfuscation decode. */
-		for (obf = 0; obf < len; obf++)
-			*(((char *)buf) + obf) ^= file_get_next_random(&f->next_random, &f->prev_random);
+		file_decode(f, buf, buf, len);
+		f->pos += len;
 	} else {
 		/*
 		 * For the case f points to a real file.
@@ -452,6 +861,126 @@ bool file_read(struct file *f, void *buf, size_t size, size_t *ret)
 	return true;
 }
 
+/* Read from a compressed entry. */
+static bool file_read_compressed(struct file *f, void *buf, size_t size, size_t *ret)
+{
+	uint8_t *dst;
+	uint64_t index, chunk_pos, chunk_len;
+	size_t len;
+
+	if (f->pos + size > f->size)
+		size = (size_t)(f->size - f->pos);
+
+	dst = buf;
+	*ret = 0;
+	while (*ret < size) {
+		index = f->pos / f->chunk_size;
+		chunk_pos = f->pos % f->chunk_size;
+		chunk_len = f->size - index * f->chunk_size;
+		if (chunk_len > f->chunk_size)
+			chunk_len = f->chunk_size;
+		len = (size_t)(chunk_len - chunk_pos);
+		if (len > size - *ret)
+			len = size - *ret;
+
+		if (chunk_pos == 0 && len == chunk_len && index != f->chunk_index) {
+			/* Decompress a whole chunk to the buffer directly. */
+			if (!file_load_chunk(f, index, dst))
+				break;
+		} else {
+			/* Decompress a chunk to the chunk buffer, and copy. */
+			if (index != f->chunk_index) {
+				if (f->chunk == NULL) {
+					f->chunk = malloc(f->chunk_size);
+					if (f->chunk == NULL) {
+						sys_out_of_memory();
+						break;
+					}
+				}
+				if (!file_load_chunk(f, index, f->chunk))
+					break;
+				f->chunk_index = index;
+			}
+			memcpy(dst, f->chunk + chunk_pos, len);
+		}
+
+		dst += len;
+		*ret += len;
+		f->pos += len;
+	}
+
+	if (*ret == 0)
+		return false;
+
+	return true;
+}
+
+/* Decompress a chunk. */
+static bool file_load_chunk(struct file *f, uint64_t index, uint8_t *dst)
+{
+	uint64_t start, len;
+
+	start = index == 0 ? f->chunk_count * 8 : f->chunk_end[index - 1];
+	len = f->size - index * f->chunk_size;
+	if (len > f->chunk_size)
+		len = f->chunk_size;
+
+	if (!file_read_stored(f, f->packed, start, (size_t)(f->chunk_end[index] - start)) ||
+	    !file_decompress(f->codec, dst, (size_t)len, f->packed, (size_t)(f->chunk_end[index] - start))) {
+		sys_error("Cannot read file \"%s\".", file_entry[f->index].name);
+		return false;
+	}
+
+	return true;
+}
+
+/* Read and decode the bytes at a position in a body. */
+static bool file_read_stored(struct file *f, void *buf, uint64_t pos, size_t size)
+{
+	if (f->map != NULL) {
+		/* Decode from the mapping directly. */
+		file_decode_v2(buf, f->map + pos, size, f->stream_key, pos);
+		return true;
+	}
+
+	/* Read by the FILE pointer. */
+	if (fseek(f->fp, (long)(f->offset + pos), SEEK_SET) != 0)
+		return false;
+	if (fread(buf, 1, size, f->fp) < size)
+		return false;
+	file_decode_v2(buf, buf, size, f->stream_key, pos);
+	return true;
+}
+
+/* Decompress a buffer that must decompress to dst_size bytes. */
+static bool file_decompress(int codec, uint8_t *dst, size_t dst_size, const uint8_t *src, size_t src_size)
+{
+	uLongf zlib_size;
+	unsigned int bzip2_size;
+	size_t brotli_size;
+
+	switch (codec) {
+	case STDFILE_CODEC_ZLIB:
+		zlib_size = (uLongf)dst_size;
+		if (uncompress(dst, &zlib_size, src, (uLong)src_size) != Z_OK)
+			return false;
+		return zlib_size == dst_size;
+	case STDFILE_CODEC_BZIP2:
+		bzip2_size = (unsigned int)dst_size;
+		if (BZ2_bzBuffToBuffDecompress((char *)dst, &bzip2_size, (char *)src, (unsigned int)src_size, 0, 0) != BZ_OK)
+			return false;
+		return bzip2_size == dst_size;
+	case STDFILE_CODEC_BROTLI:
+		brotli_size = dst_size;
+		if (BrotliDecoderDecompress(src_size, src, &brotli_size, dst) != BROTLI_DECODER_RESULT_SUCCESS)
+			return false;
+		return brotli_size == dst_size;
+	default:
+		break;
+	}
+	return false;
+}
+
 /*
  * Read a u64 from a file stream.
  */
@@ -524,7 +1053,7 @@ bool file_get_string(struct file *f, char *buf, size_t size)
 	char c;
 
 	assert(f != NULL);
-	assert(f->fp != NULL);
+	assert(f->fp != NULL || f->map != NULL);
 	assert(buf != NULL);
 	assert(size > 0);
 
@@ -567,14 +1096,16 @@ bool file_get_string(struct file *f, char *buf, size_t size)
 static void file_ungetc(struct file *f, char c)
 {
 	assert(f != NULL);
-	assert(f->fp != NULL);
+	assert(f->fp != NULL || f->map != NULL);
 
 	if (f->is_packaged) {
 		/* If f points to a package entry. */
 		assert(f->pos != 0);
-		ungetc(c, f->fp);
+		if (f->fp != NULL && f->codec == STDFILE_CODEC_STORE)
+			ungetc(c, f->fp);
 		f->pos--;
-		file_rewind_random(&f->next_random, &f->prev_random);
+		if (file_package_version == 1)
+			file_rewind_random(&f->next_random, &f->prev_random);
 	} else {
 		/* If f points to a real file. */
 		ungetc(c, f->fp);
@@ -587,9 +1118,15 @@ static void file_ungetc(struct file *f, char c)
 void file_close(struct file *f)
 {
 	assert(f != NULL);
-	assert(f->fp != NULL);
+	assert(f->fp != NULL || f->map != NULL);
 
-	fclose(f->fp);
+	if (f->fp != NULL)
+		fclose(f->fp);
+	if (f->is_packaged) {
+		free(f->chunk_end);
+		free(f->chunk);
+		free(f->packed);
+	}
 	free(f);
 }
 
@@ -599,14 +1136,17 @@ void file_close(struct file *f)
 void file_rewind(struct file *f)
 {
 	assert(f != NULL);
-	assert(f->fp != NULL);
+	assert(f->fp != NULL || f->map != NULL);
 
 	if (f->is_packaged) {
 		/* If f points to a package entry. */
-		fseek(f->fp, (long)f->offset, SEEK_SET);
+		if (f->fp != NULL)
+			fseek(f->fp, (long)f->offset, SEEK_SET);
 		f->pos = 0;
-		file_set_random_seed(f->index, &f->next_random);
-		f->prev_random = 0;
+		if (file_package_version == 1) {
+			file_set_random_seed(f->index, &f->next_random);
+			f->prev_random = 0;
+		}
 	} else {
 		/* If f points to a real file. */
 		rewind(f->fp);
@@ -614,11 +1154,250 @@ void file_rewind(struct file *f)
 	}
 }
 
+/*
+ * Seek a read file stream.
+ */
+bool file_seek(struct file *f, size_t pos)
+{
+	uint64_t i;
+
+	assert(f != NULL);
+	assert(f->fp != NULL || f->map != NULL);
+
+	/* If f points to a real file. */
+	if (!f->is_packaged)
+		return fseek(f->fp, (long)pos, SEEK_SET) == 0;
+
+	/* If f points to a package entry. */
+	if (pos > f->size)
+		return false;
+	if (f->fp != NULL && f->codec == STDFILE_CODEC_STORE &&
+	    fseek(f->fp, (long)(f->offset + pos), SEEK_SET) != 0)
+		return false;
+	if (file_package_version == 1) {
+		/* The v1 keystream is stepped from the start. */
+		file_set_random_seed(f->index, &f->next_random);
+		f->prev_random = 0;
+		for (i = 0; i < pos; i++)
+			file_get_next_random(&f->next_random, &f->prev_random);
+	}
+	f->pos = pos;
+	return true;
+}
+
+/*
+ * Map a whole file to memory.
+ */
+bool file_map(const char *file, const void **ptr, size_t *size)
+{
+	const uint8_t *p;
+	char *real_path;
+	FILE *fp;
+	size_t len;
+
+	assert(file != NULL);
+	assert(ptr != NULL);
+	assert(size != NULL);
+
+	/* Decode a packaged entry to a buffer. */
+	if (file_package_path != NULL)
+		return file_read_all(file, ptr, size);
+
+#if defined(TARGET_IOS) || defined(TARGET_WASM)
+	return false;
+#else
+	/* Open a real file. */
+	real_path = file_make_path(file);
+	if (real_path == NULL)
+		return false;
+#ifdef TARGET_WIN32
+	_fmode = _O_BINARY;
+	fp = _wfopen(win32_utf8_to_utf16(real_path), L"r");
+#else
+	fp = fopen(real_path, "r");
+#endif
+	free(real_path);
+	if (fp == NULL)
+		return false;
+
+	/* Map the file. (an empty file cannot be mapped, and is read) */
+	p = file_map_fp(fp, &len);
+	fclose(fp);
+	if (p == NULL)
+		return file_read_all(file, ptr, size);
+	if (!file_add_mapping(p, len, true)) {
+		file_unmap_region(p, len);
+		return false;
+	}
+
+	*ptr = p;
+	*size = len;
+	return true;
+#endif
+}
+
+/* Read a whole file to a buffer. */
+static bool file_read_all(const char *file, const void **ptr, size_t *size)
+{
+	struct file *f;
+	uint8_t *buf;
+	size_t len, ret;
+
+	if (!file_open(file, &f))
+		return false;
+	if (!file_get_size(f, &len)) {
+		file_close(f);
+		return false;
+	}
+	buf = malloc(len > 0 ? len : 1);
+	if (buf == NULL) {
+		file_close(f);
+		sys_out_of_memory();
+		return false;
+	}
+	if (len > 0 && (!file_read(f, buf, len, &ret) || ret != len)) {
+		sys_error("Cannot read file \"%s\".", file);
+		file_close(f);
+		free(buf);
+		return false;
+	}
+	file_close(f);
+
+	if (!file_add_mapping(buf, len, false)) {
+		free(buf);
+		return false;
+	}
+
+	*ptr = buf;
+	*size = len;
+	return true;
+}
+
+/* Put a mapping to the table. */
+static bool file_add_mapping(const void *ptr, size_t size, bool is_mapped)
+{
+	int i;
+
+	stdthread_mutex_lock(&file_mapping_mutex);
+	for (i = 0; i < MAPPING_MAX; i++) {
+		if (file_mapping[i].ptr == NULL) {
+			file_mapping[i].ptr = ptr;
+			file_mapping[i].size = size;
+			file_mapping[i].is_mapped = is_mapped;
+			break;
+		}
+	}
+	stdthread_mutex_unlock(&file_mapping_mutex);
+
+	if (i == MAPPING_MAX) {
+		sys_error("Too many mapped files.");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Unmap a file mapped by file_map().
+ */
+void file_unmap(const void *ptr)
+{
+	struct file_mapping m;
+	int i;
+
+	if (ptr == NULL)
+		return;
+
+	/* Remove from the table. */
+	m.ptr = NULL;
+	stdthread_mutex_lock(&file_mapping_mutex);
+	for (i = 0; i < MAPPING_MAX; i++) {
+		if (file_mapping[i].ptr == ptr) {
+			m = file_mapping[i];
+			file_mapping[i].ptr = NULL;
+			break;
+		}
+	}
+	stdthread_mutex_unlock(&file_mapping_mutex);
+	assert(m.ptr != NULL);
+	if (m.ptr == NULL)
+		return;
+
+	if (m.is_mapped)
+		file_unmap_region(m.ptr, m.size);
+	else
+		free((void *)m.ptr);
+}
+
+/* Map a whole stdio file read-only. (NULL if failed or empty) */
+static const uint8_t *file_map_fp(FILE *fp, size_t *size)
+{
+#ifdef TARGET_WIN32
+	HANDLE file, mapping;
+	LARGE_INTEGER len;
+	void *p;
+
+	file = (HANDLE)_get_osfhandle(_fileno(fp));
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	if (!GetFileSizeEx(file, &len) || len.QuadPart <= 0)
+		return NULL;
+	mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+		return NULL;
+	p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);	/* The view keeps the mapping. */
+	if (p == NULL)
+		return NULL;
+	*size = (size_t)len.QuadPart;
+	return p;
+#else
+	struct stat st;
+	void *p;
+
+	if (fstat(fileno(fp), &st) != 0 || st.st_size <= 0)
+		return NULL;
+	p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	*size = (size_t)st.st_size;
+	return p;
+#endif
+}
+
+/* Unmap a region mapped by file_map_fp(). */
+static void file_unmap_region(const void *ptr, size_t size)
+{
+#ifdef TARGET_WIN32
+	UNUSED_PARAMETER(size);
+	UnmapViewOfFile(ptr);
+#else
+	munmap((void *)ptr, size);
+#endif
+}
+
 /* Set a random seed. */
 static void file_set_random_seed(uint64_t index, uint64_t *next_random)
 {
-	uint64_t i, next, lsb;
+	uint64_t i, next, period;
+
+	next = file_get_key();
+
+	/* 64 steps give the value XORed with the step constant. */
+	if ((index / 64) % 2 == 1) {
+		period = 0;
+		for (i = 0; i < 64; i++)
+			period = file_step_seed(period);
+		next ^= period;
+	}
+	for (i = 0; i < index % 64; i++)
+		next = file_step_seed(next);
+
+	*next_random = next;
+}
 
+/* Get the key. */
+static uint64_t file_get_key(void)
+{
 	/* The key is shuffled so that decompilers cannot read it directly. */
 	key_reversed = ((((key_obfuscated >> 56) & 0xff) << 0) |
 			(((key_obfuscated >> 48) & 0xff) << 8) |
@@ -628,21 +1407,46 @@ static void file_set_random_seed(uint64_t index, uint64_t *next_random)
 			(((key_obfuscated >> 16) & 0xff) << 40) |
 			(((key_obfuscated >> 8)  & 0xff) << 48) |
 			(((key_obfuscated >> 0)  & 0xff) << 56));
-	next = ~(*key_ref);
-	for (i = 0; i < index; i++) {
-		/* This XOR mask is not a secret. */
-		next ^= NEXT_MASK1;
-		lsb = next >> 63;
-		next = (next << 1) | lsb;
-	}
+	return ~(*key_ref);
+}
 
-	*next_random = next;
+/* Step a seed to the next entry. */
+static uint64_t file_step_seed(uint64_t next)
+{
+	uint64_t lsb;
+
+	/* This XOR mask is not a secret. */
+	next ^= NEXT_MASK1;
+	lsb = next >> 63;
+	return (next << 1) | lsb;
+}
+
+/*
+ * Step a v1 keystream.
+ *  - This is ((key & 0xff00) * next + (key & 0xff)) % key ^ NEXT_MASK2.
+ */
+static INLINE uint64_t file_step_random(uint64_t next, uint64_t key)
+{
+	uint64_t t;
+
+	t = (key & 0xff00) * next + (key & 0xff);
+	if (key >= ((uint64_t)1 << 62)) {
+		/* t is less than 4 * key, so subtract instead of dividing. */
+		if (t >= key)
+			t -= key;
+		if (t >= key)
+			t -= key;
+		if (t >= key)
+			t -= key;
+	} else {
+		t %= key;
+	}
+	return t ^ NEXT_MASK2;
 }
 
 /* Get a next random mask. */
 static char file_get_next_random(uint64_t *next_random, uint64_t *prev_random)
 {
-	uint64_t next;
 	char ret;
 
 	/* For ungetc(). */
@@ -650,12 +1454,137 @@ static char file_get_next_random(uint64_t *next_random, uint64_t *prev_random)
 		*prev_random = *next_random;
 
 	ret = (char)(*next_random);
+	*next_random = file_step_random(*next_random, ~(*key_ref));
+
+	return ret;
+}
+
+/* Keystream bytes generated at a time. */
+#define KEYSTREAM_BLOCK		(256)
+
+/* Decode the bytes of a package entry at the current position. (src may be dst) */
+static void file_decode(struct file *f, void *dst, const void *src, size_t size)
+{
+	if (file_package_version >= 2)
+		file_decode_v2(dst, src, size, f->stream_key, f->pos);
+	else
+		file_decode_v1(dst, src, size, &f->next_random, &f->prev_random);
+}
+
+/* Decode by the v1 keystream. */
+static void file_decode_v1(uint8_t *dst, const uint8_t *src, size_t size, uint64_t *next_random, uint64_t *prev_random)
+{
+	uint8_t block[KEYSTREAM_BLOCK];
+	uint64_t key, next, prev;
+	size_t i, len;
+
+	if (size == 0)
+		return;
+
+	/* Read the volatile key once. */
+	key = ~(*key_ref);
+
 	next = *next_random;
-	next = (((~(*key_ref) & 0xff00) * next + (~(*key_ref) & 0xff)) %
-		~(*key_ref)) ^ NEXT_MASK2;
+	prev = *prev_random;
+	while (size > 0) {
+		/* Generate a block of the keystream. */
+		len = size < KEYSTREAM_BLOCK ? size : KEYSTREAM_BLOCK;
+		for (i = 0; i < len; i++) {
+			block[i] = (uint8_t)next;
+			prev = next;
+			next = file_step_random(next, key);
+		}
+
+		/* XOR the block. */
+		file_xor(dst, src, block, len);
+		dst += len;
+		src += len;
+		size -= len;
+	}
 	*next_random = next;
+	*prev_random = prev;
+}
 
-	return ret;
+/* Decode by the v2 keystream at a position. */
+static void file_decode_v2(uint8_t *dst, const uint8_t *src, size_t size, uint64_t stream_key, uint64_t pos)
+{
+	uint8_t block[8];
+	uint64_t counter, word, data;
+	size_t head, len;
+
+	counter = pos / 8;
+	head = (size_t)(pos % 8);
+
+	/* The head in the middle of a word. */
+	if (head > 0) {
+		word = HOSTTOLE64(file_mix(stream_key, counter++));
+		memcpy(block, &word, 8);
+		len = 8 - head < size ? 8 - head : size;
+		file_xor(dst, src, block + head, len);
+		dst += len;
+		src += len;
+		size -= len;
+	}
+
+	/* Whole words. (the words are independent) */
+	while (size >= 8) {
+		word = HOSTTOLE64(file_mix(stream_key, counter++));
+		memcpy(&data, src, 8);
+		data ^= word;
+		memcpy(dst, &data, 8);
+		dst += 8;
+		src += 8;
+		size -= 8;
+	}
+
+	/* The tail. */
+	if (size > 0) {
+		word = HOSTTOLE64(file_mix(stream_key, counter));
+		memcpy(block, &word, 8);
+		file_xor(dst, src, block, size);
+	}
+}
+
+/* XOR the keystream. (src may be dst) */
+static void file_xor(uint8_t *dst, const uint8_t *src, const uint8_t *key, size_t size)
+{
+	uint64_t a, b;
+	size_t i;
+
+	/* 8 bytes at a time. (compilers vectorize this loop) */
+	for (i = 0; i + 8 <= size; i += 8) {
+		memcpy(&a, src + i, 8);
+		memcpy(&b, key + i, 8);
+		a ^= b;
+		memcpy(dst + i, &a, 8);
+	}
+	for (; i < size; i++)
+		dst[i] = src[i] ^ key[i];
+}
+
+/*
+ * Obfuscate or decode bytes at a position of a stream of an entry.
+ */
+void stdfile_crypt(void *buf, size_t size, uint64_t index, bool is_name, uint64_t pos)
+{
+	file_decode_v2(buf, buf, size, file_get_stream_key(index, is_name), pos);
+}
+
+/* Get a v2 stream key of an entry. */
+static uint64_t file_get_stream_key(uint64_t index, bool is_name)
+{
+	return file_mix(file_get_key() ^ NEXT_MASK2, index * 2 + (is_name ? 1 : 0));
+}
+
+/* Mix a key and a counter. (the SplitMix64 output function) */
+static uint64_t file_mix(uint64_t key, uint64_t counter)
+{
+	uint64_t z;
+
+	z = key + counter * 0x9e3779b97f4a7c15;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
 }
 
 /* Go back to the previous random mask. */
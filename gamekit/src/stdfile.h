@@ -18,4 +18,26 @@ bool stdfile_init(char *(*make_path_func)(const char *));
 /* Cleanup the stdfile module. */
 void stdfile_cleanup(void);
 
+/*
+ * For the packer (packprogram.c)
+ */
+
+/* Package version that the packer writes. */
+#define STDFILE_PACKAGE_VERSION		(3)
+
+/* Maximum entries in a package. */
+#define STDFILE_ENTRY_MAX		(65536)
+
+/* File name length for an entry. */
+#define STDFILE_NAME_SIZE		(256)
+
+/* Codecs of the entries. */
+#define STDFILE_CODEC_STORE		(0)
+#define STDFILE_CODEC_ZLIB		(1)
+#define STDFILE_CODEC_BZIP2		(2)
+#define STDFILE_CODEC_BROTLI		(3)
+
+/* Obfuscate or decode bytes at a position of a stream of an entry. */
+void stdfile_crypt(void *buf, size_t size, uint64_t index, bool is_name, uint64_t pos);
+
 #endif
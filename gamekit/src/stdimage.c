@@ -10,6 +10,11 @@
  */
 
 #include "gamekit/gamekit.h"
+#include "stdimage.h"
+#include "stdblend.h"
+#include "stdthread.h"
+
+#include <math.h>	/* floor(), ceil() */
 
 #if defined(TARGET_WIN32)
 #include <malloc.h>	/* _aligned_malloc() */
@@ -18,6 +23,18 @@
 /* 512-bit alignment. */
 #define ALIGN_BYTES	(64)
 
+/* Minimum pixels of a rectangle to draw in parallel. */
+#define PARALLEL_MIN_PIXELS	(128 * 128)
+
+/* Minimum rows of a band. */
+#define BAND_MIN_ROWS		(8)
+
+/* Bands per thread, to balance the load. */
+#define BANDS_PER_THREAD	(4)
+
+/* Pixels sampled at a time by the scaled and transformed drawing. */
+#define SAMPLE_CHUNK		(256)
+
 /*
  * The body of the image structure.
  */
@@ -26,16 +43,102 @@ struct image {
 	int width;
 	int height;
 	pixel_t *pixels;
+
+	/* Are the colors multiplied by the alpha? */
+	bool is_premultiplied;
+
+	/* Dirty rectangle. (right and bottom are exclusive) */
+	bool is_dirty;
+	int dirty_left;
+	int dirty_top;
+	int dirty_right;
+	int dirty_bottom;
+};
+
+/* Premultiply the decoded images? */
+static bool is_decode_premultiplied;
+
+/* Draw large rectangles in parallel? */
+static bool is_parallel_enabled = true;
+
+/* Rows to fill, copy or blend. */
+struct row_job {
+	pixel_t *dst;
+	const pixel_t *src;
+	int dst_pitch;
+	int src_pitch;
+	int width;
+	int height;
+
+	/* Blending kernel and alpha. (NULL to copy or fill) */
+	stdblend_row_func blend;
+	int alpha;
+
+	/* Fill color. (if src is NULL) */
+	pixel_t color;
+
+	/* Rows per band. */
+	int band_rows;
+};
+
+/* Rows to sample and blend. */
+struct xform_job {
+	pixel_t *dst;
+	int dst_pitch;
+	int width;
+	int height;
+
+	/* Source rectangle. */
+	const pixel_t *src;
+	int src_pitch;
+	int src_w;
+	int src_h;
+
+	/*
+	 * Source position of the top-left destination pixel center, and
+	 * the steps per destination pixel. (in source pixels)
+	 */
+	double u;
+	double v;
+	double du_dx;
+	double dv_dx;
+	double du_dy;
+	double dv_dy;
+
+	int filter;
+	stdblend_row_func blend;
+	int alpha;
+
+	/* Rows per band. */
+	int band_rows;
 };
 
 /* Forward declaration. */
+static void image_apply_decode_mode(struct image *img, bool premultiply);
+static void image_draw_rows(struct image *dst_image, int dst_left, int dst_top, struct image *src_image, int width, int height, int src_left, int src_top, stdblend_row_func blend, int alpha);
+static void image_run_rows(struct row_job *job);
+static void image_run_band(void *arg, int index);
+static void image_run_parallel(int width, int height, int *band_rows, job_func func, void *arg);
+static void image_run_xform_band(void *arg, int index);
+static bool image_get_span(const struct xform_job *job, int32_t u, int32_t v, int32_t du, int32_t dv, int *left, int *right);
+static void image_sample_nearest(pixel_t *dst, const struct xform_job *job, int32_t u, int32_t v, int32_t du, int32_t dv, int count);
+static bool image_box_weights(int src_size, int dst_size, int **first, int **count, uint32_t **weight, int *taps);
 static bool image_check_draw(struct image *dst_image, int *dst_left, int *dst_top, struct image *src_image, int *width, int *height, int *src_left, int *src_top, int alpha);
+static bool image_init_decoder(void);
+static void image_cleanup_decoder(void);
 
 /*
  * Initialize the stdimage module.
  */
 bool stdimage_init(void)
 {
+	/* Use the fastest blending kernels on this CPU. */
+	stdblend_select(NULL);
+
+	/* Prepare the asynchronous decoder. */
+	if (!image_init_decoder())
+		return false;
+
 	return true;
 }
 
@@ -44,6 +147,7 @@ bool stdimage_init(void)
  */
 void stdimage_cleanup(void)
 {
+	image_cleanup_decoder();
 }
 
 /*
@@ -60,22 +164,22 @@ bool image_create(int w, int h, struct image **ret)
 	img = malloc(sizeof(struct image));
 	if (img == NULL) {
 		sys_out_of_memory();
-		return NULL;
+		return false;
 	}
 
 	/* Allocate a pixel buffer. */
 #if defined(TARGET_WIN32)
 	pixels = _aligned_malloc((size_t)w * (size_t)h * sizeof(pixel_t), ALIGN_BYTES);
 	if (pixels == NULL) {
-		system_out_of_memory();
+		sys_out_of_memory();
 		free(img);
-		return NULL;
+		return false;
 	}
 #else
 	if (posix_memalign((void **)&pixels, ALIGN_BYTES, (size_t)w * (size_t)h * sizeof(pixel_t)) != 0) {
 		sys_out_of_memory();
 		free(img);
-		return NULL;
+		return false;
 	}
 #endif
 
@@ -83,8 +187,15 @@ bool image_create(int w, int h, struct image **ret)
 	img->width = w;
 	img->height = h;
 	img->pixels = pixels;
-
-	return img;
+	img->is_premultiplied = false;
+	img->is_dirty = true;
+	img->dirty_left = 0;
+	img->dirty_top = 0;
+	img->dirty_right = w;
+	img->dirty_bottom = h;
+
+	*ret = img;
+	return true;
 }
 
 /*
@@ -138,6 +249,76 @@ pixel_t *image_get_pixels(struct image *img)
 	return img->pixels;
 }
 
+/*
+ * Mark a rectangle of an image as modified.
+ */
+void image_mark_dirty(struct image *img, int x, int y, int w, int h)
+{
+	int right, bottom;
+
+	assert(img != NULL);
+
+	/* Clip. */
+	right = x + w;
+	bottom = y + h;
+	if (x < 0)
+		x = 0;
+	if (y < 0)
+		y = 0;
+	if (right > img->width)
+		right = img->width;
+	if (bottom > img->height)
+		bottom = img->height;
+	if (x >= right || y >= bottom)
+		return;
+
+	/* Merge to the dirty rectangle. */
+	if (!img->is_dirty) {
+		img->is_dirty = true;
+		img->dirty_left = x;
+		img->dirty_top = y;
+		img->dirty_right = right;
+		img->dirty_bottom = bottom;
+		return;
+	}
+	if (x < img->dirty_left)
+		img->dirty_left = x;
+	if (y < img->dirty_top)
+		img->dirty_top = y;
+	if (right > img->dirty_right)
+		img->dirty_right = right;
+	if (bottom > img->dirty_bottom)
+		img->dirty_bottom = bottom;
+}
+
+/*
+ * Get a modified rectangle of an image.
+ */
+bool image_get_dirty_rect(struct image *img, int *x, int *y, int *w, int *h)
+{
+	assert(img != NULL);
+
+	if (!img->is_dirty)
+		return false;
+
+	*x = img->dirty_left;
+	*y = img->dirty_top;
+	*w = img->dirty_right - img->dirty_left;
+	*h = img->dirty_bottom - img->dirty_top;
+
+	return true;
+}
+
+/*
+ * Clear a modified rectangle of an image.
+ */
+void image_clear_dirty(struct image *img)
+{
+	assert(img != NULL);
+
+	img->is_dirty = false;
+}
+
 /*
  * Clear an image with a uniform color.
  */
@@ -151,8 +332,8 @@ void image_clear(struct image *img, pixel_t color)
  */
 void image_clear_rect(struct image *img, int x, int y, int w, int h, pixel_t color)
 {
-	pixel_t *pixels;
-	int i, j, sx, sy;
+	struct row_job job;
+	int sx, sy;
 
 	assert(img != NULL);
 	assert(img->width > 0 && img->height > 0);
@@ -170,11 +351,19 @@ void image_clear_rect(struct image *img, int x, int y, int w, int h, pixel_t col
 	assert(y >= 0 && y < img->height);
 	assert(h >= 0 && y + h <= img->height);
 
+	image_mark_dirty(img, x, y, w, h);
+
 	/* Fill pixels. */
-	pixels = img->pixels;
-	for (i = y; i < y + h; i++)
-		for (j = x; j < x + w; j++)
-			pixels[img->width * i + j] = color;
+	job.dst = img->pixels + img->width * y + x;
+	job.src = NULL;
+	job.dst_pitch = img->width;
+	job.src_pitch = 0;
+	job.width = w;
+	job.height = h;
+	job.blend = NULL;
+	job.alpha = 255;
+	job.color = color;
+	image_run_rows(&job);
 }
 
 /*
@@ -184,143 +373,45 @@ void image_draw_copy(struct image *dst_image, int dst_left, int dst_top,
 		     struct image *src_image, int width, int height, int src_left,
 		     int src_top)
 {
-	pixel_t * RESTRICT src_ptr;
-	pixel_t * RESTRICT dst_ptr;
-	int x, y, sw, dw;
-
 	if (!image_check_draw(dst_image, &dst_left, &dst_top, src_image, &width, &height, &src_left, &src_top, 255))
 		return;
 
-	sw = src_image->width;
-	dw = dst_image->width;
-	src_ptr = src_image->pixels + sw * src_top + src_left;
-	dst_ptr = dst_image->pixels + dw * dst_top + dst_left;
-
-	for(y = 0; y < height; y++) {
-		for(x = 0; x < width; x++)
-			*(dst_ptr + x) = *(src_ptr + x);
-		src_ptr += sw;
-		dst_ptr += dw;
-	}
+	image_draw_rows(dst_image, dst_left, dst_top, src_image, width, height, src_left, src_top, NULL, 255);
 }
 
 /*
  * Draw an image on an image. (alpha-blending, dst_alpha=255)
  */
-void draw_image_alpha(struct image *dst_image, int dst_left, int dst_top,
+void image_draw_alpha(struct image *dst_image, int dst_left, int dst_top,
 		      struct image *src_image, int width, int height,
 		      int src_left, int src_top, int alpha)
 {
-	pixel_t * RESTRICT src_ptr;
-	pixel_t * RESTRICT dst_ptr;
-	float a, src_r, src_g, src_b, src_a, dst_r, dst_g, dst_b, dst_a;
-	uint32_t src_pix, dst_pix;
-	int src_line_inc, dst_line_inc, x, y, sw, dw;
+	stdblend_row_func blend;
 
 	if (!image_check_draw(dst_image, &dst_left, &dst_top, src_image, &width, &height, &src_left, &src_top, alpha))
 		return;
 
-	sw = src_image->width;
-	dw = dst_image->width;
-	src_ptr = src_image->pixels + sw * src_top + src_left;
-	dst_ptr = dst_image->pixels + dw * dst_top + dst_left;
-	src_line_inc = sw - width;
-	dst_line_inc = dw - width;
-	a = (float)alpha / 255.0f;
-
-	for(y = 0; y < height; y++) {
-		for(x = 0; x < width; x++) {
-			/* Get the source and destination pixel values. */
-			src_pix	= *src_ptr++;
-			dst_pix	= *dst_ptr;
-
-			/* Calc alpha values. */
-			src_a = a * ((float)get_pixel_a(src_pix) / 255.0f);
-			dst_a = 1.0f - src_a;
-
-			/* Multiply the alpha value and the source pixel value. */
-			src_r = src_a * (float)get_pixel_r(src_pix);
-			src_g = src_a * (float)get_pixel_g(src_pix);
-			src_b = src_a * (float)get_pixel_b(src_pix);
-
-			/* Multiply the alpha value and the destination pixel value. */
-			dst_r = dst_a * (float)get_pixel_r(dst_pix);
-			dst_g = dst_a * (float)get_pixel_g(dst_pix);
-			dst_b = dst_a * (float)get_pixel_b(dst_pix);
-
-			/* Store to the destination. */
-			*dst_ptr++ = make_pixel(0xff,
-						(uint32_t)(src_r + dst_r),
-						(uint32_t)(src_g + dst_g),
-						(uint32_t)(src_b + dst_b));
-		}
-		src_ptr += src_line_inc;
-		dst_ptr += dst_line_inc;
-	}
+	/* Premultiplied sources need no multiplication by their alpha. */
+	blend = src_image->is_premultiplied ? stdblend.premul_alpha : stdblend.alpha;
+
+	image_draw_rows(dst_image, dst_left, dst_top, src_image, width, height, src_left, src_top, blend, alpha);
 }
 
 /*
  * Draw an image on an image. (add-blending)
  */
-void image_draw_image_add(struct image *dst_image, int dst_left, int dst_top,
-			  struct image *src_image, int width, int height,
-			  int src_left, int src_top, int alpha)
+void image_draw_add(struct image *dst_image, int dst_left, int dst_top,
+		    struct image *src_image, int width, int height,
+		    int src_left, int src_top, int alpha)
 {
-	pixel_t * RESTRICT src_ptr;
-	pixel_t * RESTRICT dst_ptr;
-	float a, src_a;
-	uint32_t src_pix, src_r, src_g, src_b;
-	uint32_t dst_pix, dst_r, dst_g, dst_b;
-	uint32_t add_r, add_g, add_b;
-	int src_line_inc, dst_line_inc, x, y, sw, dw;
+	stdblend_row_func blend;
 
 	if (!image_check_draw(dst_image, &dst_left, &dst_top, src_image, &width, &height, &src_left, &src_top, alpha))
 		return;
 
-	sw = src_image->width;
-	dw = dst_image->width;
-	src_ptr = src_image->pixels + sw * src_top + src_left;
-	dst_ptr = dst_image->pixels + dw * dst_top + dst_left;
-	src_line_inc = sw - width;
-	dst_line_inc = dw - width;
-	a = (float)alpha / 255.0f;
-
-	for(y = 0; y < height; y++) {
-		for(x = 0; x < width; x++) {
-			/* Get the source and destination pixel values. */
-			src_pix	= *src_ptr++;
-			dst_pix	= *dst_ptr;
-
-			/* Calc alpha values. */
-			src_a = a * ((float)get_pixel_a(src_pix) / 255.0f);
-
-			/* Multiply the alpha value and the source pixel value. */
-			src_r = (uint32_t)(src_a * ((float)get_pixel_r(src_pix) / 255.0f) * 255.0f);
-			src_g = (uint32_t)(src_a * ((float)get_pixel_g(src_pix) / 255.0f) * 255.0f);
-			src_b = (uint32_t)(src_a * ((float)get_pixel_b(src_pix) / 255.0f) * 255.0f);
-
-			/* Multiply the alpha value and the destination pixel value. */
-			dst_r = get_pixel_r(dst_pix);
-			dst_g = get_pixel_g(dst_pix);
-			dst_b = get_pixel_b(dst_pix);
-
-			/* Add. */
-			add_r = src_r + dst_r;
-			if (add_r > 255)
-				add_r = 255;
-			add_g = src_g + dst_g;
-			if (add_g > 255)
-				add_g = 255;
-			add_b = src_b + dst_b;
-			if (add_b > 255)
-				add_b = 255;
-
-			/* Store to the destination. */
-			*dst_ptr++ = make_pixel(0xff, add_r, add_g, add_b);
-		}
-		src_ptr += src_line_inc;
-		dst_ptr += dst_line_inc;
-	}
+	blend = src_image->is_premultiplied ? stdblend.premul_add : stdblend.add;
+
+	image_draw_rows(dst_image, dst_left, dst_top, src_image, width, height, src_left, src_top, blend, alpha);
 }
 
 /*
@@ -330,61 +421,516 @@ void image_draw_sub(struct image *dst_image, int dst_left, int dst_top,
 		    struct image *src_image, int width, int height,
 		    int src_left, int src_top, int alpha)
 {
-	pixel_t * RESTRICT src_ptr;
-	pixel_t * RESTRICT dst_ptr;
-	float a, src_a;
-	uint32_t src_pix, src_r, src_g, src_b;
-	uint32_t dst_pix, dst_r, dst_g, dst_b;
-	uint32_t sub_r, sub_g, sub_b;
-	int src_line_inc, dst_line_inc, x, y, sw, dw;
+	stdblend_row_func blend;
 
 	if (!image_check_draw(dst_image, &dst_left, &dst_top, src_image, &width, &height, &src_left, &src_top, alpha))
 		return;
 
-	sw = src_image->width;
+	blend = src_image->is_premultiplied ? stdblend.premul_sub : stdblend.sub;
+
+	image_draw_rows(dst_image, dst_left, dst_top, src_image, width, height, src_left, src_top, blend, alpha);
+}
+
+/* Draw clipped rows. */
+static void image_draw_rows(struct image *dst_image, int dst_left, int dst_top,
+			    struct image *src_image, int width, int height,
+			    int src_left, int src_top, stdblend_row_func blend,
+			    int alpha)
+{
+	struct row_job job;
+
+	job.dst = dst_image->pixels + dst_image->width * dst_top + dst_left;
+	job.src = src_image->pixels + src_image->width * src_top + src_left;
+	job.dst_pitch = dst_image->width;
+	job.src_pitch = src_image->width;
+	job.width = width;
+	job.height = height;
+	job.blend = blend;
+	job.alpha = alpha;
+	job.color = 0;
+	image_run_rows(&job);
+}
+
+/*
+ * Split the rows into bands, and run them on the job pool.  Each band
+ * writes its own rows with the same kernel, so the result doesn't
+ * depend on the number of threads.
+ */
+static void image_run_rows(struct row_job *job)
+{
+	image_run_parallel(job->width, job->height, &job->band_rows, image_run_band, job);
+}
+
+/* Run a function for each band of rows. */
+static void image_run_parallel(int width, int height, int *band_rows, job_func func, void *arg)
+{
+	int bands;
+
+	if (!is_parallel_enabled ||
+	    job_get_thread_count() == 1 ||
+	    width * height < PARALLEL_MIN_PIXELS) {
+		*band_rows = height;
+		func(arg, 0);
+		return;
+	}
+
+	bands = job_get_thread_count() * BANDS_PER_THREAD;
+	*band_rows = (height + bands - 1) / bands;
+	if (*band_rows < BAND_MIN_ROWS)
+		*band_rows = BAND_MIN_ROWS;
+	bands = (height + *band_rows - 1) / *band_rows;
+
+	job_parallel_for(bands, func, arg);
+}
+
+/* Run a band of rows. */
+static void image_run_band(void *arg, int index)
+{
+	struct row_job *job;
+	pixel_t * RESTRICT dst;
+	const pixel_t * RESTRICT src;
+	int y, top, bottom, x;
+
+	job = arg;
+	top = index * job->band_rows;
+	bottom = top + job->band_rows;
+	if (bottom > job->height)
+		bottom = job->height;
+
+	dst = job->dst + job->dst_pitch * top;
+	src = job->src != NULL ? job->src + job->src_pitch * top : NULL;
+	for (y = top; y < bottom; y++) {
+		if (src == NULL) {
+			for (x = 0; x < job->width; x++)
+				dst[x] = job->color;
+		} else if (job->blend == NULL) {
+			memcpy(dst, src, (size_t)job->width * sizeof(pixel_t));
+			src += job->src_pitch;
+		} else {
+			job->blend(dst, src, job->width, job->alpha);
+			src += job->src_pitch;
+		}
+		dst += job->dst_pitch;
+	}
+}
+
+/*
+ * Draw a scaled image on an image. (alpha-blending)
+ */
+void image_draw_scaled(struct image *dst_image, int dst_left, int dst_top,
+		       int dst_width, int dst_height,
+		       struct image *src_image, int src_left, int src_top,
+		       int src_width, int src_height,
+		       int alpha, int filter)
+{
+	float m[6];
+
+	if (dst_width <= 0 || dst_height <= 0 || src_width <= 0 || src_height <= 0)
+		return;
+
+	m[0] = (float)dst_width / (float)src_width;
+	m[1] = 0;
+	m[2] = (float)dst_left;
+	m[3] = 0;
+	m[4] = (float)dst_height / (float)src_height;
+	m[5] = (float)dst_top;
+	image_draw_transformed(dst_image, src_image, src_left, src_top, src_width, src_height, m, alpha, filter);
+}
+
+/*
+ * Draw an affine-transformed image on an image. (alpha-blending)
+ */
+void image_draw_transformed(struct image *dst_image,
+			    struct image *src_image, int src_left, int src_top,
+			    int src_width, int src_height,
+			    const float *m, int alpha, int filter)
+{
+	struct xform_job job;
+	double det, ia, ib, ic, id, cx, cy, px, py, min_x, min_y, max_x, max_y;
+	int i, x, y, w, h, sx, sy;
+
+	assert(dst_image != NULL);
+	assert(src_image != NULL);
+	assert(dst_image != src_image);
+	assert(m != NULL);
+	assert(filter == IMAGE_FILTER_NEAREST || filter == IMAGE_FILTER_BILINEAR);
+
+	if (alpha == 0)
+		return;
+
+	/* Clip the source rectangle by the source image. */
+	sx = sy = 0;
+	if (!image_clip_by_dest(src_image->width, src_image->height, &src_width, &src_height, &src_left, &src_top, &sx, &sy))
+		return;
+
+	/* Invert the matrix to map destination pixels to the source. */
+	det = (double)m[0] * m[4] - (double)m[1] * m[3];
+	if (det > -1e-6 && det < 1e-6)
+		return;
+	ia = m[4] / det;
+	ib = -m[1] / det;
+	ic = -m[3] / det;
+	id = m[0] / det;
+
+	/* Get the bounding box of the transformed rectangle. */
+	min_x = min_y = 1e9;
+	max_x = max_y = -1e9;
+	for (i = 0; i < 4; i++) {
+		cx = (i & 1) ? src_width : 0;
+		cy = (i & 2) ? src_height : 0;
+		px = m[0] * cx + m[1] * cy + m[2];
+		py = m[3] * cx + m[4] * cy + m[5];
+		min_x = px < min_x ? px : min_x;
+		min_y = py < min_y ? py : min_y;
+		max_x = px > max_x ? px : max_x;
+		max_y = py > max_y ? py : max_y;
+	}
+	if (min_x < -(1 << 24) || min_y < -(1 << 24) || max_x > (1 << 24) || max_y > (1 << 24))
+		return;
+	x = (int)floor(min_x);
+	y = (int)floor(min_y);
+	w = (int)ceil(max_x) - x;
+	h = (int)ceil(max_y) - y;
+
+	/* Clip the bounding box by the destination image. */
+	sx = sy = 0;
+	if (!image_clip_by_dest(dst_image->width, dst_image->height, &w, &h, &x, &y, &sx, &sy))
+		return;
+	image_mark_dirty(dst_image, x, y, w, h);
+
+	job.dst = dst_image->pixels + dst_image->width * y + x;
+	job.dst_pitch = dst_image->width;
+	job.width = w;
+	job.height = h;
+	job.src = src_image->pixels + src_image->width * src_top + src_left;
+	job.src_pitch = src_image->width;
+	job.src_w = src_width;
+	job.src_h = src_height;
+	job.u = ia * (x + 0.5 - m[2]) + ib * (y + 0.5 - m[5]);
+	job.v = ic * (x + 0.5 - m[2]) + id * (y + 0.5 - m[5]);
+	job.du_dx = ia;
+	job.dv_dx = ic;
+	job.du_dy = ib;
+	job.dv_dy = id;
+	job.filter = filter;
+	job.blend = src_image->is_premultiplied ? stdblend.premul_alpha : stdblend.alpha;
+	job.alpha = alpha;
+
+	image_run_parallel(w, h, &job.band_rows, image_run_xform_band, &job);
+}
+
+/* Sample and blend a band of rows. */
+static void image_run_xform_band(void *arg, int index)
+{
+	struct xform_job *job;
+	pixel_t buf[SAMPLE_CHUNK];
+	pixel_t *dst;
+	int32_t u, v, du, dv;
+	int y, top, bottom, left, right, n;
+
+	job = arg;
+	top = index * job->band_rows;
+	bottom = top + job->band_rows;
+	if (bottom > job->height)
+		bottom = job->height;
+
+	du = (int32_t)(job->du_dx * 65536.0);
+	dv = (int32_t)(job->dv_dx * 65536.0);
+	for (y = top; y < bottom; y++) {
+		/* Compute each row start in double not to accumulate errors. */
+		u = (int32_t)floor((job->u + job->du_dy * y) * 65536.0);
+		v = (int32_t)floor((job->v + job->dv_dy * y) * 65536.0);
+		if (!image_get_span(job, u, v, du, dv, &left, &right))
+			continue;
+
+		/* The bilinear filter puts the texel centers at integers. */
+		u += du * left;
+		v += dv * left;
+		if (job->filter == IMAGE_FILTER_BILINEAR) {
+			u -= 0x8000;
+			v -= 0x8000;
+		}
+
+		dst = job->dst + job->dst_pitch * y + left;
+		while (left < right) {
+			n = right - left < SAMPLE_CHUNK ? right - left : SAMPLE_CHUNK;
+			if (job->filter == IMAGE_FILTER_BILINEAR)
+				stdblend.bilinear(buf, job->src, job->src_pitch, job->src_w, job->src_h, u, v, du, dv, n);
+			else
+				image_sample_nearest(buf, job, u, v, du, dv, n);
+			job->blend(dst, buf, n, job->alpha);
+			u += du * n;
+			v += dv * n;
+			dst += n;
+			left += n;
+		}
+	}
+}
+
+/* Get the pixels of a row whose centers are in the source rectangle. */
+static bool image_get_span(const struct xform_job *job, int32_t u, int32_t v, int32_t du, int32_t dv, int *left, int *right)
+{
+	int64_t uw, vh, ux, vx;
+	int l, r;
+
+	/* An affine image of a rectangle is convex, so the span is contiguous. */
+	uw = (int64_t)job->src_w << 16;
+	vh = (int64_t)job->src_h << 16;
+	for (l = 0; l < job->width; l++) {
+		ux = u + (int64_t)du * l;
+		vx = v + (int64_t)dv * l;
+		if (ux >= 0 && ux < uw && vx >= 0 && vx < vh)
+			break;
+	}
+	if (l == job->width)
+		return false;
+	for (r = job->width; r > l; r--) {
+		ux = u + (int64_t)du * (r - 1);
+		vx = v + (int64_t)dv * (r - 1);
+		if (ux >= 0 && ux < uw && vx >= 0 && vx < vh)
+			break;
+	}
+
+	*left = l;
+	*right = r;
+	return true;
+}
+
+/* Sample with the nearest filter. */
+static void image_sample_nearest(pixel_t *dst, const struct xform_job *job, int32_t u, int32_t v, int32_t du, int32_t dv, int count)
+{
+	int i, x, y;
+
+	for (i = 0; i < count; i++) {
+		x = u >> 16;
+		y = v >> 16;
+		x = x < 0 ? 0 : (x >= job->src_w ? job->src_w - 1 : x);
+		y = y < 0 ? 0 : (y >= job->src_h ? job->src_h - 1 : y);
+		dst[i] = job->src[job->src_pitch * y + x];
+		u += du;
+		v += dv;
+	}
+}
+
+/*
+ * Resample a whole image to the whole size of another image with the
+ * box (area-averaging) filter.
+ */
+bool image_resample_box(struct image *dst_image, struct image *src_image)
+{
+	int *x_first, *x_count, *y_first, *y_count;
+	uint32_t *x_weight, *y_weight;
+	uint16_t *tmp, *t;
+	const pixel_t *s;
+	pixel_t *d;
+	uint32_t acc[4], w;
+	int x_taps, y_taps, dw, dh, sw, sh, x, y, i, c;
+
+	assert(dst_image != NULL);
+	assert(src_image != NULL);
+	assert(dst_image != src_image);
+
 	dw = dst_image->width;
-	src_ptr = src_image->pixels + sw * src_top + src_left;
-	dst_ptr = dst_image->pixels + dw * dst_top + dst_left;
-	src_line_inc = sw - width;
-	dst_line_inc = dw - width;
-	a = (float)alpha / 255.0f;
-
-	for(y = 0; y < height; y++) {
-		for(x = 0; x < width; x++) {
-			/* Get the source and destination pixel values. */
-			src_pix	= *src_ptr++;
-			dst_pix	= *dst_ptr;
-
-			/* Calc alpha values. */
-			src_a = a * ((float)get_pixel_a(src_pix) / 255.0f);
-
-			/* Multiply the alpha value and the source pixel value. */
-			src_r = (uint32_t)(src_a * ((float)get_pixel_r(src_pix) / 255.0f) * 255.0f);
-			src_g = (uint32_t)(src_a * ((float)get_pixel_g(src_pix) / 255.0f) * 255.0f);
-			src_b = (uint32_t)(src_a * ((float)get_pixel_b(src_pix) / 255.0f) * 255.0f);
-
-			/* Multiply the alpha value and the destination pixel value. */
-			dst_r = get_pixel_r(dst_pix);
-			dst_g = get_pixel_g(dst_pix);
-			dst_b = get_pixel_b(dst_pix);
-
-			/* Add. */
-			sub_r = dst_r - src_r;
-			if (sub_r < 0)
-				sub_r = 0;
-			sub_g = dst_g - src_g;
-			if (sub_g < 0)
-				sub_g = 0;
-			sub_b = dst_b - src_b;
-			if (sub_b < 0)
-				sub_b = 0;
-
-			/* Store to the destination. */
-			*dst_ptr++ = make_pixel(0xff, sub_r, sub_g, sub_b);
+	dh = dst_image->height;
+	sw = src_image->width;
+	sh = src_image->height;
+
+	/* Compute the weights of each axis. */
+	if (!image_box_weights(sw, dw, &x_first, &x_count, &x_weight, &x_taps))
+		return false;
+	if (!image_box_weights(sh, dh, &y_first, &y_count, &y_weight, &y_taps)) {
+		free(x_first);
+		return false;
+	}
+
+	/* Horizontal pass to 16-bit channels. (8 more bits of precision) */
+	tmp = malloc(sizeof(uint16_t) * 4 * (size_t)dw * (size_t)sh);
+	if (tmp == NULL) {
+		sys_out_of_memory();
+		free(x_first);
+		free(y_first);
+		return false;
+	}
+	for (y = 0; y < sh; y++) {
+		t = tmp + (size_t)4 * dw * y;
+		for (x = 0; x < dw; x++) {
+			s = src_image->pixels + sw * y + x_first[x];
+			acc[0] = acc[1] = acc[2] = acc[3] = 0;
+			for (i = 0; i < x_count[x]; i++) {
+				w = x_weight[x * x_taps + i];
+				for (c = 0; c < 4; c++)
+					acc[c] += ((s[i] >> (c * 8)) & 0xff) * w;
+			}
+			for (c = 0; c < 4; c++)
+				t[x * 4 + c] = (uint16_t)((acc[c] + 128) >> 8);
 		}
-		src_ptr += src_line_inc;
-		dst_ptr += dst_line_inc;
 	}
+
+	/* Vertical pass. */
+	d = dst_image->pixels;
+	for (y = 0; y < dh; y++) {
+		for (x = 0; x < dw; x++) {
+			acc[0] = acc[1] = acc[2] = acc[3] = 0;
+			for (i = 0; i < y_count[y]; i++) {
+				w = y_weight[y * y_taps + i];
+				t = tmp + (size_t)4 * dw * (y_first[y] + i) + x * 4;
+				for (c = 0; c < 4; c++)
+					acc[c] += t[c] * w;
+			}
+			d[dw * y + x] = ((acc[0] + (1 << 23)) >> 24) |
+					(((acc[1] + (1 << 23)) >> 24) << 8) |
+					(((acc[2] + (1 << 23)) >> 24) << 16) |
+					(((acc[3] + (1 << 23)) >> 24) << 24);
+		}
+	}
+
+	dst_image->is_premultiplied = src_image->is_premultiplied;
+	image_mark_dirty(dst_image, 0, 0, dw, dh);
+
+	free(tmp);
+	free(x_first);
+	free(y_first);
+
+	return true;
+}
+
+/*
+ * Get the weights of the box filter for an axis.  A destination pixel
+ * x covers the source range [x * src / dst, (x + 1) * src / dst), and
+ * the weight of each source pixel is its overlap with the range, in
+ * 16-bit fixed point that sums to 65536.  The arrays are allocated by
+ * one block, so free *first only.
+ */
+static bool image_box_weights(int src_size, int dst_size, int **first, int **count, uint32_t **weight, int *taps)
+{
+	uint8_t *block;
+	int64_t lo, hi, p_lo, p_hi, overlap;
+	uint32_t sum, wi;
+	int x, p, n;
+
+	/* A range covers at most this many source pixels. */
+	*taps = (src_size + dst_size - 1) / dst_size + 1;
+
+	block = malloc((sizeof(int) * 2 + sizeof(uint32_t) * (size_t)*taps) * (size_t)dst_size);
+	if (block == NULL) {
+		sys_out_of_memory();
+		return false;
+	}
+	*first = (int *)block;
+	*count = *first + dst_size;
+	*weight = (uint32_t *)(*count + dst_size);
+
+	/* Work in units of 1 / dst_size source pixels to be exact. */
+	for (x = 0; x < dst_size; x++) {
+		lo = (int64_t)x * src_size;
+		hi = lo + src_size;
+		p = (int)(lo / dst_size);
+		(*first)[x] = p;
+		n = 0;
+		sum = 0;
+		for (; p < src_size && (int64_t)p * dst_size < hi; p++) {
+			p_lo = (int64_t)p * dst_size;
+			p_hi = p_lo + dst_size;
+			overlap = (p_hi < hi ? p_hi : hi) - (p_lo > lo ? p_lo : lo);
+			wi = (uint32_t)((overlap * 65536) / src_size);
+			(*weight)[x * *taps + n++] = wi;
+			sum += wi;
+		}
+		assert(n > 0 && n <= *taps);
+
+		/* Give the rounding error to the first pixel. */
+		(*weight)[x * *taps] += 65536 - sum;
+		(*count)[x] = n;
+	}
+
+	return true;
+}
+
+/*
+ * Create the next level of a mip chain. (half size, box filter)
+ */
+bool image_create_mip(struct image *src_image, struct image **mip)
+{
+	int w, h;
+
+	assert(src_image != NULL);
+	assert(mip != NULL);
+
+	w = src_image->width / 2 > 0 ? src_image->width / 2 : 1;
+	h = src_image->height / 2 > 0 ? src_image->height / 2 : 1;
+	if (!image_create(w, h, mip))
+		return false;
+	if (!image_resample_box(*mip, src_image)) {
+		image_destroy(*mip);
+		*mip = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Draw large rectangles in parallel on the job pool.
+ */
+void image_set_parallel_enabled(bool enable)
+{
+	is_parallel_enabled = enable;
+}
+
+/*
+ * Premultiply the alpha of the images decoded after this call.
+ */
+void image_set_decode_premultiplied(bool enable)
+{
+	is_decode_premultiplied = enable;
+}
+
+/*
+ * Check if the colors of an image are multiplied by the alpha.
+ */
+bool image_is_premultiplied(struct image *img)
+{
+	assert(img != NULL);
+
+	return img->is_premultiplied;
+}
+
+/*
+ * Convert an image to premultiplied alpha.
+ */
+void image_premultiply(struct image *img)
+{
+	assert(img != NULL);
+
+	if (img->is_premultiplied)
+		return;
+
+	stdblend.premultiply(img->pixels, img->width * img->height);
+	img->is_premultiplied = true;
+	image_mark_dirty(img, 0, 0, img->width, img->height);
+}
+
+/* Apply the decode mode to a decoded image. */
+static void image_apply_decode_mode(struct image *img, bool premultiply)
+{
+	if (premultiply)
+		image_premultiply(img);
+}
+
+/*
+ * Select the blending kernels.
+ */
+bool image_set_blend_kernel(const char *name)
+{
+	return stdblend_select(name);
+}
+
+/*
+ * Get the name of the blending kernels in use.
+ */
+const char *image_get_blend_kernel(void)
+{
+	return stdblend.name;
 }
 
 /* Check for draw_image_*() parameters. */
@@ -409,6 +955,9 @@ static bool image_check_draw(struct image *dst_image, int *dst_left,
 	if(!image_clip_by_dest(dst_image->width, dst_image->height, width, height, dst_left, dst_top, src_left, src_top))
 		return false;
 
+	/* The destination rectangle will be modified. */
+	image_mark_dirty(dst_image, *dst_left, *dst_top, *width, *height);
+
 	/* Need for a draw. */
 	return true;
 }
@@ -436,7 +985,7 @@ bool image_clip_by_source(int src_cx, int src_cy, int *cx, int *cy, int *dst_x,
 		*src_x = 0;
 	}
 
-	/* Cut by a top edge. *.
+	/* Cut by a top edge. */
 	if(*src_y < 0) {
 		*cy += *src_y;
 		*dst_y -= *src_y;
@@ -447,7 +996,7 @@ bool image_clip_by_source(int src_cx, int src_cy, int *cx, int *cy, int *dst_x,
 	if(*src_x + *cx > src_cx)
 		*cx = src_cx - *src_x;
 
-	/* Cut by a bottom edge. *.
+	/* Cut by a bottom edge. */
 	if(*src_y + *cy > src_cy)
 		*cy = src_cy - *src_y;
 
@@ -526,12 +1075,18 @@ static void image_png_read_callback(png_structp png_ptr, png_bytep buf, png_size
  * Create an image with a PNG file.
  */
 bool image_create_with_png(const uint8_t *data, size_t size, struct image **img)
+{
+	return image_decode_png(data, size, is_decode_premultiplied, img);
+}
+
+/* Decode a PNG file. */
+bool image_decode_png(const uint8_t *data, size_t size, bool premultiply, struct image **img)
 {
 	struct png_reader reader;
 	png_structp png_ptr;
 	png_byte color_type, bit_depth;
 	png_infop info_ptr;
-	png_bytep *rows;
+	png_bytep * volatile rows;
 	int width;
 	int height;
 	int y;
@@ -539,7 +1094,9 @@ bool image_create_with_png(const uint8_t *data, size_t size, struct image **img)
 
 	reader.data = data;
 	reader.size = size;
-	reader.pos = 0;
+	reader.pos = 8;	/* After the signature. */
+	rows = NULL;
+	*img = NULL;
 
 	/* Check a signature. */
 	if (size < 8)
@@ -619,6 +1176,7 @@ bool image_create_with_png(const uint8_t *data, size_t size, struct image **img)
 		png_read_update_info(png_ptr, info_ptr);
 		break;
 	default:
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 		return false;
 	}
 
@@ -627,13 +1185,17 @@ bool image_create_with_png(const uint8_t *data, size_t size, struct image **img)
 		png_set_strip_16(png_ptr);
 
 	/* Allocate an image. */
-	if (!image_create(width, height, img))
+	if (!image_create(width, height, img)) {
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 		return false;
+	}
 
 	/* Allocate a rows buffer. */
 	rows = malloc(sizeof(png_bytep) * (size_t)height);
 	if (rows == NULL) {
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 		image_destroy(*img);
+		*img = NULL;
 		sys_out_of_memory();
 		return false;
 	}
@@ -650,6 +1212,9 @@ bool image_create_with_png(const uint8_t *data, size_t size, struct image **img)
 
 	/* Cleanup. */
 	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	free(rows);
+
+	image_apply_decode_mode(*img, premultiply);
 
 	return true;
 }
@@ -661,58 +1226,111 @@ static void image_png_read_callback(png_structp png_ptr, png_bytep buf, png_size
 	reader = png_get_io_ptr(png_ptr);
 
 	if (reader->pos + len > reader->size)
-		len = reader->size - reader->pos;
+		png_error(png_ptr, "Truncated PNG data.");
 
 	memcpy(buf, reader->data + reader->pos, len);
+	reader->pos += len;
 }
 
 /*
  * JPEG
  */
 
-#if __has_include(<jpeglib.h>)
-#include <jpeglib.h>
-#else
+#include <setjmp.h>
+
+/* Prefer the bundled library over a system one. */
+#if __has_include(<jpeg/jpeglib.h>)
 #include <jpeg/jpeglib.h>
+#else
+#include <jpeglib.h>
 #endif
 
+/* An error manager that returns to the decoder instead of exit(). */
+struct jpeg_error {
+	struct jpeg_error_mgr mgr;
+	jmp_buf env;
+};
+
+/* Forward declaration. */
+static void image_jpeg_error_exit(j_common_ptr cinfo);
+
 /*
  * Create an image with a JPEG file.
  */
 bool image_create_with_jpeg(const uint8_t *data, size_t size, struct image **img)
+{
+	return image_decode_jpeg(data, size, is_decode_premultiplied, 0, 0, img);
+}
+
+/*
+ * Create an image with a JPEG file, reduced to fit a size.
+ */
+bool image_create_with_jpeg_scaled(const uint8_t *data, size_t size, int max_width, int max_height, struct image **img)
+{
+	return image_decode_jpeg(data, size, is_decode_premultiplied, max_width, max_height, img);
+}
+
+/* Decode a JPEG file. */
+bool image_decode_jpeg(const uint8_t *data, size_t size, bool premultiply, int max_width, int max_height, struct image **img)
 {
 	struct jpeg_decompress_struct jpeg;
-	struct jpeg_error_mgr jerr;
+	struct jpeg_error jerr;
 	pixel_t *p;
-	unsigned char *raw_data;
-	unsigned char *line;
-	unsigned int width, height, x, y;
-	int components;
+	unsigned char * volatile line;
+	JSAMPROW row;
+	unsigned int width, height, y;
 
-	/* Start decoding. */
+	line = NULL;
+	*img = NULL;
+
+	/* Set the error manager before anything can fail. */
+	jpeg.err = jpeg_std_error(&jerr.mgr);
+	jerr.mgr.error_exit = image_jpeg_error_exit;
+	if (setjmp(jerr.env)) {
+		jpeg_destroy_decompress(&jpeg);
+		if (*img != NULL) {
+			image_destroy(*img);
+			*img = NULL;
+		}
+		if (line != NULL)
+			free(line);
+		return false;
+	}
+
+	/* Read the header. */
 	jpeg_create_decompress(&jpeg);
-	jpeg_mem_src(&jpeg, data, size);
-	jpeg.err = jpeg_std_error(&jerr);
+	jpeg_mem_src(&jpeg, data, (unsigned long)size);
 	jpeg_read_header(&jpeg, TRUE);
-	jpeg_start_decompress(&jpeg);
+	jpeg.out_color_space = JCS_RGB;
+
+	/* Scale the DCT by the largest of 8/8 to 1/8 that fits. */
+	if (max_width > 0 || max_height > 0) {
+		jpeg.scale_denom = 8;
+		for (jpeg.scale_num = 8; jpeg.scale_num > 1; jpeg.scale_num--) {
+			jpeg_calc_output_dimensions(&jpeg);
+			if ((max_width <= 0 || jpeg.output_width <= (unsigned int)max_width) &&
+			    (max_height <= 0 || jpeg.output_height <= (unsigned int)max_height))
+				break;
+		}
+	}
 
-	/* Get metrics. */
+	/* Start decoding. */
+	jpeg_start_decompress(&jpeg);
 	width = jpeg.output_width;
 	height = jpeg.output_height;
-	components = jpeg.out_color_components;
-	if (components != 3) {
+	if (jpeg.out_color_components != 3) {
 		jpeg_destroy_decompress(&jpeg);
 		return false;
 	}
 
 	/* Create an image. */
-	if (!image_create(width, height, img)) {
+	if (!image_create((int)width, (int)height, img)) {
 		jpeg_destroy_decompress(&jpeg);
 		return false;
 	}
 
 	/* Allocate a line buffer. */
-	line = malloc(width * height * 3);
+	line = malloc(width * 3);
 	if (line == NULL) {
 		sys_out_of_memory();
 		jpeg_destroy_decompress(&jpeg);
@@ -721,31 +1339,36 @@ bool image_create_with_jpeg(const uint8_t *data, size_t size, struct image **img
 		return false;
 	}
 
-	/* Decode each line. */
+	/* Decode each line, and expand it to pixels. */
 	p = (*img)->pixels;
-#if defined(TARGET_WINDOWS)
-	for (y = 0; y < height; y++) {
-		jpeg_read_scanlines(&jpeg, &line, 1);
-		for (x = 0; x < width; x++) {
-			*p++ = make_pixel(255, line[x * 3 + 2], line[x * 3 + 1], line[x * 3 + 0]);
-		}
-	}
-#else
+	row = line;
 	for (y = 0; y < height; y++) {
-		jpeg_read_scanlines(&jpeg, &line, 1);
-		for (x = 0; x < width; x++) {
-			*p++ = make_pixel(255, line[x * 3], line[x * 3 + 1], line[x * 3 + 2]);
-		}
+		jpeg_read_scanlines(&jpeg, &row, 1);
+		stdblend.expand_rgb(p, row, (int)width);
+		p += width;
 	}
-#endif
 
 	/* Cleanup. */
+	jpeg_finish_decompress(&jpeg);
 	free(line);
 	jpeg_destroy_decompress(&jpeg);
 
+	/* Opaque, so only the flag is set. */
+	if (premultiply)
+		(*img)->is_premultiplied = true;
+
 	return true;
 }
 
+/* Return to image_decode_jpeg() on an error. */
+static void image_jpeg_error_exit(j_common_ptr cinfo)
+{
+	struct jpeg_error *jerr;
+
+	jerr = (struct jpeg_error *)cinfo->err;
+	longjmp(jerr->env, 1);
+}
+
 /*
  * WebP
  */
@@ -757,54 +1380,490 @@ bool image_create_with_jpeg(const uint8_t *data, size_t size, struct image **img
  */
 bool image_create_with_webp(const uint8_t *data, size_t size, struct image **img)
 {
-	pixel_t *p;
-	uint8_t *pixels;
-	size_t file_size;
+	return image_decode_webp(data, size, is_decode_premultiplied, 0, 0, img);
+}
+
+/*
+ * Create an image with a WebP file, reduced to fit a size.
+ */
+bool image_create_with_webp_scaled(const uint8_t *data, size_t size, int max_width, int max_height, struct image **img)
+{
+	return image_decode_webp(data, size, is_decode_premultiplied, max_width, max_height, img);
+}
+
+/* Decode a WebP file. */
+bool image_decode_webp(const uint8_t *data, size_t size, bool premultiply, int max_width, int max_height, struct image **img)
+{
+	WebPDecoderConfig config;
 	int width, height;
-	int x, y;
+	double scale;
+
+	*img = NULL;
 
 	/* Get metrics. */
-	if (!WebPGetInfo(data, size, &width, &height))
+	if (!WebPInitDecoderConfig(&config))
+		return false;
+	if (WebPGetFeatures(data, size, &config.input) != VP8_STATUS_OK)
 		return false;
+	width = config.input.width;
+	height = config.input.height;
+
+	/* Scale to fit, keeping the aspect ratio. */
+	scale = 1.0;
+	if (max_width > 0 && width > max_width)
+		scale = (double)max_width / width;
+	if (max_height > 0 && height > max_height && (double)max_height / height < scale)
+		scale = (double)max_height / height;
+	if (scale < 1.0) {
+		width = (int)(width * scale + 0.5);
+		height = (int)(height * scale + 0.5);
+		if (width < 1)
+			width = 1;
+		if (height < 1)
+			height = 1;
+		config.options.use_scaling = 1;
+		config.options.scaled_width = width;
+		config.options.scaled_height = height;
+	}
 
 	/* Create an image. */
 	if (!image_create(width, height, img))
 		return false;
 
-	/* Do decoding. */
-	pixels = WebPDecodeRGBA(data, size, &width, &height);
-	if (pixels == NULL) {
+	/* Decode into the pixels in the order of make_pixel(). */
+#if defined(IMAGE_ORDER_RGBA)
+	config.output.colorspace = MODE_BGRA;
+#else
+	config.output.colorspace = MODE_RGBA;
+#endif
+	config.output.is_external_memory = 1;
+	config.output.u.RGBA.rgba = (uint8_t *)(*img)->pixels;
+	config.output.u.RGBA.stride = width * (int)sizeof(pixel_t);
+	config.output.u.RGBA.size = (size_t)width * (size_t)height * sizeof(pixel_t);
+	if (WebPDecode(data, size, &config) != VP8_STATUS_OK) {
+		WebPFreeDecBuffer(&config.output);
 		image_destroy(*img);
 		*img = NULL;
 		return false;
 	}
+	WebPFreeDecBuffer(&config.output);
 
-	/* Copy pixels. */
-	p = (*img)->pixels;
-#if defined(ORDER_RGBA)
-	/* Use RGBA as is. */
-	for (y = 0; y < height; y++) {
-		for (x = 0; x < width; x++) {
-			*p++ = make_pixel(pixels[y * width * 4 + x * 4 + 3],
-					  pixels[y * width * 4 + x * 4 + 0],
-					  pixels[y * width * 4 + x * 4 + 1],
-					  pixels[y * width * 4 + x * 4 + 2]);
+	image_apply_decode_mode(*img, premultiply);
+
+	return true;
+}
+
+/*
+ * Asynchronous decoding
+ */
+
+/* Maximum decoding requests in flight. */
+#define DECODE_MAX		(256)
+
+/* Maximum decoder threads. */
+#define DECODER_THREAD_MAX	(JOB_THREAD_MAX)
+
+/* States of a request. */
+enum decode_state {
+	DECODE_FREE,
+	DECODE_PENDING,
+	DECODE_RUNNING,
+	DECODE_DONE,
+};
+
+/* The body of the decoding request. */
+struct image_decode {
+	enum decode_state state;
+
+	/* Input. (data is read from the file if file is not NULL) */
+	const uint8_t *data;
+	size_t size;
+	char *file;
+	int format;
+	bool premultiply;
+
+	/* Result. */
+	struct image *img;
+	bool is_succeeded;
+
+	/* Next pending request. */
+	struct image_decode *next;
+};
+
+static struct image_decode decode_table[DECODE_MAX];
+
+/* Pending requests in FIFO order. */
+static struct image_decode *decode_head;
+static struct image_decode *decode_tail;
+
+/* Decoder threads. (started on the first request) */
+static stdthread_t decoder[DECODER_THREAD_MAX];
+static int decoder_count;
+static int decoder_thread_count = -1;
+static bool is_decoder_quitting;
+
+/* The lock and the conditions. (protects the above) */
+static stdthread_mutex_t decode_mutex;
+static stdthread_cond_t pending_cond;
+static stdthread_cond_t done_cond;
+static bool is_decode_initialized;
+
+/* Forward declaration. */
+static bool image_enqueue_decode(const uint8_t *data, size_t size, const char *file, int format, struct image_decode **dec);
+static bool image_start_decoders(void);
+static void image_stop_decoders(void);
+static int image_decoder_main(void *arg);
+static void image_run_decode(struct image_decode *dec);
+
+/* Initialize the decoder pool. (the threads start lazily) */
+static bool image_init_decoder(void)
+{
+	if (!stdthread_mutex_init(&decode_mutex) ||
+	    !stdthread_cond_init(&pending_cond) ||
+	    !stdthread_cond_init(&done_cond)) {
+		sys_error("Cannot initialize the image decoder.");
+		return false;
+	}
+	is_decode_initialized = true;
+
+	memset(decode_table, 0, sizeof(decode_table));
+	decode_head = NULL;
+	decode_tail = NULL;
+	decoder_count = 0;
+	is_decoder_quitting = false;
+
+	return true;
+}
+
+/* Cleanup the decoder pool. */
+static void image_cleanup_decoder(void)
+{
+	int i;
+
+	if (!is_decode_initialized)
+		return;
+
+	image_stop_decoders();
+
+	/* Release the requests that were never waited. */
+	for (i = 0; i < DECODE_MAX; i++) {
+		if (decode_table[i].state == DECODE_FREE)
+			continue;
+		if (decode_table[i].img != NULL)
+			image_destroy(decode_table[i].img);
+		free(decode_table[i].file);
+	}
+	memset(decode_table, 0, sizeof(decode_table));
+	decode_head = NULL;
+	decode_tail = NULL;
+
+	stdthread_cond_destroy(&done_cond);
+	stdthread_cond_destroy(&pending_cond);
+	stdthread_mutex_destroy(&decode_mutex);
+	is_decode_initialized = false;
+}
+
+/*
+ * Set the number of decoder threads.
+ */
+void image_set_decoder_thread_count(int thread_count)
+{
+	if (thread_count < 0)
+		thread_count = -1;
+	if (thread_count > DECODER_THREAD_MAX)
+		thread_count = DECODER_THREAD_MAX;
+
+	if (!is_decode_initialized) {
+		decoder_thread_count = thread_count;
+		return;
+	}
+
+	/* Pending requests stay queued for the new threads. */
+	image_stop_decoders();
+	stdthread_mutex_lock(&decode_mutex);
+	decoder_thread_count = thread_count;
+	if (decode_head != NULL && thread_count != 0)
+		image_start_decoders();
+	stdthread_mutex_unlock(&decode_mutex);
+}
+
+/*
+ * Start decoding an image in memory.
+ */
+bool image_decode_async(const uint8_t *data, size_t size, int format, struct image_decode **dec)
+{
+	assert(data != NULL);
+	assert(dec != NULL);
+
+	return image_enqueue_decode(data, size, NULL, format, dec);
+}
+
+/*
+ * Start reading and decoding an image file.
+ */
+bool image_decode_file_async(const char *file, struct image_decode **dec)
+{
+	assert(file != NULL);
+	assert(dec != NULL);
+
+	return image_enqueue_decode(NULL, 0, file, IMAGE_FORMAT_AUTO, dec);
+}
+
+/*
+ * Check if a decoding request has finished.
+ */
+bool image_is_decode_finished(struct image_decode *dec)
+{
+	bool is_finished;
+
+	assert(dec != NULL);
+
+	stdthread_mutex_lock(&decode_mutex);
+	assert(dec->state != DECODE_FREE);
+	is_finished = dec->state == DECODE_DONE;
+	stdthread_mutex_unlock(&decode_mutex);
+
+	return is_finished;
+}
+
+/*
+ * Wait for a decoding request, and release it.
+ */
+bool image_wait_decode(struct image_decode *dec, struct image **img)
+{
+	struct image_decode **link;
+	struct image_decode *prev;
+	bool is_succeeded;
+
+	assert(dec != NULL);
+	assert(img != NULL);
+
+	stdthread_mutex_lock(&decode_mutex);
+	assert(dec->state != DECODE_FREE);
+
+	/* Run it here if no thread has taken it. */
+	if (dec->state == DECODE_PENDING) {
+		prev = NULL;
+		for (link = &decode_head; *link != dec; link = &(*link)->next)
+			prev = *link;
+		*link = dec->next;
+		if (decode_tail == dec)
+			decode_tail = prev;
+		dec->state = DECODE_RUNNING;
+
+		stdthread_mutex_unlock(&decode_mutex);
+		image_run_decode(dec);
+		stdthread_mutex_lock(&decode_mutex);
+		dec->state = DECODE_DONE;
+	}
+
+	while (dec->state != DECODE_DONE)
+		stdthread_cond_wait(&done_cond, &decode_mutex);
+
+	/* Release the request. */
+	*img = dec->img;
+	is_succeeded = dec->is_succeeded;
+	free(dec->file);
+	memset(dec, 0, sizeof(struct image_decode));
+
+	stdthread_mutex_unlock(&decode_mutex);
+
+	return is_succeeded;
+}
+
+/* Put a request to the queue. */
+static bool image_enqueue_decode(const uint8_t *data, size_t size, const char *file, int format, struct image_decode **dec)
+{
+	struct image_decode *d;
+	int i;
+
+	assert(is_decode_initialized);
+
+	stdthread_mutex_lock(&decode_mutex);
+
+	/* Start the threads on the first request. */
+	if (decoder_count == 0 && decoder_thread_count != 0 &&
+	    !image_start_decoders()) {
+		stdthread_mutex_unlock(&decode_mutex);
+		return false;
+	}
+
+	/* Get a free request. */
+	for (i = 0; i < DECODE_MAX; i++)
+		if (decode_table[i].state == DECODE_FREE)
+			break;
+	if (i == DECODE_MAX) {
+		stdthread_mutex_unlock(&decode_mutex);
+		sys_error("Too many image decoding requests.");
+		return false;
+	}
+	d = &decode_table[i];
+
+	d->data = data;
+	d->size = size;
+	d->file = NULL;
+	if (file != NULL) {
+		d->file = strdup(file);
+		if (d->file == NULL) {
+			stdthread_mutex_unlock(&decode_mutex);
+			sys_out_of_memory();
+			return false;
 		}
 	}
-#else
-	/* Reverse the pixel order for OpenGL. (RGB -> BGR) */
-	for (y = 0; y < height; y++) {
-		for (x = 0; x < width; x++) {
-			*p++ = make_pixel(pixels[y * width * 4 + x * 4 + 3],
-					  pixels[y * width * 4 + x * 4 + 2],
-					  pixels[y * width * 4 + x * 4 + 1],
-					  pixels[y * width * 4 + x * 4 + 0]);
+	d->format = format;
+	d->premultiply = is_decode_premultiplied;
+	d->img = NULL;
+	d->is_succeeded = false;
+	d->next = NULL;
+	d->state = DECODE_PENDING;
+
+	/* Append it to the queue. */
+	if (decode_tail != NULL)
+		decode_tail->next = d;
+	else
+		decode_head = d;
+	decode_tail = d;
+	stdthread_cond_signal(&pending_cond);
+
+	stdthread_mutex_unlock(&decode_mutex);
+
+	*dec = d;
+	return true;
+}
+
+/* Start the decoder threads. (called with decode_mutex locked) */
+static bool image_start_decoders(void)
+{
+	int count, i;
+
+	/* Leave a thread for the game by default. */
+	count = decoder_thread_count;
+	if (count < 0) {
+		count = job_get_thread_count() - 1;
+		if (count < 1)
+			count = 1;
+	}
+
+	is_decoder_quitting = false;
+	for (i = 0; i < count; i++) {
+		if (!stdthread_create(&decoder[i], image_decoder_main, NULL)) {
+			/* Run with the threads created so far. */
+			sys_error("Cannot create an image decoder thread.");
+			break;
 		}
+		decoder_count++;
 	}
-#endif
 
-	/* Cleanup. */
-	WebPFree(pixels);
+	return decoder_count > 0;
+}
 
-	return true;
+/* Stop the decoder threads after their current requests. */
+static void image_stop_decoders(void)
+{
+	int i;
+
+	stdthread_mutex_lock(&decode_mutex);
+	is_decoder_quitting = true;
+	stdthread_cond_broadcast(&pending_cond);
+	stdthread_mutex_unlock(&decode_mutex);
+
+	for (i = 0; i < decoder_count; i++)
+		stdthread_join(decoder[i]);
+
+	stdthread_mutex_lock(&decode_mutex);
+	decoder_count = 0;
+	is_decoder_quitting = false;
+	stdthread_mutex_unlock(&decode_mutex);
+}
+
+/* A decoder thread. */
+static int image_decoder_main(void *arg)
+{
+	struct image_decode *dec;
+
+	UNUSED_PARAMETER(arg);
+
+	stdthread_mutex_lock(&decode_mutex);
+	while (true) {
+		/* Wait for a request. */
+		while (!is_decoder_quitting && decode_head == NULL)
+			stdthread_cond_wait(&pending_cond, &decode_mutex);
+		if (is_decoder_quitting)
+			break;
+
+		/* Take the oldest one. */
+		dec = decode_head;
+		decode_head = dec->next;
+		if (decode_head == NULL)
+			decode_tail = NULL;
+		dec->state = DECODE_RUNNING;
+
+		stdthread_mutex_unlock(&decode_mutex);
+		image_run_decode(dec);
+		stdthread_mutex_lock(&decode_mutex);
+
+		dec->state = DECODE_DONE;
+		stdthread_cond_broadcast(&done_cond);
+	}
+	stdthread_mutex_unlock(&decode_mutex);
+
+	return 0;
+}
+
+/* Read and decode a request. (without the lock) */
+static void image_run_decode(struct image_decode *dec)
+{
+	const void *map;
+	size_t size;
+	int format;
+
+	/* Map the file. */
+	map = NULL;
+	if (dec->file != NULL) {
+		if (!file_map(dec->file, &map, &size))
+			return;
+		dec->data = map;
+		dec->size = size;
+	}
+
+	/* Decode. */
+	format = dec->format;
+	if (format == IMAGE_FORMAT_AUTO)
+		format = image_detect_format(dec->data, dec->size);
+	switch (format) {
+	case IMAGE_FORMAT_PNG:
+		dec->is_succeeded = image_decode_png(dec->data, dec->size, dec->premultiply, &dec->img);
+		break;
+	case IMAGE_FORMAT_JPEG:
+		dec->is_succeeded = image_decode_jpeg(dec->data, dec->size, dec->premultiply, 0, 0, &dec->img);
+		break;
+	case IMAGE_FORMAT_WEBP:
+		dec->is_succeeded = image_decode_webp(dec->data, dec->size, dec->premultiply, 0, 0, &dec->img);
+		break;
+	default:
+		sys_error("Unknown image format.");
+		break;
+	}
+	if (!dec->is_succeeded)
+		dec->img = NULL;
+
+	if (map != NULL) {
+		file_unmap(map);
+		dec->data = NULL;
+		dec->size = 0;
+	}
+}
+
+/*
+ * Detect an image format by the signature.
+ */
+int image_detect_format(const uint8_t *data, size_t size)
+{
+	if (size >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0)
+		return IMAGE_FORMAT_PNG;
+	if (size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff)
+		return IMAGE_FORMAT_JPEG;
+	if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WEBP", 4) == 0)
+		return IMAGE_FORMAT_WEBP;
+	return IMAGE_FORMAT_AUTO;
 }
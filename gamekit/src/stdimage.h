@@ -20,4 +20,13 @@ bool stdimage_init(void);
 /* Cleanup the stdimage module. */
 void stdimage_cleanup(void);
 
+/*
+ * Decode an image with an explicit alpha mode, regardless of
+ * image_set_decode_premultiplied().  The JPEG and WebP decoders reduce
+ * the image to fit max_width x max_height if both are positive.
+ */
+bool image_decode_png(const uint8_t *data, size_t size, bool premultiply, struct image **img);
+bool image_decode_jpeg(const uint8_t *data, size_t size, bool premultiply, int max_width, int max_height, struct image **img);
+bool image_decode_webp(const uint8_t *data, size_t size, bool premultiply, int max_width, int max_height, struct image **img);
+
 #endif
@@ -0,0 +1,89 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdinput.c: The standard implementation of the input event queue.
+ */
+
+/*
+ * [Queue]
+ *
+ * The queue is a ring of a power-of-two size with free-running indices.
+ * The producer writes an event and then publishes the tail with the
+ * release order, and the consumer reads the tail with the acquire order
+ * before it reads the event.  The head is published the other way
+ * around, so a slot is never written while it is read.
+ */
+
+#include "gamekit/gamekit.h"
+
+#include <stdatomic.h>
+
+/* Size of the queue. (must be a power of two) */
+#define EVENT_MAX	(256)
+
+/* Events. */
+static struct input_event event_ring[EVENT_MAX];
+
+/* Next index to read. (written by the consumer) */
+static atomic_uint event_head;
+
+/* Next index to write. (written by the producer) */
+static atomic_uint event_tail;
+
+/* Number of the dropped events. */
+static atomic_int dropped_count;
+
+/*
+ * Get the oldest input event.
+ */
+bool input_poll_event(struct input_event *event)
+{
+	unsigned int head, tail;
+
+	assert(event != NULL);
+
+	head = atomic_load_explicit(&event_head, memory_order_relaxed);
+	tail = atomic_load_explicit(&event_tail, memory_order_acquire);
+	if (head == tail)
+		return false;
+
+	*event = event_ring[head & (EVENT_MAX - 1)];
+	atomic_store_explicit(&event_head, head + 1, memory_order_release);
+
+	return true;
+}
+
+/*
+ * Put an input event.
+ */
+bool input_push_event(const struct input_event *event)
+{
+	unsigned int head, tail;
+
+	assert(event != NULL);
+
+	tail = atomic_load_explicit(&event_tail, memory_order_relaxed);
+	head = atomic_load_explicit(&event_head, memory_order_acquire);
+	if (tail - head == EVENT_MAX) {
+		atomic_fetch_add_explicit(&dropped_count, 1, memory_order_relaxed);
+		return false;
+	}
+
+	event_ring[tail & (EVENT_MAX - 1)] = *event;
+	atomic_store_explicit(&event_tail, tail + 1, memory_order_release);
+
+	return true;
+}
+
+/*
+ * Get the number of the events dropped by a full queue.
+ */
+int input_get_dropped_event_count(void)
+{
+	return atomic_load_explicit(&dropped_count, memory_order_relaxed);
+}
@@ -0,0 +1,241 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdjob.c: The standard implementation of the job_ interface.
+ */
+
+/*
+ * [Parallel-for]
+ *
+ * A parallel-for publishes its function and range, increments the
+ * generation, and wakes the workers.  Each participant, including the
+ * caller, takes the next index by an atomic increment until the range
+ * is exhausted, and then counts itself as finished.  The caller waits
+ * until all participants have finished, so the job structure is not
+ * reused while a late worker still reads it.
+ *
+ * Workers with an index not less than the active thread count skip the
+ * generation, so that job_set_thread_count() can measure the scaling
+ * without recreating the threads.
+ */
+
+#include "gamekit/gamekit.h"
+#include "stdthread.h"
+
+#include <stdatomic.h>
+
+/* Worker threads. */
+static stdthread_t worker[JOB_THREAD_MAX];
+static int worker_count;
+
+/* Threads in use including the caller. */
+static int active_count;
+
+/* The lock and the conditions. */
+static stdthread_mutex_t job_mutex;
+static stdthread_cond_t start_cond;
+static stdthread_cond_t finish_cond;
+static bool is_initialized;
+
+/* Serializes the parallel-fors. */
+static atomic_flag busy_flag = ATOMIC_FLAG_INIT;
+
+/* Is the calling thread running a parallel-for? */
+static THREAD_LOCAL bool is_in_job;
+
+/* The current job. (protected by job_mutex except next_index) */
+static struct {
+	job_func func;
+	void *arg;
+	int count;
+	atomic_int next_index;
+	int generation;
+	int participant_count;
+	int finished_count;
+	bool is_quitting;
+} job;
+
+/* Forward declaration. */
+static int job_worker_main(void *arg);
+static void job_run_indices(void);
+
+/*
+ * Initialize the "job" module.
+ */
+bool job_init_module(int thread_count)
+{
+	int i;
+
+	if (thread_count < 1)
+		thread_count = 1;
+	if (thread_count > JOB_THREAD_MAX)
+		thread_count = JOB_THREAD_MAX;
+
+	if (!stdthread_mutex_init(&job_mutex) ||
+	    !stdthread_cond_init(&start_cond) ||
+	    !stdthread_cond_init(&finish_cond)) {
+		sys_error("Cannot initialize the job pool.");
+		return false;
+	}
+	is_initialized = true;
+
+	memset(&job, 0, sizeof(job));
+	worker_count = 0;
+	for (i = 0; i < thread_count - 1; i++) {
+		if (!stdthread_create(&worker[i], job_worker_main, (void *)(intptr_t)(i + 1))) {
+			/* Run with the threads created so far. */
+			sys_error("Cannot create a job thread.");
+			break;
+		}
+		worker_count++;
+	}
+	active_count = worker_count + 1;
+
+	return true;
+}
+
+/*
+ * Cleanup the "job" module.
+ */
+void job_cleanup_module(void)
+{
+	int i;
+
+	if (!is_initialized)
+		return;
+
+	stdthread_mutex_lock(&job_mutex);
+	job.is_quitting = true;
+	stdthread_cond_broadcast(&start_cond);
+	stdthread_mutex_unlock(&job_mutex);
+
+	for (i = 0; i < worker_count; i++)
+		stdthread_join(worker[i]);
+	worker_count = 0;
+	active_count = 1;
+
+	stdthread_cond_destroy(&finish_cond);
+	stdthread_cond_destroy(&start_cond);
+	stdthread_mutex_destroy(&job_mutex);
+	is_initialized = false;
+}
+
+/*
+ * Get the number of threads in use.
+ */
+int job_get_thread_count(void)
+{
+	return is_initialized ? active_count : 1;
+}
+
+/*
+ * Limit the number of threads in use.
+ */
+void job_set_thread_count(int thread_count)
+{
+	if (!is_initialized)
+		return;
+
+	if (thread_count < 1)
+		thread_count = 1;
+	if (thread_count > worker_count + 1)
+		thread_count = worker_count + 1;
+
+	stdthread_mutex_lock(&job_mutex);
+	active_count = thread_count;
+	stdthread_mutex_unlock(&job_mutex);
+}
+
+/*
+ * Run a function for each index, and wait for them.
+ */
+void job_parallel_for(int count, job_func func, void *arg)
+{
+	int i;
+
+	assert(func != NULL);
+
+	if (count <= 0)
+		return;
+
+	/* Run on the calling thread if there's nothing to share. */
+	if (!is_initialized || active_count == 1 || count == 1 ||
+	    is_in_job || atomic_flag_test_and_set(&busy_flag)) {
+		for (i = 0; i < count; i++)
+			func(arg, i);
+		return;
+	}
+
+	/* Publish the job. */
+	stdthread_mutex_lock(&job_mutex);
+	job.func = func;
+	job.arg = arg;
+	job.count = count;
+	atomic_store(&job.next_index, 0);
+	job.participant_count = active_count;
+	job.finished_count = 0;
+	job.generation++;
+	stdthread_cond_broadcast(&start_cond);
+	stdthread_mutex_unlock(&job_mutex);
+
+	/* Take part in it. */
+	job_run_indices();
+
+	/* Wait for the workers. */
+	stdthread_mutex_lock(&job_mutex);
+	job.finished_count++;
+	while (job.finished_count < job.participant_count)
+		stdthread_cond_wait(&finish_cond, &job_mutex);
+	stdthread_mutex_unlock(&job_mutex);
+
+	atomic_flag_clear(&busy_flag);
+}
+
+/* Run the indices until the range is exhausted. */
+static void job_run_indices(void)
+{
+	int index;
+
+	is_in_job = true;
+	while ((index = atomic_fetch_add(&job.next_index, 1)) < job.count)
+		job.func(job.arg, index);
+	is_in_job = false;
+}
+
+/* A worker thread. */
+static int job_worker_main(void *arg)
+{
+	int id, generation;
+
+	id = (int)(intptr_t)arg;
+	generation = 0;
+
+	stdthread_mutex_lock(&job_mutex);
+	while (true) {
+		/* Wait for a new job. */
+		while (!job.is_quitting && job.generation == generation)
+			stdthread_cond_wait(&start_cond, &job_mutex);
+		if (job.is_quitting)
+			break;
+		generation = job.generation;
+
+		/* Skip it if this thread is not in use. */
+		if (id >= job.participant_count)
+			continue;
+
+		stdthread_mutex_unlock(&job_mutex);
+		job_run_indices();
+		stdthread_mutex_lock(&job_mutex);
+
+		if (++job.finished_count == job.participant_count)
+			stdthread_cond_signal(&finish_cond);
+	}
+	stdthread_mutex_unlock(&job_mutex);
+
+	return 0;
+}
@@ -0,0 +1,374 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdprof.c: The standard implementation of the prof_ interface.
+ */
+
+/*
+ * [Recording]
+ *
+ * A track records the zones of the current frame to its own array,
+ * and only the thread of the track touches it, so no lock is needed.
+ * The array is written to the trace file at the end of the frame.
+ * Each event is written by one fprintf() call, and stdio serializes
+ * the calls of the threads.
+ *
+ * [Statistics]
+ *
+ * The last HISTORY_MAX frame times of each track are kept in a ring,
+ * and the percentiles are computed on a sorted copy when queried.
+ */
+
+#include "gamekit/gamekit.h"
+
+/* Maximum zones recorded in a frame. */
+#define ZONE_MAX	(4096)
+
+/* Maximum depth of nested zones. */
+#define DEPTH_MAX	(32)
+
+/* Frames kept for the statistics. */
+#define HISTORY_MAX	(240)
+
+/* A zone. */
+struct zone {
+	const char *name;
+	uint64_t begin;
+	uint64_t end;
+};
+
+/* A track. */
+struct track {
+	/* Is in a frame? */
+	bool is_in_frame;
+
+	/* Is the current frame traced? */
+	bool is_traced;
+
+	/* Start time of the current frame. */
+	uint64_t frame_begin;
+
+	/* Zones in the current frame. */
+	struct zone zone[ZONE_MAX];
+	int zone_count;
+
+	/* Open zones. */
+	int stack[DEPTH_MAX];
+	int depth;
+
+	/* Open zones not recorded for the limits. (innermost) */
+	int overflow;
+
+	/* GPU time of the current frame. (negative if not set) */
+	float gpu_time;
+
+	/* Recent frames. */
+	float frame_history[HISTORY_MAX];
+	float gpu_history[HISTORY_MAX];
+	int history_count;
+	int history_head;
+};
+
+static struct track track[PROF_TRACK_MAX];
+
+/* Track of the calling thread. */
+static THREAD_LOCAL int cur_track;
+
+/* Trace file. */
+static FILE *trace_fp;
+
+/* Base time of the trace. */
+static uint64_t trace_base;
+
+/* Forward declaration. */
+static void prof_write_frame(struct track *t, int index);
+static double prof_to_micro(uint64_t t);
+static int prof_compare_float(const void *a, const void *b);
+static float prof_percentile(float *sorted, int count, int percent);
+
+/*
+ * Initialize the "prof" module.
+ */
+bool prof_init_module(void)
+{
+	memset(track, 0, sizeof(track));
+	cur_track = PROF_TRACK_MAIN;
+	trace_fp = NULL;
+
+	return true;
+}
+
+/*
+ * Cleanup the "prof" module.
+ */
+void prof_cleanup_module(void)
+{
+	prof_stop_trace();
+}
+
+/*
+ * Set the track of the calling thread.
+ */
+void prof_set_track(int index)
+{
+	assert(index >= 0 && index < PROF_TRACK_MAX);
+
+	cur_track = index;
+}
+
+/*
+ * Begin a frame of the track of the calling thread.
+ */
+void prof_begin_frame(void)
+{
+	struct track *t;
+
+	t = &track[cur_track];
+	t->is_in_frame = true;
+	t->is_traced = trace_fp != NULL;
+	t->zone_count = 0;
+	t->depth = 0;
+	t->overflow = 0;
+	t->gpu_time = -1.0f;
+	t->frame_begin = sys_get_nano_tick();
+}
+
+/*
+ * End a frame of the track of the calling thread.
+ */
+void prof_end_frame(void)
+{
+	struct track *t;
+	uint64_t end;
+
+	t = &track[cur_track];
+	if (!t->is_in_frame)
+		return;
+	end = sys_get_nano_tick();
+
+	/* Close the zones left open. */
+	t->overflow = 0;
+	while (t->depth > 0)
+		t->zone[t->stack[--t->depth]].end = end;
+
+	/* Put the frame to the history. */
+	t->frame_history[t->history_head] = (float)((double)(end - t->frame_begin) / 1000000.0);
+	t->gpu_history[t->history_head] = t->gpu_time;
+	t->history_head = (t->history_head + 1) % HISTORY_MAX;
+	if (t->history_count < HISTORY_MAX)
+		t->history_count++;
+
+	if (t->is_traced && trace_fp != NULL) {
+		prof_write_frame(t, cur_track);
+		fprintf(trace_fp,
+			",\n{\"name\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+			prof_to_micro(t->frame_begin),
+			(double)(end - t->frame_begin) / 1000.0,
+			cur_track);
+	}
+
+	t->is_in_frame = false;
+}
+
+/*
+ * Begin a zone.
+ */
+void prof_begin_zone(const char *name)
+{
+	struct track *t;
+
+	assert(name != NULL);
+
+	t = &track[cur_track];
+	if (!t->is_in_frame)
+		return;
+
+	/*
+	 * Count the overflowed zones apart from the stack to keep the
+	 * nesting.  Zones inside an overflowed one overflow too.
+	 */
+	if (t->overflow > 0 || t->depth == DEPTH_MAX || t->zone_count == ZONE_MAX) {
+		t->overflow++;
+		return;
+	}
+
+	t->zone[t->zone_count].name = name;
+	t->zone[t->zone_count].begin = sys_get_nano_tick();
+	t->zone[t->zone_count].end = 0;
+	t->stack[t->depth++] = t->zone_count++;
+}
+
+/*
+ * End the innermost zone.
+ */
+void prof_end_zone(void)
+{
+	struct track *t;
+
+	t = &track[cur_track];
+	if (!t->is_in_frame)
+		return;
+
+	if (t->overflow > 0) {
+		t->overflow--;
+		return;
+	}
+	if (t->depth == 0)
+		return;
+	t->zone[t->stack[--t->depth]].end = sys_get_nano_tick();
+}
+
+/*
+ * Set the GPU time of the current frame.
+ */
+void prof_set_gpu_time(float ms)
+{
+	track[cur_track].gpu_time = ms;
+}
+
+/*
+ * Get the statistics of the recent frames.
+ */
+void prof_get_stats(struct prof_stats *stats)
+{
+	struct track *t;
+	float frame[HISTORY_MAX], gpu[HISTORY_MAX];
+	float sum;
+	int i, gpu_count;
+
+	assert(stats != NULL);
+
+	t = &track[cur_track];
+
+	memset(stats, 0, sizeof(struct prof_stats));
+	stats->frame_count = t->history_count;
+	stats->gpu_p50 = -1.0f;
+	stats->gpu_p99 = -1.0f;
+	if (t->history_count == 0)
+		return;
+
+	sum = 0;
+	gpu_count = 0;
+	for (i = 0; i < t->history_count; i++) {
+		frame[i] = t->frame_history[i];
+		sum += frame[i];
+		if (t->gpu_history[i] >= 0)
+			gpu[gpu_count++] = t->gpu_history[i];
+	}
+
+	qsort(frame, (size_t)t->history_count, sizeof(float), prof_compare_float);
+	stats->frame_avg = sum / (float)t->history_count;
+	stats->frame_p50 = prof_percentile(frame, t->history_count, 50);
+	stats->frame_p99 = prof_percentile(frame, t->history_count, 99);
+	stats->frame_max = frame[t->history_count - 1];
+
+	if (gpu_count > 0) {
+		qsort(gpu, (size_t)gpu_count, sizeof(float), prof_compare_float);
+		stats->gpu_p50 = prof_percentile(gpu, gpu_count, 50);
+		stats->gpu_p99 = prof_percentile(gpu, gpu_count, 99);
+	}
+}
+
+/*
+ * Start writing a trace.
+ */
+bool prof_start_trace(const char *file)
+{
+	assert(file != NULL);
+
+	prof_stop_trace();
+
+	trace_fp = fopen(file, "w");
+	if (trace_fp == NULL) {
+		sys_error("Cannot open %s.", file);
+		return false;
+	}
+	trace_base = sys_get_nano_tick();
+
+	/* Name the tracks. (the following events start with a comma) */
+	fprintf(trace_fp,
+		"{\"traceEvents\":[\n"
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"main\"}},\n"
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"render\"}}",
+		PROF_TRACK_MAIN,
+		PROF_TRACK_RENDER);
+
+	return true;
+}
+
+/*
+ * Stop writing a trace.
+ */
+void prof_stop_trace(void)
+{
+	if (trace_fp == NULL)
+		return;
+
+	fprintf(trace_fp, "\n]}\n");
+	fclose(trace_fp);
+	trace_fp = NULL;
+}
+
+/* Write the zones of a frame. */
+static void prof_write_frame(struct track *t, int index)
+{
+	struct zone *z;
+	int i;
+
+	for (i = 0; i < t->zone_count; i++) {
+		z = &t->zone[i];
+		fprintf(trace_fp,
+			",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+			z->name,
+			prof_to_micro(z->begin),
+			(double)(z->end - z->begin) / 1000.0,
+			index);
+	}
+
+	if (t->gpu_time >= 0) {
+		fprintf(trace_fp,
+			",\n{\"name\":\"GPU ms\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"gpu\":%.3f}}",
+			prof_to_micro(t->frame_begin),
+			(double)t->gpu_time);
+	}
+}
+
+/* Convert a time to microseconds since the trace start. */
+static double prof_to_micro(uint64_t t)
+{
+	if (t < trace_base)
+		return 0;
+
+	return (double)(t - trace_base) / 1000.0;
+}
+
+/* Compare floats for qsort(). */
+static int prof_compare_float(const void *a, const void *b)
+{
+	float x, y;
+
+	x = *(const float *)a;
+	y = *(const float *)b;
+	if (x < y)
+		return -1;
+	if (x > y)
+		return 1;
+	return 0;
+}
+
+/* Get a percentile of a sorted array. (nearest rank) */
+static float prof_percentile(float *sorted, int count, int percent)
+{
+	int rank;
+
+	rank = (count * percent + 99) / 100;
+	if (rank < 1)
+		rank = 1;
+
+	return sorted[rank - 1];
+}
@@ -0,0 +1,523 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdrendercmd.c: The standard implementation of the render command lists.
+ */
+
+/*
+ * [Command Layout]
+ *
+ * A command list is a byte array of commands.  Each command is a
+ * fixed-size struct cmd, followed by variable-size data for streaming
+ * commands and the rows of texture uploads.  Commands are aligned to 8
+ * bytes.
+ *
+ * [Frames]
+ *
+ * In the deferred mode, render_submit_cmd_list() appends a list to the
+ * recording frame.  The HAL swaps the recording frame and the replaying
+ * frame when the render thread has finished the previous frame, so the
+ * render thread replays frame N while the game thread records frame
+ * N+1.  Thus, a list submitted in frame N may be reset in frame N+2.
+ */
+
+#include "gamekit/gamekit.h"
+#include "stdrendercmd.h"
+
+/* False assertion. */
+#define NEVER_COME_HERE		0
+
+/* Maximum command lists. */
+#define CMD_LIST_MAX		(64)
+
+/* Maximum lists submitted in a frame. */
+#define SUBMIT_MAX		(256)
+
+/* Initial capacity of a list. */
+#define CMD_LIST_INITIAL	(64 * 1024)
+
+/* Alignment of commands. */
+#define CMD_ALIGN		(8)
+
+/* Command types. */
+enum cmd_type {
+	CMD_BIND_PIPELINE,
+	CMD_BIND_VERTEX_BUFFER,
+	CMD_BIND_INDEX_BUFFER,
+	CMD_BIND_INSTANCE_BUFFER,
+	CMD_BIND_TEXTURE,
+	CMD_SET_BLEND_MODE,
+	CMD_UPDATE_CONSTANT,
+	CMD_STREAM_VERTEX_BUFFER,
+	CMD_STREAM_INDEX_BUFFER,
+	CMD_UPLOAD_TEXTURE,
+	CMD_DRAW,
+	CMD_DRAW_INSTANCED,
+	CMD_QUEUE_DRAW,
+};
+
+/* A command. */
+struct cmd {
+	int type;
+
+	/* Bytes including this struct and the following data. */
+	int size;
+
+	union {
+		struct render_pipeline *pipeline;
+		struct render_vertex_buffer *vertex_buffer;
+		struct render_index_buffer *index_buffer;
+		struct {
+			int index;
+			struct render_texture *tex;
+		} texture;
+		int blend_mode;
+		struct {
+			struct render_pipeline *pipeline;
+			int index;
+			float value[16];
+		} constant;
+		struct {
+			void *buf;
+			int count;
+		} stream;
+		struct {
+			struct render_texture *tex;
+			int width;
+			int height;
+			int x;
+			int y;
+			int w;
+			int h;
+			bool is_premultiplied;
+		} upload;
+		struct {
+			int offset;
+			int count;
+			int instances;
+		} draw;
+		struct render_draw_item item;
+	} u;
+};
+
+/* A command list. */
+struct render_cmd_list {
+	bool is_used;
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+};
+
+static struct render_cmd_list cmd_list[CMD_LIST_MAX];
+
+/* Submitted lists of the recording frame and the replaying frame. */
+static struct render_cmd_list *frame_list[2][SUBMIT_MAX];
+static int frame_list_count[2];
+static int record_frame;
+
+/* Is in the deferred mode? */
+static bool is_deferred;
+
+/* Forward declaration. */
+static struct cmd *render_cmd_alloc(struct render_cmd_list *list, int type, size_t extra);
+static void render_cmd_copy_rect(struct render_cmd_list *list, struct render_texture *tex, struct image *img, int x, int y, int w, int h);
+static void render_cmd_replay(struct render_cmd_list *list);
+
+/*
+ * Create a command list.
+ */
+bool render_create_cmd_list(struct render_cmd_list **list)
+{
+	int i;
+
+	assert(list != NULL);
+
+	for (i = 0; i < CMD_LIST_MAX; i++) {
+		if (!cmd_list[i].is_used)
+			break;
+	}
+	if (i == CMD_LIST_MAX) {
+		sys_error("Too many command lists.");
+		return false;
+	}
+
+	cmd_list[i].data = malloc(CMD_LIST_INITIAL);
+	if (cmd_list[i].data == NULL) {
+		sys_out_of_memory();
+		return false;
+	}
+	cmd_list[i].is_used = true;
+	cmd_list[i].size = 0;
+	cmd_list[i].capacity = CMD_LIST_INITIAL;
+
+	*list = &cmd_list[i];
+
+	return true;
+}
+
+/*
+ * Destroy a command list.
+ */
+void render_destroy_cmd_list(struct render_cmd_list *list)
+{
+	assert(list != NULL);
+
+	free(list->data);
+	list->data = NULL;
+	list->is_used = false;
+}
+
+/*
+ * Clear the commands in a list.
+ */
+void render_cmd_reset(struct render_cmd_list *list)
+{
+	assert(list != NULL);
+
+	list->size = 0;
+}
+
+void render_cmd_bind_pipeline(struct render_cmd_list *list, struct render_pipeline *pipeline)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_BIND_PIPELINE, 0);
+	if (c != NULL)
+		c->u.pipeline = pipeline;
+}
+
+void render_cmd_bind_vertex_buffer(struct render_cmd_list *list, struct render_vertex_buffer *buf)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_BIND_VERTEX_BUFFER, 0);
+	if (c != NULL)
+		c->u.vertex_buffer = buf;
+}
+
+void render_cmd_bind_index_buffer(struct render_cmd_list *list, struct render_index_buffer *buf)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_BIND_INDEX_BUFFER, 0);
+	if (c != NULL)
+		c->u.index_buffer = buf;
+}
+
+void render_cmd_bind_instance_buffer(struct render_cmd_list *list, struct render_vertex_buffer *buf)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_BIND_INSTANCE_BUFFER, 0);
+	if (c != NULL)
+		c->u.vertex_buffer = buf;
+}
+
+void render_cmd_bind_texture(struct render_cmd_list *list, int index, struct render_texture *tex)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_BIND_TEXTURE, 0);
+	if (c != NULL) {
+		c->u.texture.index = index;
+		c->u.texture.tex = tex;
+	}
+}
+
+void render_cmd_set_blend_mode(struct render_cmd_list *list, int mode)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_SET_BLEND_MODE, 0);
+	if (c != NULL)
+		c->u.blend_mode = mode;
+}
+
+void render_cmd_update_constant(struct render_cmd_list *list, struct render_pipeline *pipeline, int index, const float *src, int count)
+{
+	struct cmd *c;
+
+	assert(count > 0 && count <= 16);
+
+	c = render_cmd_alloc(list, CMD_UPDATE_CONSTANT, 0);
+	if (c != NULL) {
+		c->u.constant.pipeline = pipeline;
+		c->u.constant.index = index;
+		memcpy(c->u.constant.value, src, sizeof(float) * (size_t)count);
+	}
+}
+
+void render_cmd_stream_vertex_buffer(struct render_cmd_list *list, struct render_vertex_buffer *buf, const float *src, int count)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_STREAM_VERTEX_BUFFER, sizeof(float) * (size_t)count);
+	if (c != NULL) {
+		c->u.stream.buf = buf;
+		c->u.stream.count = count;
+		memcpy(c + 1, src, sizeof(float) * (size_t)count);
+	}
+}
+
+void render_cmd_stream_index_buffer(struct render_cmd_list *list, struct render_index_buffer *buf, const short *src, int count)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_STREAM_INDEX_BUFFER, sizeof(short) * (size_t)count);
+	if (c != NULL) {
+		c->u.stream.buf = buf;
+		c->u.stream.count = count;
+		memcpy(c + 1, src, sizeof(short) * (size_t)count);
+	}
+}
+
+void render_cmd_upload_texture(struct render_cmd_list *list, struct render_texture *tex, struct image *img)
+{
+	render_record_texture_storage(tex, image_get_width(img), image_get_height(img));
+	render_cmd_copy_rect(list, tex, img, 0, 0, image_get_width(img), image_get_height(img));
+}
+
+void render_cmd_update_texture(struct render_cmd_list *list, struct render_texture *tex, struct image *img)
+{
+	int x, y, w, h;
+
+	/* Record the whole image unless the storage is known to be there. */
+	if (!render_record_texture_storage(tex, image_get_width(img), image_get_height(img))) {
+		render_cmd_copy_rect(list, tex, img, 0, 0, image_get_width(img), image_get_height(img));
+		image_clear_dirty(img);
+		return;
+	}
+
+	if (!image_get_dirty_rect(img, &x, &y, &w, &h))
+		return;
+	render_cmd_copy_rect(list, tex, img, x, y, w, h);
+	image_clear_dirty(img);
+}
+
+void render_cmd_draw_triangle_strip(struct render_cmd_list *list, int offset, int count)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_DRAW, 0);
+	if (c != NULL) {
+		c->u.draw.offset = offset;
+		c->u.draw.count = count;
+	}
+}
+
+void render_cmd_draw_instanced(struct render_cmd_list *list, int offset, int count, int instances)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_DRAW_INSTANCED, 0);
+	if (c != NULL) {
+		c->u.draw.offset = offset;
+		c->u.draw.count = count;
+		c->u.draw.instances = instances;
+	}
+}
+
+void render_cmd_queue_draw(struct render_cmd_list *list, const struct render_draw_item *item)
+{
+	struct cmd *c;
+
+	c = render_cmd_alloc(list, CMD_QUEUE_DRAW, 0);
+	if (c != NULL)
+		c->u.item = *item;
+}
+
+/* Append a command to a list. */
+static struct cmd *render_cmd_alloc(struct render_cmd_list *list, int type, size_t extra)
+{
+	struct cmd *c;
+	uint8_t *data;
+	size_t size, capacity;
+
+	assert(list != NULL);
+	assert(list->is_used);
+
+	size = (sizeof(struct cmd) + extra + CMD_ALIGN - 1) & ~(size_t)(CMD_ALIGN - 1);
+
+	/* Grow the list. */
+	if (list->size + size > list->capacity) {
+		capacity = list->capacity;
+		while (list->size + size > capacity)
+			capacity *= 2;
+		data = realloc(list->data, capacity);
+		if (data == NULL) {
+			sys_out_of_memory();
+			return NULL;
+		}
+		list->data = data;
+		list->capacity = capacity;
+	}
+
+	c = (struct cmd *)(list->data + list->size);
+	c->type = type;
+	c->size = (int)size;
+	list->size += size;
+
+	return c;
+}
+
+/* Record an upload with a copy of a rectangle, as the image may change later. */
+static void render_cmd_copy_rect(struct render_cmd_list *list, struct render_texture *tex, struct image *img, int x, int y, int w, int h)
+{
+	struct cmd *c;
+	const pixel_t *src;
+	pixel_t *dst;
+	int width, i;
+
+	c = render_cmd_alloc(list, CMD_UPLOAD_TEXTURE, sizeof(pixel_t) * (size_t)w * (size_t)h);
+	if (c == NULL)
+		return;
+	width = image_get_width(img);
+	c->u.upload.tex = tex;
+	c->u.upload.width = width;
+	c->u.upload.height = image_get_height(img);
+	c->u.upload.x = x;
+	c->u.upload.y = y;
+	c->u.upload.w = w;
+	c->u.upload.h = h;
+	c->u.upload.is_premultiplied = image_is_premultiplied(img);
+	src = image_get_pixels(img) + y * width + x;
+	dst = (pixel_t *)(c + 1);
+	for (i = 0; i < h; i++) {
+		memcpy(dst, src, sizeof(pixel_t) * (size_t)w);
+		src += width;
+		dst += w;
+	}
+}
+
+/*
+ * Submit a command list.
+ */
+void render_submit_cmd_list(struct render_cmd_list *list)
+{
+	assert(list != NULL);
+
+	if (!is_deferred) {
+		render_cmd_replay(list);
+		return;
+	}
+
+	if (frame_list_count[record_frame] == SUBMIT_MAX) {
+		sys_error("Too many command lists submitted.");
+		return;
+	}
+	frame_list[record_frame][frame_list_count[record_frame]++] = list;
+}
+
+/* Execute the commands in a list. */
+static void render_cmd_replay(struct render_cmd_list *list)
+{
+	struct cmd *c;
+	size_t pos;
+
+	for (pos = 0; pos < list->size; pos += (size_t)c->size) {
+		c = (struct cmd *)(list->data + pos);
+		switch (c->type) {
+		case CMD_BIND_PIPELINE:
+			render_bind_pipeline(c->u.pipeline);
+			break;
+		case CMD_BIND_VERTEX_BUFFER:
+			render_bind_vertex_buffer(c->u.vertex_buffer);
+			break;
+		case CMD_BIND_INDEX_BUFFER:
+			render_bind_index_buffer(c->u.index_buffer);
+			break;
+		case CMD_BIND_INSTANCE_BUFFER:
+			render_bind_instance_buffer(c->u.vertex_buffer);
+			break;
+		case CMD_BIND_TEXTURE:
+			render_bind_texture(c->u.texture.index, c->u.texture.tex);
+			break;
+		case CMD_SET_BLEND_MODE:
+			render_set_blend_mode(c->u.blend_mode);
+			break;
+		case CMD_UPDATE_CONSTANT:
+			render_update_constant_by_index(c->u.constant.pipeline,
+							c->u.constant.index,
+							c->u.constant.value);
+			break;
+		case CMD_STREAM_VERTEX_BUFFER:
+			render_stream_vertex_buffer(c->u.stream.buf,
+						    (const float *)(c + 1),
+						    c->u.stream.count);
+			break;
+		case CMD_STREAM_INDEX_BUFFER:
+			render_stream_index_buffer(c->u.stream.buf,
+						   (const short *)(c + 1),
+						   c->u.stream.count);
+			break;
+		case CMD_UPLOAD_TEXTURE:
+			render_upload_texture_pixels(c->u.upload.tex,
+						     c->u.upload.width,
+						     c->u.upload.height,
+						     c->u.upload.is_premultiplied,
+						     (const pixel_t *)(c + 1),
+						     c->u.upload.x,
+						     c->u.upload.y,
+						     c->u.upload.w,
+						     c->u.upload.h);
+			break;
+		case CMD_DRAW:
+			render_draw_triangle_strip(c->u.draw.offset, c->u.draw.count);
+			break;
+		case CMD_DRAW_INSTANCED:
+			render_draw_instanced(c->u.draw.offset, c->u.draw.count, c->u.draw.instances);
+			break;
+		case CMD_QUEUE_DRAW:
+			render_queue_draw(&c->u.item);
+			break;
+		default:
+			assert(NEVER_COME_HERE);
+			break;
+		}
+	}
+}
+
+/*
+ * Check whether the submitted lists are replayed on a render thread.
+ */
+bool render_is_cmd_deferred(void)
+{
+	return is_deferred;
+}
+
+/*
+ * Defer the submitted lists to a render thread.
+ */
+void stdrendercmd_set_deferred(bool deferred)
+{
+	is_deferred = deferred;
+	frame_list_count[0] = 0;
+	frame_list_count[1] = 0;
+	record_frame = 0;
+}
+
+/*
+ * Hand the lists submitted in this frame to the render thread.
+ */
+void stdrendercmd_swap_frame(void)
+{
+	record_frame ^= 1;
+	frame_list_count[record_frame] = 0;
+}
+
+/*
+ * Replay the lists handed to the render thread.
+ */
+void stdrendercmd_replay_frame(void)
+{
+	int replay_frame, i;
+
+	replay_frame = record_frame ^ 1;
+	for (i = 0; i < frame_list_count[replay_frame]; i++)
+		render_cmd_replay(frame_list[replay_frame][i]);
+}
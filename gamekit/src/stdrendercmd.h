@@ -0,0 +1,38 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdrendercmd.h: The standard implementation of the render command lists.
+ */
+
+#ifndef GAMEKIT_STDRENDERCMD_H
+#define GAMEKIT_STDRENDERCMD_H
+
+#include "gamekit/compat.h"
+
+/* Defer the submitted lists to a render thread. */
+void stdrendercmd_set_deferred(bool is_deferred);
+
+/* Hand the lists submitted in this frame to the render thread. (game thread) */
+void stdrendercmd_swap_frame(void);
+
+/* Replay the lists handed to the render thread. (render thread) */
+void stdrendercmd_replay_frame(void);
+
+/*
+ * Provided by the render implementation.
+ */
+
+/*
+ * Mirror the storage of a texture as a recorded upload of width x
+ * height specifies it, and return whether the recorded uploads have
+ * already specified it at that size. (recording thread)
+ */
+struct render_texture;
+bool render_record_texture_storage(struct render_texture *tex, int width, int height);
+
+#endif
@@ -0,0 +1,211 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdthread.c: Threads, mutexes and condition variables for the
+ *              standard modules, on pthreads or Win32.
+ *
+ * Apple platforms have no C11 <threads.h>, so the modules use this
+ * instead.
+ */
+
+#include "gamekit/gamekit.h"
+#include "stdthread.h"
+
+/* The function and argument of a starting thread. */
+struct start_arg {
+	int (*func)(void *);
+	void *arg;
+};
+
+/* Forward declaration. */
+#if defined(TARGET_WINDOWS)
+static DWORD WINAPI stdthread_main(LPVOID param);
+#else
+static void *stdthread_main(void *param);
+#endif
+
+/*
+ * Start a thread.
+ */
+bool stdthread_create(stdthread_t *thread, int (*func)(void *), void *arg)
+{
+	struct start_arg *sa;
+
+	assert(thread != NULL);
+	assert(func != NULL);
+
+	/* The thread frees it. */
+	sa = malloc(sizeof(struct start_arg));
+	if (sa == NULL) {
+		sys_out_of_memory();
+		return false;
+	}
+	sa->func = func;
+	sa->arg = arg;
+
+#if defined(TARGET_WINDOWS)
+	*thread = CreateThread(NULL, 0, stdthread_main, sa, 0, NULL);
+	if (*thread == NULL) {
+		free(sa);
+		return false;
+	}
+#else
+	if (pthread_create(thread, NULL, stdthread_main, sa) != 0) {
+		free(sa);
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+/* The entry point of a thread. */
+#if defined(TARGET_WINDOWS)
+static DWORD WINAPI stdthread_main(LPVOID param)
+#else
+static void *stdthread_main(void *param)
+#endif
+{
+	struct start_arg sa;
+
+	sa = *(struct start_arg *)param;
+	free(param);
+
+	sa.func(sa.arg);
+
+#if defined(TARGET_WINDOWS)
+	return 0;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * Wait for a thread to exit.
+ */
+void stdthread_join(stdthread_t thread)
+{
+#if defined(TARGET_WINDOWS)
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+
+/*
+ * Initialize a mutex.
+ */
+bool stdthread_mutex_init(stdthread_mutex_t *mutex)
+{
+#if defined(TARGET_WINDOWS)
+	InitializeSRWLock(mutex);
+	return true;
+#else
+	return pthread_mutex_init(mutex, NULL) == 0;
+#endif
+}
+
+/*
+ * Destroy a mutex.
+ */
+void stdthread_mutex_destroy(stdthread_mutex_t *mutex)
+{
+#if defined(TARGET_WINDOWS)
+	/* An SRW lock has no resources. */
+	UNUSED_PARAMETER(mutex);
+#else
+	pthread_mutex_destroy(mutex);
+#endif
+}
+
+/*
+ * Lock a mutex.
+ */
+void stdthread_mutex_lock(stdthread_mutex_t *mutex)
+{
+#if defined(TARGET_WINDOWS)
+	AcquireSRWLockExclusive(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+
+/*
+ * Unlock a mutex.
+ */
+void stdthread_mutex_unlock(stdthread_mutex_t *mutex)
+{
+#if defined(TARGET_WINDOWS)
+	ReleaseSRWLockExclusive(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+/*
+ * Initialize a condition variable.
+ */
+bool stdthread_cond_init(stdthread_cond_t *cond)
+{
+#if defined(TARGET_WINDOWS)
+	InitializeConditionVariable(cond);
+	return true;
+#else
+	return pthread_cond_init(cond, NULL) == 0;
+#endif
+}
+
+/*
+ * Destroy a condition variable.
+ */
+void stdthread_cond_destroy(stdthread_cond_t *cond)
+{
+#if defined(TARGET_WINDOWS)
+	/* A condition variable has no resources. */
+	UNUSED_PARAMETER(cond);
+#else
+	pthread_cond_destroy(cond);
+#endif
+}
+
+/*
+ * Wait for a condition variable.
+ */
+void stdthread_cond_wait(stdthread_cond_t *cond, stdthread_mutex_t *mutex)
+{
+#if defined(TARGET_WINDOWS)
+	SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+#else
+	pthread_cond_wait(cond, mutex);
+#endif
+}
+
+/*
+ * Wake a thread waiting for a condition variable.
+ */
+void stdthread_cond_signal(stdthread_cond_t *cond)
+{
+#if defined(TARGET_WINDOWS)
+	WakeConditionVariable(cond);
+#else
+	pthread_cond_signal(cond);
+#endif
+}
+
+/*
+ * Wake all threads waiting for a condition variable.
+ */
+void stdthread_cond_broadcast(stdthread_cond_t *cond)
+{
+#if defined(TARGET_WINDOWS)
+	WakeAllConditionVariable(cond);
+#else
+	pthread_cond_broadcast(cond);
+#endif
+}
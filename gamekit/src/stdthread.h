@@ -0,0 +1,63 @@
+/* -*- coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*- */
+
+/*
+ * GameKit
+ * Copyright (c) 2025, The Horizon Authors. All rights reserved.
+ */
+
+/*
+ * stdthread.h: Threads, mutexes and condition variables for the
+ *              standard modules, on pthreads or Win32.
+ */
+
+#ifndef GAMEKIT_STDTHREAD_H
+#define GAMEKIT_STDTHREAD_H
+
+#include "gamekit/compat.h"
+
+#if defined(TARGET_WINDOWS)
+#include <windows.h>
+typedef HANDLE stdthread_t;
+typedef SRWLOCK stdthread_mutex_t;
+typedef CONDITION_VARIABLE stdthread_cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t stdthread_t;
+typedef pthread_mutex_t stdthread_mutex_t;
+typedef pthread_cond_t stdthread_cond_t;
+#endif
+
+/* Start a thread. */
+bool stdthread_create(stdthread_t *thread, int (*func)(void *), void *arg);
+
+/* Wait for a thread to exit. */
+void stdthread_join(stdthread_t thread);
+
+/* Initialize a mutex. */
+bool stdthread_mutex_init(stdthread_mutex_t *mutex);
+
+/* Destroy a mutex. */
+void stdthread_mutex_destroy(stdthread_mutex_t *mutex);
+
+/* Lock a mutex. */
+void stdthread_mutex_lock(stdthread_mutex_t *mutex);
+
+/* Unlock a mutex. */
+void stdthread_mutex_unlock(stdthread_mutex_t *mutex);
+
+/* Initialize a condition variable. */
+bool stdthread_cond_init(stdthread_cond_t *cond);
+
+/* Destroy a condition variable. */
+void stdthread_cond_destroy(stdthread_cond_t *cond);
+
+/* Unlock a mutex, wait for a condition variable, and lock the mutex again. */
+void stdthread_cond_wait(stdthread_cond_t *cond, stdthread_mutex_t *mutex);
+
+/* Wake a thread waiting for a condition variable. */
+void stdthread_cond_signal(stdthread_cond_t *cond);
+
+/* Wake all threads waiting for a condition variable. */
+void stdthread_cond_broadcast(stdthread_cond_t *cond);
+
+#endif